@@ -0,0 +1,2479 @@
+//=================================================================================================================================
+//
+// Work Graphs CPU bench
+//
+// Headless driver for the CPU execution path of the graph in D3D12WorkGraphsSandbox.hlsl. Runs the graph without a D3D12
+// device so it can be benchmarked and used as a reference on any platform, e.g. on Linux:
+//
+//   g++ -std=c++20 -O2 -pthread -I../WorkGraphsSandbox WorkGraphsCpuBench.cpp -o WorkGraphsCpuBench
+//   ./WorkGraphsCpuBench hello --image ../WorkGraphsSandbox/data/albert.jpg
+//
+//=================================================================================================================================
+
+#define _CRT_SECURE_NO_WARNINGS
+#define STB_IMAGE_IMPLEMENTATION
+#include "cpu_atrous_filter.h"
+#include "cpu_bilateral_filter.h"
+#include "cpu_coalescing.h"
+#include "cpu_gaussian_blur.h"
+#include "cpu_guided_filter.h"
+#include "cpu_image.h"
+#include "cpu_median_filter.h"
+#include "cpu_nlm_filter.h"
+#include "cpu_record_capture.h"
+#include "cpu_sandbox_nodes.h"
+#include "cpu_summed_area_table.h"
+#include "cpu_thread_pool.h"
+#include "cpu_variable_radius_filter.h"
+#include "cpu_work_graph.h"
+#include "work_graph_batch.h"
+#include "work_graph_dirty_tiles.h"
+#include "work_graph_fusion.h"
+#include "work_graph_memory_estimator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	//=============================================================================================================================
+	// Minimal "--name value" argument lookup.
+	class bench_args
+	{
+	public:
+		bench_args(int argc, char** argv) : argc(argc), argv(argv) {}
+
+		const char* GetString(const char* name, const char* default_value) const
+		{
+			for (int i = 2; i + 1 < argc; i++)
+				if (strcmp(argv[i], name) == 0)
+					return argv[i + 1];
+			return default_value;
+		}
+		uint32_t GetUint(const char* name, uint32_t default_value) const
+		{
+			const char* value = GetString(name, nullptr);
+			return value ? (uint32_t)strtoul(value, nullptr, 10) : default_value;
+		}
+		// Comma separated, e.g. --radius 2,4,8.
+		std::vector<uint32_t> GetUintList(const char* name, std::vector<uint32_t> default_value) const
+		{
+			const char* value = GetString(name, nullptr);
+			if (!value)
+				return default_value;
+			std::vector<uint32_t> list;
+			for (char* end = nullptr; *value; value = *end ? end + 1 : end)
+				list.push_back((uint32_t)strtoul(value, &end, 10));
+			return list;
+		}
+		float GetFloat(const char* name, float default_value) const
+		{
+			const char* value = GetString(name, nullptr);
+			return value ? (float)atof(value) : default_value;
+		}
+		bool HasFlag(const char* name) const
+		{
+			for (int i = 2; i < argc; i++)
+				if (strcmp(argv[i], name) == 0)
+					return true;
+			return false;
+		}
+
+	private:
+		int argc;
+		char** argv;
+	};
+
+	double SecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	bool LoadInputTexture(const bench_args& args, cpu_texture& texture)
+	{
+		const char* file = args.GetString("--image", "../WorkGraphsSandbox/data/albert.jpg");
+		cpu_image_rgba8 image;
+		if (!LoadImageFromFile(file, image))
+		{
+			printf("Failed to load %s\n", file);
+			return false;
+		}
+		MakeTextureFromImage(image, texture);
+		printf("Input: %s (%ux%u)\n", file, texture.width, texture.height);
+		return true;
+	}
+
+	void PrintNodeStats(const cpu_work_graph& graph, uint32_t frames)
+	{
+		for (uint32_t n = 0; n < graph.NodeCount(); n++)
+		{
+			const cpu_node_stats& s = graph.Stats(n);
+			printf("  %-12s invocations/frame %10.0f  records in/frame %10.0f  records out/frame %10.0f  records/s %12.0f\n",
+				graph.Node(n).name.c_str(), (double)s.invocations / frames, (double)s.records_in / frames, (double)s.records_out / frames,
+				s.RecordsPerSecond());
+		}
+	}
+
+	uint64_t SlabAllocations(const cpu_work_graph& graph)
+	{
+		uint64_t slabs = 0u;
+		for (uint32_t n = 0; n < graph.NodeCount(); n++)
+			slabs += graph.Arena(n) ? graph.Arena(n)->HeapAllocations() : 0u;
+		return slabs;
+	}
+
+	// steady_slabs and steady_items: slab and work item allocations made after the first frame, 0 or the few a frame needs
+	// when more blocks or items are in flight at once than in the first one; they must not keep growing with the frame count.
+	void PrintArenaStats(const cpu_work_graph& graph, uint64_t steady_slabs, uint64_t steady_items)
+	{
+		for (uint32_t n = 0; n < graph.NodeCount(); n++)
+		{
+			const cpu_record_arena* arena = graph.Arena(n);
+			if (!arena)
+				continue;
+			printf("  %-12s arena [MaxRecords(%u)] slot %6u B  reserved %10llu B  peak in flight %10llu B  slabs %llu\n",
+				graph.Node(n).name.c_str(), arena->MaxRecords(), arena->SlotBytes(), (unsigned long long)arena->ReservedBytes(),
+				(unsigned long long)arena->PeakBytesInFlight(), (unsigned long long)arena->HeapAllocations());
+		}
+		printf("  slab allocations after the first frame: %llu, work item allocations: %llu (%llu in total)\n",
+			(unsigned long long)steady_slabs, (unsigned long long)steady_items, (unsigned long long)graph.ItemAllocations());
+	}
+
+	// --trace file.json: per work item trace of the dispatches that follow, written by WriteTrace().
+	void BeginTrace(const bench_args& args, cpu_work_graph& graph)
+	{
+		if (args.GetString("--trace", nullptr))
+			graph.EnableTracing(true, 1u << 20);
+	}
+
+	void WriteTrace(const bench_args& args, cpu_work_graph& graph)
+	{
+		const char* file = args.GetString("--trace", nullptr);
+		if (!file)
+			return;
+		work_graph_trace trace;
+		graph.CollectTrace(trace);
+		graph.EnableTracing(false);
+		std::vector<work_graph_trace_summary> summary;
+		trace.Summarize(summary);
+		printf("Trace: %zu events, %llu dropped\n", trace.Events().size(), (unsigned long long)graph.DroppedTraceEvents());
+		for (const work_graph_trace_summary& t : summary)
+			printf("  %-26s events %8llu  invocations %10llu  records in %10llu  out %10llu  total %10.3f ms  max %9.1f us\n",
+				t.name.c_str(), (unsigned long long)t.events, (unsigned long long)t.invocations, (unsigned long long)t.records_in,
+				(unsigned long long)t.records_out, t.total_ns * 1e-6, t.max_ns * 1e-3);
+		if (trace.WriteChromeTrace(file))
+			printf("  Chrome trace written to %s\n", file);
+		else
+			printf("  Failed to write %s\n", file);
+	}
+
+	//=============================================================================================================================
+	// hello: runs the HelloWorkGraphs graph (firstNode -> secondNode) and validates that it copies SRV to UAV like on the GPU.
+	int RunHello(const bench_args& args)
+	{
+		cpu_texture SRV;
+		if (!LoadInputTexture(args, SRV))
+			return 1;
+		cpu_texture UAV;
+		UAV.Resize(SRV.width, SRV.height);
+
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		cpu_work_graph graph(pool);
+		cpu_hello_work_graph ids = AddHelloWorkGraphNodes(graph, SRV, UAV);
+		entryRecord record = MakeHelloEntryRecord(SRV.width, SRV.height, 0);
+		BeginTrace(args, graph);
+
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 20));
+		double seconds = 0.0;
+		uint64_t warm_slabs = 0u, warm_items = 0u;
+		for (uint32_t f = 0; f < frames; f++)
+		{
+			UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+			auto start = std::chrono::steady_clock::now();
+			graph.DispatchGraph(ids.first_node, &record, 1, sizeof(record));
+			seconds += SecondsSince(start);
+			if (f == 0u)
+			{
+				warm_slabs = SlabAllocations(graph);
+				warm_items = graph.ItemAllocations();
+			}
+		}
+
+		double records = (double)graph.Stats(ids.second_node).records_in;
+		printf("Threads: %u, frames: %u\n", pool.Size(), frames);
+		printf("  %.3f ms/frame, %.1f M records/s\n", 1000.0 * seconds / frames, records / seconds * 1e-6);
+		PrintNodeStats(graph, frames);
+		PrintArenaStats(graph, SlabAllocations(graph) - warm_slabs, graph.ItemAllocations() - warm_items);
+		const cpu_scheduler_stats& sched = graph.SchedulerStats();
+		printf("  work items local %llu, stolen %llu, records consumed on producing worker %.1f%%\n",
+			(unsigned long long)sched.items_local, (unsigned long long)sched.items_stolen, 100.0 * sched.LocalRecordFraction());
+		WriteTrace(args, graph);
+
+		float max_diff = CompareTextures(SRV, UAV);
+		printf("Validation (UAV == SRV): %s (max diff %g)\n", max_diff == 0.0f ? "PASS" : "FAIL", max_diff);
+		return max_diff == 0.0f ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// coalescing: runs the coalescing variant of secondNode under each flush heuristic and reports batch fill and throughput.
+	int RunCoalescing(const bench_args& args)
+	{
+		cpu_texture SRV;
+		if (!LoadInputTexture(args, SRV))
+			return 1;
+		cpu_texture UAV;
+		UAV.Resize(SRV.width, SRV.height);
+
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 10));
+		uint32_t max_records = std::max(1u, std::min(256u, args.GetUint("--max-records", 256)));
+		uint32_t timeout = args.GetUint("--timeout", 4);
+		float thresholds[] = { 0.0f, 0.5f, 0.8f };
+		if (args.GetString("--threshold", nullptr))
+			thresholds[0] = thresholds[1] = thresholds[2] = args.GetFloat("--threshold", 0.0f);
+
+		std::shared_ptr<const cpu_flush_heuristic> heuristics[] =
+		{
+			std::make_shared<cpu_fill_to_max_flush>(),
+			std::make_shared<cpu_producer_timeout_flush>(timeout),
+			std::make_shared<cpu_drain_on_idle_flush>(),
+		};
+
+		printf("Threads: %u, frames: %u, [MaxRecords(%u)], producer timeout %u\n", pool.Size(), frames, max_records, timeout);
+		printf("  %-16s %9s %10s %10s %12s %14s %8s %8s %8s %8s\n", "heuristic", "threshold", "ms/frame", "batches", "avg batch",
+			"records/s", "full", "timeout", "idle", "drain");
+		for (float threshold : thresholds)
+		{
+			for (const auto& heuristic : heuristics)
+			{
+				cpu_hello_work_graph_config config;
+				config.coalescing_second_node = true;
+				config.second_node_max_records = max_records;
+				config.flush_heuristic = heuristic;
+				config.producer_threshold = threshold;
+
+				cpu_work_graph graph(pool);
+				cpu_hello_work_graph ids = AddHelloWorkGraphNodes(graph, SRV, UAV, config);
+				entryRecord record = MakeHelloEntryRecord(SRV.width, SRV.height, 0);
+
+				double seconds = 0.0;
+				for (uint32_t f = 0; f < frames; f++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					graph.DispatchGraph(ids.first_node, &record, 1, sizeof(record));
+					seconds += SecondsSince(start);
+				}
+
+				const cpu_node_stats& s = graph.Stats(ids.second_node);
+				const cpu_coalescing_queue& c = *graph.Coalescer(ids.second_node);
+				printf("  %-16s %9.2f %10.3f %10.0f %12.1f %14.0f %8llu %8llu %8llu %8llu\n", heuristic->Name(), threshold,
+					1000.0 * seconds / frames, (double)s.invocations / frames, s.AverageBatchSize(), s.RecordsPerSecond(),
+					(unsigned long long)c.Flushes(cpu_flush_reason::full) / frames, (unsigned long long)c.Flushes(cpu_flush_reason::heuristic) / frames,
+					(unsigned long long)c.Flushes(cpu_flush_reason::idle) / frames, (unsigned long long)c.Flushes(cpu_flush_reason::drain) / frames);
+			}
+		}
+		return 0;
+	}
+
+	//=============================================================================================================================
+	// schedule: peak record memory against throughput for each scheduling policy.
+	int RunSchedule(const bench_args& args)
+	{
+		cpu_texture SRV;
+		if (!LoadInputTexture(args, SRV))
+			return 1;
+		cpu_texture UAV;
+		UAV.Resize(SRV.width, SRV.height);
+
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 10));
+		std::vector<cpu_scheduling_policy> policies = {
+			{ cpu_scheduling_mode::breadth_first, 0u },
+			{ cpu_scheduling_mode::depth_first, 0u },
+		};
+		if (const char* budget = args.GetString("--budget", nullptr))
+			policies.push_back({ cpu_scheduling_mode::hybrid, strtoull(budget, nullptr, 10) });
+		else
+			for (uint64_t budget : { 4096ull, 65536ull, 262144ull })
+				policies.push_back({ cpu_scheduling_mode::hybrid, budget });
+
+		printf("Threads: %u, frames: %u\n", pool.Size(), frames);
+		printf("  %-14s %10s %10s %14s %16s %16s %18s %s\n", "policy", "budget", "ms/frame", "M records/s", "peak records",
+			"peak bytes", "arena reserved B", "validation");
+		int result = 0;
+		for (const cpu_scheduling_policy& policy : policies)
+		{
+			cpu_work_graph graph(pool, policy);
+			cpu_hello_work_graph ids = AddHelloWorkGraphNodes(graph, SRV, UAV);
+			entryRecord record = MakeHelloEntryRecord(SRV.width, SRV.height, 0);
+
+			double seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+				auto start = std::chrono::steady_clock::now();
+				graph.DispatchGraph(ids.first_node, &record, 1, sizeof(record));
+				seconds += SecondsSince(start);
+			}
+
+			const cpu_scheduler_stats& sched = graph.SchedulerStats();
+			uint64_t reserved = 0u;
+			for (uint32_t n = 0; n < graph.NodeCount(); n++)
+				reserved += graph.Arena(n) ? graph.Arena(n)->ReservedBytes() : 0u;
+			bool valid = CompareTextures(SRV, UAV) == 0.0f;
+			result |= valid ? 0 : 1;
+			printf("  %-14s %10llu %10.3f %14.1f %16llu %16llu %18llu %s\n", SchedulingModeName(policy.mode),
+				(unsigned long long)policy.in_flight_record_budget, 1000.0 * seconds / frames,
+				(double)graph.Stats(ids.second_node).records_in / seconds * 1e-6, (unsigned long long)sched.peak_records_in_flight.load(),
+				(unsigned long long)sched.peak_record_bytes_in_flight.load(), (unsigned long long)reserved, valid ? "PASS" : "FAIL");
+		}
+		return result;
+	}
+
+	//=============================================================================================================================
+	// backpressure: bounds secondNode's input queue with a high-water mark on the firstNode -> secondNode edge. Breadth first
+	// (the default --policy) lets firstNode produce every record before secondNode runs, so it's where the bound matters.
+	int RunBackpressure(const bench_args& args)
+	{
+		cpu_texture SRV;
+		if (!LoadInputTexture(args, SRV))
+			return 1;
+		cpu_texture UAV;
+		UAV.Resize(SRV.width, SRV.height);
+
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 10));
+		cpu_scheduling_policy policy = { cpu_scheduling_mode::breadth_first, 0u };
+		if (const char* mode = args.GetString("--policy", nullptr))
+		{
+			if (strcmp(mode, "depth") == 0)
+				policy.mode = cpu_scheduling_mode::depth_first;
+			else if (strcmp(mode, "hybrid") == 0)
+				policy = { cpu_scheduling_mode::hybrid, 65536u };
+		}
+		std::vector<uint32_t> marks = { 0u, 65536u, 16384u, 4096u, 1024u, 256u };
+		if (const char* mark = args.GetString("--mark", nullptr))
+			marks = { (uint32_t)strtoul(mark, nullptr, 10) };
+		bool coalescing = args.HasFlag("--coalescing");
+
+		printf("Threads: %u, frames: %u, policy: %s, secondNode: %s\n", pool.Size(), frames, SchedulingModeName(policy.mode),
+			coalescing ? "coalescing" : "thread");
+		printf("  %-10s %10s %14s %14s %14s %12s %12s %14s %12s %s\n", "mark", "ms/frame", "peak queued", "avg queued", "peak bytes",
+			"stalls/frm", "us/stall", "items/stall", "yields/frm", "validation");
+		int result = 0;
+		for (uint32_t mark : marks)
+		{
+			cpu_work_graph graph(pool, policy);
+			cpu_hello_work_graph_config config;
+			config.coalescing_second_node = coalescing;
+			config.second_node_high_water_mark = mark;
+			cpu_hello_work_graph ids = AddHelloWorkGraphNodes(graph, SRV, UAV, config);
+			entryRecord record = MakeHelloEntryRecord(SRV.width, SRV.height, 0);
+
+			double seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+				auto start = std::chrono::steady_clock::now();
+				graph.DispatchGraph(ids.first_node, &record, 1, sizeof(record));
+				seconds += SecondsSince(start);
+			}
+
+			const cpu_node_stats& queue = graph.Stats(ids.second_node);
+			const cpu_edge_stats& edge = graph.EdgeStats(ids.first_node, 0);
+			bool valid = CompareTextures(SRV, UAV) == 0.0f;
+			result |= valid ? 0 : 1;
+			char name[16] = "unbounded";
+			if (mark > 0u)
+				snprintf(name, sizeof(name), "%u", mark);
+			printf("  %-10s %10.3f %14llu %14.0f %14llu %12.0f %12.2f %14.2f %12.0f %s\n", name, 1000.0 * seconds / frames,
+				(unsigned long long)queue.peak_queued_records.load(), queue.AverageQueuedRecords(),
+				(unsigned long long)graph.SchedulerStats().peak_record_bytes_in_flight.load(), (double)edge.stalls / frames,
+				edge.AverageStallMicroseconds(), edge.stalls ? (double)edge.items_run / (double)edge.stalls : 0.0,
+				(double)edge.yields / frames, valid ? "PASS" : "FAIL");
+		}
+		return result;
+	}
+
+	// Threads the GPU would launch for the recorded invocations: a group is NumThreads threads, a thread launch one.
+	uint64_t ThreadsLaunched(const cpu_work_graph& graph)
+	{
+		uint64_t threads = 0u;
+		for (uint32_t n = 0; n < graph.NodeCount(); n++)
+		{
+			const cpu_node_desc& desc = graph.Node(n);
+			uint64_t per_invocation = desc.launch == cpu_node_launch::thread ? 1u :
+				(uint64_t)desc.num_threads.x * desc.num_threads.y * desc.num_threads.z;
+			threads += graph.Stats(n).invocations * per_invocation;
+		}
+		return threads;
+	}
+
+	//=============================================================================================================================
+	// adaptive: recursive quadtree refinement (refineTile) against the fixed 16x16 grid of firstNode.
+	int RunAdaptive(const bench_args& args)
+	{
+		cpu_texture SRV;
+		if (!LoadInputTexture(args, SRV))
+			return 1;
+		cpu_texture UAV;
+		UAV.Resize(SRV.width, SRV.height);
+
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 10));
+		std::vector<float> thresholds = { 0.0f, 0.02f, 0.05f, 0.1f, 0.2f };
+		if (args.GetString("--threshold", nullptr))
+			thresholds = { args.GetFloat("--threshold", 0.05f) };
+
+		printf("Threads: %u, frames: %u, root tiles %ux%u, [NodeMaxRecursionDepth(%u)]\n", pool.Size(), frames, 16u << c_maxRefineDepth,
+			16u << c_maxRefineDepth, c_maxRefineDepth);
+		printf("  %-22s %10s %14s %14s %12s %12s %10s %10s\n", "graph", "ms/frame", "threads/frame", "secondNode", "fillTile grp",
+			"refine grp", "work", "PSNR dB");
+
+		uint64_t fixed_threads = 0u;
+		{
+			cpu_work_graph graph(pool);
+			cpu_hello_work_graph ids = AddHelloWorkGraphNodes(graph, SRV, UAV);
+			entryRecord record = MakeHelloEntryRecord(SRV.width, SRV.height, 0);
+			double seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				graph.DispatchGraph(ids.first_node, &record, 1, sizeof(record));
+				seconds += SecondsSince(start);
+			}
+			fixed_threads = ThreadsLaunched(graph) / frames;
+			printf("  %-22s %10.3f %14llu %14.0f %12s %12s %9.1f%% %10.1f\n", "firstNode 16x16 grid", 1000.0 * seconds / frames,
+				(unsigned long long)fixed_threads, (double)graph.Stats(ids.second_node).records_in / frames, "-", "-", 100.0,
+				ComputePSNR(SRV, UAV));
+		}
+
+		std::vector<tileRecord> roots;
+		MakeRefineRootTiles(SRV.width, SRV.height, roots);
+		for (float threshold : thresholds)
+		{
+			cpu_work_graph graph(pool);
+			cpu_adaptive_work_graph ids = AddAdaptiveTilingNodes(graph, SRV, UAV, threshold);
+			double seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				graph.DispatchGraph(ids.refine_tile, roots.data(), (uint32_t)roots.size(), sizeof(tileRecord));
+				seconds += SecondsSince(start);
+			}
+			uint64_t threads = ThreadsLaunched(graph) / frames;
+			char name[64];
+			snprintf(name, sizeof(name), "refineTile t=%.2f", threshold);
+			printf("  %-22s %10.3f %14llu %14.0f %12.0f %12.0f %9.1f%% %10.1f\n", name, 1000.0 * seconds / frames, (unsigned long long)threads,
+				(double)graph.Stats(ids.second_node).records_in / frames, (double)graph.Stats(ids.fill_tile).invocations / frames,
+				(double)graph.Stats(ids.refine_tile).invocations / frames, 100.0 * (double)threads / (double)fixed_threads,
+				ComputePSNR(SRV, UAV));
+		}
+		return 0;
+	}
+
+	//=============================================================================================================================
+	// batch: batchFirstNode over a folder of images (or --count copies of --image), one DispatchGraph per image vs one for all.
+	int RunBatch(const bench_args& args)
+	{
+		std::vector<cpu_texture> inputs;
+		if (const char* dir = args.GetString("--dir", nullptr))
+		{
+			std::vector<std::filesystem::path> files;
+			for (const auto& entry : std::filesystem::directory_iterator(dir))
+				files.push_back(entry.path());
+			std::sort(files.begin(), files.end());
+			for (const std::filesystem::path& file : files)
+			{
+				cpu_image_rgba8 image;
+				if (!LoadImageFromFile(file.string().c_str(), image))
+					continue;
+				inputs.emplace_back();
+				MakeTextureFromImage(image, inputs.back());
+			}
+			printf("Input: %zu images from %s\n", inputs.size(), dir);
+		}
+		else
+		{
+			cpu_texture texture;
+			if (!LoadInputTexture(args, texture))
+				return 1;
+			inputs.assign(std::max(1u, args.GetUint("--count", 16)), texture);
+		}
+		if (inputs.empty())
+			return 1;
+
+		cpu_descriptor_heap heap;
+		std::vector<cpu_texture> outputs(inputs.size());
+		std::vector<work_graph_batch_image> images(inputs.size());
+		double pixels = 0.0;
+		for (size_t i = 0; i < inputs.size(); i++)
+		{
+			outputs[i].Resize(inputs[i].width, inputs[i].height);
+			images[i] = { inputs[i].width, inputs[i].height, heap.Add(inputs[i]), 0u };
+			pixels += (double)inputs[i].width * inputs[i].height;
+		}
+		for (size_t i = 0; i < inputs.size(); i++)
+			images[i].uav_index = heap.Add(outputs[i]);
+
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		cpu_work_graph graph(pool);
+		cpu_batch_work_graph ids = AddBatchNodes(graph, heap);
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 5));
+		uint32_t tile_size = BatchTileSize(args.GetUint("--tile", c_batchMaxTileSize));
+
+		std::vector<std::vector<batchEntryRecord>> per_image(images.size());
+		for (size_t i = 0; i < images.size(); i++)
+			BuildBatchEntryRecords(&images[i], 1, tile_size, per_image[i]);
+		std::vector<batchEntryRecord> batched;
+		BuildBatchEntryRecords(images, tile_size, batched);
+		BeginTrace(args, graph);
+
+		printf("Threads: %u, frames: %u, images: %zu (%.1f Mpixels), tile %u, entry records %zu\n", pool.Size(), frames, images.size(),
+			pixels * 1e-6, tile_size, batched.size());
+		printf("  %-22s %12s %12s %12s %10s\n", "dispatch", "ms/batch", "images/s", "Mpixels/s", "valid");
+		bool valid = true;
+		for (int batch = 0; batch < 2; batch++)
+		{
+			double seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				for (cpu_texture& output : outputs)
+					output.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+				auto start = std::chrono::steady_clock::now();
+				if (batch)
+				{
+					graph.DispatchGraph(ids.batch_first_node, batched.data(), (uint32_t)batched.size(), sizeof(batchEntryRecord));
+				}
+				else
+				{
+					for (const std::vector<batchEntryRecord>& records : per_image)
+						graph.DispatchGraph(ids.batch_first_node, records.data(), (uint32_t)records.size(), sizeof(batchEntryRecord));
+				}
+				seconds += SecondsSince(start);
+			}
+			float max_diff = 0.0f;
+			for (size_t i = 0; i < inputs.size(); i++)
+				max_diff = std::max(max_diff, CompareTextures(inputs[i], outputs[i]));
+			valid = valid && max_diff == 0.0f;
+			printf("  %-22s %12.3f %12.1f %12.1f %10s\n", batch ? "one for the batch" : "one per image", 1000.0 * seconds / frames,
+				images.size() * frames / seconds, pixels * frames / seconds * 1e-6, max_diff == 0.0f ? "PASS" : "FAIL");
+		}
+		WriteTrace(args, graph);
+		return valid ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// incremental: a run of --frames frames over batchFirstNode in which the input gets an --edit-size square edited every
+	// --edit-every frames, redrawn in full every frame (what the app did before) vs only the dirty tiles (work_graph_dirty_tiles.h).
+	// Then refineTile on only the root tiles that hold a dirty tile, checked against a full refineTile dispatch every frame.
+	int RunIncremental(const bench_args& args)
+	{
+		cpu_texture original;
+		if (!LoadInputTexture(args, original))
+			return 1;
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 120));
+		uint32_t edit_every = std::max(1u, args.GetUint("--edit-every", 8));
+		uint32_t edit_size = std::max(1u, args.GetUint("--edit-size", 48));
+		// Inverts an edit_size square of SRV at a random spot every edit_every frames and marks its tiles.
+		auto edit = [&](uint32_t f, cpu_texture& SRV, std::mt19937& rng, work_graph_dirty_tiles& dirty_tiles)
+		{
+			if (f == 0u || f % edit_every != 0u)
+				return;
+			uint32_t x = rng() % SRV.width, y = rng() % SRV.height;
+			for (uint32_t py = y; py < std::min(SRV.height, y + edit_size); py++)
+			{
+				for (uint32_t px = x; px < std::min(SRV.width, x + edit_size); px++)
+				{
+					float4 v = SRV.Load(uint2{ px, py });
+					SRV.Store(uint2{ px, py }, float4{ 1.0f - v.x, 1.0f - v.y, 1.0f - v.z, v.w });
+				}
+			}
+			dirty_tiles.MarkRect(x, y, edit_size, edit_size);
+		};
+
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		printf("Threads: %u, frames: %u, a %ux%u edit every %u frames\n", pool.Size(), frames, edit_size, edit_size, edit_every);
+		printf("  %-12s %10s %12s %12s %14s %10s\n", "redraw", "ms/frame", "dispatches", "tiles/frame", "records/frame", "valid");
+		int result = 0;
+		for (bool incremental : { false, true })
+		{
+			cpu_texture SRV = original;
+			cpu_texture UAV;
+			UAV.Resize(SRV.width, SRV.height);
+			UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+			cpu_descriptor_heap heap;
+			work_graph_batch_image image = { SRV.width, SRV.height, heap.Add(SRV), heap.Add(UAV) };
+			cpu_work_graph graph(pool);
+			cpu_batch_work_graph ids = AddBatchNodes(graph, heap);
+			work_graph_dirty_tiles dirty_tiles;
+			dirty_tiles.Resize(SRV.width, SRV.height);
+			std::vector<batchEntryRecord> records;
+			std::mt19937 rng(1u);
+
+			double seconds = 0.0;
+			uint64_t dispatches = 0u, tiles = 0u, num_records = 0u;
+			bool valid = true;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				edit(f, SRV, rng, dirty_tiles);
+				auto start = std::chrono::steady_clock::now();
+				records.clear();
+				if (!incremental)
+				{
+					UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+					tiles += dirty_tiles.TileCount();
+					BuildBatchEntryRecords(&image, 1, c_batchMaxTileSize, records);
+				}
+				else
+				{
+					tiles += dirty_tiles.DirtyCount();
+					dirty_tiles.BuildDirtyEntryRecords(image, records);
+				}
+				if (!records.empty())
+				{
+					graph.DispatchGraph(ids.batch_first_node, records.data(), (uint32_t)records.size(), sizeof(batchEntryRecord));
+					dispatches++;
+					num_records += records.size();
+				}
+				seconds += SecondsSince(start);
+				valid = valid && CompareTextures(SRV, UAV) == 0.0f;
+			}
+			result |= valid ? 0 : 1;
+			printf("  %-12s %10.3f %12llu %12.1f %14.2f %10s\n", incremental ? "dirty tiles" : "full", 1000.0 * seconds / frames,
+				(unsigned long long)dispatches, (double)tiles / frames, (double)num_records / frames, valid ? "PASS" : "FAIL");
+		}
+
+		{
+			cpu_texture SRV = original;
+			cpu_texture UAV, reference;
+			UAV.Resize(SRV.width, SRV.height);
+			reference.Resize(SRV.width, SRV.height);
+			float threshold = args.GetFloat("--threshold", 0.05f);
+			cpu_work_graph graph(pool), reference_graph(pool);
+			cpu_adaptive_work_graph ids = AddAdaptiveTilingNodes(graph, SRV, UAV, threshold);
+			cpu_adaptive_work_graph reference_ids = AddAdaptiveTilingNodes(reference_graph, SRV, reference, threshold);
+			std::vector<tileRecord> roots, all_roots;
+			MakeRefineRootTiles(SRV.width, SRV.height, all_roots);
+			work_graph_dirty_tiles dirty_tiles;
+			dirty_tiles.Resize(SRV.width, SRV.height);
+			std::mt19937 rng(1u);
+
+			double seconds = 0.0;
+			uint64_t dispatches = 0u, tiles = 0u, num_records = 0u;
+			bool valid = true;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				edit(f, SRV, rng, dirty_tiles);
+				auto start = std::chrono::steady_clock::now();
+				roots.clear();
+				tiles += dirty_tiles.DirtyCount();
+				dirty_tiles.BuildDirtyRefineRoots(roots);
+				if (!roots.empty())
+				{
+					graph.DispatchGraph(ids.refine_tile, roots.data(), (uint32_t)roots.size(), sizeof(tileRecord));
+					dispatches++;
+					num_records += roots.size();
+				}
+				seconds += SecondsSince(start);
+				reference_graph.DispatchGraph(reference_ids.refine_tile, all_roots.data(), (uint32_t)all_roots.size(), sizeof(tileRecord));
+				valid = valid && CompareTextures(reference, UAV) == 0.0f;
+			}
+			result |= valid ? 0 : 1;
+			printf("  %-12s %10.3f %12llu %12.1f %14.2f %10s\n", "refine roots", 1000.0 * seconds / frames, (unsigned long long)dispatches,
+				(double)tiles / frames, (double)num_records / frames, valid ? "PASS" : "FAIL");
+		}
+		return result;
+	}
+
+	//=============================================================================================================================
+	// capture: runs the HelloWorkGraphs graph (or refineTile with --adaptive) and writes every record it produced to --out.
+	int RunCapture(const bench_args& args)
+	{
+		cpu_texture SRV;
+		if (!LoadInputTexture(args, SRV))
+			return 1;
+		cpu_texture UAV;
+		UAV.Resize(SRV.width, SRV.height);
+
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		cpu_work_graph graph(pool);
+		cpu_record_capture capture;
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 1));
+		auto start = std::chrono::steady_clock::now();
+		if (args.HasFlag("--adaptive"))
+		{
+			cpu_adaptive_work_graph ids = AddAdaptiveTilingNodes(graph, SRV, UAV, args.GetFloat("--threshold", 0.05f));
+			std::vector<tileRecord> roots;
+			MakeRefineRootTiles(SRV.width, SRV.height, roots);
+			graph.EnableCapture(&capture);
+			for (uint32_t f = 0; f < frames; f++)
+				graph.DispatchGraph(ids.refine_tile, roots.data(), (uint32_t)roots.size(), sizeof(tileRecord));
+		}
+		else
+		{
+			cpu_hello_work_graph ids = AddHelloWorkGraphNodes(graph, SRV, UAV);
+			entryRecord record = MakeHelloEntryRecord(SRV.width, SRV.height, 0);
+			graph.EnableCapture(&capture);
+			for (uint32_t f = 0; f < frames; f++)
+				graph.DispatchGraph(ids.first_node, &record, 1, sizeof(record));
+		}
+		double seconds = SecondsSince(start);
+		graph.EnableCapture(nullptr);
+
+		const char* file = args.GetString("--out", "capture.wgrc");
+		printf("Threads: %u, dispatches: %u, %.3f ms/dispatch while capturing\n", pool.Size(), capture.Dispatches(), 1000.0 * seconds / frames);
+		for (uint32_t n = 0; n < capture.NodeCount(); n++)
+			printf("  %-12s %10llu records x %u bytes\n", capture.NodeName(n).c_str(), (unsigned long long)capture.RecordCount(n),
+				capture.RecordStride(n));
+		if (!capture.Write(file))
+		{
+			printf("Failed to write %s\n", file);
+			return 1;
+		}
+		printf("  %zu bytes in %zu chunks written to %s\n", capture.StreamBytes(), capture.Chunks().size(), file);
+		return 0;
+	}
+
+	//=============================================================================================================================
+	// replay: feeds one node the records it received in a capture, with its own outputs discarded, and times it alone.
+	int RunReplay(const bench_args& args)
+	{
+		const char* file = args.GetString("--capture", "capture.wgrc");
+		cpu_record_capture capture;
+		if (!capture.Read(file))
+		{
+			printf("Failed to read %s\n", file);
+			return 1;
+		}
+		cpu_texture SRV;
+		if (!LoadInputTexture(args, SRV))
+			return 1;
+		cpu_texture UAV;
+		UAV.Resize(SRV.width, SRV.height);
+
+		// The same node functions the capture ran, picked by the entry node found in the capture.
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		cpu_work_graph graph(pool);
+		if (capture.FindNode("refineTile") != ~0u)
+			AddAdaptiveTilingNodes(graph, SRV, UAV, args.GetFloat("--threshold", 0.05f));
+		else
+			AddHelloWorkGraphNodes(graph, SRV, UAV);
+
+		const char* name = args.GetString("--node", "secondNode");
+		uint32_t captured = capture.FindNode(name);
+		uint32_t node = ~0u;
+		for (uint32_t n = 0; n < graph.NodeCount(); n++)
+			node = graph.Node(n).name == name ? n : node;
+		if (captured == ~0u || node == ~0u || capture.RecordStride(captured) != graph.Node(node).input_record_stride)
+		{
+			printf("%s has no records for a node named %s that this graph can run\n", file, name);
+			return 1;
+		}
+
+		std::vector<std::vector<uint8_t>> dispatches(capture.Dispatches());
+		std::vector<uint32_t> counts(capture.Dispatches());
+		for (uint32_t d = 0; d < capture.Dispatches(); d++)
+			counts[d] = capture.Gather(captured, d, dispatches[d]);
+
+		graph.SetOutputsDiscarded(true);
+		BeginTrace(args, graph);
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 10));
+		double seconds = 0.0;
+		uint64_t records = 0u;
+		for (uint32_t f = 0; f < frames; f++)
+		{
+			UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+			for (uint32_t d = 0; d < capture.Dispatches(); d++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				graph.DispatchGraph(node, dispatches[d].data(), counts[d], capture.RecordStride(captured));
+				seconds += SecondsSince(start);
+				records += counts[d];
+			}
+		}
+
+		printf("Replaying %s from %s: %u dispatches, %llu records each pass, threads: %u, frames: %u\n", name, file, capture.Dispatches(),
+			(unsigned long long)(records / frames), pool.Size(), frames);
+		printf("  %.3f ms/pass, %.1f M records/s, %llu output records discarded per pass\n", 1000.0 * seconds / frames,
+			records / seconds * 1e-6, (unsigned long long)(graph.Stats(node).records_out / frames));
+		WriteTrace(args, graph);
+		// secondNode writes every pixel of the hello graph, replaying it alone must reproduce the captured run's output.
+		if (capture.FindNode("firstNode") != ~0u && graph.Node(node).outputs.empty())
+			printf("  UAV vs SRV: max diff %g, PSNR %.1f dB\n", CompareTextures(SRV, UAV), ComputePSNR(SRV, UAV));
+		return 0;
+	}
+
+	//=============================================================================================================================
+	// wave: secondNode one record at a time vs as SIMD waves of 8 and 16 lanes per ISA, alone on every pixel of the image and
+	// inside the hello graph. --threshold makes firstNode emit only bright pixels, so most waves are partially filled.
+	int RunWave(const bench_args& args)
+	{
+		cpu_texture SRV;
+		if (!LoadInputTexture(args, SRV))
+			return 1;
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 20));
+		float threshold = args.GetFloat("--threshold", 0.0f);
+
+		// secondNode's input for every pixel, plus a record outside the UAV that must be masked off.
+		std::vector<secondNodeInput> records;
+		for (uint32_t y = 0; y < SRV.height; y++)
+			for (uint32_t x = 0; x < SRV.width; x++)
+				records.push_back(secondNodeInput{ SRV.Load(uint2{ x, y }), uint2{ x, y } });
+		records.push_back(secondNodeInput{ float4{ 1.0f, 0.0f, 1.0f, 1.0f }, uint2{ SRV.width, 0u } });
+		entryRecord record = MakeHelloEntryRecord(SRV.width, SRV.height, 0);
+
+		struct wave_config
+		{
+			uint32_t lanes;
+			cpu_wave_isa isa;
+		};
+		std::vector<wave_config> configs = { { 0u, cpu_wave_isa::scalar } };
+		for (uint32_t lanes : { 8u, 16u })
+			for (cpu_wave_isa isa : { cpu_wave_isa::scalar, cpu_wave_isa::avx2, cpu_wave_isa::avx512 })
+				if (IsWaveIsaSupported(isa))
+					configs.push_back({ lanes, isa });
+
+		printf("Threads: %u, frames: %u, secondNode alone on %zu records, hello graph with threshold %g\n", pool.Size(), frames,
+			records.size(), threshold);
+		printf("  %-8s %5s  %14s %14s  %12s %14s  %s\n", "ISA", "lanes", "alone M rec/s", "body M rec/s", "graph ms", "graph records", "UAV");
+		cpu_texture reference_alone, reference_graph;
+		bool pass = true;
+		for (const wave_config& w : configs)
+		{
+			cpu_hello_work_graph_config config;
+			config.second_node_wave_lanes = w.lanes;
+			config.wave_isa = w.isa;
+			config.producer_threshold = threshold;
+
+			cpu_texture UAV;
+			UAV.Resize(SRV.width, SRV.height);
+			cpu_work_graph alone(pool);
+			cpu_hello_work_graph alone_ids = AddHelloWorkGraphNodes(alone, SRV, UAV, config);
+			double alone_seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+				auto start = std::chrono::steady_clock::now();
+				alone.DispatchGraph(alone_ids.second_node, records.data(), (uint32_t)records.size(), sizeof(secondNodeInput));
+				alone_seconds += SecondsSince(start);
+			}
+			if (w.lanes == 0u)
+				reference_alone = UAV;
+			float alone_diff = CompareTextures(reference_alone, UAV);
+
+			cpu_work_graph graph(pool);
+			cpu_hello_work_graph ids = AddHelloWorkGraphNodes(graph, SRV, UAV, config);
+			double graph_seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+				auto start = std::chrono::steady_clock::now();
+				graph.DispatchGraph(ids.first_node, &record, 1, sizeof(record));
+				graph_seconds += SecondsSince(start);
+			}
+			if (w.lanes == 0u)
+				reference_graph = UAV;
+			float graph_diff = CompareTextures(reference_graph, UAV);
+			bool ok = alone_diff == 0.0f && graph_diff == 0.0f;
+			pass = pass && ok;
+
+			printf("  %-8s %5s  %14.1f %14.1f  %12.3f %14.0f  %s\n", w.lanes ? WaveIsaName(w.isa) : "-",
+				w.lanes ? std::to_string(w.lanes).c_str() : "1", (double)records.size() * frames / alone_seconds * 1e-6,
+				alone.Stats(alone_ids.second_node).RecordsPerSecond() * 1e-6, 1000.0 * graph_seconds / frames,
+				(double)graph.Stats(ids.second_node).records_in / frames, ok ? "PASS" : "FAIL");
+		}
+		printf("Validation (same UAV as one record at a time): %s\n", pass ? "PASS" : "FAIL");
+		return pass ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// group: nodes written per thread with barriers and groupshared memory on cpu_group_executor vs the same nodes with the
+	// barriers split by hand: thirdNode on --records records and refineTile on the image.
+	void PrintGroupExecutorStats(const cpu_group_executor& executor, uint32_t frames)
+	{
+		cpu_group_executor_stats s = executor.Stats();
+		printf("    groups/frame %.0f, barriers/group %.2f, resumes/thread %.2f, scratch peak %zu B, scratch heap allocations %llu\n",
+			(double)s.groups / frames, s.groups ? (double)s.barriers / s.groups : 0.0, s.threads ? (double)s.resumes / s.threads : 0.0,
+			s.peak_scratch_bytes, (unsigned long long)s.scratch_heap_allocations);
+	}
+
+	int RunGroup(const bench_args& args)
+	{
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 10));
+		float threshold = args.GetFloat("--threshold", 0.05f);
+		bool pass = true;
+		printf("Threads: %u, frames: %u\n", pool.Size(), frames);
+
+		std::vector<thirdNodeInput> records(std::max(1u, args.GetUint("--records", 1u << 20)));
+		for (size_t r = 0; r < records.size(); r++)
+			records[r].entryRecordIndex = (uint32_t)(r % c_numEntryRecords);
+		printf("  thirdNode [NumThreads(32,1,1)] [MaxRecords(32)], %zu records\n", records.size());
+		for (bool coroutines : { false, true })
+		{
+			std::atomic<uint32_t> UAV[2 * c_numEntryRecords];
+			cpu_group_executor executor(pool.Size());
+			cpu_work_graph graph(pool);
+			uint32_t third = AddThirdNode(graph, UAV, coroutines ? &executor : nullptr);
+			double seconds = 0.0;
+			uint64_t counted = 0u;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				for (std::atomic<uint32_t>& u : UAV)
+					u = 0u;
+				auto start = std::chrono::steady_clock::now();
+				graph.DispatchGraph(third, records.data(), (uint32_t)records.size(), sizeof(thirdNodeInput));
+				seconds += SecondsSince(start);
+				for (uint32_t l = 0; l < c_numEntryRecords; l++)
+					counted += UAV[c_numEntryRecords + l];
+			}
+			bool ok = counted == (uint64_t)records.size() * frames;
+			pass = pass && ok;
+			printf("  %-22s %10.3f ms/frame %10.1f M records/s  count %s\n", coroutines ? "coroutine threads" : "barriers split by hand",
+				1000.0 * seconds / frames, (double)records.size() * frames / seconds * 1e-6, ok ? "PASS" : "FAIL");
+			if (coroutines)
+				PrintGroupExecutorStats(executor, frames);
+		}
+
+		cpu_texture SRV;
+		if (!LoadInputTexture(args, SRV))
+			return 1;
+		std::vector<tileRecord> roots;
+		MakeRefineRootTiles(SRV.width, SRV.height, roots);
+		printf("  refineTile [NumThreads(16,16,1)], threshold %g\n", threshold);
+		cpu_texture reference;
+		for (bool coroutines : { false, true })
+		{
+			cpu_texture UAV;
+			UAV.Resize(SRV.width, SRV.height);
+			cpu_group_executor executor(pool.Size());
+			cpu_work_graph graph(pool);
+			cpu_adaptive_work_graph ids = AddAdaptiveTilingNodes(graph, SRV, UAV, threshold, coroutines ? &executor : nullptr);
+			double seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				graph.DispatchGraph(ids.refine_tile, roots.data(), (uint32_t)roots.size(), sizeof(tileRecord));
+				seconds += SecondsSince(start);
+			}
+			if (!coroutines)
+				reference = UAV;
+			bool ok = CompareTextures(reference, UAV) == 0.0f;
+			pass = pass && ok;
+			printf("  %-22s %10.3f ms/frame, refineTile %8.3f ms/frame busy over %.0f groups  UAV %s\n",
+				coroutines ? "coroutine threads" : "barriers split by hand", 1000.0 * seconds / frames,
+				graph.Stats(ids.refine_tile).busy_ns * 1e-6 / frames, (double)graph.Stats(ids.refine_tile).invocations / frames,
+				ok ? "PASS" : "FAIL");
+			if (coroutines)
+				PrintGroupExecutorStats(executor, frames);
+		}
+		printf("Validation (same results as the hand split ports): %s\n", pass ? "PASS" : "FAIL");
+		return pass ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	bool ReadTextFile(const char* file, std::string& out_text)
+	{
+		std::ifstream stream(file);
+		if (!stream)
+		{
+			printf("Failed to open %s\n", file);
+			return false;
+		}
+		std::stringstream text;
+		text << stream.rdbuf();
+		out_text = text.str();
+		return true;
+	}
+
+	// Every entry node gets --records records with an expected dispatch grid of --grid x,y,z (default: the sandbox image),
+	// except batchFirstNode, which gets a record per --batch-tile tile of the image that grid covers.
+	work_graph_estimate_options EstimateOptions(const bench_args& args, const hlsl_work_graph_desc& desc)
+	{
+		work_graph_estimate_options options;
+		std::vector<uint32_t> grid = { 64u, 64u, 1u };
+		if (const char* g = args.GetString("--grid", nullptr))
+		{
+			grid = { 1u, 1u, 1u };
+			sscanf(g, "%u,%u,%u", &grid[0], &grid[1], &grid[2]);
+		}
+		uint32_t batch_tile_size = args.GetUint("--batch-tile", 256);
+		for (size_t i = 0; i < desc.nodes.size(); i++)
+		{
+			const hlsl_node_decl& node = desc.nodes[i];
+			if (!desc.IsEntry(i))
+				continue;
+			if (node.name == "batchFirstNode")
+			{
+				work_graph_batch_image image = { grid[0] * 16u, grid[1] * 16u };
+				uint32_t tile_groups = BatchTileSize(batch_tile_size) / 16u;
+				options.entry_grid[node.name] = { tile_groups, tile_groups, 1u };
+				options.entry_records[node.name] = BatchEntryRecordCount(image, batch_tile_size) * grid[2];
+				continue;
+			}
+			options.entry_grid[node.name] = grid;
+			options.entry_records[node.name] = args.GetUint("--records", 1);
+		}
+		return options;
+	}
+
+	//=============================================================================================================================
+	// estimate: offline record memory estimate for the nodes declared in a work graph .hlsl file.
+	int RunEstimate(const bench_args& args)
+	{
+		const char* file = args.GetString("--hlsl", "../WorkGraphsSandbox/D3D12WorkGraphsSandbox.hlsl");
+		std::string source;
+		if (!ReadTextFile(file, source))
+			return 1;
+		hlsl_work_graph_desc desc = ParseWorkGraphHLSL(source);
+		work_graph_memory_estimate estimate = EstimateWorkGraphMemory(desc, EstimateOptions(args, desc));
+
+		printf("%s: %zu record structs, %zu nodes\n", file, desc.records.size(), desc.nodes.size());
+		for (const hlsl_record_struct& r : desc.records)
+			printf("  struct %-20s %4u bytes%s\n", r.name.c_str(), r.size, r.has_dispatch_grid ? " (SV_DispatchGrid)" : "");
+		printf("  %-16s %-13s %14s %14s %14s %14s %12s\n", "node", "launch", "records worst", "records exp.", "bytes worst", "bytes exp.",
+			"bytes/group");
+		for (size_t i = 0; i < desc.nodes.size(); i++)
+		{
+			const hlsl_node_decl& node = desc.nodes[i];
+			const work_graph_node_estimate& e = estimate.nodes[i];
+			const char* launch = node.launch == hlsl_node_launch::broadcasting ? "broadcasting" :
+				node.launch == hlsl_node_launch::coalescing ? "coalescing" : "thread";
+			printf("  %-16s %-13s %14.0f %14.0f %14.0f %14.0f %12llu\n", node.name.c_str(), launch, e.input_records[0], e.input_records[1],
+				e.input_bytes[0], e.input_bytes[1], (unsigned long long)e.invocation_output_bytes);
+			for (const hlsl_node_output& o : node.outputs)
+				printf("    -> %-13s [MaxRecords(%u)] %s, %u bytes\n", o.target.c_str(), o.max_records, o.record_type.c_str(), o.record_size);
+		}
+		printf("  total record bytes: worst %.0f, expected %.0f; smallest amount that lets any group make progress %llu\n",
+			estimate.total_bytes[0], estimate.total_bytes[1], (unsigned long long)estimate.min_progress_bytes);
+		for (const std::string& w : desc.warnings)
+			printf("  warning: %s\n", w.c_str());
+		for (const std::string& w : estimate.warnings)
+			printf("  warning: %s\n", w.c_str());
+		return 0;
+	}
+
+	//=============================================================================================================================
+	// fusion: fuses thread launch consumers into their producers, writes the fused HLSL and compares the hello graph on the CPU
+	// with and without secondNode fused into firstNode.
+	int RunFusion(const bench_args& args)
+	{
+		const char* file = args.GetString("--hlsl", "../WorkGraphsSandbox/D3D12WorkGraphsSandbox.hlsl");
+		std::string source;
+		if (!ReadTextFile(file, source))
+			return 1;
+		work_graph_fusion_result fusion = FuseWorkGraphHLSL(source, EstimateOptions(args, ParseWorkGraphHLSL(source)));
+
+		printf("%s: %zu edges into thread launch nodes\n", file, fusion.edges.size());
+		for (const work_graph_fusion_edge& e : fusion.edges)
+		{
+			printf("  %-14s -> %-16s %-16s %3u B  %10.0f records/frame  %12.0f B/frame  %s%s\n", e.producer.c_str(), e.consumer.c_str(),
+				e.record_type.c_str(), e.record_size, e.records_per_frame, e.bytes_per_frame, e.fused ? "fused" : "kept: ", e.reason.c_str());
+		}
+		for (const std::string& n : fusion.removed_nodes)
+			printf("  removed node %s\n", n.c_str());
+		printf("  record traffic eliminated: %.0f B/frame (%.1f MB/frame, written and read back)\n", fusion.EliminatedBytesPerFrame(),
+			fusion.EliminatedBytesPerFrame() / (1024.0 * 1024.0));
+		for (const std::string& w : fusion.warnings)
+			printf("  warning: %s\n", w.c_str());
+		if (const char* out = args.GetString("--out", nullptr))
+		{
+			std::ofstream stream(out, std::ios::binary);
+			stream << fusion.hlsl;
+			printf("  fused HLSL: %s%s\n", out, stream ? "" : " (write failed)");
+		}
+
+		cpu_texture SRV;
+		if (!LoadInputTexture(args, SRV))
+			return 1;
+		cpu_texture UAV;
+		UAV.Resize(SRV.width, SRV.height);
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 20));
+		entryRecord record = MakeHelloEntryRecord(SRV.width, SRV.height, 0);
+		bool pass = true;
+		printf("Threads: %u, frames: %u\n", pool.Size(), frames);
+		for (bool fused : { false, true })
+		{
+			cpu_work_graph graph(pool);
+			cpu_hello_work_graph_config config;
+			config.fuse_second_node = fused;
+			cpu_hello_work_graph ids = AddHelloWorkGraphNodes(graph, SRV, UAV, config);
+			double seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+				auto start = std::chrono::steady_clock::now();
+				graph.DispatchGraph(ids.first_node, &record, 1, sizeof(record));
+				seconds += SecondsSince(start);
+			}
+			float max_diff = CompareTextures(SRV, UAV);
+			pass = pass && max_diff == 0.0f;
+			printf("  %-8s %.3f ms/frame, secondNode records/frame %10.0f, record traffic %12.0f B/frame, UAV == SRV: %s\n",
+				fused ? "fused" : "unfused", 1000.0 * seconds / frames, (double)graph.Stats(ids.second_node).records_in / frames,
+				2.0 * (double)graph.Stats(ids.second_node).records_in / frames * sizeof(secondNodeInput), max_diff == 0.0f ? "PASS" : "FAIL");
+		}
+		return pass ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// Hardware cache miss counts of the calling thread and of the threads it starts afterwards, so create it before the thread
+	// pool. There is no generic L2 miss event: cache-references counts the last level cache accesses, which on most x86 CPUs
+	// are the L2 misses, and cache-misses the last level misses. Linux perf events only, often not exposed in VMs.
+	class cache_miss_counters
+	{
+	public:
+		cache_miss_counters()
+		{
+#if defined(__linux__)
+			const uint64_t configs[2] = { PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES };
+			for (int i = 0; i < 2; i++)
+			{
+				perf_event_attr attr = {};
+				attr.size = sizeof(attr);
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = configs[i];
+				attr.inherit = 1;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+			}
+#endif
+		}
+		~cache_miss_counters()
+		{
+#if defined(__linux__)
+			for (int fd : fds)
+				if (fd >= 0)
+					close(fd);
+#endif
+		}
+		cache_miss_counters(const cache_miss_counters&) = delete;
+		cache_miss_counters& operator=(const cache_miss_counters&) = delete;
+
+		bool Available() const { return fds[0] >= 0 && fds[1] >= 0; }
+
+		// Totals since construction, 0 if unavailable.
+		uint64_t L2Misses() const { return Read(fds[0]); }
+		uint64_t LastLevelMisses() const { return Read(fds[1]); }
+
+	private:
+		static uint64_t Read(int fd)
+		{
+			uint64_t value = 0u;
+#if defined(__linux__)
+			if (fd >= 0 && read(fd, &value, sizeof(value)) != (ssize_t)sizeof(value))
+				value = 0u;
+#else
+			(void)fd;
+#endif
+			return value;
+		}
+
+		int fds[2] = { -1, -1 };
+	};
+
+	// Smooth gradients with a checker pattern, so the copy has something to compare.
+	void MakeSyntheticTexture(uint32_t width, uint32_t height, cpu_texture& texture)
+	{
+		texture.Resize(width, height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				float checker = ((x / 64u + y / 64u) & 1u) ? 1.0f : 0.5f;
+				texture.Store(uint2{ x, y }, float4{ checker * x / width, checker * y / height, checker * (x ^ y) / 8192.0f, 1.0f });
+			}
+		}
+	}
+
+	//=============================================================================================================================
+	// order: batchFirstNode -> batchSecondNode with its groups run in row-major, Morton and Hilbert order, on the bundled images
+	// (or --image) and a synthetic --synthetic WxH image (default 7680x4320, 0 to skip).
+	int RunOrder(const bench_args& args)
+	{
+		std::vector<std::pair<std::string, cpu_texture>> inputs;
+		std::vector<std::string> files;
+		if (const char* file = args.GetString("--image", nullptr))
+			files.push_back(file);
+		else
+			files = { "../WorkGraphsSandbox/data/albert.jpg", "../WorkGraphsSandbox/data/albert_gaussian_noise.jpg", "../WorkGraphsSandbox/data/monalisa.jpg" };
+		for (const std::string& file : files)
+		{
+			cpu_image_rgba8 image;
+			if (!LoadImageFromFile(file.c_str(), image))
+			{
+				printf("Failed to load %s\n", file.c_str());
+				return 1;
+			}
+			inputs.emplace_back(std::filesystem::path(file).filename().string(), cpu_texture());
+			MakeTextureFromImage(image, inputs.back().second);
+		}
+		uint32_t synthetic_width = 7680u, synthetic_height = 4320u;
+		if (const char* size = args.GetString("--synthetic", nullptr))
+		{
+			if (sscanf(size, "%ux%u", &synthetic_width, &synthetic_height) != 2)
+				synthetic_width = synthetic_height = 0u;
+		}
+		if (synthetic_width > 0u && synthetic_height > 0u)
+		{
+			inputs.emplace_back("synthetic", cpu_texture());
+			MakeSyntheticTexture(synthetic_width, synthetic_height, inputs.back().second);
+		}
+
+		cache_miss_counters counters;
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 5));
+		printf("Threads: %u, frames: %u, cache miss counters: %s\n", pool.Size(), frames, counters.Available() ? "yes" : "n/a");
+		bool pass = true;
+		for (auto& input : inputs)
+		{
+			cpu_texture& SRV = input.second;
+			cpu_texture UAV;
+			UAV.Resize(SRV.width, SRV.height);
+			cpu_descriptor_heap heap;
+			work_graph_batch_image image = { SRV.width, SRV.height, heap.Add(SRV), heap.Add(UAV) };
+			std::vector<batchEntryRecord> records;
+			BuildBatchEntryRecords(&image, 1, c_batchMaxTileSize, records);
+			printf("%s (%ux%u), %zu entry records\n", input.first.c_str(), SRV.width, SRV.height, records.size());
+			printf("  %-10s %10s %16s %16s %8s\n", "order", "ms/frame", "L2 misses/frame", "LLC misses/frame", "valid");
+			for (cpu_group_order order : { cpu_group_order::row_major, cpu_group_order::morton, cpu_group_order::hilbert })
+			{
+				cpu_work_graph graph(pool);
+				cpu_batch_work_graph ids = AddBatchNodes(graph, heap, order);
+				// One untimed frame builds the group order and warms the record arenas.
+				graph.DispatchGraph(ids.batch_first_node, records.data(), (uint32_t)records.size(), sizeof(batchEntryRecord));
+				double seconds = 0.0;
+				uint64_t l2_misses = 0u, llc_misses = 0u;
+				for (uint32_t f = 0; f < frames; f++)
+				{
+					UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+					uint64_t l2_start = counters.L2Misses(), llc_start = counters.LastLevelMisses();
+					auto start = std::chrono::steady_clock::now();
+					graph.DispatchGraph(ids.batch_first_node, records.data(), (uint32_t)records.size(), sizeof(batchEntryRecord));
+					seconds += SecondsSince(start);
+					l2_misses += counters.L2Misses() - l2_start;
+					llc_misses += counters.LastLevelMisses() - llc_start;
+				}
+				float max_diff = CompareTextures(SRV, UAV);
+				pass = pass && max_diff == 0.0f;
+				char l2[32] = "n/a", llc[32] = "n/a";
+				if (counters.Available())
+				{
+					snprintf(l2, sizeof(l2), "%.0f", (double)l2_misses / frames);
+					snprintf(llc, sizeof(llc), "%.0f", (double)llc_misses / frames);
+				}
+				printf("  %-10s %10.3f %16s %16s %8s\n", GroupOrderName(order), 1000.0 * seconds / frames, l2, llc, max_diff == 0.0f ? "PASS" : "FAIL");
+			}
+		}
+		return pass ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// encoding: the hello graph with each firstNode -> secondNode record layout of work_graph_record_encoding.h, record bytes
+	// moved per frame and time, on --image or a synthetic --synthetic WxH image (not limited to 8-bit values).
+	int RunEncoding(const bench_args& args)
+	{
+		cpu_texture SRV;
+		uint32_t synthetic_width = 0u, synthetic_height = 0u;
+		if (const char* size = args.GetString("--synthetic", nullptr))
+			sscanf(size, "%ux%u", &synthetic_width, &synthetic_height);
+		if (synthetic_width > 0u && synthetic_height > 0u)
+		{
+			MakeSyntheticTexture(synthetic_width, synthetic_height, SRV);
+			printf("Input: synthetic (%ux%u)\n", SRV.width, SRV.height);
+		}
+		else if (!LoadInputTexture(args, SRV))
+		{
+			return 1;
+		}
+		cpu_texture UAV, expected;
+		UAV.Resize(SRV.width, SRV.height);
+		expected.Resize(SRV.width, SRV.height);
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 20));
+		entryRecord record = MakeHelloEntryRecord(SRV.width, SRV.height, 0);
+		printf("Threads: %u, frames: %u\n", pool.Size(), frames);
+		printf("  %-12s %7s %12s %16s %12s %10s %10s %14s %10s\n", "encoding", "bytes", "records", "record B/frame", "MB/frame", "ms/frame",
+			"GB/s", "max |UAV-SRV|", "valid");
+		bool pass = true;
+		for (work_graph_record_encoding encoding : { work_graph_record_encoding::float4_uint2, work_graph_record_encoding::half4_uint16,
+			work_graph_record_encoding::unorm8_uint16 })
+		{
+			// What secondNode should store: the SRV through the same encode and decode as the nodes.
+			for (size_t t = 0; t < SRV.texels.size(); t++)
+			{
+				const float4& c = SRV.texels[t];
+				expected.texels[t] = encoding == work_graph_record_encoding::half4_uint16 ? DecodeColorHalf4(EncodeColorHalf4(c)) :
+					encoding == work_graph_record_encoding::unorm8_uint16 ? DecodeColorUnorm8(EncodeColorUnorm8(c)) : c;
+			}
+
+			cpu_work_graph graph(pool);
+			cpu_hello_work_graph_config config;
+			config.second_node_encoding = encoding;
+			cpu_hello_work_graph ids = AddHelloWorkGraphNodes(graph, SRV, UAV, config);
+			// One untimed frame warms the record arenas.
+			graph.DispatchGraph(ids.first_node, &record, 1, sizeof(record));
+			graph.ResetStats();
+			double seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				UAV.Clear(float4{ 1.0f, 0.0f, 0.0f, 1.0f });
+				auto start = std::chrono::steady_clock::now();
+				graph.DispatchGraph(ids.first_node, &record, 1, sizeof(record));
+				seconds += SecondsSince(start);
+			}
+			bool valid = CompareTextures(expected, UAV) == 0.0f;
+			pass = pass && valid;
+			// Written by firstNode and read back by secondNode.
+			double records = (double)graph.Stats(ids.second_node).records_in / frames;
+			double bytes = 2.0 * records * RecordEncodingSize(encoding);
+			printf("  %-12s %7u %12.0f %16.0f %12.2f %10.3f %10.2f %14.6f %10s\n", RecordEncodingName(encoding), RecordEncodingSize(encoding),
+				records, bytes, bytes / (1024.0 * 1024.0), 1000.0 * seconds / frames, bytes * frames / seconds * 1e-9,
+				CompareTextures(SRV, UAV), valid ? "PASS" : "FAIL");
+		}
+		return pass ? 0 : 1;
+	}
+
+	// --synthetic WxH if given, otherwise --image.
+	bool LoadFilterInput(const bench_args& args, cpu_texture& texture)
+	{
+		uint32_t width = 0u, height = 0u;
+		if (const char* size = args.GetString("--synthetic", nullptr))
+			sscanf(size, "%ux%u", &width, &height);
+		if (width == 0u || height == 0u)
+			return LoadInputTexture(args, texture);
+		MakeSyntheticTexture(width, height, texture);
+		printf("Input: synthetic (%ux%u)\n", width, height);
+		return true;
+	}
+
+	//=============================================================================================================================
+	// blur: separable Gaussian (cpu_gaussian_blur.h) per radius, scalar vs AVX2 with full rows vs L2 sized strips in the
+	// vertical pass. The scalar run is checked against a direct 2D convolution at sampled pixels, the others against it.
+	int RunBlur(const bench_args& args)
+	{
+		cpu_texture SRV;
+		if (!LoadFilterInput(args, SRV))
+			return 1;
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 10));
+		std::vector<uint32_t> radii = args.GetUintList("--radius", { 1u, 2u, 4u, 8u, 16u, 32u });
+		cpu_gaussian_blur_options options;
+		options.l2_bytes = args.GetUint("--l2", options.l2_bytes / 1024u) * 1024u;
+		printf("Threads: %u, frames: %u, L2 budget %u KB, AVX2: %s\n", pool.Size(), frames, options.l2_bytes / 1024u,
+			IsWaveIsaSupported(cpu_wave_isa::avx2) ? "yes" : "no (scalar only)");
+		printf("  %6s %-16s %8s %10s %10s %12s %8s\n", "radius", "variant", "strip", "ms/frame", "MPix/s", "max diff", "valid");
+
+		struct blur_variant
+		{
+			const char* name;
+			cpu_wave_isa isa;
+			bool full_rows;
+		};
+		const blur_variant variants[] = { { "scalar", cpu_wave_isa::scalar, false }, { "AVX2 full rows", cpu_wave_isa::avx2, true },
+			{ "AVX2 L2 strips", cpu_wave_isa::avx2, false } };
+		bool pass = true;
+		cpu_gaussian_blur blur;
+		cpu_texture UAV, reference;
+		std::vector<float> weights;
+		for (uint32_t radius : radii)
+		{
+			options.radius = radius;
+			BuildGaussianKernel(radius, options.sigma, weights);
+			for (const blur_variant& v : variants)
+			{
+				if (v.isa != cpu_wave_isa::scalar && !IsWaveIsaSupported(v.isa))
+					continue;
+				options.isa = v.isa;
+				options.strip_width = v.full_rows ? SRV.width : 0u;
+				blur.Run(pool, SRV, UAV, options);
+				double seconds = 0.0;
+				for (uint32_t f = 0; f < frames; f++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					blur.Run(pool, SRV, UAV, options);
+					seconds += SecondsSince(start);
+				}
+
+				float max_diff = 0.0f;
+				if (v.isa == cpu_wave_isa::scalar)
+				{
+					reference = UAV;
+					// Direct 2D convolution with clamped edges at every 61st pixel.
+					for (size_t i = 0; i < SRV.texels.size(); i += 61u)
+					{
+						int32_t px = (int32_t)(i % SRV.width), py = (int32_t)(i / SRV.width);
+						double acc[4] = {};
+						for (int32_t ky = -(int32_t)radius; ky <= (int32_t)radius; ky++)
+						{
+							for (int32_t kx = -(int32_t)radius; kx <= (int32_t)radius; kx++)
+							{
+								uint32_t sx = (uint32_t)std::clamp(px + kx, 0, (int32_t)SRV.width - 1);
+								uint32_t sy = (uint32_t)std::clamp(py + ky, 0, (int32_t)SRV.height - 1);
+								double w = (double)weights[kx + radius] * weights[ky + radius];
+								float4 t = SRV.Load(uint2{ sx, sy });
+								acc[0] += w * t.x;
+								acc[1] += w * t.y;
+								acc[2] += w * t.z;
+								acc[3] += w * t.w;
+							}
+						}
+						const float4& u = UAV.texels[i];
+						max_diff = std::max({ max_diff, (float)std::fabs(acc[0] - u.x), (float)std::fabs(acc[1] - u.y),
+							(float)std::fabs(acc[2] - u.z), (float)std::fabs(acc[3] - u.w) });
+					}
+				}
+				else
+				{
+					max_diff = CompareTextures(reference, UAV);
+				}
+				bool valid = max_diff <= 1e-5f;
+				pass = pass && valid;
+				printf("  %6u %-16s %8u %10.3f %10.1f %12.2e %8s\n", radius, v.name, blur.StripWidth(), 1000.0 * seconds / frames,
+					(double)SRV.width * SRV.height * frames / seconds * 1e-6, max_diff, valid ? "PASS" : "FAIL");
+			}
+		}
+		return pass ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// bilateral: bilateral filter (cpu_bilateral_filter.h) of the noisy image per radius, scalar vs AVX2, checked against exp()
+	// per tap at sampled pixels, with the PSNR against the clean image.
+	int RunBilateral(const bench_args& args)
+	{
+		const char* file = args.GetString("--image", "../WorkGraphsSandbox/data/albert_gaussian_noise.jpg");
+		const char* clean_file = args.GetString("--clean", "../WorkGraphsSandbox/data/albert.jpg");
+		cpu_image_rgba8 image, clean_image;
+		if (!LoadImageFromFile(file, image) || !LoadImageFromFile(clean_file, clean_image))
+		{
+			printf("Failed to load %s or %s\n", file, clean_file);
+			return 1;
+		}
+		cpu_texture SRV, clean;
+		MakeTextureFromImage(image, SRV);
+		MakeTextureFromImage(clean_image, clean);
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 3));
+		uint32_t scalar_max_radius = args.GetUint("--scalar-max-radius", 4);
+		std::vector<uint32_t> radii = args.GetUintList("--radius", { 2u, 4u, 8u, 16u });
+		cpu_bilateral_filter_options options;
+		options.sigma_range = args.GetFloat("--sigma-range", options.sigma_range);
+		// The weights are normalized, so an output is off by about the weight error.
+		const float tolerance = 2.0f * BilateralLutTolerance();
+		printf("Input: %s (%ux%u), PSNR against %s: %.2f dB\n", file, SRV.width, SRV.height, clean_file, ComputePSNR(SRV, clean));
+		printf("Threads: %u, frames: %u, sigma_range %g, LUT %u entries, tolerance %.2e\n", pool.Size(), frames, options.sigma_range,
+			c_bilateralRangeLutSize, tolerance);
+		printf("  %6s %-8s %10s %10s %14s %14s %10s %8s\n", "radius", "variant", "ms/frame", "MPix/s", "max diff exp", "max diff scalar",
+			"PSNR dB", "valid");
+		bool pass = true;
+		cpu_bilateral_filter filter;
+		cpu_texture UAV, scalar_result;
+		for (uint32_t radius : radii)
+		{
+			options.radius = radius;
+			bool have_scalar = false;
+			for (cpu_wave_isa isa : { cpu_wave_isa::scalar, cpu_wave_isa::avx2 })
+			{
+				if ((isa == cpu_wave_isa::scalar && radius > scalar_max_radius) || !IsWaveIsaSupported(isa))
+					continue;
+				options.isa = isa;
+				double seconds = 0.0;
+				for (uint32_t f = 0; f < frames; f++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					filter.Run(pool, SRV, UAV, options);
+					seconds += SecondsSince(start);
+				}
+
+				float exact_diff = 0.0f;
+				for (size_t i = 0; i < UAV.texels.size(); i += 997u)
+				{
+					float4 e = BilateralFilterPixelExact(SRV, (uint32_t)(i % SRV.width), (uint32_t)(i / SRV.width), options);
+					const float4& u = UAV.texels[i];
+					exact_diff = std::max({ exact_diff, std::fabs(e.x - u.x), std::fabs(e.y - u.y), std::fabs(e.z - u.z), std::fabs(e.w - u.w) });
+				}
+				char scalar_diff[32] = "-";
+				bool valid = exact_diff <= tolerance;
+				if (isa == cpu_wave_isa::scalar)
+				{
+					scalar_result = UAV;
+					have_scalar = true;
+				}
+				else if (have_scalar)
+				{
+					float diff = CompareTextures(scalar_result, UAV);
+					snprintf(scalar_diff, sizeof(scalar_diff), "%.2e", diff);
+					valid = valid && diff <= 1e-4f;
+				}
+				pass = pass && valid;
+				printf("  %6u %-8s %10.3f %10.2f %14.2e %14s %10.2f %8s\n", radius, WaveIsaName(isa), 1000.0 * seconds / frames,
+					(double)SRV.width * SRV.height * frames / seconds * 1e-6, exact_diff, scalar_diff, ComputePSNR(UAV, clean),
+					valid ? "PASS" : "FAIL");
+			}
+		}
+		return pass ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// atrous: a-trous wavelet filter (cpu_atrous_filter.h) of the noisy image, pass per level vs fused per tile size: time,
+	// bytes moved to and from memory and how many more texels the halos make it filter. The fused runs must match the pass
+	// per level one exactly, AVX2 must match scalar within rounding.
+	int RunAtrous(const bench_args& args)
+	{
+		const char* file = args.GetString("--image", "../WorkGraphsSandbox/data/albert_gaussian_noise.jpg");
+		const char* clean_file = args.GetString("--clean", "../WorkGraphsSandbox/data/albert.jpg");
+		cpu_image_rgba8 image, clean_image;
+		if (!LoadImageFromFile(file, image) || !LoadImageFromFile(clean_file, clean_image))
+		{
+			printf("Failed to load %s or %s\n", file, clean_file);
+			return 1;
+		}
+		cpu_texture SRV, clean;
+		MakeTextureFromImage(image, SRV);
+		MakeTextureFromImage(clean_image, clean);
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 5));
+		std::vector<uint32_t> tiles = args.GetUintList("--tile", { 128u, 256u, 512u });
+		cpu_atrous_filter_options options;
+		options.levels = std::clamp(args.GetUint("--levels", options.levels), 1u, c_atrousMaxLevels);
+		options.sigma_color = args.GetFloat("--sigma-color", options.sigma_color);
+		options.sigma_decay = args.GetFloat("--sigma-decay", options.sigma_decay);
+		options.max_halo = args.GetFloat("--max-halo", options.max_halo);
+		const double pixels = (double)SRV.width * SRV.height;
+		printf("Input: %s (%ux%u), PSNR against %s: %.2f dB\n", file, SRV.width, SRV.height, clean_file, ComputePSNR(SRV, clean));
+		printf("Threads: %u, frames: %u, levels %u (halo %u), sigma_color %g, sigma_decay %g, max halo %g of the tile\n", pool.Size(), frames,
+			options.levels, AtrousHalo(options.levels), options.sigma_color, options.sigma_decay, options.max_halo);
+
+		// Scalar pass per level, the reference.
+		cpu_atrous_filter filter;
+		cpu_texture UAV, reference, scalar;
+		options.isa = cpu_wave_isa::scalar;
+		filter.Run(pool, SRV, scalar, options);
+		options.isa = cpu_wave_isa::avx2;
+
+		printf("  %-14s %6s %6s %10s %10s %10s %10s %8s %12s %12s %8s %12s %8s\n", "variant", "tile", "fused", "ms/frame", "MB read",
+			"MB written", "B/pixel", "bytes %", "filtered/px", "scratch KB", "PSNR dB", "max diff", "valid");
+		bool pass = true;
+		double naive_bytes = 0.0;
+		std::vector<uint32_t> variants = { 0u };
+		variants.insert(variants.end(), tiles.begin(), tiles.end());
+		for (uint32_t tile : variants)
+		{
+			options.fused = tile > 0u;
+			options.tile_size = tile;
+			filter.Run(pool, SRV, UAV, options);
+			double seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				filter.Run(pool, SRV, UAV, options);
+				seconds += SecondsSince(start);
+			}
+			const cpu_atrous_filter_stats& stats = filter.Stats();
+			double bytes = (double)(stats.bytes_read + stats.bytes_written);
+			float max_diff;
+			bool valid;
+			if (!options.fused)
+			{
+				reference = UAV;
+				naive_bytes = bytes;
+				max_diff = CompareTextures(scalar, UAV);
+				valid = max_diff <= 1e-4f;
+			}
+			else
+			{
+				max_diff = CompareTextures(reference, UAV);
+				valid = max_diff == 0.0f;
+			}
+			pass = pass && valid;
+			char tile_name[16] = "-";
+			if (options.fused)
+				snprintf(tile_name, sizeof(tile_name), "%u", tile);
+			// bytes % is of the pass per level run's; fused is how many levels ran per tile.
+			printf("  %-14s %6s %6u %10.3f %10.2f %10.2f %10.1f %8.0f %12.2f %12.0f %8.2f %12.2e %8s\n", options.fused ? "fused" : "pass per level",
+				tile_name, stats.fused_levels, 1000.0 * seconds / frames, stats.bytes_read / (1024.0 * 1024.0), stats.bytes_written / (1024.0 * 1024.0),
+				bytes / pixels, 100.0 * bytes / naive_bytes, stats.texels_filtered / pixels, stats.scratch_bytes / 1024.0,
+				ComputePSNR(UAV, clean), max_diff, valid ? "PASS" : "FAIL");
+		}
+		return pass ? 0 : 1;
+	}
+
+	// Time for workers that each take the next grain tiles of order when they finish, if tile t takes costs[t]: the finish time
+	// of the last one, over what it would be with the work split perfectly. 1 is perfectly balanced.
+	double ModelScheduleImbalance(const std::vector<uint32_t>& order, uint32_t grain, const std::vector<double>& costs, uint32_t workers)
+	{
+		std::vector<double> busy_until(workers, 0.0);
+		double total = 0.0;
+		for (size_t i = 0; i < order.size(); i += grain)
+		{
+			double chunk = 0.0;
+			for (size_t j = i; j < std::min(order.size(), i + grain); j++)
+				chunk += costs[order[j]];
+			*std::min_element(busy_until.begin(), busy_until.end()) += chunk;
+			total += chunk;
+		}
+		return total > 0.0 ? *std::max_element(busy_until.begin(), busy_until.end()) * workers / total : 1.0;
+	}
+
+	//=============================================================================================================================
+	// variable: variance driven variable radius bilateral (cpu_variable_radius_filter.h) vs the fixed radius one, on the noisy
+	// image and on the clean one with noise that grows from none at the top to --ramp sigma at the bottom. Each tile must
+	// match the fixed radius filter at its radius exactly. Imbalance is measured from the taps per worker and modeled for
+	// --model-workers workers taking tiles in each schedule's order.
+	int RunVariable(const bench_args& args)
+	{
+		const char* file = args.GetString("--image", "../WorkGraphsSandbox/data/albert_gaussian_noise.jpg");
+		const char* clean_file = args.GetString("--clean", "../WorkGraphsSandbox/data/albert.jpg");
+		cpu_image_rgba8 image, clean_image;
+		if (!LoadImageFromFile(file, image) || !LoadImageFromFile(clean_file, clean_image))
+		{
+			printf("Failed to load %s or %s\n", file, clean_file);
+			return 1;
+		}
+		cpu_texture noisy, clean, ramp;
+		MakeTextureFromImage(image, noisy);
+		MakeTextureFromImage(clean_image, clean);
+		float ramp_sigma = args.GetFloat("--ramp", 0.25f);
+		ramp = clean;
+		std::mt19937 rng(1u);
+		std::normal_distribution<float> gaussian(0.0f, 1.0f);
+		for (size_t i = 0; i < ramp.texels.size(); i++)
+		{
+			float sigma = ramp_sigma * (float)(i / ramp.width) / (float)std::max(1u, ramp.height - 1u);
+			float4& t = ramp.texels[i];
+			t.x = std::clamp(t.x + sigma * gaussian(rng), 0.0f, 1.0f);
+			t.y = std::clamp(t.y + sigma * gaussian(rng), 0.0f, 1.0f);
+			t.z = std::clamp(t.z + sigma * gaussian(rng), 0.0f, 1.0f);
+		}
+
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 3));
+		uint32_t model_workers = std::max(1u, args.GetUint("--model-workers", 16));
+		std::vector<uint32_t> fixed_radii = args.GetUintList("--fixed", { 2u, 4u, 8u });
+		cpu_variable_radius_filter_options options;
+		options.max_radius = std::min(args.GetUint("--max-radius", options.max_radius), 32u);
+		options.noise_target = args.GetFloat("--target", options.noise_target);
+		options.sigma_range = args.GetFloat("--sigma-range", options.sigma_range);
+		printf("Threads: %u, frames: %u, max radius %u, noise target %g, sigma_range %g, imbalance modeled for %u workers\n", pool.Size(),
+			frames, options.max_radius, options.noise_target, options.sigma_range, model_workers);
+
+		struct bench_input
+		{
+			const char* name;
+			const cpu_texture* texture;
+		};
+		const bench_input inputs[] = { { file, &noisy }, { "clean + noise ramp", &ramp } };
+		bool pass = true;
+		cpu_variable_radius_filter variable;
+		cpu_bilateral_filter fixed;
+		cpu_bilateral_filter_options fixed_options;
+		fixed_options.sigma_range = options.sigma_range;
+		cpu_texture UAV, reference;
+		std::vector<uint32_t> order;
+		for (const bench_input& input : inputs)
+		{
+			const cpu_texture& SRV = *input.texture;
+			const double pixels = (double)SRV.width * SRV.height;
+			variable.Run(pool, SRV, UAV, options);
+			const cpu_tile_radius_map& map = variable.Map();
+			printf("\n%s (%ux%u), PSNR %.2f dB, tiles per radius:", input.name, SRV.width, SRV.height, ComputePSNR(SRV, clean));
+			std::vector<uint32_t> histogram(options.max_radius + 1u, 0u);
+			for (uint8_t r : map.radius)
+				histogram[r]++;
+			for (uint32_t r = 0; r <= options.max_radius; r++)
+				printf(" %u:%u", r, histogram[r]);
+			printf("\n");
+
+			// Every tile against the fixed radius filter at its radius, radius 0 against the input.
+			float max_diff = 0.0f;
+			for (uint32_t r = 0; r <= options.max_radius; r++)
+			{
+				if (histogram[r] == 0u)
+					continue;
+				if (r > 0u)
+				{
+					fixed_options.radius = r;
+					fixed.Run(pool, SRV, reference, fixed_options);
+				}
+				const cpu_texture& expected = r > 0u ? reference : SRV;
+				for (uint32_t t = 0; t < map.radius.size(); t++)
+				{
+					if (map.radius[t] != r)
+						continue;
+					uint32_t x0 = (t % map.tiles_x) * c_radiusTileSize, y0 = (t / map.tiles_x) * c_radiusTileSize;
+					for (uint32_t y = y0; y < std::min(SRV.height, y0 + c_radiusTileSize); y++)
+					{
+						for (uint32_t x = x0; x < std::min(SRV.width, x0 + c_radiusTileSize); x++)
+						{
+							float4 e = expected.Load(uint2{ x, y }), u = UAV.Load(uint2{ x, y });
+							max_diff = std::max({ max_diff, std::fabs(e.x - u.x), std::fabs(e.y - u.y), std::fabs(e.z - u.z), std::fabs(e.w - u.w) });
+						}
+					}
+				}
+			}
+			// What filterTile computes, exp() per tap, at sampled pixels.
+			float exact_diff = 0.0f;
+			cpu_bilateral_filter_options exact_options = fixed_options;
+			for (size_t i = 0; i < UAV.texels.size(); i += 997u)
+			{
+				uint32_t x = (uint32_t)(i % SRV.width), y = (uint32_t)(i / SRV.width);
+				exact_options.radius = map.radius[(y / c_radiusTileSize) * map.tiles_x + x / c_radiusTileSize];
+				float4 e = BilateralFilterPixelExact(SRV, x, y, exact_options);
+				const float4& u = UAV.texels[i];
+				exact_diff = std::max({ exact_diff, std::fabs(e.x - u.x), std::fabs(e.y - u.y), std::fabs(e.z - u.z), std::fabs(e.w - u.w) });
+			}
+			bool valid = max_diff == 0.0f && exact_diff <= 2.0f * BilateralLutTolerance();
+			pass = pass && valid;
+			printf("Max diff against the fixed radius filter per tile %.2e, against exp() per tap %.2e (tolerance %.2e)\n", max_diff,
+				exact_diff, 2.0f * BilateralLutTolerance());
+
+			// Tap cost per tile for the model; a copied tile counts as one tap per pixel.
+			std::vector<double> costs(map.radius.size());
+			for (size_t t = 0; t < costs.size(); t++)
+				costs[t] = (double)(2u * map.radius[t] + 1u) * (2u * map.radius[t] + 1u);
+
+			printf("  %-22s %10s %10s %8s %12s %12s %12s\n", "filter", "ms/frame", "taps/px", "PSNR dB", "imbalance", "modeled", "valid");
+			for (uint32_t r : fixed_radii)
+			{
+				fixed_options.radius = r;
+				double seconds = 0.0;
+				for (uint32_t f = 0; f < frames; f++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					fixed.Run(pool, SRV, UAV, fixed_options);
+					seconds += SecondsSince(start);
+				}
+				char name[32];
+				snprintf(name, sizeof(name), "fixed r=%u", r);
+				printf("  %-22s %10.3f %10.1f %8.2f %12s %12s %12s\n", name, 1000.0 * seconds / frames, (2.0 * r + 1.0) * (2.0 * r + 1.0),
+					ComputePSNR(UAV, clean), "-", "-", "-");
+			}
+			for (cpu_tile_schedule schedule : { cpu_tile_schedule::raster, cpu_tile_schedule::cost_sorted })
+			{
+				options.schedule = schedule;
+				double seconds = 0.0;
+				for (uint32_t f = 0; f < frames; f++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					variable.Run(pool, SRV, UAV, options);
+					seconds += SecondsSince(start);
+				}
+				const cpu_variable_radius_filter_stats& stats = variable.Stats();
+				uint32_t grain = BuildTileOrder(map, schedule, model_workers, order);
+				char name[32];
+				snprintf(name, sizeof(name), "variable, %s", TileScheduleName(schedule));
+				printf("  %-22s %10.3f %10.1f %8.2f %12.2f %12.2f %12s\n", name, 1000.0 * seconds / frames, stats.taps / pixels,
+					ComputePSNR(UAV, clean), stats.taps > 0u ? (double)stats.max_worker_taps * pool.Size() / stats.taps : 1.0,
+					ModelScheduleImbalance(order, grain, costs, model_workers), valid ? "PASS" : "FAIL");
+			}
+		}
+		return pass ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// sat: summed-area tables (cpu_summed_area_table.h) of the 8-bit image and of its float texture, scalar vs AVX2 build, then
+	// box filters read from them per radius against the direct 2D box convolution (up to --direct-max-radius), all checked
+	// against the box mean in doubles at sampled pixels. Last, 3 iterated boxes vs cpu_gaussian_blur at sigma = radius / 3,
+	// compared by PSNR since the blur clamps at the edges where the boxes are truncated.
+	int RunSat(const bench_args& args)
+	{
+		cpu_image_rgba8 image;
+		uint32_t width = 0u, height = 0u;
+		if (const char* size = args.GetString("--synthetic", nullptr))
+			sscanf(size, "%ux%u", &width, &height);
+		if (width > 0u && height > 0u)
+		{
+			// Quantized so the 8-bit and float tables see the same texels.
+			cpu_texture synthetic;
+			MakeSyntheticTexture(width, height, synthetic);
+			image.width = width;
+			image.height = height;
+			image.pixels.resize((size_t)width * height * 4u);
+			for (size_t i = 0; i < synthetic.texels.size(); i++)
+			{
+				const float* t = &synthetic.texels[i].x;
+				for (uint32_t c = 0; c < 4u; c++)
+					image.pixels[i * 4u + c] = (uint8_t)(std::clamp(t[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+			}
+			printf("Input: synthetic (%ux%u)\n", width, height);
+		}
+		else
+		{
+			const char* file = args.GetString("--image", "../WorkGraphsSandbox/data/albert.jpg");
+			if (!LoadImageFromFile(file, image))
+			{
+				printf("Failed to load %s\n", file);
+				return 1;
+			}
+			printf("Input: %s (%ux%u)\n", file, image.width, image.height);
+		}
+		cpu_texture SRV;
+		MakeTextureFromImage(image, SRV);
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 10));
+		uint32_t direct_max_radius = args.GetUint("--direct-max-radius", 8);
+		std::vector<uint32_t> radii = args.GetUintList("--radius", { 1u, 4u, 16u, 64u, 256u });
+		cpu_summed_area_table_options options;
+		options.strip_width = args.GetUint("--strip", options.strip_width);
+		const bool avx2 = IsWaveIsaSupported(cpu_wave_isa::avx2);
+		const double pixels = (double)SRV.width * SRV.height;
+		printf("Threads: %u, frames: %u, column strips of %u entries, AVX2: %s\n", pool.Size(), frames, options.strip_width,
+			avx2 ? "yes" : "no (scalar only)");
+
+		// Build: each table against the scalar build of its kind, exactly.
+		cpu_summed_area_table<uint32_t> table_u32, reference_u32;
+		cpu_summed_area_table<double> table_f64, reference_f64;
+		options.isa = cpu_wave_isa::scalar;
+		BuildSummedAreaTable(pool, image, reference_u32, options);
+		BuildSummedAreaTable(pool, SRV, reference_f64, options);
+		bool pass = true;
+		printf("  %-18s %10s %10s %10s %8s\n", "table build", "ms/frame", "MPix/s", "MB", "valid");
+		for (cpu_wave_isa isa : { cpu_wave_isa::scalar, cpu_wave_isa::avx2 })
+		{
+			if (isa != cpu_wave_isa::scalar && !avx2)
+				continue;
+			options.isa = isa;
+			for (uint32_t kind = 0; kind < 2u; kind++)
+			{
+				double seconds = 0.0;
+				for (uint32_t f = 0; f < frames; f++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					if (kind == 0u)
+						BuildSummedAreaTable(pool, image, table_u32, options);
+					else
+						BuildSummedAreaTable(pool, SRV, table_f64, options);
+					seconds += SecondsSince(start);
+				}
+				bool valid = kind == 0u ? table_u32.sums == reference_u32.sums : table_f64.sums == reference_f64.sums;
+				pass = pass && valid;
+				size_t bytes = kind == 0u ? table_u32.sums.size() * sizeof(uint32_t) : table_f64.sums.size() * sizeof(double);
+				char name[32];
+				snprintf(name, sizeof(name), "%s %s", kind == 0u ? "uint32" : "double", WaveIsaName(isa));
+				printf("  %-18s %10.3f %10.1f %10.1f %8s\n", name, 1000.0 * seconds / frames, pixels * frames / seconds * 1e-6,
+					bytes / (1024.0 * 1024.0), valid ? "PASS" : "FAIL");
+			}
+		}
+
+		// Box filters per radius. Sampled pixels of every variant against the mean in doubles, the variants of a kind against
+		// its scalar one exactly.
+		printf("\n  %6s %-18s %10s %10s %12s %8s\n", "radius", "box filter", "ms/frame", "MPix/s", "max diff", "valid");
+		cpu_texture UAV, reference;
+		std::vector<float> inv_columns_f32;
+		std::vector<double> inv_columns_f64;
+		for (uint32_t radius : radii)
+		{
+			const int32_t r = (int32_t)std::min(radius, c_satMaxBoxRadius);
+			const size_t stride = 61u * std::max<size_t>(1u, (size_t)(r / 16) * (r / 16));
+			auto sampled_diff = [&](const cpu_texture& filtered)
+			{
+				float max_diff = 0.0f;
+				for (size_t i = 0; i < SRV.texels.size(); i += stride)
+				{
+					int32_t px = (int32_t)(i % SRV.width), py = (int32_t)(i / SRV.width);
+					int32_t x0 = std::max(px - r, 0), x1 = std::min(px + r, (int32_t)SRV.width - 1);
+					int32_t y0 = std::max(py - r, 0), y1 = std::min(py + r, (int32_t)SRV.height - 1);
+					double acc[4] = {};
+					for (int32_t y = y0; y <= y1; y++)
+					{
+						for (int32_t x = x0; x <= x1; x++)
+						{
+							const float4& t = SRV.texels[(size_t)y * SRV.width + x];
+							acc[0] += t.x;
+							acc[1] += t.y;
+							acc[2] += t.z;
+							acc[3] += t.w;
+						}
+					}
+					double count = (double)(x1 - x0 + 1) * (y1 - y0 + 1);
+					const float4& u = filtered.texels[i];
+					max_diff = std::max({ max_diff, (float)std::fabs(acc[0] / count - u.x), (float)std::fabs(acc[1] / count - u.y),
+						(float)std::fabs(acc[2] / count - u.z), (float)std::fabs(acc[3] / count - u.w) });
+				}
+				return max_diff;
+			};
+
+			if ((uint32_t)r <= direct_max_radius)
+			{
+				// Direct 2D convolution, (2r + 1)^2 taps per texel.
+				auto start = std::chrono::steady_clock::now();
+				UAV.Resize(SRV.width, SRV.height);
+				pool.ParallelFor(0u, SRV.height, 8u, [&](uint32_t begin, uint32_t end, uint32_t)
+				{
+					for (int32_t py = (int32_t)begin; py < (int32_t)end; py++)
+					{
+						int32_t y0 = std::max(py - r, 0), y1 = std::min(py + r, (int32_t)SRV.height - 1);
+						for (int32_t px = 0; px < (int32_t)SRV.width; px++)
+						{
+							int32_t x0 = std::max(px - r, 0), x1 = std::min(px + r, (int32_t)SRV.width - 1);
+							float4 acc = { 0.0f, 0.0f, 0.0f, 0.0f };
+							for (int32_t y = y0; y <= y1; y++)
+							{
+								for (int32_t x = x0; x <= x1; x++)
+								{
+									const float4& t = SRV.texels[(size_t)y * SRV.width + x];
+									acc.x += t.x;
+									acc.y += t.y;
+									acc.z += t.z;
+									acc.w += t.w;
+								}
+							}
+							float inv = 1.0f / (float)((x1 - x0 + 1) * (y1 - y0 + 1));
+							UAV.texels[(size_t)py * SRV.width + px] = float4{ acc.x * inv, acc.y * inv, acc.z * inv, acc.w * inv };
+						}
+					}
+				});
+				double seconds = SecondsSince(start);
+				float max_diff = sampled_diff(UAV);
+				bool valid = max_diff <= 1e-5f;
+				pass = pass && valid;
+				printf("  %6d %-18s %10.3f %10.1f %12.2e %8s\n", r, "direct", 1000.0 * seconds, pixels / seconds * 1e-6, max_diff, valid ? "PASS" : "FAIL");
+			}
+
+			for (uint32_t kind = 0; kind < 2u; kind++)
+			{
+				for (cpu_wave_isa isa : { cpu_wave_isa::scalar, cpu_wave_isa::avx2 })
+				{
+					if (isa != cpu_wave_isa::scalar && !avx2)
+						continue;
+					options.isa = isa;
+					double seconds = 0.0;
+					for (uint32_t f = 0; f < frames; f++)
+					{
+						auto start = std::chrono::steady_clock::now();
+						if (kind == 0u)
+							BoxFilter(pool, reference_u32, (uint32_t)r, UAV, options, inv_columns_f32);
+						else
+							BoxFilter(pool, reference_f64, (uint32_t)r, UAV, options, inv_columns_f64);
+						seconds += SecondsSince(start);
+					}
+					float max_diff = sampled_diff(UAV);
+					bool valid = max_diff <= 1e-5f;
+					if (isa == cpu_wave_isa::scalar)
+						reference = UAV;
+					else
+						valid = valid && CompareTextures(reference, UAV) == 0.0f;
+					pass = pass && valid;
+					char name[32];
+					snprintf(name, sizeof(name), "SAT %s %s", kind == 0u ? "uint32" : "double", WaveIsaName(isa));
+					printf("  %6d %-18s %10.3f %10.1f %12.2e %8s\n", r, name, 1000.0 * seconds / frames, pixels * frames / seconds * 1e-6,
+						max_diff, valid ? "PASS" : "FAIL");
+				}
+			}
+		}
+
+		// Approximate Gaussian: table builds included, against the separable blur's cost, which grows with the radius.
+		printf("\n  %6s %8s %-22s %10s %10s %16s\n", "radius", "sigma", "Gaussian", "ms/frame", "MPix/s", "PSNR dB vs sep.");
+		cpu_iterated_box_filter iterated;
+		cpu_iterated_box_filter_options iterated_options;
+		iterated_options.passes = std::max(1u, args.GetUint("--passes", iterated_options.passes));
+		iterated_options.table = options;
+		cpu_gaussian_blur blur;
+		cpu_gaussian_blur_options blur_options;
+		for (uint32_t radius : radii)
+		{
+			blur_options.radius = std::min(radius, 1024u);
+			iterated_options.sigma = std::max(blur_options.radius / 3.0f, 0.5f);
+			double seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				blur.Run(pool, SRV, reference, blur_options);
+				seconds += SecondsSince(start);
+			}
+			printf("  %6u %8.2f %-22s %10.3f %10.1f %16s\n", blur_options.radius, iterated_options.sigma, "separable", 1000.0 * seconds / frames,
+				pixels * frames / seconds * 1e-6, "-");
+			seconds = 0.0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				iterated.Run(pool, image, UAV, iterated_options);
+				seconds += SecondsSince(start);
+			}
+			std::string name = std::to_string(iterated_options.passes) + " boxes, r";
+			for (uint32_t r : iterated.Radii())
+				name += (name.back() == 'r' ? "=" : ",") + std::to_string(r);
+			printf("  %6u %8.2f %-22s %10.3f %10.1f %16.2f\n", blur_options.radius, iterated_options.sigma, name.c_str(), 1000.0 * seconds / frames,
+				pixels * frames / seconds * 1e-6, ComputePSNR(reference, UAV));
+		}
+		return pass ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// median: constant time median filter (cpu_median_filter.h) of the image with salt and pepper noise per radius, scalar vs
+	// AVX2 histograms against the direct median of each window (up to --direct-max-radius), which every variant must match at
+	// sampled pixels exactly, with the PSNR against the clean image.
+	int RunMedian(const bench_args& args)
+	{
+		const char* file = args.GetString("--image", "../WorkGraphsSandbox/data/albert.jpg");
+		cpu_image_rgba8 clean_image;
+		if (!LoadImageFromFile(file, clean_image))
+		{
+			printf("Failed to load %s\n", file);
+			return 1;
+		}
+		// A --density fraction of the pixels turned black or white.
+		float density = std::clamp(args.GetFloat("--density", 0.1f), 0.0f, 1.0f);
+		cpu_image_rgba8 SRV = clean_image;
+		std::mt19937 rng(1u);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		for (size_t i = 0; i < SRV.pixels.size(); i += 4u)
+		{
+			if (uniform(rng) < density)
+			{
+				uint8_t v = uniform(rng) < 0.5f ? 0u : 255u;
+				SRV.pixels[i] = SRV.pixels[i + 1u] = SRV.pixels[i + 2u] = v;
+			}
+		}
+		cpu_texture clean, filtered;
+		MakeTextureFromImage(clean_image, clean);
+		MakeTextureFromImage(SRV, filtered);
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 3));
+		uint32_t direct_max_radius = args.GetUint("--direct-max-radius", 4);
+		std::vector<uint32_t> radii = args.GetUintList("--radius", { 1u, 2u, 4u, 8u, 16u, 32u });
+		cpu_median_filter_options options;
+		options.band_height = args.GetUint("--band", 0);
+		options.strip_width = args.GetUint("--strip", 0);
+		options.l2_bytes = args.GetUint("--l2", options.l2_bytes / 1024u) * 1024u;
+		const double pixels = (double)SRV.width * SRV.height;
+		printf("Input: %s (%ux%u) with %.0f%% salt and pepper, PSNR %.2f dB\n", file, SRV.width, SRV.height, 100.0 * density,
+			ComputePSNR(filtered, clean));
+		printf("Threads: %u, frames: %u, AVX2: %s\n", pool.Size(), frames, IsWaveIsaSupported(cpu_wave_isa::avx2) ? "yes" : "no (scalar only)");
+		printf("  %6s %-8s %10s %10s %10s %10s %8s %8s\n", "radius", "variant", "tile", "ms/frame", "MPix/s", "overlap", "PSNR dB", "valid");
+
+		// The median of the clamped window of channel c around (px, py), by partial sort.
+		auto direct_median = [&](int32_t px, int32_t py, int32_t r, uint32_t c, std::vector<uint8_t>& window)
+		{
+			window.clear();
+			for (int32_t y = py - r; y <= py + r; y++)
+			{
+				const uint8_t* row = SRV.Row((uint32_t)std::clamp(y, 0, (int32_t)SRV.height - 1));
+				for (int32_t x = px - r; x <= px + r; x++)
+					window.push_back(row[std::clamp(x, 0, (int32_t)SRV.width - 1) * 4 + (int32_t)c]);
+			}
+			std::nth_element(window.begin(), window.begin() + window.size() / 2u, window.end());
+			return window[window.size() / 2u];
+		};
+
+		bool pass = true;
+		cpu_median_filter median;
+		cpu_image_rgba8 UAV, reference;
+		std::vector<uint8_t> window;
+		for (uint32_t radius : radii)
+		{
+			const int32_t r = (int32_t)std::min(radius, c_medianMaxRadius);
+			auto sampled_mismatches = [&](const cpu_image_rgba8& image)
+			{
+				uint32_t mismatches = 0u;
+				for (size_t i = 0; i < (size_t)SRV.width * SRV.height; i += 61u)
+				{
+					int32_t px = (int32_t)(i % SRV.width), py = (int32_t)(i / SRV.width);
+					for (uint32_t c = 0; c < 4u; c++)
+						mismatches += direct_median(px, py, r, c, window) != image.pixels[i * 4u + c];
+				}
+				return mismatches;
+			};
+
+			if ((uint32_t)r <= direct_max_radius)
+			{
+				// Direct: the (2r + 1)^2 texels of every window gathered and partially sorted.
+				UAV = SRV;
+				auto start = std::chrono::steady_clock::now();
+				pool.ParallelFor(0u, SRV.height, 8u, [&](uint32_t begin, uint32_t end, uint32_t)
+				{
+					std::vector<uint8_t> gathered;
+					for (uint32_t y = begin; y < end; y++)
+					{
+						for (uint32_t x = 0; x < SRV.width; x++)
+						{
+							for (uint32_t c = 0; c < 4u; c++)
+								UAV.Row(y)[x * 4u + c] = direct_median((int32_t)x, (int32_t)y, r, c, gathered);
+						}
+					}
+				});
+				double seconds = SecondsSince(start);
+				MakeTextureFromImage(UAV, filtered);
+				printf("  %6d %-8s %10s %10.3f %10.1f %10s %8.2f %8s\n", r, "direct", "-", 1000.0 * seconds, pixels / seconds * 1e-6, "-",
+					ComputePSNR(filtered, clean), "-");
+			}
+
+			for (cpu_wave_isa isa : { cpu_wave_isa::scalar, cpu_wave_isa::avx2 })
+			{
+				if (isa != cpu_wave_isa::scalar && !IsWaveIsaSupported(isa))
+					continue;
+				options.radius = (uint32_t)r;
+				options.isa = isa;
+				double seconds = 0.0;
+				for (uint32_t f = 0; f < frames; f++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					median.Run(pool, SRV, UAV, options);
+					seconds += SecondsSince(start);
+				}
+				bool valid = sampled_mismatches(UAV) == 0u;
+				if (isa == cpu_wave_isa::scalar)
+					reference = UAV;
+				else
+					valid = valid && reference.pixels == UAV.pixels;
+				pass = pass && valid;
+				const cpu_median_filter_stats& stats = median.Stats();
+				MakeTextureFromImage(UAV, filtered);
+				char tile[24], overlap[16];
+				snprintf(tile, sizeof(tile), "%ux%u", stats.strip_width, stats.band_height);
+				snprintf(overlap, sizeof(overlap), "%.1f%%", 100.0 * stats.overlap_texels / pixels);
+				printf("  %6d %-8s %10s %10.3f %10.1f %10s %8.2f %8s\n", r, WaveIsaName(isa), tile, 1000.0 * seconds / frames,
+					pixels * frames / seconds * 1e-6, overlap, ComputePSNR(filtered, clean), valid ? "PASS" : "FAIL");
+			}
+		}
+		return pass ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// nlm: non-local means (cpu_nlm_filter.h) of the noisy image per quality, scalar vs AVX2, with the PSNR against the clean
+	// image. Sampled pixels are checked against the direct O(search^2 patch^2) sum with exp(), whose time per pixel gives the
+	// estimate of a direct run.
+	int RunNlm(const bench_args& args)
+	{
+		const char* file = args.GetString("--image", "../WorkGraphsSandbox/data/albert_gaussian_noise.jpg");
+		const char* clean_file = args.GetString("--clean", "../WorkGraphsSandbox/data/albert.jpg");
+		cpu_image_rgba8 image, clean_image;
+		if (!LoadImageFromFile(file, image) || !LoadImageFromFile(clean_file, clean_image))
+		{
+			printf("Failed to load %s or %s\n", file, clean_file);
+			return 1;
+		}
+		cpu_texture SRV, clean;
+		MakeTextureFromImage(image, SRV);
+		MakeTextureFromImage(clean_image, clean);
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 1));
+		uint32_t scalar_max_search = args.GetUint("--scalar-max-search", 6);
+		cpu_nlm_filter_options options;
+		options.sigma = args.GetFloat("--sigma", 0.0f);
+		options.search_radius = args.GetUint("--search", 0);
+		options.patch_radius = args.GetUint("--patch", 0);
+		options.h = args.GetFloat("--h", 0.0f);
+		options.tile_size = args.GetUint("--tile", options.tile_size);
+		std::vector<cpu_nlm_quality> qualities;
+		const char* quality = args.GetString("--quality", "fast,balanced,best");
+		for (cpu_nlm_quality q : { cpu_nlm_quality::fast, cpu_nlm_quality::balanced, cpu_nlm_quality::best })
+		{
+			if (strstr(quality, NlmQualityName(q)))
+				qualities.push_back(q);
+		}
+		// Weights are within the LUT tolerance, patch distances off by the float rounding of the integral images.
+		const float tolerance = 4.0f * BilateralLutTolerance();
+		const double pixels = (double)SRV.width * SRV.height;
+		printf("Input: %s (%ux%u), PSNR against %s: %.2f dB, estimated noise sigma %.4f (%.1f of 255)\n", file, SRV.width, SRV.height,
+			clean_file, ComputePSNR(SRV, clean), EstimateNoiseSigma(pool, SRV), 255.0f * EstimateNoiseSigma(pool, SRV));
+		printf("Threads: %u, frames: %u, tile %u, tolerance %.2e\n", pool.Size(), frames, options.tile_size, tolerance);
+		printf("  %-9s %-8s %6s %5s %8s %8s %10s %10s %12s %8s %10s %8s\n", "quality", "variant", "search", "patch", "h", "offsets",
+			"taps/px", "ms/frame", "direct est.", "PSNR dB", "max diff", "valid");
+
+		bool pass = true;
+		cpu_nlm_filter nlm;
+		cpu_texture UAV;
+		for (cpu_nlm_quality q : qualities)
+		{
+			options.quality = q;
+			for (cpu_wave_isa isa : { cpu_wave_isa::scalar, cpu_wave_isa::avx2 })
+			{
+				if (isa != cpu_wave_isa::scalar && !IsWaveIsaSupported(isa))
+					continue;
+				options.isa = isa;
+				if (isa == cpu_wave_isa::scalar && ResolveNlmParams(options, 1.0f / 255.0f).search_radius > scalar_max_search &&
+					ResolveNlmParams(options, 1.0f).search_radius > scalar_max_search)
+					continue;
+				double seconds = 0.0;
+				for (uint32_t f = 0; f < frames; f++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					nlm.Run(pool, SRV, UAV, options);
+					seconds += SecondsSince(start);
+				}
+				const cpu_nlm_params& params = nlm.Params();
+				float max_diff = 0.0f;
+				uint32_t samples = 0u;
+				auto start = std::chrono::steady_clock::now();
+				for (size_t i = 0; i < UAV.texels.size(); i += 4999u, samples++)
+				{
+					float4 e = NlmFilterPixelExact(SRV, (uint32_t)(i % SRV.width), (uint32_t)(i / SRV.width), params);
+					const float4& u = UAV.texels[i];
+					max_diff = std::max({ max_diff, std::fabs(e.x - u.x), std::fabs(e.y - u.y), std::fabs(e.z - u.z), std::fabs(e.w - u.w) });
+				}
+				double direct = SecondsSince(start) / samples * pixels / pool.Size();
+				bool valid = max_diff <= tolerance;
+				pass = pass && valid;
+				printf("  %-9s %-8s %6u %5u %8.4f %8llu %10llu %10.1f %12.1f %8.2f %10.2e %8s\n", NlmQualityName(q), WaveIsaName(isa),
+					params.search_radius, params.patch_radius, params.h, (unsigned long long)nlm.Stats().offsets,
+					(unsigned long long)nlm.Stats().direct_taps, 1000.0 * seconds / frames, 1000.0 * direct, ComputePSNR(UAV, clean), max_diff,
+					valid ? "PASS" : "FAIL");
+			}
+		}
+		return pass ? 0 : 1;
+	}
+
+	//=============================================================================================================================
+	// guided: guided filter (cpu_guided_filter.h) of the noisy image tiled out to each width, gray and color guides, fused
+	// scalar vs AVX2 against an unfused baseline that box filters packed full images through double summed-area tables, and
+	// the subsampled variant. The fused runs are checked against the baseline, or the AVX2 run against the scalar one where
+	// the baseline's images don't fit, the subsampled runs report their PSNR against the full resolution filter.
+	template<cpu_guided_guide Guide>
+	void GuidedFilterUnfused(cpu_thread_pool& pool, const cpu_texture& SRV, cpu_texture& UAV, const cpu_guided_filter_options& options,
+		uint64_t& out_bytes)
+	{
+		using namespace cpu_guided_filter_detail;
+		const uint32_t K1 = pass_sizes<Guide>::quantities, K2 = pass_sizes<Guide>::coefficients;
+		const uint32_t width = SRV.width, height = SRV.height;
+		std::vector<cpu_texture> planes(K1 / 4u), means(K1 / 4u);
+		for (uint32_t i = 0; i < K1 / 4u; i++)
+			planes[i].Resize(width, height);
+		UAV.Resize(width, height);
+		cpu_summed_area_table<double> table;
+		cpu_summed_area_table_options sat_options;
+		std::vector<double> inv_columns;
+		auto box = [&](uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				BuildSummedAreaTable(pool, planes[i], table, sat_options);
+				BoxFilter(pool, table, options.radius, means[i], sat_options, inv_columns);
+			}
+		};
+		// Quantities, their means, coefficients, their means, output.
+		pool.ParallelFor(0u, height, 8u, [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			float q[K1];
+			for (size_t i = (size_t)begin * width; i < (size_t)end * width; i++)
+			{
+				if (Guide == cpu_guided_guide::gray)
+					GrayQuantities(SRV.texels[i], SRV.texels[i], q);
+				else
+					ColorQuantities(SRV.texels[i], SRV.texels[i], q);
+				for (uint32_t k = 0; k < K1; k++)
+					(&planes[k / 4u].texels[i].x)[k % 4u] = q[k];
+			}
+		});
+		box(K1 / 4u);
+		pool.ParallelFor(0u, height, 8u, [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			float m[K1], c[K2];
+			for (size_t i = (size_t)begin * width; i < (size_t)end * width; i++)
+			{
+				for (uint32_t k = 0; k < K1; k++)
+					m[k] = (&means[k / 4u].texels[i].x)[k % 4u];
+				if (Guide == cpu_guided_guide::gray)
+					GrayCoefficients(m, options.eps, c);
+				else
+					ColorCoefficients(m, options.eps, c);
+				for (uint32_t k = 0; k < K2; k++)
+					(&planes[k / 4u].texels[i].x)[k % 4u] = c[k];
+			}
+		});
+		box(K2 / 4u);
+		pool.ParallelFor(0u, height, 8u, [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			float m[K2];
+			for (size_t i = (size_t)begin * width; i < (size_t)end * width; i++)
+			{
+				for (uint32_t k = 0; k < K2; k++)
+					m[k] = (&means[k / 4u].texels[i].x)[k % 4u];
+				UAV.texels[i] = Guide == cpu_guided_guide::gray ? ApplyGray(m, SRV.texels[i], SRV.texels[i]) : ApplyColor(m, SRV.texels[i], SRV.texels[i]);
+			}
+		});
+		out_bytes = 2u * (uint64_t)planes.size() * width * height * sizeof(float4) + table.sums.size() * sizeof(double);
+	}
+
+	// source repeated across a width x height texture.
+	void TileTexture(const cpu_texture& source, uint32_t width, uint32_t height, cpu_texture& out)
+	{
+		out.Resize(width, height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+				out.texels[(size_t)y * width + x] = source.texels[(size_t)(y % source.height) * source.width + x % source.width];
+		}
+	}
+
+	int RunGuided(const bench_args& args)
+	{
+		const char* file = args.GetString("--image", "../WorkGraphsSandbox/data/albert_gaussian_noise.jpg");
+		const char* clean_file = args.GetString("--clean", "../WorkGraphsSandbox/data/albert.jpg");
+		cpu_image_rgba8 image, clean_image;
+		if (!LoadImageFromFile(file, image) || !LoadImageFromFile(clean_file, clean_image))
+		{
+			printf("Failed to load %s or %s\n", file, clean_file);
+			return 1;
+		}
+		cpu_texture noisy_source, clean_source;
+		MakeTextureFromImage(image, noisy_source);
+		MakeTextureFromImage(clean_image, clean_source);
+		cpu_thread_pool pool(args.GetUint("--threads", 0));
+		uint32_t frames = std::max(1u, args.GetUint("--frames", 1));
+		std::vector<uint32_t> widths = args.GetUintList("--sizes", { 1024u, 4096u, 16384u });
+		std::vector<uint32_t> subsamples = args.GetUintList("--subsample", { 2u, 4u });
+		uint32_t max_height = std::max(1u, args.GetUint("--max-height", 1024));
+		uint64_t baseline_max_pixels = (uint64_t)args.GetUint("--baseline-max-pixels", 4096u * 1024u);
+		cpu_guided_filter_options options;
+		options.radius = args.GetUint("--radius", options.radius);
+		options.eps = args.GetFloat("--eps", options.eps);
+		options.band_height = args.GetUint("--band", options.band_height);
+		const float tolerance = 1e-3f;
+		printf("Input: %s tiled, PSNR against %s: %.2f dB\n", file, clean_file, ComputePSNR(noisy_source, clean_source));
+		printf("Threads: %u, frames: %u, radius %u, eps %g, bands of %u rows, tolerance %.0e\n", pool.Size(), frames, options.radius,
+			options.eps, options.band_height, tolerance);
+		printf("  %-12s %-6s %-12s %10s %10s %12s %10s %8s %12s %8s\n", "size", "guide", "variant", "ms/frame", "MPix/s", "interm. MB",
+			"max diff", "PSNR dB", "vs full dB", "valid");
+
+		bool pass = true;
+		cpu_guided_filter guided;
+		cpu_texture SRV, clean, UAV, reference, full;
+		for (uint32_t width : widths)
+		{
+			const uint32_t height = std::min(width, max_height);
+			TileTexture(noisy_source, width, height, SRV);
+			TileTexture(clean_source, width, height, clean);
+			const double pixels = (double)width * height;
+			char size[32];
+			snprintf(size, sizeof(size), "%ux%u", width, height);
+			for (cpu_guided_guide guide : { cpu_guided_guide::gray, cpu_guided_guide::color })
+			{
+				options.guide = guide;
+				options.subsample = 1u;
+				bool baseline = pixels <= (double)baseline_max_pixels;
+				if (baseline)
+				{
+					uint64_t bytes = 0u;
+					double seconds = 0.0;
+					for (uint32_t f = 0; f < frames; f++)
+					{
+						auto start = std::chrono::steady_clock::now();
+						if (guide == cpu_guided_guide::gray)
+							GuidedFilterUnfused<cpu_guided_guide::gray>(pool, SRV, reference, options, bytes);
+						else
+							GuidedFilterUnfused<cpu_guided_guide::color>(pool, SRV, reference, options, bytes);
+						seconds += SecondsSince(start);
+					}
+					printf("  %-12s %-6s %-12s %10.1f %10.1f %12.1f %10s %8.2f %12s %8s\n", size, GuidedGuideName(guide), "unfused",
+						1000.0 * seconds / frames, pixels * frames / seconds * 1e-6, bytes / (1024.0 * 1024.0), "-",
+						ComputePSNR(reference, clean), "-", "-");
+				}
+				for (cpu_wave_isa isa : { cpu_wave_isa::scalar, cpu_wave_isa::avx2 })
+				{
+					if (isa != cpu_wave_isa::scalar && !IsWaveIsaSupported(isa))
+						continue;
+					options.isa = isa;
+					double seconds = 0.0;
+					for (uint32_t f = 0; f < frames; f++)
+					{
+						auto start = std::chrono::steady_clock::now();
+						guided.Run(pool, SRV, UAV, options);
+						seconds += SecondsSince(start);
+					}
+					// Without the baseline the scalar run is the reference of the AVX2 one.
+					const bool checked = baseline || isa != cpu_wave_isa::scalar;
+					float max_diff = checked ? CompareTextures(UAV, reference) : 0.0f;
+					bool valid = max_diff <= tolerance;
+					pass = pass && valid;
+					if (!baseline && isa == cpu_wave_isa::scalar)
+						std::swap(UAV, reference);
+					char variant[32];
+					snprintf(variant, sizeof(variant), "fused %s", WaveIsaName(isa));
+					char diff[32] = "-";
+					if (checked)
+						snprintf(diff, sizeof(diff), "%.2e", max_diff);
+					printf("  %-12s %-6s %-12s %10.1f %10.1f %12.1f %10s %8.2f %12s %8s\n", size, GuidedGuideName(guide), variant,
+						1000.0 * seconds / frames, pixels * frames / seconds * 1e-6, guided.Stats().intermediate_bytes / (1024.0 * 1024.0), diff,
+						ComputePSNR(!baseline && isa == cpu_wave_isa::scalar ? reference : UAV, clean), "-", checked ? (valid ? "PASS" : "FAIL") : "-");
+				}
+				std::swap(UAV, full);
+				for (uint32_t s : subsamples)
+				{
+					options.subsample = std::max(1u, s);
+					double seconds = 0.0;
+					for (uint32_t f = 0; f < frames; f++)
+					{
+						auto start = std::chrono::steady_clock::now();
+						guided.Run(pool, SRV, UAV, options);
+						seconds += SecondsSince(start);
+					}
+					char variant[32];
+					snprintf(variant, sizeof(variant), "s=%u r=%u", options.subsample, guided.Stats().radius);
+					printf("  %-12s %-6s %-12s %10.1f %10.1f %12.1f %10s %8.2f %12.2f %8s\n", size, GuidedGuideName(guide), variant,
+						1000.0 * seconds / frames, pixels * frames / seconds * 1e-6, guided.Stats().intermediate_bytes / (1024.0 * 1024.0), "-",
+						ComputePSNR(UAV, clean), ComputePSNR(UAV, full), "-");
+				}
+			}
+			reference = cpu_texture();
+		}
+		return pass ? 0 : 1;
+	}
+
+	struct bench_mode
+	{
+		const char* name;
+		const char* description;
+		int (*run)(const bench_args& args);
+	};
+
+	const bench_mode g_modes[] =
+	{
+		{ "hello", "HelloWorkGraphs graph throughput and validation [--image --frames --threads --trace out.json]", RunHello },
+		{ "coalescing", "coalescing secondNode batch fill per flush heuristic [--max-records --timeout --threshold]", RunCoalescing },
+		{ "schedule", "peak record memory vs throughput per scheduling policy [--frames --threads --budget]", RunSchedule },
+		{ "backpressure", "bounded secondNode queue: high-water mark vs peak occupancy, stalls and time [--mark --policy --coalescing --frames --threads]", RunBackpressure },
+		{ "adaptive", "recursive quadtree tiling vs the fixed 16x16 grid [--threshold --frames --threads]", RunAdaptive },
+		{ "batch", "many images in one DispatchGraph vs one per image [--dir | --image --count] [--tile --frames --threads --trace]", RunBatch },
+		{ "incremental", "redraw every frame vs only the tiles an input edit made dirty, batchFirstNode and refineTile [--image --frames --edit-every --edit-size --threshold --threads]", RunIncremental },
+		{ "capture", "write the records of a run to a binary stream [--out --frames --adaptive --threshold]", RunCapture },
+		{ "replay", "run one node alone on the records it got in a capture [--capture --node --frames --threads --trace]", RunReplay },
+		{ "wave", "secondNode per record vs SIMD waves of 8/16 lanes per ISA [--image --frames --threads --threshold]", RunWave },
+		{ "group", "coroutine thread groups with barriers vs hand split ports of thirdNode and refineTile [--records --threshold --frames]", RunGroup },
+		{ "estimate", "offline record memory estimate of a work graph .hlsl [--hlsl --grid x,y,z --records --batch-tile]", RunEstimate },
+		{ "fusion", "fuse 1:1 thread launch consumers into their producers [--hlsl --out --grid --image --frames --threads]", RunFusion },
+		{ "encoding", "secondNode record bytes/frame and time per packed record layout [--image --synthetic WxH --frames --threads]", RunEncoding },
+		{ "blur", "separable Gaussian, scalar vs AVX2/FMA with and without L2 column strips [--image --synthetic WxH --radius 1,2,4 --l2 KB --frames --threads]", RunBlur },
+		{ "bilateral", "bilateral filter with spatial and range LUTs, scalar vs AVX2 per radius, PSNR [--image --clean --radius 2,4,8,16 --sigma-range --scalar-max-radius --frames --threads]", RunBilateral },
+		{ "atrous", "5-level a-trous wavelet denoiser, pass per level vs tile fused with halos: time and bytes moved [--image --clean --levels --tile 128,256,512 --max-halo --sigma-color --sigma-decay --frames --threads]", RunAtrous },
+		{ "variable", "per tile noise estimate and radius vs fixed radius bilateral, raster vs cost sorted tile schedule [--image --clean --ramp --max-radius --target --fixed 2,4 --model-workers --frames --threads]", RunVariable },
+		{ "sat", "summed-area table build (uint32 of 8-bit, double of float) and O(1) box filters vs direct convolution, iterated boxes vs separable Gaussian [--image --synthetic WxH --radius 1,4,16 --direct-max-radius --strip --passes --frames --threads]", RunSat },
+		{ "median", "constant time median of salt and pepper noise per radius, scalar vs AVX2 histograms vs direct [--image --density --radius 1,2,4 --l2 KB --strip --band --direct-max-radius --frames --threads]", RunMedian },
+		{ "nlm", "non-local means with integral image patch distances per quality, scalar vs AVX2 vs direct, PSNR [--image --clean --quality fast,balanced,best --sigma --search --patch --h --tile --scalar-max-search --frames --threads]", RunNlm },
+		{ "guided", "O(1) guided filter, gray and color guides, fused box means scalar vs AVX2 vs unfused summed-area table passes, subsampled coefficients, PSNR [--image --clean --sizes 1024,4096,16384 --max-height --radius --eps --subsample 2,4 --band --baseline-max-pixels --frames --threads]", RunGuided },
+		{ "order", "broadcasting groups in row-major vs Morton vs Hilbert order, time and cache misses [--image --synthetic WxH --frames --threads]", RunOrder },
+	};
+}
+
+int main(int argc, char** argv)
+{
+	if (argc >= 2)
+	{
+		for (const bench_mode& mode : g_modes)
+		{
+			if (strcmp(argv[1], mode.name) == 0)
+				return mode.run(bench_args(argc, argv));
+		}
+	}
+	printf("Usage: WorkGraphsCpuBench <mode> [options]\n");
+	for (const bench_mode& mode : g_modes)
+		printf("  %-12s %s\n", mode.name, mode.description);
+	return 1;
+}
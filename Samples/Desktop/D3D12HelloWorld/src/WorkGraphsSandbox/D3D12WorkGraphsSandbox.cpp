@@ -17,6 +17,14 @@
 
 #include "dx12_helpers.h"
 #include "image_loading.h"
+#include "work_graph_batch.h"
+#include "work_graph_dirty_tiles.h"
+#include "work_graph_memory_estimator.h"
+#include "work_graph_records.h"
+#include "work_graph_trace.h"
+
+#include <fstream>
+#include <sstream>
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_dx12.h"
@@ -31,30 +39,219 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 class WorkGraphContext
 {
 public:
-	void Init(D3DContext& D3D, LPCWSTR pWorkGraphName)
+	void Init(D3DContext& D3D, LPCWSTR pWorkGraphName, const work_graph_backing_memory_policy& policy)
 	{
 		CComPtr<ID3D12StateObjectProperties1> spSOProps;
 		spSOProps = state_object;
 		hWorkGraph = spSOProps->GetProgramIdentifier(pWorkGraphName);
-		CComPtr<ID3D12WorkGraphProperties> spWGProps;
 		spWGProps = state_object;
-		UINT WorkGraphIndex = spWGProps->GetWorkGraphIndex(pWorkGraphName);
+		WorkGraphIndex = spWGProps->GetWorkGraphIndex(pWorkGraphName);
         spWGProps->GetWorkGraphMemoryRequirements(WorkGraphIndex, &MemReqs);
-		BackingMemory.SizeInBytes = MemReqs.MaxSizeInBytes;
-		MakeBuffer(D3D, &backing_memory, BackingMemory.SizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-		BackingMemory.StartAddress = backing_memory->GetGPUVirtualAddress();
+		ResizeBackingMemory(D3D, policy);
+	}
+
+	// The graph has several entry nodes (firstNode, refineTile), so DispatchGraph has to look up which one it seeds.
+	UINT EntrypointIndex(LPCWSTR pNodeName) const
+	{
+		D3D12_NODE_ID id = { pNodeName, 0 };
+		return spWGProps->GetEntrypointIndex(WorkGraphIndex, id);
+	}
+
+	// The caller makes sure the GPU is done with the current backing memory.
+	void ResizeBackingMemory(D3DContext& D3D, const work_graph_backing_memory_policy& policy)
+	{
+		if (backing_memory)
+		{
+			backing_memory->Release();
+			backing_memory = nullptr;
+		}
+		backing_policy = policy;
+		BackingMemory.SizeInBytes = ChooseBackingMemorySize(MemReqs.MinSizeInBytes, MemReqs.MaxSizeInBytes, MemReqs.SizeGranularityInBytes, policy);
+		BackingMemory.StartAddress = 0;
+		if (BackingMemory.SizeInBytes > 0)
+		{
+			MakeBuffer(D3D, &backing_memory, BackingMemory.SizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+			BackingMemory.StartAddress = backing_memory->GetGPUVirtualAddress();
+		}
+		char text[256];
+		snprintf(text, sizeof(text), ">>> Backing memory (%s, %.2f): %llu bytes, requirements min %llu, max %llu, granularity %llu",
+			BackingMemoryModeName(policy.mode), policy.budget_fraction, (unsigned long long)BackingMemory.SizeInBytes,
+			(unsigned long long)MemReqs.MinSizeInBytes, (unsigned long long)MemReqs.MaxSizeInBytes, (unsigned long long)MemReqs.SizeGranularityInBytes);
+		PRINT(text);
 	}
 
 	ID3D12Resource* backing_memory = nullptr;
 	D3D12_GPU_VIRTUAL_ADDRESS_RANGE BackingMemory = {};
 	D3D12_PROGRAM_IDENTIFIER hWorkGraph = {};
 	D3D12_WORK_GRAPH_MEMORY_REQUIREMENTS MemReqs = {};
+	work_graph_backing_memory_policy backing_policy;
+	CComPtr<ID3D12WorkGraphProperties> spWGProps;
+	UINT WorkGraphIndex = 0;
 
     CComPtr<ID3D12StateObject> state_object;
 	ID3D12RootSignature* root_signature = nullptr;
 };
 
-void initialize_work_graph(D3DContext& D3D, WorkGraphContext& wg_context, ID3DBlob* library)
+// GPU timestamps around each DispatchGraph. The queries of a frame are resolved into its slot of a readback buffer and read
+// once WaitForNextFrameResources() hands the same frame context out again, so reading never stalls the GPU.
+class DispatchGraphTimer
+{
+public:
+	static const UINT c_maxDispatchesPerFrame = 8;
+	static const size_t c_maxTraceEvents = 4096;
+	static const UINT c_historySize = 256;
+
+	void Init(D3DContext& D3D)
+	{
+		D3D12_QUERY_HEAP_DESC desc = {};
+		desc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+		desc.Count = c_queriesPerFrame * APP_NUM_FRAMES_IN_FLIGHT;
+		VERIFY_SUCCEEDED(D3D.device->CreateQueryHeap(&desc, IID_PPV_ARGS(&query_heap)));
+
+		CD3DX12_RESOURCE_DESC rd = CD3DX12_RESOURCE_DESC::Buffer(desc.Count * sizeof(UINT64));
+		CD3DX12_HEAP_PROPERTIES hp(D3D12_HEAP_TYPE_READBACK);
+		VERIFY_SUCCEEDED(D3D.device->CreateCommittedResource(&hp, D3D12_HEAP_FLAG_NONE, &rd, D3D12_RESOURCE_STATE_COPY_DEST, NULL,
+			IID_PPV_ARGS(&readback)));
+		VERIFY_SUCCEEDED(D3D.command_queue->GetTimestampFrequency(&frequency));
+		trace.SetTrackName(0, "GPU direct queue");
+	}
+
+	void Release()
+	{
+		if (query_heap) query_heap->Release();
+		if (readback) readback->Release();
+		query_heap = nullptr;
+		readback = nullptr;
+	}
+
+	// Call once the frame context previously recorded with this slot has finished on the GPU.
+	void BeginFrame(UINT slot)
+	{
+		frame = slot % APP_NUM_FRAMES_IN_FLIGHT;
+		frame_slot& f = frames[frame];
+		if (f.count > 0)
+		{
+			D3D12_RANGE range = { frame * c_queriesPerFrame * sizeof(UINT64), (frame * c_queriesPerFrame + f.count * 2) * sizeof(UINT64) };
+			UINT64* ticks = nullptr;
+			VERIFY_SUCCEEDED(readback->Map(0, &range, (void**)&ticks));
+			ticks += frame * c_queriesPerFrame;
+			if (origin == 0)
+				origin = ticks[0];
+			double total_ms = 0.0;
+			for (UINT d = 0; d < f.count; d++)
+			{
+				work_graph_trace_event e;
+				e.name = f.names[d];
+				e.begin_ns = TicksToNs(ticks[2 * d] - origin);
+				e.end_ns = TicksToNs(ticks[2 * d + 1] - origin);
+				e.records_in = f.records[d];
+				trace.Add(e);
+				total_ms += (e.end_ns - e.begin_ns) * 1e-6;
+			}
+			D3D12_RANGE written = { 0, 0 };
+			readback->Unmap(0, &written);
+			trace.Trim(c_maxTraceEvents);
+			history[history_offset] = (float)total_ms;
+			history_offset = (history_offset + 1) % c_historySize;
+			last_frame_ms = (float)total_ms;
+		}
+		f.count = 0;
+	}
+
+	void Begin(ID3D12GraphicsCommandList* pCL)
+	{
+		if (frames[frame].count < c_maxDispatchesPerFrame)
+			pCL->EndQuery(query_heap, D3D12_QUERY_TYPE_TIMESTAMP, frame * c_queriesPerFrame + frames[frame].count * 2);
+	}
+
+	void End(ID3D12GraphicsCommandList* pCL, const char* name, UINT num_records)
+	{
+		frame_slot& f = frames[frame];
+		if (f.count >= c_maxDispatchesPerFrame)
+			return;
+		pCL->EndQuery(query_heap, D3D12_QUERY_TYPE_TIMESTAMP, frame * c_queriesPerFrame + f.count * 2 + 1);
+		f.names[f.count] = trace.Intern(string("DispatchGraph ") + name);
+		f.records[f.count] = num_records;
+		f.count++;
+	}
+
+	void EndFrame(ID3D12GraphicsCommandList* pCL)
+	{
+		if (frames[frame].count > 0)
+			pCL->ResolveQueryData(query_heap, D3D12_QUERY_TYPE_TIMESTAMP, frame * c_queriesPerFrame, frames[frame].count * 2, readback,
+				frame * c_queriesPerFrame * sizeof(UINT64));
+	}
+
+	work_graph_trace trace;
+	float history[c_historySize] = {};
+	UINT history_offset = 0;
+	float last_frame_ms = 0.0f;
+
+private:
+	static const UINT c_queriesPerFrame = 2 * c_maxDispatchesPerFrame;
+
+	struct frame_slot
+	{
+		UINT count = 0;
+		uint32_t names[c_maxDispatchesPerFrame] = {};
+		UINT records[c_maxDispatchesPerFrame] = {};
+	};
+
+	uint64_t TicksToNs(UINT64 ticks) const { return (uint64_t)((double)ticks * 1e9 / (double)frequency); }
+
+	ID3D12QueryHeap* query_heap = nullptr;
+	ID3D12Resource* readback = nullptr;
+	UINT64 frequency = 1;
+	UINT64 origin = 0;
+	UINT frame = 0;
+	frame_slot frames[APP_NUM_FRAMES_IN_FLIGHT];
+};
+
+void print_memory_estimate(const char* pFile, UINT width, UINT height, UINT batch_tile_size)
+{
+	std::ifstream stream(pFile);
+	if (!stream)
+		return;
+	std::stringstream source;
+	source << stream.rdbuf();
+	hlsl_work_graph_desc desc = ParseWorkGraphHLSL(source.str());
+
+	// Entries cover the image in 16x16 groups, batchFirstNode with a record per tile.
+	work_graph_estimate_options options;
+	for (size_t i = 0; i < desc.nodes.size(); i++)
+	{
+		const hlsl_node_decl& node = desc.nodes[i];
+		if (!desc.IsEntry(i))
+			continue;
+		if (node.name == "batchFirstNode")
+		{
+			work_graph_batch_image batch_image = { width, height };
+			UINT tile_groups = BatchTileSize(batch_tile_size) / 16;
+			options.entry_grid[node.name] = { tile_groups, tile_groups, 1u };
+			options.entry_records[node.name] = BatchEntryRecordCount(batch_image, batch_tile_size);
+		}
+		else
+		{
+			options.entry_grid[node.name] = { width / 16, height / 16, 1u };
+		}
+	}
+	work_graph_memory_estimate estimate = EstimateWorkGraphMemory(desc, options);
+
+	PRINT(">>> Record memory estimate...");
+	char text[256];
+	for (size_t i = 0; i < desc.nodes.size(); i++)
+	{
+		const work_graph_node_estimate& e = estimate.nodes[i];
+		snprintf(text, sizeof(text), "    %-16s worst %12.0f bytes, expected %12.0f bytes", e.name.c_str(), e.input_bytes[0], e.input_bytes[1]);
+		PRINT(text);
+	}
+	snprintf(text, sizeof(text), "    total            worst %12.0f bytes, expected %12.0f bytes", estimate.total_bytes[0], estimate.total_bytes[1]);
+	PRINT(text);
+	for (const std::string& w : desc.warnings)
+		PRINT(w.c_str());
+}
+
+void initialize_work_graph(D3DContext& D3D, WorkGraphContext& wg_context, ID3DBlob* library, const work_graph_backing_memory_policy& policy)
 {
     PRINT(">>> Creating work graph...\n");
 	{
@@ -71,17 +268,63 @@ void initialize_work_graph(D3DContext& D3D, WorkGraphContext& wg_context, ID3DBl
 		pWG->SetProgramName(workGraphName);
 
 		VERIFY_SUCCEEDED(D3D.device->CreateStateObject(SO, IID_PPV_ARGS(&wg_context.state_object)));
-        wg_context.Init(D3D, workGraphName);
+        wg_context.Init(D3D, workGraphName, policy);
 	}
 }
 
-void run_work_graph(D3DContext& D3D, WorkGraphContext& wg_context, image_data const& result, image_data const& input)
+// Which entry node run_work_graph() seeds.
+enum class sandbox_entry
+{
+	first_node,
+	refine_tile,
+	batch_first_node,
+	half_first_node,   // firstNode with 12 byte records, see work_graph_record_encoding.h
+	unorm8_first_node, // firstNode with 8 byte records
+	variance_tile,     // denoise with a radius per tile, see work_graph_tile_radius.h
+};
+
+// Entries whose dirty tiles can be redrawn on their own, see work_graph_dirty_tiles.h. The others are redrawn in full.
+bool supports_partial_redraw(sandbox_entry entry)
+{
+	return entry == sandbox_entry::first_node || entry == sandbox_entry::batch_first_node || entry == sandbox_entry::refine_tile;
+}
+
+// One record per tile of every input, all in a single DispatchGraph. results[i] receives inputs[i].
+void dispatch_batch(D3DContext& D3D, WorkGraphContext& wg_context, DispatchGraphTimer& timer, image_data const* results, image_data const* inputs,
+	UINT count, UINT tile_size)
+{
+	vector<work_graph_batch_image> images(count);
+	for (UINT i = 0; i < count; i++)
+	{
+		images[i].width = results[i].width;
+		images[i].height = results[i].height;
+		images[i].srv_index = D3D.srv_desc_heap_alloc.Index(inputs[i].srv_cpu_handle);
+		images[i].uav_index = D3D.srv_desc_heap_alloc.Index(results[i].uav_cpu_handle);
+	}
+	vector<batchEntryRecord> inputData;
+	BuildBatchEntryRecords(images, tile_size, inputData);
+
+	D3D12_DISPATCH_GRAPH_DESC DSDesc = {};
+	DSDesc.Mode = D3D12_DISPATCH_MODE_NODE_CPU_INPUT;
+	DSDesc.NodeCPUInput.EntrypointIndex = wg_context.EntrypointIndex(L"batchFirstNode");
+	DSDesc.NodeCPUInput.NumRecords = (UINT)inputData.size();
+	DSDesc.NodeCPUInput.RecordStrideInBytes = sizeof(batchEntryRecord);
+	DSDesc.NodeCPUInput.pRecords = inputData.data();
+	timer.Begin(D3D.command_list);
+	D3D.command_list->DispatchGraph(&DSDesc);
+	timer.End(D3D.command_list, "batchFirstNode", DSDesc.NodeCPUInput.NumRecords);
+}
+
+// With dirty_tiles, only redraws those and clears them; entry must be one supports_partial_redraw() allows.
+void run_work_graph(D3DContext& D3D, WorkGraphContext& wg_context, DispatchGraphTimer& timer, image_data const& result, image_data const& input,
+	sandbox_entry entry, UINT batch_tile_size, work_graph_dirty_tiles* dirty_tiles = nullptr)
 {
     Transition(D3D.command_list, result.texture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
     D3D.command_list->SetDescriptorHeaps(1, &D3D.srv_desc_heap);
     const float clear_color[4] = { 1.0f, .0f, .0f, 1.0f };
-    D3D.command_list->ClearUnorderedAccessViewFloat(result.uav_gpu_handle, result.clear_cpu_handle, result.texture, clear_color, 0, nullptr);
+	if (!dirty_tiles)
+		D3D.command_list->ClearUnorderedAccessViewFloat(result.uav_gpu_handle, result.clear_cpu_handle, result.texture, clear_color, 0, nullptr);
 
 	D3D.command_list->SetComputeRootSignature(wg_context.root_signature);
     D3D.command_list->SetComputeRootDescriptorTable(0, result.uav_gpu_handle);
@@ -94,29 +337,108 @@ void run_work_graph(D3DContext& D3D, WorkGraphContext& wg_context, image_data co
 	setProg.WorkGraph.BackingMemory = wg_context.BackingMemory;
 	D3D.command_list->SetProgram(&setProg);
 
-	struct entryRecord
+	if (dirty_tiles)
 	{
-		UINT gridSize[3];
-		UINT recordIndex;
-	};
+		// The tiles that aren't dirty keep what the previous dispatches wrote.
+		vector<tileRecord> dirtyRoots;
+		vector<batchEntryRecord> dirtyRecords;
+		D3D12_DISPATCH_GRAPH_DESC DSDesc = {};
+		DSDesc.Mode = D3D12_DISPATCH_MODE_NODE_CPU_INPUT;
+		const char* name = "batchFirstNode (dirty tiles)";
+		if (entry == sandbox_entry::refine_tile)
+		{
+			dirty_tiles->BuildDirtyRefineRoots(dirtyRoots);
+			DSDesc.NodeCPUInput.EntrypointIndex = wg_context.EntrypointIndex(L"refineTile");
+			DSDesc.NodeCPUInput.NumRecords = (UINT)dirtyRoots.size();
+			DSDesc.NodeCPUInput.RecordStrideInBytes = sizeof(tileRecord);
+			DSDesc.NodeCPUInput.pRecords = dirtyRoots.data();
+			name = "refineTile (dirty tiles)";
+		}
+		else
+		{
+			// firstNode draws the same copy as batchFirstNode, whose records can start at any tile.
+			work_graph_batch_image batch_image = { result.width, result.height, D3D.srv_desc_heap_alloc.Index(input.srv_cpu_handle),
+				D3D.srv_desc_heap_alloc.Index(result.uav_cpu_handle) };
+			dirty_tiles->BuildDirtyEntryRecords(batch_image, dirtyRecords);
+			DSDesc.NodeCPUInput.EntrypointIndex = wg_context.EntrypointIndex(L"batchFirstNode");
+			DSDesc.NodeCPUInput.NumRecords = (UINT)dirtyRecords.size();
+			DSDesc.NodeCPUInput.RecordStrideInBytes = sizeof(batchEntryRecord);
+			DSDesc.NodeCPUInput.pRecords = dirtyRecords.data();
+		}
+		timer.Begin(D3D.command_list);
+		D3D.command_list->DispatchGraph(&DSDesc);
+		timer.End(D3D.command_list, name, DSDesc.NodeCPUInput.NumRecords);
+
+		Transition(D3D.command_list, result.texture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		return;
+	}
+
+	if (entry == sandbox_entry::batch_first_node)
+	{
+		// The sandbox only has one image, split into tiles it still exercises the many-records path.
+		dispatch_batch(D3D, wg_context, timer, &result, &input, 1, batch_tile_size);
+
+		Transition(D3D.command_list, result.texture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		return;
+	}
+
+	if (entry == sandbox_entry::refine_tile)
+	{
+		vector<tileRecord> rootTiles;
+		MakeRefineRootTiles(result.width, result.height, rootTiles);
+
+		D3D12_DISPATCH_GRAPH_DESC DSDesc = {};
+		DSDesc.Mode = D3D12_DISPATCH_MODE_NODE_CPU_INPUT;
+		DSDesc.NodeCPUInput.EntrypointIndex = wg_context.EntrypointIndex(L"refineTile");
+		DSDesc.NodeCPUInput.NumRecords = (UINT)rootTiles.size();
+		DSDesc.NodeCPUInput.RecordStrideInBytes = sizeof(tileRecord);
+		DSDesc.NodeCPUInput.pRecords = rootTiles.data();
+		timer.Begin(D3D.command_list);
+		D3D.command_list->DispatchGraph(&DSDesc);
+		timer.End(D3D.command_list, "refineTile", DSDesc.NodeCPUInput.NumRecords);
+
+		Transition(D3D.command_list, result.texture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		return;
+	}
+
 	vector<entryRecord> inputData;
 	UINT numRecords = 1;
 	inputData.resize(numRecords);
 	for (UINT recordIndex = 0; recordIndex < numRecords; recordIndex++)
 	{
-		inputData[recordIndex].gridSize[0] = result.width / 16;
-        inputData[recordIndex].gridSize[1] = result.height / 16;
-        inputData[recordIndex].gridSize[2] = 1u;
+		inputData[recordIndex].gridSize.x = result.width / 16;
+        inputData[recordIndex].gridSize.y = result.height / 16;
+        inputData[recordIndex].gridSize.z = 1u;
 		inputData[recordIndex].recordIndex = recordIndex;
 	}
 
+	// The packed record variants and varianceTile take the same entryRecord.
+	LPCWSTR node = L"firstNode";
+	const char* name = "firstNode";
+	if (entry == sandbox_entry::half_first_node)
+	{
+		node = L"halfFirstNode";
+		name = "halfFirstNode";
+	}
+	else if (entry == sandbox_entry::unorm8_first_node)
+	{
+		node = L"unorm8FirstNode";
+		name = "unorm8FirstNode";
+	}
+	else if (entry == sandbox_entry::variance_tile)
+	{
+		node = L"varianceTile";
+		name = "varianceTile";
+	}
 	D3D12_DISPATCH_GRAPH_DESC DSDesc = {};
 	DSDesc.Mode = D3D12_DISPATCH_MODE_NODE_CPU_INPUT;
-	DSDesc.NodeCPUInput.EntrypointIndex = 0;
+	DSDesc.NodeCPUInput.EntrypointIndex = wg_context.EntrypointIndex(node);
 	DSDesc.NodeCPUInput.NumRecords = numRecords;
 	DSDesc.NodeCPUInput.RecordStrideInBytes = sizeof(entryRecord);
 	DSDesc.NodeCPUInput.pRecords = inputData.data();
+	timer.Begin(D3D.command_list);
 	D3D.command_list->DispatchGraph(&DSDesc);
+	timer.End(D3D.command_list, name, numRecords);
 
     Transition(D3D.command_list, result.texture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 }
@@ -181,8 +503,27 @@ int main(int, char**)
             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
     }
 
+    // Max is the fastest setting; min and budgeted trade throughput for memory and can be changed from the UI.
+    work_graph_backing_memory_policy backing_policy;
+    float budget_slider = backing_policy.budget_fraction;
+    int entry = (int)sandbox_entry::first_node;
+    int batch_tile_size = 256;
+
+    print_memory_estimate(pFile, image.width, image.height, (UINT)batch_tile_size);
+
     WorkGraphContext wg_context;
-    initialize_work_graph(D3D, wg_context, library);
+    initialize_work_graph(D3D, wg_context, library, backing_policy);
+    DispatchGraphTimer timer;
+    timer.Init(D3D);
+    vector<work_graph_trace_summary> trace_summary;
+
+    // The input never changes, so the graph only runs when a parameter the result depends on changes (all of it is redrawn)
+    // or tiles are marked dirty (only they are redrawn). Unchecking "Redraw only what changed" dispatches every frame.
+    bool incremental = true;
+    work_graph_dirty_tiles dirty_tiles;
+    dirty_tiles.Resize(image.width, image.height);
+    UINT64 frames_dispatched = 0, frames_total = 0;
+    UINT last_dirty_tiles = 0;
 
     image_data result;
     {
@@ -223,15 +564,101 @@ int main(int, char**)
 		ImGui_ImplWin32_NewFrame();
 		ImGui::NewFrame();
 
+		if (backing_policy.mode != wg_context.backing_policy.mode || backing_policy.budget_fraction != wg_context.backing_policy.budget_fraction)
+		{
+			WaitForLastSubmittedFrame(D3D);
+			wg_context.ResizeBackingMemory(D3D, backing_policy);
+		}
+
 		FrameContext* frameCtx = WaitForNextFrameResources(D3D);
 		UINT backBufferIdx = D3D.swapchain->GetCurrentBackBufferIndex();
 		frameCtx->CommandAllocator->Reset();
 
         D3D.command_list->Reset(frameCtx->CommandAllocator, nullptr);
-        run_work_graph(D3D, wg_context, result, image);
+        timer.BeginFrame(D3D.uFrameIndex);
+        {
+            struct { int entry, batch_tile_size; } parameters = { entry, batch_tile_size };
+            dirty_tiles.TrackParameters(parameters);
+            // Edits promote to a full redraw for the entries that can't redraw a few tiles.
+            if (!incremental || (dirty_tiles.Any() && !supports_partial_redraw((sandbox_entry)entry)))
+                dirty_tiles.MarkAll();
+            frames_total++;
+            if (dirty_tiles.Any())
+            {
+                frames_dispatched++;
+                last_dirty_tiles = dirty_tiles.DirtyCount();
+                if (dirty_tiles.All())
+                {
+                    dirty_tiles.Clear();
+                    run_work_graph(D3D, wg_context, timer, result, image, (sandbox_entry)entry, (UINT)batch_tile_size);
+                }
+                else
+                {
+                    run_work_graph(D3D, wg_context, timer, result, image, (sandbox_entry)entry, (UINT)batch_tile_size, &dirty_tiles);
+                }
+            }
+        }
+        timer.EndFrame(D3D.command_list);
         {
 			ImGui::Begin("DirectX12 Work Graph Test");
+			int mode = (int)backing_policy.mode;
+			ImGui::Combo("Backing memory", &mode, "min\0max\0budgeted\0");
+			backing_policy.mode = (work_graph_backing_memory_mode)mode;
+			if (backing_policy.mode == work_graph_backing_memory_mode::budgeted)
+			{
+				// Only reallocate once the slider is released.
+				ImGui::SliderFloat("Budget", &budget_slider, 0.0f, 1.0f);
+				if (ImGui::IsItemDeactivatedAfterEdit())
+					backing_policy.budget_fraction = budget_slider;
+			}
+			ImGui::Combo("Entry node", &entry, "firstNode\0refineTile (adaptive tiling)\0batchFirstNode\0halfFirstNode (12 byte records)\0unorm8FirstNode (8 byte records)\0varianceTile (denoise, radius per tile)\0");
+			if (entry == (int)sandbox_entry::batch_first_node)
+				ImGui::SliderInt("Batch tile size", &batch_tile_size, 16, (int)c_batchMaxTileSize);
+			ImGui::Text("%llu bytes (min %llu, max %llu)", (unsigned long long)wg_context.BackingMemory.SizeInBytes,
+				(unsigned long long)wg_context.MemReqs.MinSizeInBytes, (unsigned long long)wg_context.MemReqs.MaxSizeInBytes);
+			ImGui::Checkbox("Redraw only what changed", &incremental);
+			ImGui::Text("Dispatched %llu of %llu frames, %u of %u tiles last time", (unsigned long long)frames_dispatched,
+				(unsigned long long)frames_total, last_dirty_tiles, dirty_tiles.TileCount());
 			ImGui::Image((ImTextureID)result.srv_gpu_handle.ptr, ImVec2((float)result.width, (float)result.height));
+			// Holding the left button over the image marks the tiles under the cursor dirty, to try out partial redraws.
+			if (ImGui::IsItemHovered() && ImGui::IsMouseDown(ImGuiMouseButton_Left))
+			{
+				ImVec2 cursor = ImGui::GetMousePos(), origin = ImGui::GetItemRectMin();
+				float x = std::max(cursor.x - origin.x - 16.0f, 0.0f), y = std::max(cursor.y - origin.y - 16.0f, 0.0f);
+				dirty_tiles.MarkRect((UINT)x, (UINT)y, 32, 32);
+			}
+			ImGui::End();
+
+			ImGui::Begin("Work graph trace");
+			char overlay[64];
+			snprintf(overlay, sizeof(overlay), "%.3f ms", timer.last_frame_ms);
+			ImGui::PlotLines("GPU DispatchGraph", timer.history, DispatchGraphTimer::c_historySize, timer.history_offset, overlay, 0.0f,
+				FLT_MAX, ImVec2(0, 80));
+			timer.trace.Summarize(trace_summary);
+			if (ImGui::BeginTable("dispatches", 5))
+			{
+				ImGui::TableSetupColumn("dispatch");
+				ImGui::TableSetupColumn("count");
+				ImGui::TableSetupColumn("records");
+				ImGui::TableSetupColumn("avg ms");
+				ImGui::TableSetupColumn("max ms");
+				ImGui::TableHeadersRow();
+				for (const work_graph_trace_summary& t : trace_summary)
+				{
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn(); ImGui::TextUnformatted(t.name.c_str());
+					ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)t.events);
+					ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)t.records_in);
+					ImGui::TableNextColumn(); ImGui::Text("%.3f", t.total_ns * 1e-6 / (double)t.events);
+					ImGui::TableNextColumn(); ImGui::Text("%.3f", t.max_ns * 1e-6);
+				}
+				ImGui::EndTable();
+			}
+			if (ImGui::Button("Export trace_event JSON"))
+			{
+				const char* file = "work_graph_trace.json";
+				PRINT(timer.trace.WriteChromeTrace(file) ? ">>> Trace written to work_graph_trace.json" : ">>> Failed to write work_graph_trace.json");
+			}
 			ImGui::End();
 		}
 		ImGui::Render();
@@ -262,6 +689,7 @@ int main(int, char**)
     }
 
     WaitForLastSubmittedFrame(D3D);
+    timer.Release();
 
 	// Cleanup
 	ImGui_ImplDX12_Shutdown();
@@ -25,12 +25,16 @@
 // ================================================================================================================================
 GlobalRootSignature globalRS = 
 {
+    "RootFlags( CBV_SRV_UAV_HEAP_DIRECTLY_INDEXED ),"
     "DescriptorTable( UAV( u0 ) ),"
     "DescriptorTable( SRV( t1, numDescriptors = 1) )" 
 };
 RWTexture2D<float4> UAV : register(u0);
 Texture2D<float4> SRV : register(t1);
 
+#include "work_graph_record_encoding.h"
+#include "work_graph_tile_radius.h"
+
 struct entryRecord
 {
     uint3 gridSize : SV_DispatchGrid;
@@ -43,6 +47,53 @@ struct secondNodeInput
     uint2 index;
 };
 
+// Packed secondNodeInput layouts, see work_graph_record_encoding.h.
+struct secondNodeInputHalf
+{
+    uint2 color;
+    uint index;
+};
+
+struct secondNodeInputUnorm8
+{
+    uint color;
+    uint index;
+};
+
+struct tileRecord
+{
+    uint2 origin;
+    uint size;
+};
+
+struct fillTileInput
+{
+    uint3 gridSize : SV_DispatchGrid;
+    uint2 origin;
+    float4 value;
+};
+
+struct batchEntryRecord
+{
+    uint3 gridSize : SV_DispatchGrid;
+    uint2 origin;
+    uint srvIndex;
+    uint uavIndex;
+};
+
+struct batchPixelRecord
+{
+    float4 value;
+    uint2 index;
+    uint uavIndex;
+};
+
+struct filterTileRecord
+{
+    uint2 origin;
+    uint radius;
+};
+
 #if 0
 struct thirdNodeInput
 {
@@ -52,6 +103,10 @@ struct thirdNodeInput
 
 static const uint c_numEntryRecords = 1;
 
+// Adaptive tiling: root tiles are 16 << c_maxRefineDepth pixels wide so the recursion always bottoms out at 16x16.
+static const uint c_maxRefineDepth = 4;
+static const float c_refineThreshold = 0.05;
+
 
 [Shader("node")]
 [NodeLaunch("broadcasting")]
@@ -97,6 +152,297 @@ void secondNode(
 }
 #endif
 
+// --------------------------------------------------------------------------------------------------------------------------------
+// halfFirstNode and unorm8FirstNode are firstNode with the color and index packed into a secondNodeInputHalf (12 bytes) or a
+// secondNodeInputUnorm8 (8 bytes) record instead of the 24 byte secondNodeInput. They're separate entries seeded with the same
+// entryRecord, so the three record sizes can be timed side by side. The packing is in work_graph_record_encoding.h, which the
+// CPU path uses too.
+// --------------------------------------------------------------------------------------------------------------------------------
+[Shader("node")]
+[NodeLaunch("broadcasting")]
+[NodeMaxDispatchGrid(256,256,1)]
+[NumThreads(16,16,1)]
+void halfFirstNode(
+    DispatchNodeInputRecord<entryRecord> inputData,
+    [MaxRecords(256)] NodeOutput<secondNodeInputHalf> halfSecondNode,
+    uint3 groupThreadID : SV_GroupThreadID,
+    uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    uint2 i = dispatchThreadID.xy;
+    float4 r = SRV[i];
+
+    uint u = groupThreadID.x + groupThreadID.y * 16;
+    GroupNodeOutputRecords<secondNodeInputHalf> out_record = halfSecondNode.GetGroupNodeOutputRecords(256);
+    out_record[u].color = EncodeColorHalf4(r);
+    out_record[u].index = EncodePixelIndex16(i);
+    out_record.OutputComplete();
+}
+
+[Shader("node")]
+[NodeLaunch("thread")]
+void halfSecondNode(
+    ThreadNodeInputRecord<secondNodeInputHalf> inputData)
+{
+    float4 r = DecodeColorHalf4(inputData.Get().color);
+    uint2 i = DecodePixelIndex16(inputData.Get().index);
+    UAV[i] = r;
+}
+
+[Shader("node")]
+[NodeLaunch("broadcasting")]
+[NodeMaxDispatchGrid(256,256,1)]
+[NumThreads(16,16,1)]
+void unorm8FirstNode(
+    DispatchNodeInputRecord<entryRecord> inputData,
+    [MaxRecords(256)] NodeOutput<secondNodeInputUnorm8> unorm8SecondNode,
+    uint3 groupThreadID : SV_GroupThreadID,
+    uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    uint2 i = dispatchThreadID.xy;
+    float4 r = SRV[i];
+
+    uint u = groupThreadID.x + groupThreadID.y * 16;
+    GroupNodeOutputRecords<secondNodeInputUnorm8> out_record = unorm8SecondNode.GetGroupNodeOutputRecords(256);
+    out_record[u].color = EncodeColorUnorm8(r);
+    out_record[u].index = EncodePixelIndex16(i);
+    out_record.OutputComplete();
+}
+
+[Shader("node")]
+[NodeLaunch("thread")]
+void unorm8SecondNode(
+    ThreadNodeInputRecord<secondNodeInputUnorm8> inputData)
+{
+    float4 r = DecodeColorUnorm8(inputData.Get().color);
+    uint2 i = DecodePixelIndex16(inputData.Get().index);
+    UAV[i] = r;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------
+// refineTile is a second entry to the graph that covers the image with a quadtree instead of the fixed 16x16 grid of firstNode.
+// 
+// Each group looks at a 16x16 grid of samples spread over its tile. A tile whose samples are within c_refineThreshold in
+// luminance is filled with their average by fillTile, otherwise it is split in four and the children are sent back to
+// refineTile. Non-uniform 16x16 tiles end up as per-pixel records for secondNode, like firstNode would emit.
+// --------------------------------------------------------------------------------------------------------------------------------
+groupshared uint g_lumMin;
+groupshared uint g_lumMax;
+groupshared uint g_colorSum[4];
+
+[Shader("node")]
+[NodeLaunch("broadcasting")]
+[NodeIsProgramEntry]
+[NodeDispatchGrid(1,1,1)]
+[NumThreads(16,16,1)]
+[NodeMaxRecursionDepth(4)] // c_maxRefineDepth
+void refineTile(
+    DispatchNodeInputRecord<tileRecord> inputData,
+    [MaxRecords(4)] NodeOutput<tileRecord> refineTile,
+    [MaxRecords(1)] NodeOutput<fillTileInput> fillTile,
+    [MaxRecords(256)] NodeOutput<secondNodeInput> secondNode,
+    uint3 groupThreadID : SV_GroupThreadID,
+    uint groupIndex : SV_GroupIndex)
+{
+    tileRecord tile = inputData.Get();
+    uint cell = tile.size / 16;
+    uint2 i = tile.origin + groupThreadID.xy * cell + cell / 2;
+    float4 r = SRV[i];
+
+    if (groupIndex == 0)
+    {
+        g_lumMin = 0xffffffff;
+        g_lumMax = 0;
+        for (uint c = 0; c < 4; c++)
+            g_colorSum[c] = 0;
+    }
+    Barrier(GROUP_SHARED_MEMORY, GROUP_SCOPE|GROUP_SYNC);
+
+    // Luminance is non-negative, so its bits order like the float.
+    uint lum = asuint(dot(r.rgb, float3(0.299, 0.587, 0.114)));
+    InterlockedMin(g_lumMin, lum);
+    InterlockedMax(g_lumMax, lum);
+    uint4 q = uint4(saturate(r) * 255.0 + 0.5);
+    InterlockedAdd(g_colorSum[0], q.x);
+    InterlockedAdd(g_colorSum[1], q.y);
+    InterlockedAdd(g_colorSum[2], q.z);
+    InterlockedAdd(g_colorSum[3], q.w);
+    Barrier(GROUP_SHARED_MEMORY, GROUP_SCOPE|GROUP_SYNC);
+
+    bool isUniform = asfloat(g_lumMax) - asfloat(g_lumMin) <= c_refineThreshold;
+    bool canSplit = tile.size > 16 && GetRemainingRecursionLevels() > 0;
+    if (isUniform || (!canSplit && tile.size > 16))
+    {
+        GroupNodeOutputRecords<fillTileInput> fill = fillTile.GetGroupNodeOutputRecords(1);
+        if (groupIndex == 0)
+        {
+            fill[0].gridSize = uint3(tile.size / 16, tile.size / 16, 1);
+            fill[0].origin = tile.origin;
+            fill[0].value = float4(g_colorSum[0], g_colorSum[1], g_colorSum[2], g_colorSum[3]) / (256.0 * 255.0);
+        }
+        fill.OutputComplete();
+    }
+    else if (canSplit)
+    {
+        GroupNodeOutputRecords<tileRecord> children = refineTile.GetGroupNodeOutputRecords(4);
+        if (groupIndex < 4)
+        {
+            uint childSize = tile.size / 2;
+            children[groupIndex].origin = tile.origin + uint2(groupIndex & 1, groupIndex >> 1) * childSize;
+            children[groupIndex].size = childSize;
+        }
+        children.OutputComplete();
+    }
+    else
+    {
+        GroupNodeOutputRecords<secondNodeInput> out_record = secondNode.GetGroupNodeOutputRecords(256);
+        out_record[groupIndex].value = r;
+        out_record[groupIndex].index = i;
+        out_record.OutputComplete();
+    }
+}
+
+[Shader("node")]
+[NodeLaunch("broadcasting")]
+[NodeMaxDispatchGrid(16,16,1)]
+[NumThreads(16,16,1)]
+void fillTile(
+    DispatchNodeInputRecord<fillTileInput> inputData,
+    uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    UAV[inputData.Get().origin + dispatchThreadID.xy] = inputData.Get().value;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------
+// batchFirstNode runs the firstNode -> secondNode copy over many images in one DispatchGraph.
+// 
+// Each entry record carries the ResourceDescriptorHeap indices of its image's SRV and UAV, and covers up to 256x256 groups
+// from origin so large images can be split over several records. The C++ side builds the records with
+// BuildBatchEntryRecords() in work_graph_batch.h.
+// --------------------------------------------------------------------------------------------------------------------------------
+[Shader("node")]
+[NodeLaunch("broadcasting")]
+[NodeMaxDispatchGrid(256,256,1)]
+[NumThreads(16,16,1)]
+void batchFirstNode(
+    DispatchNodeInputRecord<batchEntryRecord> inputData,
+    [MaxRecords(256)] NodeOutput<batchPixelRecord> batchSecondNode,
+    uint3 groupThreadID : SV_GroupThreadID,
+    uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    batchEntryRecord entry = inputData.Get();
+    Texture2D<float4> src = ResourceDescriptorHeap[entry.srvIndex];
+    uint2 i = entry.origin + dispatchThreadID.xy;
+    float4 r = src[i];
+
+    uint u = groupThreadID.x + groupThreadID.y * 16;
+    GroupNodeOutputRecords<batchPixelRecord> out_record = batchSecondNode.GetGroupNodeOutputRecords(256);
+    out_record[u].value = r;
+    out_record[u].index = i;
+    out_record[u].uavIndex = entry.uavIndex;
+    out_record.OutputComplete();
+}
+
+[Shader("node")]
+[NodeLaunch("thread")]
+void batchSecondNode(
+    ThreadNodeInputRecord<batchPixelRecord> inputData)
+{
+    batchPixelRecord p = inputData.Get();
+    // Records from different images can share a wave.
+    RWTexture2D<float4> dst = ResourceDescriptorHeap[NonUniformResourceIndex(p.uavIndex)];
+    dst[p.index] = p.value;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------
+// varianceTile is an entry that denoises with a radius per 16x16 tile, spending taps only where the tile is noisy.
+// 
+// It takes the same entryRecord as firstNode, one group per tile. The group estimates its tile's noise from the luminance
+// (see work_graph_tile_radius.h for the estimate and the radius it picks) and copies a clean tile straight to the UAV, or
+// sends it to filterTile with its radius. filterTile groups then cost (2r + 1)^2 taps per pixel, from 9 to 289, and the
+// scheduler spreads them over the GPU. The CPU engine with the same prepass is cpu_variable_radius_filter.h.
+// --------------------------------------------------------------------------------------------------------------------------------
+groupshared uint g_tileLum[16 * 16];
+groupshared uint g_tileLaplacian;
+
+[Shader("node")]
+[NodeLaunch("broadcasting")]
+[NodeMaxDispatchGrid(256,256,1)]
+[NumThreads(16,16,1)]
+void varianceTile(
+    DispatchNodeInputRecord<entryRecord> inputData,
+    [MaxRecords(1)] NodeOutput<filterTileRecord> filterTile,
+    uint3 groupID : SV_GroupID,
+    uint3 groupThreadID : SV_GroupThreadID,
+    uint3 dispatchThreadID : SV_DispatchThreadID,
+    uint groupIndex : SV_GroupIndex)
+{
+    uint2 i = dispatchThreadID.xy;
+    float4 r = SRV[i];
+
+    if (groupIndex == 0)
+        g_tileLaplacian = 0;
+    uint lum = QuantizeTileLuminance(r);
+    g_tileLum[groupIndex] = lum;
+    Barrier(GROUP_SHARED_MEMORY, GROUP_SCOPE|GROUP_SYNC);
+
+    uint2 t = groupThreadID.xy;
+    if (t.x > 0 && t.x < 15 && t.y > 0 && t.y < 15)
+    {
+        int c = int(g_tileLum[groupIndex - 17] + g_tileLum[groupIndex - 15] + g_tileLum[groupIndex + 15] + g_tileLum[groupIndex + 17]) -
+            2 * int(g_tileLum[groupIndex - 16] + g_tileLum[groupIndex - 1] + g_tileLum[groupIndex + 1] + g_tileLum[groupIndex + 16]) +
+            4 * int(lum);
+        InterlockedAdd(g_tileLaplacian, uint(abs(c)));
+    }
+    Barrier(GROUP_SHARED_MEMORY, GROUP_SCOPE|GROUP_SYNC);
+
+    uint radius = PickTileRadius(TileNoiseSigma(g_tileLaplacian, 14 * 14), c_tileNoiseTarget, c_maxTileRadius);
+    GroupNodeOutputRecords<filterTileRecord> tile = filterTile.GetGroupNodeOutputRecords(radius > 0 ? 1 : 0);
+    if (radius > 0 && groupIndex == 0)
+    {
+        tile[0].origin = groupID.xy * 16;
+        tile[0].radius = radius;
+    }
+    tile.OutputComplete();
+    if (radius == 0)
+        UAV[i] = r;
+}
+
+// Bilateral filter of one tile with the radius varianceTile picked, as cpu_bilateral_filter.h computes it but with exp() for
+// the weights its tables hold.
+[Shader("node")]
+[NodeLaunch("broadcasting")]
+[NodeDispatchGrid(1,1,1)]
+[NumThreads(16,16,1)]
+void filterTile(
+    DispatchNodeInputRecord<filterTileRecord> inputData,
+    uint3 groupThreadID : SV_GroupThreadID)
+{
+    filterTileRecord tile = inputData.Get();
+    int2 p = int2(tile.origin + groupThreadID.xy);
+    uint2 size;
+    SRV.GetDimensions(size.x, size.y);
+    int radius = int(tile.radius);
+    float sigmaSpatial = max(radius / 2.0, 0.5);
+    float spatialScale = -1.0 / (2.0 * sigmaSpatial * sigmaSpatial);
+    float rangeScale = -1.0 / (2.0 * c_tileRangeSigma * c_tileRangeSigma);
+    float4 c = SRV[p];
+
+    float4 sum = 0;
+    float weightSum = 0;
+    for (int dy = -radius; dy <= radius; dy++)
+    {
+        for (int dx = -radius; dx <= radius; dx++)
+        {
+            float4 q = SRV[clamp(p + int2(dx, dy), 0, int2(size) - 1)];
+            float3 d = q.rgb - c.rgb;
+            float w = exp(float(dx * dx + dy * dy) * spatialScale) * exp(dot(d, d) * rangeScale);
+            sum += w * q;
+            weightSum += w;
+        }
+    }
+    UAV[p] = sum / weightSum;
+}
+
 #if 0
 groupshared uint g_sum[c_numEntryRecords];
 
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_bilateral_filter.h"
+#include "cpu_image.h"
+#include "cpu_thread_pool.h"
+#include "cpu_wave.h"
+
+//=================================================================================================================================
+// Edge avoiding a-trous wavelet filter of a cpu_texture, the multi-pass denoiser shape (SVGF) that is bandwidth bound between
+// its passes
+//
+// Level i filters the previous level's output with the 5x5 B3 spline kernel (1 4 6 4 1) / 16, its taps 2^i texels apart, each
+// tap also weighted by wr(|c(q) - c(p)|^2), the range weight of the bilateral filter with sigma_color * sigma_decay^i, looked
+// up in the same kind of LUT (cpu_bilateral_filter.h). Edges are clamped. Two ways to run the levels:
+// - pass per level: every level reads the whole previous level back from memory and writes a whole new one, the way separate
+//   dispatches do
+// - fused: the image is cut into tiles and a worker runs every level of a tile before the next, in scratch buffers that
+//   stay in cache. Level i needs its input 2 * 2^i texels past its output on every side, so a tile is loaded with a halo
+//   of AtrousHalo() texels, and each level computes the part of the halo that later levels still read. Memory traffic is
+//   then one read of the tile plus halo and one write of the tile, traded for filtering the halos more than once.
+//   The halo doubles with every level, so fusing all 5 levels (halo 62) into tiles of 32 and 64 texels filtered 66 and 25
+//   texels per pixel and ran 10x and 4x slower than pass per level. Only the levels AtrousFusedLevels() allows run per
+//   tile, the rest a pass each over the fused output.
+// Fusing saves bandwidth, not time, on a core that is compute bound: on one core the fused runs moved 19-81% of the bytes
+// but took 1.0-1.35x as long as pass per level, tile 512 about even. It can only pay off where the passes wait on memory.
+// Both run the same kernels on the same pixels, so their results are identical; Stats() has the bytes each moved to and
+// from memory, intermediates the fused run keeps in its scratch not counted.
+//
+// Levels work on planes, one per channel, so the AVX2 kernel runs 8 pixels side by side like the bilateral one. It keeps the
+// scalar loop's rounding (no FMA), and takes every aligned group of 8 pixels whose taps are all inside the image, whichever
+// way the level is run.
+//=================================================================================================================================
+static const uint32_t c_atrousMaxLevels = 8u;
+
+struct cpu_atrous_filter_options
+{
+	uint32_t levels = 5u;                  // 1 .. c_atrousMaxLevels
+	float sigma_color = 0.3f;              // range sigma of level 0, of the RGB distance in [0, 1] units
+	float sigma_decay = 0.5f;              // factor per level: coarse levels only average what is alike
+	bool fused = false;
+	uint32_t tile_size = 256u;             // texels, fused runs; rounded up to a multiple of 8
+	float max_halo = 0.25f;                // fused runs: the levels past the halo this fraction of the tile allows run a pass each
+	cpu_wave_isa isa = cpu_wave_isa::avx2; // avx512 runs the AVX2 kernel
+	uint32_t band_height = 8u;             // rows per work item, pass per level runs
+};
+
+// What the last run moved to and from memory.
+struct cpu_atrous_filter_stats
+{
+	uint64_t bytes_read = 0u;
+	uint64_t bytes_written = 0u;
+	uint64_t texels_filtered = 0u; // over all levels, halos included
+	uint32_t passes = 0u;          // over the whole image
+	uint32_t fused_levels = 0u;    // run per tile, the rest ran a pass each
+	uint64_t scratch_bytes = 0u;   // per worker, fused runs
+};
+
+// Texels of input a tile needs past its edges for levels 0 .. levels - 1: 2 * (1 + 2 + .. + 2^(levels - 1)).
+inline uint32_t AtrousHalo(uint32_t levels)
+{
+	return 2u * ((1u << levels) - 1u);
+}
+
+// How many of the first levels a fused run takes per tile: as many as keep the halo within max_halo * tile_size.
+inline uint32_t AtrousFusedLevels(uint32_t levels, uint32_t tile_size, float max_halo)
+{
+	uint32_t fused = 0u;
+	while (fused < levels && (float)AtrousHalo(fused + 1u) <= max_halo * (float)tile_size)
+		fused++;
+	return fused;
+}
+
+namespace cpu_atrous_filter_detail
+{
+	// Products of two taps are exact in float, so the kernels weight a tap the same whatever order they multiply in.
+	static const float c_kernel[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+
+	// Half open, in image texels.
+	struct rect
+	{
+		int32_t x0, y0, x1, y1;
+
+		uint64_t Area() const { return (uint64_t)(x1 - x0) * (uint64_t)(y1 - y0); }
+	};
+
+	// The texels of a rect of the image, one plane per channel.
+	struct plane_view
+	{
+		float* planes[4]; // r, g, b, a
+		uint32_t pitch;
+		int32_t x0, y0;
+
+		size_t Offset(int32_t x, int32_t y) const { return (size_t)(y - y0) * pitch + (size_t)(x - x0); }
+	};
+
+	struct level_view
+	{
+		plane_view src;
+		plane_view dst;        // unless out is set
+		float4* out;           // the last level writes the image straight to the UAV
+		int32_t width, height; // of the image, taps are clamped to it
+		int32_t step;
+		const float* lut;
+		float lut_scale;
+	};
+
+	// r grown by 2 * step on every side, clipped to the image, with x0 and x1 on multiples of 8 (or the image's right edge).
+	inline rect LevelInputRect(const rect& r, int32_t step, int32_t width, int32_t height)
+	{
+		return rect{ std::max(0, r.x0 - 2 * step) & ~7, std::max(0, r.y0 - 2 * step),
+			std::min(width, (r.x1 + 2 * step + 7) & ~7), std::min(height, r.y1 + 2 * step) };
+	}
+
+	inline void Deinterleave(const cpu_texture& SRV, const plane_view& dst, const rect& r)
+	{
+		for (int32_t y = r.y0; y < r.y1; y++)
+		{
+			const float4* row = &SRV.texels[(size_t)y * SRV.width];
+			size_t o = dst.Offset(r.x0, y);
+			for (int32_t x = r.x0; x < r.x1; x++, o++)
+			{
+				dst.planes[0][o] = row[x].x;
+				dst.planes[1][o] = row[x].y;
+				dst.planes[2][o] = row[x].z;
+				dst.planes[3][o] = row[x].w;
+			}
+		}
+	}
+
+	// rows[k] is the offset in the source planes of the row of tap k, x0 included.
+	inline void FilterPixelScalar(const level_view& v, const size_t* rows, int32_t x, int32_t y)
+	{
+		const plane_view& s = v.src;
+		size_t center = rows[2] + (size_t)x;
+		float cr = s.planes[0][center], cg = s.planes[1][center], cb = s.planes[2][center];
+		float sum[4] = {}, weight_sum = 0.0f;
+		for (uint32_t ky = 0; ky < 5u; ky++)
+		{
+			for (int32_t kx = 0; kx < 5; kx++)
+			{
+				size_t q = rows[ky] + (size_t)std::clamp(x + (kx - 2) * v.step, 0, v.width - 1);
+				float dr = s.planes[0][q] - cr, dg = s.planes[1][q] - cg, db = s.planes[2][q] - cb;
+				float d2 = dr * dr + dg * dg + db * db;
+				uint32_t index = (uint32_t)std::min(d2 * v.lut_scale + 0.5f, (float)c_bilateralRangeLutSize);
+				float w = (c_kernel[ky] * c_kernel[kx]) * v.lut[index];
+				for (uint32_t c = 0; c < 4u; c++)
+					sum[c] += w * s.planes[c][q];
+				weight_sum += w;
+			}
+		}
+		// The center tap weighs 36 / 256, so weight_sum > 0.
+		float inv = 1.0f / weight_sum;
+		if (v.out)
+		{
+			v.out[(size_t)y * v.width + x] = float4{ sum[0] * inv, sum[1] * inv, sum[2] * inv, sum[3] * inv };
+			return;
+		}
+		size_t o = v.dst.Offset(x, y);
+		for (uint32_t c = 0; c < 4u; c++)
+			v.dst.planes[c][o] = sum[c] * inv;
+	}
+
+#if defined(CPU_WAVE_X86)
+	// Pixels x .. x + 7, all of whose taps are inside the image.
+	CPU_WAVE_TARGET_AVX2 inline void FilterPixels8Avx2(const level_view& v, const size_t* rows, int32_t x, int32_t y)
+	{
+		const plane_view& s = v.src;
+		size_t center = rows[2] + (size_t)x;
+		__m256 cr = _mm256_loadu_ps(s.planes[0] + center), cg = _mm256_loadu_ps(s.planes[1] + center), cb = _mm256_loadu_ps(s.planes[2] + center);
+		const __m256 scale = _mm256_set1_ps(v.lut_scale), half = _mm256_set1_ps(0.5f), last = _mm256_set1_ps((float)c_bilateralRangeLutSize);
+		__m256 sr = _mm256_setzero_ps(), sg = _mm256_setzero_ps(), sb = _mm256_setzero_ps(), sa = _mm256_setzero_ps();
+		__m256 weight_sum = _mm256_setzero_ps();
+		for (uint32_t ky = 0; ky < 5u; ky++)
+		{
+			for (int32_t kx = 0; kx < 5; kx++)
+			{
+				size_t q = rows[ky] + (size_t)(x + (kx - 2) * v.step);
+				__m256 qr = _mm256_loadu_ps(s.planes[0] + q), qg = _mm256_loadu_ps(s.planes[1] + q), qb = _mm256_loadu_ps(s.planes[2] + q);
+				__m256 dr = _mm256_sub_ps(qr, cr), dg = _mm256_sub_ps(qg, cg), db = _mm256_sub_ps(qb, cb);
+				__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dr, dr), _mm256_mul_ps(dg, dg)), _mm256_mul_ps(db, db));
+				__m256i index = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(d2, scale), half), last));
+				__m256 w = _mm256_mul_ps(_mm256_set1_ps(c_kernel[ky] * c_kernel[kx]), _mm256_i32gather_ps(v.lut, index, 4));
+				sr = _mm256_add_ps(sr, _mm256_mul_ps(w, qr));
+				sg = _mm256_add_ps(sg, _mm256_mul_ps(w, qg));
+				sb = _mm256_add_ps(sb, _mm256_mul_ps(w, qb));
+				sa = _mm256_add_ps(sa, _mm256_mul_ps(w, _mm256_loadu_ps(s.planes[3] + q)));
+				weight_sum = _mm256_add_ps(weight_sum, w);
+			}
+		}
+		__m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), weight_sum);
+		sr = _mm256_mul_ps(sr, inv);
+		sg = _mm256_mul_ps(sg, inv);
+		sb = _mm256_mul_ps(sb, inv);
+		sa = _mm256_mul_ps(sa, inv);
+		if (v.out)
+		{
+			StoreFloat4LanesAvx2(&v.out[(size_t)y * v.width + x].x, sr, sg, sb, sa);
+			return;
+		}
+		size_t o = v.dst.Offset(x, y);
+		_mm256_storeu_ps(v.dst.planes[0] + o, sr);
+		_mm256_storeu_ps(v.dst.planes[1] + o, sg);
+		_mm256_storeu_ps(v.dst.planes[2] + o, sb);
+		_mm256_storeu_ps(v.dst.planes[3] + o, sa);
+	}
+#endif
+
+	// One level over r, whose x1 is a multiple of 8 or the image width.
+	inline void FilterLevel(const level_view& v, const rect& r, bool avx2)
+	{
+		for (int32_t y = r.y0; y < r.y1; y++)
+		{
+			size_t rows[5];
+			for (int32_t k = 0; k < 5; k++)
+				rows[k] = v.src.Offset(0, std::clamp(y + (k - 2) * v.step, 0, v.height - 1));
+			for (int32_t x = r.x0; x < r.x1; )
+			{
+#if defined(CPU_WAVE_X86)
+				if (avx2 && (x & 7) == 0 && x + 8 <= r.x1 && x - 2 * v.step >= 0 && x + 7 + 2 * v.step < v.width)
+				{
+					FilterPixels8Avx2(v, rows, x, y);
+					x += 8;
+					continue;
+				}
+#endif
+				FilterPixelScalar(v, rows, x, y);
+				x++;
+			}
+		}
+	}
+}
+
+// Keeps the LUTs, intermediates and per worker scratch between runs, so filtering same sized images doesn't allocate.
+class cpu_atrous_filter
+{
+public:
+	// Filters SRV into UAV, which is resized to match.
+	void Run(cpu_thread_pool& pool, const cpu_texture& SRV, cpu_texture& UAV, const cpu_atrous_filter_options& options)
+	{
+		if (UAV.width != SRV.width || UAV.height != SRV.height)
+			UAV.Resize(SRV.width, SRV.height);
+		stats = cpu_atrous_filter_stats();
+		if (SRV.width == 0u || SRV.height == 0u)
+			return;
+		levels = std::clamp(options.levels, 1u, c_atrousMaxLevels);
+		if (levels != lut_levels || options.sigma_color != lut_sigma_color || options.sigma_decay != lut_sigma_decay)
+		{
+			for (uint32_t i = 0; i < levels; i++)
+				lut_scales[i] = BuildBilateralRangeLut(options.sigma_color * std::pow(options.sigma_decay, (float)i), luts[i]);
+			lut_levels = levels;
+			lut_sigma_color = options.sigma_color;
+			lut_sigma_decay = options.sigma_decay;
+		}
+		bool avx2 = options.isa != cpu_wave_isa::scalar && IsWaveIsaSupported(cpu_wave_isa::avx2);
+		const uint32_t tile = std::max(8u, (options.tile_size + 7u) & ~7u);
+		uint32_t fused_levels = options.fused ? AtrousFusedLevels(levels, tile, options.max_halo) : 0u;
+		if (fused_levels > 0u)
+			RunFused(pool, SRV, UAV, tile, fused_levels, avx2);
+		if (fused_levels < levels)
+			RunPassPerLevel(pool, SRV, UAV, options, fused_levels, avx2);
+	}
+
+	// Of the last run.
+	const cpu_atrous_filter_stats& Stats() const { return stats; }
+
+private:
+	cpu_atrous_filter_detail::level_view MakeLevelView(const cpu_texture& SRV, uint32_t level) const
+	{
+		cpu_atrous_filter_detail::level_view v = {};
+		v.width = (int32_t)SRV.width;
+		v.height = (int32_t)SRV.height;
+		v.step = 1 << level;
+		v.lut = luts[level].data();
+		v.lut_scale = lut_scales[level];
+		return v;
+	}
+
+	// Planes of texels texels each, back to back in buffer.
+	static cpu_atrous_filter_detail::plane_view MakePlaneView(std::vector<float>& buffer, size_t texels, const cpu_atrous_filter_detail::rect& r)
+	{
+		if (buffer.size() < 4u * texels)
+			buffer.resize(4u * texels);
+		float* base = buffer.data();
+		return cpu_atrous_filter_detail::plane_view{ { base, base + texels, base + 2u * texels, base + 3u * texels },
+			(uint32_t)(r.x1 - r.x0), r.x0, r.y0 };
+	}
+
+	// Levels first_level .. levels - 1; the ones before ran fused and left their output in the intermediate the next reads.
+	void RunPassPerLevel(cpu_thread_pool& pool, const cpu_texture& SRV, cpu_texture& UAV, const cpu_atrous_filter_options& options,
+		uint32_t first_level, bool avx2)
+	{
+		using namespace cpu_atrous_filter_detail;
+		const uint32_t width = SRV.width, height = SRV.height;
+		const size_t texels = (size_t)width * height;
+		const rect image = { 0, 0, (int32_t)width, (int32_t)height };
+		plane_view buffers[2] = { MakePlaneView(intermediates[0], texels, image), MakePlaneView(intermediates[1], texels, image) };
+		const uint32_t band = std::max(1u, options.band_height);
+
+		if (first_level == 0u)
+		{
+			pool.ParallelFor(0u, height, band, [&](uint32_t begin, uint32_t end, uint32_t)
+			{
+				Deinterleave(SRV, buffers[0], rect{ 0, (int32_t)begin, (int32_t)width, (int32_t)end });
+			});
+		}
+		for (uint32_t level = first_level; level < levels; level++)
+		{
+			level_view v = MakeLevelView(SRV, level);
+			v.src = buffers[level & 1u];
+			v.dst = buffers[(level + 1u) & 1u];
+			v.out = level + 1u == levels ? UAV.texels.data() : nullptr;
+			pool.ParallelFor(0u, height, band, [&](uint32_t begin, uint32_t end, uint32_t)
+			{
+				FilterLevel(v, rect{ 0, (int32_t)begin, (int32_t)width, (int32_t)end }, avx2);
+			});
+		}
+
+		// Each pass reads its input once and writes its output once; the rows a tap reaches are still in cache.
+		uint32_t passes = levels - first_level + (first_level == 0u ? 1u : 0u);
+		stats.passes += passes;
+		stats.bytes_read += passes * texels * sizeof(float4);
+		stats.bytes_written += passes * texels * sizeof(float4);
+		stats.texels_filtered += (levels - first_level) * texels;
+	}
+
+	// Levels 0 .. fused_levels - 1 per tile. If that isn't all of them the last writes the intermediate the next pass reads.
+	void RunFused(cpu_thread_pool& pool, const cpu_texture& SRV, cpu_texture& UAV, uint32_t tile_size, uint32_t fused_levels, bool avx2)
+	{
+		using namespace cpu_atrous_filter_detail;
+		const int32_t width = (int32_t)SRV.width, height = (int32_t)SRV.height;
+		const int32_t tile = (int32_t)tile_size;
+		const uint32_t tiles_x = (uint32_t)((width + tile - 1) / tile), tiles_y = (uint32_t)((height + tile - 1) / tile);
+		// The largest input rect of a tile, for the scratch size: the halo, plus what aligning levels 0 and 1 to 8 texels adds.
+		const int32_t halo = (int32_t)AtrousHalo(fused_levels);
+		const size_t scratch_texels = (size_t)std::min(width, tile + 2 * halo + 24) * (size_t)std::min(height, tile + 2 * halo);
+		const rect image = { 0, 0, width, height };
+		const plane_view out = fused_levels < levels ?
+			MakePlaneView(intermediates[fused_levels & 1u], (size_t)width * height, image) : plane_view{};
+		if (workers.size() < pool.Size())
+			workers.resize(pool.Size());
+		for (worker_state& w : workers)
+			w.stats = cpu_atrous_filter_stats();
+
+		pool.ParallelFor(0u, tiles_x * tiles_y, 1u, [&](uint32_t begin, uint32_t end, uint32_t worker)
+		{
+			worker_state& state = workers[worker];
+			for (uint32_t t = begin; t < end; t++)
+			{
+				// rects[i] is level i's input, rects[fused_levels] the tile.
+				rect rects[c_atrousMaxLevels + 1u];
+				int32_t x0 = (int32_t)(t % tiles_x) * tile, y0 = (int32_t)(t / tiles_x) * tile;
+				rects[fused_levels] = rect{ x0, y0, std::min(width, x0 + tile), std::min(height, y0 + tile) };
+				for (uint32_t level = fused_levels; level-- > 0u; )
+					rects[level] = LevelInputRect(rects[level + 1u], 1 << level, width, height);
+
+				Deinterleave(SRV, MakePlaneView(state.scratch[0], scratch_texels, rects[0]), rects[0]);
+				for (uint32_t level = 0; level < fused_levels; level++)
+				{
+					level_view v = MakeLevelView(SRV, level);
+					v.src = MakePlaneView(state.scratch[level & 1u], scratch_texels, rects[level]);
+					bool last = level + 1u == fused_levels;
+					v.dst = last ? out : MakePlaneView(state.scratch[(level + 1u) & 1u], scratch_texels, rects[level + 1u]);
+					v.out = last && fused_levels == levels ? UAV.texels.data() : nullptr;
+					FilterLevel(v, rects[level + 1u], avx2);
+					state.stats.texels_filtered += rects[level + 1u].Area();
+				}
+				state.stats.bytes_read += rects[0].Area() * sizeof(float4);
+				state.stats.bytes_written += rects[fused_levels].Area() * sizeof(float4);
+			}
+		});
+
+		stats.passes = 1u;
+		stats.fused_levels = fused_levels;
+		stats.scratch_bytes = 2u * 4u * scratch_texels * sizeof(float);
+		for (const worker_state& w : workers)
+		{
+			stats.bytes_read += w.stats.bytes_read;
+			stats.bytes_written += w.stats.bytes_written;
+			stats.texels_filtered += w.stats.texels_filtered;
+		}
+	}
+
+	// Padded so workers don't share cache lines.
+	struct alignas(64) worker_state
+	{
+		std::vector<float> scratch[2];
+		cpu_atrous_filter_stats stats;
+	};
+
+	uint32_t levels = 0u;
+	std::vector<float> luts[c_atrousMaxLevels];
+	float lut_scales[c_atrousMaxLevels] = {};
+	uint32_t lut_levels = 0u;
+	float lut_sigma_color = 0.0f;
+	float lut_sigma_decay = 0.0f;
+	std::vector<float> intermediates[2];
+	std::vector<worker_state> workers;
+	cpu_atrous_filter_stats stats;
+};
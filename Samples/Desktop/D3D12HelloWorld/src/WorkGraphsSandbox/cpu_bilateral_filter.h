@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_image.h"
+#include "cpu_thread_pool.h"
+#include "cpu_wave.h"
+
+//=================================================================================================================================
+// Edge preserving bilateral filter of a cpu_texture, the CPU reference for a denoising filter node
+//
+// out(p) = sum_q ws(q - p) wr(|c(q) - c(p)|^2) c(q) / sum_q ws(q - p) wr(|c(q) - c(p)|^2)
+// over the (2 * radius + 1)^2 window around p with clamped edges, where
+// - ws(d) = exp(-|d|^2 / (2 sigma_spatial^2)), a table per window offset
+// - wr(d2) = exp(-d2 / (2 sigma_range^2)) of the squared RGB distance, looked up in c_bilateralRangeLutSize entries over
+//   [0, 2 sigma_range^2 * c_bilateralRangeCutoff], nearest entry, and 0 past the end
+// All four channels are averaged with the same weights. A node that uploads the same two tables and does the same lookup
+// gets the same result up to float rounding; each LUT weight is within BilateralLutTolerance() of exp() evaluated per tap.
+//
+// The input is first split into padded planes, one per channel, so the AVX2 kernel loads 8 neighbouring pixels of a channel
+// with one load and runs 8 output pixels side by side; range weights come from the LUT with a gather. Rows are spread over
+// the thread pool in bands. The scalar loop is the fallback and the reference for the vector one.
+//=================================================================================================================================
+static const uint32_t c_bilateralRangeLutSize = 4096u;
+// wr is cut off where it drops below exp(-c_bilateralRangeCutoff), about 1e-4.
+static const float c_bilateralRangeCutoff = 9.2f;
+
+struct cpu_bilateral_filter_options
+{
+	uint32_t radius = 4u;
+	float sigma_spatial = 0.0f;            // <= 0: radius / 2
+	float sigma_range = 0.3f;              // of the RGB distance in [0, 1] units, above the noise in it
+	cpu_wave_isa isa = cpu_wave_isa::avx2; // avx512 runs the AVX2 kernel
+	uint32_t band_height = 8u;             // rows per work item
+};
+
+// Largest difference between a range weight from the LUT and from exp(), the error bound per weight.
+inline float BilateralLutTolerance()
+{
+	// A lookup is at most half an entry off and the slope of exp(-x) is at most 1; past the cutoff the weight is dropped.
+	// In units of d2 / (2 sigma_range^2) the table spacing doesn't depend on sigma_range.
+	return 0.5f * c_bilateralRangeCutoff / (float)(c_bilateralRangeLutSize - 1u) + std::exp(-c_bilateralRangeCutoff);
+}
+
+// ws for the offsets (dx, dy), row major from (-radius, -radius).
+inline void BuildBilateralSpatialTable(uint32_t radius, float sigma_spatial, std::vector<float>& out_table)
+{
+	if (sigma_spatial <= 0.0f)
+		sigma_spatial = std::max(radius / 2.0f, 0.5f);
+	uint32_t side = 2u * radius + 1u;
+	out_table.resize((size_t)side * side);
+	for (uint32_t y = 0; y < side; y++)
+	{
+		for (uint32_t x = 0; x < side; x++)
+		{
+			float dx = (float)x - radius, dy = (float)y - radius;
+			out_table[(size_t)y * side + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma_spatial * sigma_spatial));
+		}
+	}
+}
+
+// wr at c_bilateralRangeLutSize points plus a trailing 0 for everything past the cutoff. Returns the index scale: the entry
+// for d2 is min(d2 * scale + 0.5, c_bilateralRangeLutSize).
+inline float BuildBilateralRangeLut(float sigma_range, std::vector<float>& out_lut)
+{
+	float max_d2 = 2.0f * sigma_range * sigma_range * c_bilateralRangeCutoff;
+	float scale = (float)(c_bilateralRangeLutSize - 1u) / max_d2;
+	out_lut.resize(c_bilateralRangeLutSize + 1u);
+	for (uint32_t i = 0; i < c_bilateralRangeLutSize; i++)
+		out_lut[i] = std::exp(-(i / scale) / (2.0f * sigma_range * sigma_range));
+	out_lut[c_bilateralRangeLutSize] = 0.0f;
+	return scale;
+}
+
+// One pixel with exp() per tap instead of the tables, what the LUT is checked against.
+inline float4 BilateralFilterPixelExact(const cpu_texture& SRV, uint32_t px, uint32_t py, const cpu_bilateral_filter_options& options)
+{
+	const int32_t r = (int32_t)options.radius;
+	float sigma_spatial = options.sigma_spatial > 0.0f ? options.sigma_spatial : std::max(options.radius / 2.0f, 0.5f);
+	float4 c = SRV.Load(uint2{ px, py });
+	double sum[4] = {}, weight_sum = 0.0;
+	for (int32_t dy = -r; dy <= r; dy++)
+	{
+		for (int32_t dx = -r; dx <= r; dx++)
+		{
+			uint32_t qx = (uint32_t)std::clamp((int32_t)px + dx, 0, (int32_t)SRV.width - 1);
+			uint32_t qy = (uint32_t)std::clamp((int32_t)py + dy, 0, (int32_t)SRV.height - 1);
+			float4 q = SRV.Load(uint2{ qx, qy });
+			double d2 = (double)(q.x - c.x) * (q.x - c.x) + (double)(q.y - c.y) * (q.y - c.y) + (double)(q.z - c.z) * (q.z - c.z);
+			double w = std::exp(-(double)(dx * dx + dy * dy) / (2.0 * sigma_spatial * sigma_spatial)) *
+				std::exp(-d2 / (2.0 * options.sigma_range * options.sigma_range));
+			sum[0] += w * q.x;
+			sum[1] += w * q.y;
+			sum[2] += w * q.z;
+			sum[3] += w * q.w;
+			weight_sum += w;
+		}
+	}
+	return float4{ (float)(sum[0] / weight_sum), (float)(sum[1] / weight_sum), (float)(sum[2] / weight_sum), (float)(sum[3] / weight_sum) };
+}
+
+namespace cpu_bilateral_filter_detail
+{
+	// The padded planes and tables one run reads.
+	struct filter_view
+	{
+		const float* planes[4]; // r, g, b, a; pitch floats per row, the texel (x, y) at [(y + radius) * pitch + x + radius]
+		uint32_t pitch;
+		uint32_t radius;
+		const float* spatial;
+		const float* lut;
+		float lut_scale;
+	};
+
+	inline float4 FilterPixelScalar(const filter_view& v, uint32_t x, uint32_t y)
+	{
+		const uint32_t side = 2u * v.radius + 1u;
+		size_t center = (size_t)(y + v.radius) * v.pitch + x + v.radius;
+		float cr = v.planes[0][center], cg = v.planes[1][center], cb = v.planes[2][center];
+		float sum[4] = {}, weight_sum = 0.0f;
+		for (uint32_t ky = 0; ky < side; ky++)
+		{
+			size_t row = (size_t)(y + ky) * v.pitch + x;
+			for (uint32_t kx = 0; kx < side; kx++)
+			{
+				size_t q = row + kx;
+				float dr = v.planes[0][q] - cr, dg = v.planes[1][q] - cg, db = v.planes[2][q] - cb;
+				float d2 = dr * dr + dg * dg + db * db;
+				uint32_t index = (uint32_t)std::min(d2 * v.lut_scale + 0.5f, (float)c_bilateralRangeLutSize);
+				float w = v.spatial[ky * side + kx] * v.lut[index];
+				for (uint32_t c = 0; c < 4u; c++)
+					sum[c] += w * v.planes[c][q];
+				weight_sum += w;
+			}
+		}
+		// The center tap has weight ws(0) * wr(0) = 1, so weight_sum >= 1.
+		float inv = 1.0f / weight_sum;
+		return float4{ sum[0] * inv, sum[1] * inv, sum[2] * inv, sum[3] * inv };
+	}
+
+#if defined(CPU_WAVE_X86)
+	// Pixels x .. x + 7 of row y.
+	CPU_WAVE_TARGET_AVX2 inline void FilterPixels8Avx2(const filter_view& v, uint32_t x, uint32_t y, float4* out)
+	{
+		const uint32_t side = 2u * v.radius + 1u;
+		size_t center = (size_t)(y + v.radius) * v.pitch + x + v.radius;
+		__m256 cr = _mm256_loadu_ps(v.planes[0] + center), cg = _mm256_loadu_ps(v.planes[1] + center), cb = _mm256_loadu_ps(v.planes[2] + center);
+		const __m256 scale = _mm256_set1_ps(v.lut_scale), half = _mm256_set1_ps(0.5f), last = _mm256_set1_ps((float)c_bilateralRangeLutSize);
+		__m256 sr = _mm256_setzero_ps(), sg = _mm256_setzero_ps(), sb = _mm256_setzero_ps(), sa = _mm256_setzero_ps();
+		__m256 weight_sum = _mm256_setzero_ps();
+		for (uint32_t ky = 0; ky < side; ky++)
+		{
+			size_t row = (size_t)(y + ky) * v.pitch + x;
+			const float* spatial = v.spatial + ky * side;
+			for (uint32_t kx = 0; kx < side; kx++)
+			{
+				size_t q = row + kx;
+				__m256 qr = _mm256_loadu_ps(v.planes[0] + q), qg = _mm256_loadu_ps(v.planes[1] + q), qb = _mm256_loadu_ps(v.planes[2] + q);
+				__m256 dr = _mm256_sub_ps(qr, cr), dg = _mm256_sub_ps(qg, cg), db = _mm256_sub_ps(qb, cb);
+				// Rounded like the scalar loop (no FMA), so both pick the same LUT entries.
+				__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dr, dr), _mm256_mul_ps(dg, dg)), _mm256_mul_ps(db, db));
+				__m256i index = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(d2, scale), half), last));
+				__m256 w = _mm256_mul_ps(_mm256_broadcast_ss(spatial + kx), _mm256_i32gather_ps(v.lut, index, 4));
+				sr = _mm256_fmadd_ps(w, qr, sr);
+				sg = _mm256_fmadd_ps(w, qg, sg);
+				sb = _mm256_fmadd_ps(w, qb, sb);
+				sa = _mm256_fmadd_ps(w, _mm256_loadu_ps(v.planes[3] + q), sa);
+				weight_sum = _mm256_add_ps(weight_sum, w);
+			}
+		}
+		__m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), weight_sum);
+		sr = _mm256_mul_ps(sr, inv);
+		sg = _mm256_mul_ps(sg, inv);
+		sb = _mm256_mul_ps(sb, inv);
+		sa = _mm256_mul_ps(sa, inv);
+		StoreFloat4LanesAvx2(&out->x, sr, sg, sb, sa);
+	}
+#endif
+
+	// planes[c] gets channel c of SRV with pad clamped texels on every side, width + 2 * pad floats per row.
+	inline void BuildPaddedPlanes(cpu_thread_pool& pool, const cpu_texture& SRV, uint32_t pad, std::vector<float> (&planes)[4])
+	{
+		const uint32_t width = SRV.width, height = SRV.height;
+		const uint32_t pitch = width + 2u * pad, rows = height + 2u * pad;
+		for (std::vector<float>& plane : planes)
+			plane.resize((size_t)pitch * rows);
+		pool.ParallelFor(0u, rows, 16u, [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			for (uint32_t py = begin; py < end; py++)
+			{
+				uint32_t sy = (uint32_t)std::clamp((int32_t)py - (int32_t)pad, 0, (int32_t)height - 1);
+				const float4* row = &SRV.texels[(size_t)sy * width];
+				for (uint32_t px = 0; px < pitch; px++)
+				{
+					const float4& t = row[std::clamp((int32_t)px - (int32_t)pad, 0, (int32_t)width - 1)];
+					size_t i = (size_t)py * pitch + px;
+					planes[0][i] = t.x;
+					planes[1][i] = t.y;
+					planes[2][i] = t.z;
+					planes[3][i] = t.w;
+				}
+			}
+		});
+	}
+
+	// Pixels [x0, x1) x [y0, y1) into UAV, 8 at a time from x0 while they fit.
+	inline void FilterRect(const filter_view& v, uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, bool avx2, cpu_texture& UAV)
+	{
+		for (uint32_t y = y0; y < y1; y++)
+		{
+			float4* out = &UAV.texels[(size_t)y * UAV.width];
+			uint32_t x = x0;
+#if defined(CPU_WAVE_X86)
+			if (avx2)
+			{
+				for (; x + 8u <= x1; x += 8u)
+					FilterPixels8Avx2(v, x, y, out + x);
+			}
+#else
+			(void)avx2;
+#endif
+			for (; x < x1; x++)
+				out[x] = FilterPixelScalar(v, x, y);
+		}
+	}
+}
+
+// Keeps the tables, planes and per run state between runs, so filtering same sized images doesn't allocate.
+class cpu_bilateral_filter
+{
+public:
+	// Filters SRV into UAV, which is resized to match.
+	void Run(cpu_thread_pool& pool, const cpu_texture& SRV, cpu_texture& UAV, const cpu_bilateral_filter_options& options)
+	{
+		using namespace cpu_bilateral_filter_detail;
+		const uint32_t width = SRV.width, height = SRV.height, radius = options.radius;
+		if (UAV.width != width || UAV.height != height)
+			UAV.Resize(width, height);
+		if (width == 0u || height == 0u)
+			return;
+		if (radius != table_radius || options.sigma_spatial != table_sigma_spatial || options.sigma_range != table_sigma_range || lut.empty())
+		{
+			BuildBilateralSpatialTable(radius, options.sigma_spatial, spatial);
+			lut_scale = BuildBilateralRangeLut(options.sigma_range, lut);
+			table_radius = radius;
+			table_sigma_spatial = options.sigma_spatial;
+			table_sigma_range = options.sigma_range;
+		}
+
+		BuildPaddedPlanes(pool, SRV, radius, planes);
+		filter_view view = { { planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data() }, width + 2u * radius, radius,
+			spatial.data(), lut.data(), lut_scale };
+		bool avx2 = options.isa != cpu_wave_isa::scalar && IsWaveIsaSupported(cpu_wave_isa::avx2);
+		pool.ParallelFor(0u, height, std::max(1u, options.band_height), [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			FilterRect(view, 0u, width, begin, end, avx2, UAV);
+		});
+	}
+
+private:
+	std::vector<float> spatial;
+	std::vector<float> lut;
+	float lut_scale = 0.0f;
+	uint32_t table_radius = 0u;
+	float table_sigma_spatial = 0.0f;
+	float table_sigma_range = 0.0f;
+	std::vector<float> planes[4];
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "cpu_record_block.h"
+
+//=================================================================================================================================
+// Coalescing launch for the CPU execution path
+//
+// Records sent to a [NodeLaunch("coalescing")] node are gathered into batches of up to [MaxRecords(N)] records, like
+// GroupNodeInputRecords on the GPU. A full batch always launches. When a partial batch launches is decided by a flush
+// heuristic, which lets us study how batch fill rate trades against latency before picking a launch mode in the HLSL.
+// Whatever the heuristic, partial batches are flushed once the graph has nothing else left to run.
+//=================================================================================================================================
+
+struct cpu_coalescing_state
+{
+	uint32_t pending_records = 0u;       // records in the partial batch
+	uint32_t max_records = 0u;           // [MaxRecords(N)]
+	uint32_t producers_since_flush = 0u; // OutputComplete() calls that fed the partial batch
+};
+
+class cpu_flush_heuristic
+{
+public:
+	virtual ~cpu_flush_heuristic() {}
+	virtual const char* Name() const = 0;
+	// Called after a producer appended records and the batch is still partial.
+	virtual bool FlushOnAppend(const cpu_coalescing_state&) const { return false; }
+	// Called when a worker runs out of queued work while producers may still be running elsewhere.
+	virtual bool FlushOnIdle(const cpu_coalescing_state&) const { return false; }
+};
+
+// Only launches full batches; partial batches wait until the graph drains.
+class cpu_fill_to_max_flush : public cpu_flush_heuristic
+{
+public:
+	const char* Name() const override { return "fill-to-max"; }
+};
+
+// Launches a partial batch once it has been fed by 'max_producers' OutputComplete() calls without filling up.
+class cpu_producer_timeout_flush : public cpu_flush_heuristic
+{
+public:
+	explicit cpu_producer_timeout_flush(uint32_t max_producers) : max_producers(std::max(1u, max_producers)) {}
+	const char* Name() const override { return "producer-timeout"; }
+	bool FlushOnAppend(const cpu_coalescing_state& state) const override { return state.producers_since_flush >= max_producers; }
+
+private:
+	uint32_t max_producers;
+};
+
+// Launches whatever is pending as soon as a worker would otherwise go idle.
+class cpu_drain_on_idle_flush : public cpu_flush_heuristic
+{
+public:
+	const char* Name() const override { return "drain-on-idle"; }
+	bool FlushOnIdle(const cpu_coalescing_state& state) const override { return state.pending_records > 0u; }
+};
+
+enum class cpu_flush_reason
+{
+	full,
+	heuristic,
+	idle,
+	drain,
+	backpressure, // a producer is stalled on the node's input queue, see cpu_node_output_desc::high_water_mark
+	count,
+};
+
+//=================================================================================================================================
+// Per-node batch accumulator. Batches are handed out as blocks allocated through the callback passed in.
+class cpu_coalescing_queue
+{
+public:
+	using allocate_function = std::function<cpu_record_block*(uint32_t capacity)>;
+
+	cpu_coalescing_queue(uint32_t max_records, uint32_t stride, const cpu_flush_heuristic* heuristic)
+		: max_records(max_records), stride(stride), heuristic(heuristic) {}
+
+	// Copies count records into the current batch, appending every batch that launches to out_batches.
+	void Append(const uint8_t* records, uint32_t count, const allocate_function& allocate, std::vector<cpu_record_block*>& out_batches)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		while (count > 0u)
+		{
+			if (!batch)
+			{
+				batch = allocate(max_records);
+				batch->count = 0u;
+			}
+			uint32_t n = std::min(count, max_records - batch->count);
+			memcpy(batch->Record(batch->count), records, (size_t)n * stride);
+			batch->count += n;
+			records += (size_t)n * stride;
+			count -= n;
+			if (batch->count == max_records)
+				Launch(cpu_flush_reason::full, out_batches);
+		}
+		if (batch)
+		{
+			producers_since_flush++;
+			if (heuristic->FlushOnAppend(State()))
+				Launch(cpu_flush_reason::heuristic, out_batches);
+		}
+		else
+		{
+			producers_since_flush = 0u;
+		}
+	}
+
+	// Launches the partial batch if the heuristic wants to on idle, or unconditionally when draining or under backpressure.
+	bool Flush(cpu_flush_reason reason, std::vector<cpu_record_block*>& out_batches)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!batch || batch->count == 0u)
+			return false;
+		if (reason == cpu_flush_reason::idle && !heuristic->FlushOnIdle(State()))
+			return false;
+		Launch(reason, out_batches);
+		return true;
+	}
+
+	uint64_t Flushes(cpu_flush_reason reason) const { return flushes[(int)reason]; }
+	const cpu_flush_heuristic& Heuristic() const { return *heuristic; }
+
+	void ResetStats()
+	{
+		for (auto& f : flushes)
+			f = 0u;
+	}
+
+private:
+	cpu_coalescing_state State() const
+	{
+		cpu_coalescing_state state;
+		state.pending_records = batch ? batch->count : 0u;
+		state.max_records = max_records;
+		state.producers_since_flush = producers_since_flush;
+		return state;
+	}
+
+	void Launch(cpu_flush_reason reason, std::vector<cpu_record_block*>& out_batches)
+	{
+		out_batches.push_back(batch);
+		batch = nullptr;
+		producers_since_flush = 0u;
+		flushes[(int)reason]++;
+	}
+
+	std::mutex mutex;
+	uint32_t max_records;
+	uint32_t stride;
+	const cpu_flush_heuristic* heuristic;
+	cpu_record_block* batch = nullptr;
+	uint32_t producers_since_flush = 0u;
+	uint64_t flushes[(int)cpu_flush_reason::count] = {};
+};
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_image.h"
+#include "cpu_thread_pool.h"
+#include "cpu_wave.h"
+
+//=================================================================================================================================
+// Separable Gaussian blur of a cpu_texture, the CPU baseline for filter nodes
+//
+// Two passes through a float4 intermediate, both spread over the thread pool:
+// - horizontal, one row at a time: the row is copied with its edges clamped into a per worker buffer radius texels wider on
+//   either side, so the kernel loop needs no bounds checks
+// - vertical, in column strips narrow enough that the 2 * radius + 1 intermediate rows an output row reads stay in L2 while
+//   the strip is walked down; work items are strip x band of rows, so narrow images still spread over every worker
+// Edges are clamped, like a CLAMP sampler. The AVX2 kernels hold two float4 texels per register and accumulate with FMA; like
+// the wave bodies they are compiled for AVX2 whatever the build targets and picked at runtime, with the scalar loops as the
+// fallback and the reference.
+//=================================================================================================================================
+struct cpu_gaussian_blur_options
+{
+	uint32_t radius = 8u;
+	float sigma = 0.0f;                    // <= 0: radius / 3, so the kernel ends at 3 sigma
+	cpu_wave_isa isa = cpu_wave_isa::avx2; // avx512 runs the AVX2 kernels
+	uint32_t l2_bytes = 256u * 1024u;      // budget for a strip's intermediate rows
+	uint32_t strip_width = 0u;             // texels; 0 sizes strips from l2_bytes, >= the width runs full rows
+	uint32_t band_height = 32u;            // rows per vertical work item
+};
+
+// 2 * radius + 1 weights summing to 1.
+inline void BuildGaussianKernel(uint32_t radius, float sigma, std::vector<float>& out_weights)
+{
+	if (sigma <= 0.0f)
+		sigma = std::max(radius / 3.0f, 0.5f);
+	out_weights.resize(2u * radius + 1u);
+	double sum = 0.0;
+	for (uint32_t k = 0; k < out_weights.size(); k++)
+	{
+		double d = (double)k - radius;
+		double w = std::exp(-d * d / (2.0 * sigma * sigma));
+		out_weights[k] = (float)w;
+		sum += w;
+	}
+	for (float& w : out_weights)
+		w = (float)(w / sum);
+}
+
+namespace cpu_gaussian_blur_detail
+{
+	inline void HorizontalScalar(const float4* padded, float4* out, uint32_t width, const float* weights, uint32_t taps)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			float4 acc = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (uint32_t k = 0; k < taps; k++)
+			{
+				const float4& t = padded[x + k];
+				acc.x += weights[k] * t.x;
+				acc.y += weights[k] * t.y;
+				acc.z += weights[k] * t.z;
+				acc.w += weights[k] * t.w;
+			}
+			out[x] = acc;
+		}
+	}
+
+	// rows[k] is the intermediate row for tap k, already offset to the strip.
+	inline void VerticalScalar(const float4* const* rows, float4* out, uint32_t count, const float* weights, uint32_t taps)
+	{
+		for (uint32_t x = 0; x < count; x++)
+		{
+			float4 acc = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (uint32_t k = 0; k < taps; k++)
+			{
+				const float4& t = rows[k][x];
+				acc.x += weights[k] * t.x;
+				acc.y += weights[k] * t.y;
+				acc.z += weights[k] * t.z;
+				acc.w += weights[k] * t.w;
+			}
+			out[x] = acc;
+		}
+	}
+
+#if defined(CPU_WAVE_X86)
+	// Eight texels per step in four accumulators, which covers the FMA latency, then two, then one.
+	CPU_WAVE_TARGET_AVX2 inline void HorizontalAvx2(const float4* padded, float4* out, uint32_t width, const float* weights, uint32_t taps)
+	{
+		const float* p = &padded->x;
+		float* o = &out->x;
+		uint32_t x = 0;
+		for (; x + 8u <= width; x += 8u)
+		{
+			__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps(), acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+			for (uint32_t k = 0; k < taps; k++)
+			{
+				const float* t = p + (x + k) * 4u;
+				__m256 w = _mm256_broadcast_ss(&weights[k]);
+				acc0 = _mm256_fmadd_ps(w, _mm256_loadu_ps(t), acc0);
+				acc1 = _mm256_fmadd_ps(w, _mm256_loadu_ps(t + 8u), acc1);
+				acc2 = _mm256_fmadd_ps(w, _mm256_loadu_ps(t + 16u), acc2);
+				acc3 = _mm256_fmadd_ps(w, _mm256_loadu_ps(t + 24u), acc3);
+			}
+			_mm256_storeu_ps(o + x * 4u, acc0);
+			_mm256_storeu_ps(o + x * 4u + 8u, acc1);
+			_mm256_storeu_ps(o + x * 4u + 16u, acc2);
+			_mm256_storeu_ps(o + x * 4u + 24u, acc3);
+		}
+		for (; x + 2u <= width; x += 2u)
+		{
+			__m256 acc = _mm256_setzero_ps();
+			for (uint32_t k = 0; k < taps; k++)
+				acc = _mm256_fmadd_ps(_mm256_broadcast_ss(&weights[k]), _mm256_loadu_ps(p + (x + k) * 4u), acc);
+			_mm256_storeu_ps(o + x * 4u, acc);
+		}
+		for (; x < width; x++)
+		{
+			__m128 acc = _mm_setzero_ps();
+			for (uint32_t k = 0; k < taps; k++)
+				acc = _mm_fmadd_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(p + (x + k) * 4u), acc);
+			_mm_storeu_ps(o + x * 4u, acc);
+		}
+	}
+
+	// Eight texels per step in four accumulators, then two, then one.
+	CPU_WAVE_TARGET_AVX2 inline void VerticalAvx2(const float4* const* rows, float4* out, uint32_t count, const float* weights, uint32_t taps)
+	{
+		float* o = &out->x;
+		uint32_t x = 0;
+		for (; x + 8u <= count; x += 8u)
+		{
+			__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps(), acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+			for (uint32_t k = 0; k < taps; k++)
+			{
+				const float* r = &rows[k][x].x;
+				__m256 w = _mm256_broadcast_ss(&weights[k]);
+				acc0 = _mm256_fmadd_ps(w, _mm256_loadu_ps(r), acc0);
+				acc1 = _mm256_fmadd_ps(w, _mm256_loadu_ps(r + 8u), acc1);
+				acc2 = _mm256_fmadd_ps(w, _mm256_loadu_ps(r + 16u), acc2);
+				acc3 = _mm256_fmadd_ps(w, _mm256_loadu_ps(r + 24u), acc3);
+			}
+			_mm256_storeu_ps(o + x * 4u, acc0);
+			_mm256_storeu_ps(o + x * 4u + 8u, acc1);
+			_mm256_storeu_ps(o + x * 4u + 16u, acc2);
+			_mm256_storeu_ps(o + x * 4u + 24u, acc3);
+		}
+		for (; x + 2u <= count; x += 2u)
+		{
+			__m256 acc = _mm256_setzero_ps();
+			for (uint32_t k = 0; k < taps; k++)
+				acc = _mm256_fmadd_ps(_mm256_broadcast_ss(&weights[k]), _mm256_loadu_ps(&rows[k][x].x), acc);
+			_mm256_storeu_ps(o + x * 4u, acc);
+		}
+		for (; x < count; x++)
+		{
+			__m128 acc = _mm_setzero_ps();
+			for (uint32_t k = 0; k < taps; k++)
+				acc = _mm_fmadd_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(&rows[k][x].x), acc);
+			_mm_storeu_ps(o + x * 4u, acc);
+		}
+	}
+#endif
+}
+
+// Keeps the kernel, the intermediate and per worker buffers between runs, so blurring same sized images doesn't allocate.
+class cpu_gaussian_blur
+{
+public:
+	// Blurs SRV into UAV, which is resized to match. pool must be the one every run uses.
+	void Run(cpu_thread_pool& pool, const cpu_texture& SRV, cpu_texture& UAV, const cpu_gaussian_blur_options& options)
+	{
+		using namespace cpu_gaussian_blur_detail;
+		const uint32_t width = SRV.width, height = SRV.height, radius = options.radius;
+		if (UAV.width != width || UAV.height != height)
+			UAV.Resize(width, height);
+		if (width == 0u || height == 0u)
+			return;
+		if (weights.size() != 2u * radius + 1u || sigma != options.sigma)
+		{
+			BuildGaussianKernel(radius, options.sigma, weights);
+			sigma = options.sigma;
+		}
+		if (intermediate.width != width || intermediate.height != height)
+			intermediate.Resize(width, height);
+		if (workers.size() < pool.Size())
+			workers.resize(pool.Size());
+		bool avx2 = options.isa != cpu_wave_isa::scalar && IsWaveIsaSupported(cpu_wave_isa::avx2);
+		const uint32_t taps = (uint32_t)weights.size();
+		const float* w = weights.data();
+
+		pool.ParallelFor(0u, height, 4u, [&](uint32_t begin, uint32_t end, uint32_t worker)
+		{
+			std::vector<float4>& padded = workers[worker].padded;
+			padded.resize((size_t)width + 2u * radius);
+			for (uint32_t y = begin; y < end; y++)
+			{
+				const float4* row = &SRV.texels[(size_t)y * width];
+				std::fill(padded.begin(), padded.begin() + radius, row[0]);
+				std::copy(row, row + width, padded.begin() + radius);
+				std::fill(padded.begin() + radius + width, padded.end(), row[width - 1u]);
+				float4* out = &intermediate.texels[(size_t)y * width];
+#if defined(CPU_WAVE_X86)
+				if (avx2)
+				{
+					HorizontalAvx2(padded.data(), out, width, w, taps);
+					continue;
+				}
+#endif
+				HorizontalScalar(padded.data(), out, width, w, taps);
+			}
+		});
+
+		strip = StripWidth(options, width);
+		const uint32_t strips = (width + strip - 1u) / strip;
+		const uint32_t band = std::max(1u, options.band_height);
+		const uint32_t bands = (height + band - 1u) / band;
+		pool.ParallelFor(0u, strips * bands, 1u, [&](uint32_t begin, uint32_t end, uint32_t worker)
+		{
+			std::vector<const float4*>& rows = workers[worker].rows;
+			rows.resize(taps);
+			for (uint32_t item = begin; item < end; item++)
+			{
+				uint32_t x0 = (item / bands) * strip, count = std::min(strip, width - x0);
+				uint32_t y0 = (item % bands) * band, y1 = std::min(height, y0 + band);
+				for (uint32_t y = y0; y < y1; y++)
+				{
+					for (uint32_t k = 0; k < taps; k++)
+					{
+						int32_t src = std::clamp((int32_t)(y + k) - (int32_t)radius, 0, (int32_t)height - 1);
+						rows[k] = &intermediate.texels[(size_t)src * width + x0];
+					}
+					float4* out = &UAV.texels[(size_t)y * width + x0];
+#if defined(CPU_WAVE_X86)
+					if (avx2)
+					{
+						VerticalAvx2(rows.data(), out, count, w, taps);
+						continue;
+					}
+#endif
+					VerticalScalar(rows.data(), out, count, w, taps);
+				}
+			}
+		});
+	}
+
+	// Of the last run.
+	uint32_t StripWidth() const { return strip; }
+
+	// 2 * radius + 2 rows of the strip (the taps plus the output row) in l2_bytes, a multiple of 8 texels.
+	static uint32_t StripWidth(const cpu_gaussian_blur_options& options, uint32_t width)
+	{
+		if (options.strip_width > 0u)
+			return std::min(options.strip_width, width);
+		uint32_t texels = options.l2_bytes / ((2u * options.radius + 2u) * (uint32_t)sizeof(float4));
+		return std::min(width, std::max(8u, texels & ~7u));
+	}
+
+private:
+	// Padded so workers don't share cache lines.
+	struct alignas(64) worker_state
+	{
+		std::vector<float4> padded;
+		std::vector<const float4*> rows;
+	};
+
+	std::vector<float> weights;
+	float sigma = 0.0f;
+	cpu_texture intermediate;
+	std::vector<worker_state> workers;
+	uint32_t strip = 0u;
+};
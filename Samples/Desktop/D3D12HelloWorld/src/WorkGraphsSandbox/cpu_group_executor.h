@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+//=================================================================================================================================
+// Thread group emulation for node bodies that use Barrier() and groupshared memory (needs C++20)
+//
+// The other CPU ports loop over a group's threads and split the loop by hand wherever the HLSL has a barrier. Here a node
+// body is written per thread, as in the HLSL, as a coroutine that co_awaits group.Barrier(). cpu_group_executor runs all
+// threads of a group on the calling worker: each thread runs until its next barrier (or its end), then the next thread does,
+// and once every thread that hasn't returned is waiting, they all resume. Threads that returned no longer take part.
+//
+// Because only one thread of the group runs at a time:
+// - groupshared variables are one struct per group, allocated from the worker's scratch memory and zero initialized
+// - InterlockedAdd() and friends on groupshared memory are plain read-modify-writes
+// - barriers without GROUP_SYNC are no-ops, only GROUP_SYNC needs co_await group.Barrier()
+// Coroutine frames come from the same per-worker scratch memory, which is reset after each group, so once warm a group
+// costs no heap allocations. Group wide calls such as GetGroupNodeOutputRecords() are made by one thread between barriers.
+//=================================================================================================================================
+class cpu_thread_group;
+
+// Bump allocator reused group after group; chunks are only freed with the executor.
+class cpu_group_scratch
+{
+public:
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+	{
+		for (;;)
+		{
+			// Chunks too small for what's left of this group are skipped until the next Reset().
+			for (; chunk < chunks.size(); chunk++, offset = 0u)
+			{
+				size_t at = (offset + alignment - 1u) & ~(alignment - 1u);
+				if (at + size <= chunks[chunk].size)
+				{
+					offset = at + size;
+					in_use += size;
+					peak = std::max(peak, in_use);
+					return chunks[chunk].data.get() + at;
+				}
+			}
+			size_t bytes = std::max<size_t>(64u * 1024u, size + alignment);
+			chunks.push_back({ std::unique_ptr<uint8_t[]>(new uint8_t[bytes]), bytes });
+			chunk = chunks.size() - 1u;
+			heap_allocations++;
+		}
+	}
+
+	void Reset()
+	{
+		chunk = 0u;
+		offset = 0u;
+		in_use = 0u;
+	}
+
+	size_t PeakBytes() const { return peak; }
+	uint64_t HeapAllocations() const { return heap_allocations; }
+
+private:
+	struct scratch_chunk
+	{
+		std::unique_ptr<uint8_t[]> data;
+		size_t size = 0u;
+	};
+	std::vector<scratch_chunk> chunks;
+	size_t chunk = 0u;
+	size_t offset = 0u;
+	size_t in_use = 0u;
+	size_t peak = 0u;
+	uint64_t heap_allocations = 0u;
+};
+
+// Return type of a thread body. The body's first parameter must be the cpu_thread_group, that's where its frame comes from.
+class cpu_group_thread
+{
+public:
+	struct promise_type;
+	using handle_type = std::coroutine_handle<promise_type>;
+
+	struct promise_type
+	{
+		template<typename... Args>
+		static void* operator new(size_t size, cpu_thread_group& group, Args&...);
+		static void operator delete(void*, size_t) {}
+
+		cpu_group_thread get_return_object() { return cpu_group_thread(handle_type::from_promise(*this)); }
+		// Created suspended, the executor starts the threads in order.
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::abort(); }
+	};
+
+	cpu_group_thread() = default;
+	cpu_group_thread(cpu_group_thread&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+	cpu_group_thread& operator=(cpu_group_thread&& other) noexcept
+	{
+		std::swap(handle, other.handle);
+		return *this;
+	}
+	cpu_group_thread(const cpu_group_thread&) = delete;
+	cpu_group_thread& operator=(const cpu_group_thread&) = delete;
+	~cpu_group_thread()
+	{
+		if (handle)
+			handle.destroy();
+	}
+
+private:
+	friend class cpu_group_executor;
+	explicit cpu_group_thread(handle_type handle) : handle(handle) {}
+	handle_type handle = nullptr;
+};
+
+// What a thread body sees of its group.
+class cpu_thread_group
+{
+public:
+	struct barrier_awaiter
+	{
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<>) const noexcept {}
+		void await_resume() const noexcept {}
+	};
+
+	uint32_t Size() const { return size; }
+
+	// Barrier(..., GROUP_SCOPE|GROUP_SYNC), use as co_await group.Barrier().
+	barrier_awaiter Barrier() { return {}; }
+
+	cpu_group_scratch& Scratch() { return *scratch; }
+
+private:
+	friend class cpu_group_executor;
+	cpu_group_scratch* scratch = nullptr;
+	uint32_t size = 0u;
+};
+
+template<typename... Args>
+inline void* cpu_group_thread::promise_type::operator new(size_t size, cpu_thread_group& group, Args&...)
+{
+	return group.Scratch().Allocate(size);
+}
+
+struct cpu_group_executor_stats
+{
+	uint64_t groups = 0u;
+	uint64_t threads = 0u;
+	uint64_t barriers = 0u; // group wide, one per co_await group.Barrier() of the group's threads
+	uint64_t resumes = 0u;
+	size_t peak_scratch_bytes = 0u;
+	uint64_t scratch_heap_allocations = 0u;
+};
+
+// One per node; Run() may be called concurrently for different workers.
+class cpu_group_executor
+{
+public:
+	explicit cpu_group_executor(uint32_t num_workers) : workers(num_workers) {}
+
+	// Runs body(group, shared, thread_index) for thread_index in [0, num_threads) as one group, with shared a zero
+	// initialized Shared that all threads of the group see.
+	template<typename Shared, typename Body>
+	void Run(uint32_t worker, uint32_t num_threads, Body&& body)
+	{
+		static_assert(std::is_trivially_destructible<Shared>::value, "groupshared data is dropped with the scratch memory");
+		worker_state& w = workers[worker];
+		cpu_thread_group group;
+		group.scratch = &w.scratch;
+		group.size = num_threads;
+		Shared* shared = new (w.scratch.Allocate(sizeof(Shared), alignof(Shared))) Shared();
+
+		w.threads.clear();
+		for (uint32_t t = 0; t < num_threads; t++)
+			w.threads.push_back(body(group, *shared, t));
+
+		// One pass per barrier phase; a thread that returned stays done.
+		uint32_t running = num_threads;
+		uint32_t phases = 0u;
+		while (running > 0u)
+		{
+			running = 0u;
+			for (cpu_group_thread& thread : w.threads)
+			{
+				if (thread.handle.done())
+					continue;
+				thread.handle.resume();
+				w.stats.resumes++;
+				running += thread.handle.done() ? 0u : 1u;
+			}
+			phases++;
+		}
+
+		w.threads.clear(); // destroys the frames before their memory is reused
+		w.scratch.Reset();
+		w.stats.groups++;
+		w.stats.threads += num_threads;
+		w.stats.barriers += phases - 1u;
+		w.stats.peak_scratch_bytes = std::max(w.stats.peak_scratch_bytes, w.scratch.PeakBytes());
+		w.stats.scratch_heap_allocations = w.scratch.HeapAllocations();
+	}
+
+	// Summed over workers; not while groups are running.
+	cpu_group_executor_stats Stats() const
+	{
+		cpu_group_executor_stats total;
+		for (const worker_state& w : workers)
+		{
+			total.groups += w.stats.groups;
+			total.threads += w.stats.threads;
+			total.barriers += w.stats.barriers;
+			total.resumes += w.stats.resumes;
+			total.peak_scratch_bytes = std::max(total.peak_scratch_bytes, w.stats.peak_scratch_bytes);
+			total.scratch_heap_allocations += w.stats.scratch_heap_allocations;
+		}
+		return total;
+	}
+
+private:
+	// Padded so workers don't share cache lines.
+	struct alignas(64) worker_state
+	{
+		cpu_group_scratch scratch;
+		std::vector<cpu_group_thread> threads;
+		cpu_group_executor_stats stats;
+	};
+	std::vector<worker_state> workers;
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "work_graph_records.h"
+
+//=================================================================================================================================
+// Order in which the groups of a broadcasting dispatch grid run on the CPU path
+//
+// The executor hands out groups as ranges of a linear index; by default that index is row major, so a worker's range is a
+// strip of rows. With Morton (Z-order) or Hilbert order the index walks a space filling curve instead, so a range, and the
+// groups that run close in time across workers, cover a compact 2D area, which keeps neighbouring SRV reads and UAV writes
+// in cache. Each z slice of the grid is walked separately.
+// - morton walks the enclosing power of two square in Z-order and skips groups outside the grid
+// - hilbert uses the generalized Hilbert curve, which works for any width and height; every step goes to an adjacent group,
+//   except for one diagonal step when exactly one of width and height is odd
+//=================================================================================================================================
+enum class cpu_group_order
+{
+	row_major,
+	morton,
+	hilbert,
+};
+
+inline const char* GroupOrderName(cpu_group_order order)
+{
+	switch (order)
+	{
+	case cpu_group_order::row_major: return "row-major";
+	case cpu_group_order::morton: return "Morton";
+	case cpu_group_order::hilbert: return "Hilbert";
+	}
+	return "?";
+}
+
+namespace cpu_group_order_detail
+{
+	inline void Morton(uint32_t x0, uint32_t y0, uint32_t size, uint32_t width, uint32_t height, uint32_t base, std::vector<uint32_t>& out)
+	{
+		if (x0 >= width || y0 >= height)
+			return;
+		if (size == 1u)
+		{
+			out.push_back(base + y0 * width + x0);
+			return;
+		}
+		uint32_t half = size / 2u;
+		Morton(x0, y0, half, width, height, base, out);
+		Morton(x0 + half, y0, half, width, height, base, out);
+		Morton(x0, y0 + half, half, width, height, base, out);
+		Morton(x0 + half, y0 + half, half, width, height, base, out);
+	}
+
+	inline int32_t Sign(int32_t v) { return (v > 0) - (v < 0); }
+	inline int32_t FloorHalf(int32_t v) { return v >= 0 ? v / 2 : -((-v + 1) / 2); }
+
+	// Generalized Hilbert curve over the rectangle spanned from (x, y) by the major axis a and the minor axis b.
+	inline void Hilbert(int32_t x, int32_t y, int32_t ax, int32_t ay, int32_t bx, int32_t by, uint32_t width, uint32_t base,
+		std::vector<uint32_t>& out)
+	{
+		int32_t w = std::abs(ax + ay), h = std::abs(bx + by);
+		int32_t dax = Sign(ax), day = Sign(ay), dbx = Sign(bx), dby = Sign(by);
+		if (h == 1)
+		{
+			for (int32_t i = 0; i < w; i++, x += dax, y += day)
+				out.push_back(base + (uint32_t)y * width + (uint32_t)x);
+			return;
+		}
+		if (w == 1)
+		{
+			for (int32_t i = 0; i < h; i++, x += dbx, y += dby)
+				out.push_back(base + (uint32_t)y * width + (uint32_t)x);
+			return;
+		}
+
+		int32_t ax2 = FloorHalf(ax), ay2 = FloorHalf(ay), bx2 = FloorHalf(bx), by2 = FloorHalf(by);
+		int32_t w2 = std::abs(ax2 + ay2), h2 = std::abs(bx2 + by2);
+		if (2 * w > 3 * h)
+		{
+			// Long rectangle: split along the major axis into two halves, keeping the first one even so the curve can continue.
+			if ((w2 & 1) && w > 2)
+			{
+				ax2 += dax;
+				ay2 += day;
+			}
+			Hilbert(x, y, ax2, ay2, bx, by, width, base, out);
+			Hilbert(x + ax2, y + ay2, ax - ax2, ay - ay2, bx, by, width, base, out);
+		}
+		else
+		{
+			// Up along the minor axis, across, and back down.
+			if ((h2 & 1) && h > 2)
+			{
+				bx2 += dbx;
+				by2 += dby;
+			}
+			Hilbert(x, y, bx2, by2, ax2, ay2, width, base, out);
+			Hilbert(x + bx2, y + by2, ax, ay, bx - bx2, by - by2, width, base, out);
+			Hilbert(x + (ax - dax) + (bx2 - dbx), y + (ay - day) + (by2 - dby), -bx2, -by2, -(ax - ax2), -(ay - ay2), width, base, out);
+		}
+	}
+}
+
+// out[i] = row-major index (x + y * grid.x + z * grid.x * grid.y) of the i-th group to run.
+inline void BuildGroupOrder(cpu_group_order order, uint3 grid, std::vector<uint32_t>& out)
+{
+	using namespace cpu_group_order_detail;
+	out.clear();
+	out.reserve((size_t)grid.x * grid.y * grid.z);
+	uint32_t side = 1u;
+	while (side < grid.x || side < grid.y)
+		side *= 2u;
+	for (uint32_t z = 0; z < grid.z; z++)
+	{
+		uint32_t base = z * grid.x * grid.y;
+		if (order == cpu_group_order::morton)
+			Morton(0u, 0u, side, grid.x, grid.y, base, out);
+		else if (order == cpu_group_order::hilbert && grid.x >= grid.y)
+			Hilbert(0, 0, (int32_t)grid.x, 0, 0, (int32_t)grid.y, grid.x, base, out);
+		else if (order == cpu_group_order::hilbert)
+			Hilbert(0, 0, 0, (int32_t)grid.y, (int32_t)grid.x, 0, grid.x, base, out);
+		else
+			for (uint32_t i = 0; i < grid.x * grid.y; i++)
+				out.push_back(base + i);
+	}
+}
+
+// Group orders built so far, one per order and grid size; entries live as long as the cache. Thread safe.
+class cpu_group_order_cache
+{
+public:
+	// nullptr for row_major, the executor's own order.
+	const uint32_t* Get(cpu_group_order order, uint3 grid)
+	{
+		if (order == cpu_group_order::row_major)
+			return nullptr;
+		// Consecutive records of a node mostly share their grid.
+		const entry* l = last.load(std::memory_order_acquire);
+		if (l && l->Matches(order, grid))
+			return l->groups.data();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const std::unique_ptr<entry>& e : entries)
+		{
+			if (e->Matches(order, grid))
+			{
+				last.store(e.get(), std::memory_order_release);
+				return e->groups.data();
+			}
+		}
+		entries.emplace_back(new entry());
+		entry& e = *entries.back();
+		e.order = order;
+		e.grid = grid;
+		BuildGroupOrder(order, grid, e.groups);
+		last.store(&e, std::memory_order_release);
+		return e.groups.data();
+	}
+
+private:
+	struct entry
+	{
+		cpu_group_order order = cpu_group_order::row_major;
+		uint3 grid = { 0u, 0u, 0u };
+		std::vector<uint32_t> groups;
+
+		bool Matches(cpu_group_order o, uint3 g) const { return order == o && grid.x == g.x && grid.y == g.y && grid.z == g.z; }
+	};
+
+	std::mutex mutex;
+	std::vector<std::unique_ptr<entry>> entries;
+	std::atomic<const entry*> last{ nullptr };
+};
@@ -0,0 +1,531 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_image.h"
+#include "cpu_thread_pool.h"
+#include "cpu_wave.h"
+
+//=================================================================================================================================
+// Guided filter of a cpu_texture (He, Sun and Tang), edge preserving smoothing at a cost independent of the radius
+//
+// In every (2r + 1)^2 window the output is modeled as a linear function of the guide I, q = a I + b, fitted to the input p by
+// least squares with a penalty eps on a:
+// - gray guide, I the luminance of the guide: a = cov(I, p) / (var(I) + eps), b = mean(p) - a mean(I), per RGB channel of p
+// - color guide, I the guide's RGB: a = (cov(I) + eps U)^-1 cov(I, p), a 3-vector per channel of p, b = mean(p) - a . mean(I)
+// and out = mean(a) . I + mean(b), the coefficients averaged over the windows that cover the pixel. Everything is box means:
+// of I, I I^T, p and I p in the first pass, of a and b in the second. Alpha is copied from p. Windows are truncated at the
+// edges and averaged over the texels inside.
+//
+// Box means are running sums, so a texel costs the same at any radius: per column, the sum of the quantities over the
+// window's rows, moved down a row by adding the row that enters and subtracting the one that leaves; along a row, the sum of
+// the column sums over the window, moved right the same way and summed again every c_guidedResumeColumns columns so float
+// rounding doesn't build up along wide rows. All the quantities of a pass are summed side by side, 8 (gray) or 24 (color)
+// floats per texel, 1 or 3 AVX2 registers per step. They are computed from the guide and input as rows enter and leave the
+// window, and each row's means go straight into the coefficients, so the mean and variance passes are fused and the only full
+// image intermediate is the coefficients, 8 or 16 floats per texel; the second pass applies its means to the guide as it
+// goes. Work items are bands of band_height rows whose column sums are primed from the r rows above them.
+//
+// With subsample s > 1 the guide and input are box averaged down by s, both passes run there with radius r / s, and the
+// averaged coefficients are bilinearly upsampled and applied to the full resolution guide (He and Sun, "Fast Guided Filter").
+//=================================================================================================================================
+enum class cpu_guided_guide
+{
+	gray,
+	color,
+};
+
+inline const char* GuidedGuideName(cpu_guided_guide guide)
+{
+	return guide == cpu_guided_guide::gray ? "gray" : "color";
+}
+
+struct cpu_guided_filter_options
+{
+	uint32_t radius = 8u;
+	float eps = 0.01f;                     // of the guide's variance in [0, 1] units, (0.1)^2: edges with less contrast are smoothed
+	cpu_guided_guide guide = cpu_guided_guide::color;
+	uint32_t subsample = 1u;               // coefficients at 1 / subsample resolution
+	cpu_wave_isa isa = cpu_wave_isa::avx2; // avx512 runs the AVX2 loops
+	uint32_t band_height = 64u;            // rows per work item
+};
+
+struct cpu_guided_filter_stats
+{
+	uint32_t coefficient_width = 0u; // the resolution the passes ran at
+	uint32_t coefficient_height = 0u;
+	uint32_t radius = 0u;            // there
+	uint64_t intermediate_bytes = 0u; // full image buffers between passes
+};
+
+// Columns between two sums of a row from scratch.
+static const uint32_t c_guidedResumeColumns = 256u;
+
+namespace cpu_guided_filter_detail
+{
+	// Floats per texel summed in the first and second pass.
+	template<cpu_guided_guide Guide> struct pass_sizes;
+	template<> struct pass_sizes<cpu_guided_guide::gray> { static const uint32_t quantities = 8u, coefficients = 8u; };
+	template<> struct pass_sizes<cpu_guided_guide::color> { static const uint32_t quantities = 24u, coefficients = 16u; };
+
+	inline float Luminance(const float4& c) { return 0.299f * c.x + 0.587f * c.y + 0.114f * c.z; }
+
+	// columns += entering - leaving, either may be null.
+	inline void MoveColumnsScalar(float* columns, const float* entering, const float* leaving, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			columns[i] += (entering ? entering[i] : 0.0f) - (leaving ? leaving[i] : 0.0f);
+	}
+
+	// Means of the window around each texel of a row from the column sums, K floats per texel.
+	template<uint32_t K>
+	inline void SweepRowScalar(const float* columns, uint32_t width, uint32_t r, float inv_rows, float* means)
+	{
+		float sum[K] = {};
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const uint32_t first = x > r ? x - r : 0u, last = std::min(x + r, width - 1u);
+			if (x % c_guidedResumeColumns == 0u)
+			{
+				std::fill(sum, sum + K, 0.0f);
+				for (uint32_t k = first; k <= last; k++)
+				{
+					for (uint32_t i = 0; i < K; i++)
+						sum[i] += columns[(size_t)k * K + i];
+				}
+			}
+			else
+			{
+				if (x + r < width)
+				{
+					for (uint32_t i = 0; i < K; i++)
+						sum[i] += columns[(size_t)(x + r) * K + i];
+				}
+				if (x > r)
+				{
+					for (uint32_t i = 0; i < K; i++)
+						sum[i] -= columns[(size_t)(x - r - 1u) * K + i];
+				}
+			}
+			float inv = inv_rows / (float)(last - first + 1u);
+			for (uint32_t i = 0; i < K; i++)
+				means[(size_t)x * K + i] = sum[i] * inv;
+		}
+	}
+
+#if defined(CPU_WAVE_X86)
+	CPU_WAVE_TARGET_AVX2 inline void MoveColumnsAvx2(float* columns, const float* entering, const float* leaving, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8u <= count; i += 8u)
+		{
+			__m256 c = _mm256_loadu_ps(columns + i);
+			if (entering)
+				c = _mm256_add_ps(c, _mm256_loadu_ps(entering + i));
+			if (leaving)
+				c = _mm256_sub_ps(c, _mm256_loadu_ps(leaving + i));
+			_mm256_storeu_ps(columns + i, c);
+		}
+		MoveColumnsScalar(columns + i, entering ? entering + i : nullptr, leaving ? leaving + i : nullptr, count - i);
+	}
+
+	// Same as SweepRowScalar(), the K sums in K / 8 registers.
+	template<uint32_t K>
+	CPU_WAVE_TARGET_AVX2 inline void SweepRowAvx2(const float* columns, uint32_t width, uint32_t r, float inv_rows, float* means)
+	{
+		const uint32_t registers = K / 8u;
+		__m256 sum[K / 8u];
+		for (uint32_t i = 0; i < registers; i++)
+			sum[i] = _mm256_setzero_ps();
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const uint32_t first = x > r ? x - r : 0u, last = std::min(x + r, width - 1u);
+			if (x % c_guidedResumeColumns == 0u)
+			{
+				for (uint32_t i = 0; i < registers; i++)
+					sum[i] = _mm256_setzero_ps();
+				for (uint32_t k = first; k <= last; k++)
+				{
+					for (uint32_t i = 0; i < registers; i++)
+						sum[i] = _mm256_add_ps(sum[i], _mm256_loadu_ps(columns + (size_t)k * K + i * 8u));
+				}
+			}
+			else
+			{
+				if (x + r < width)
+				{
+					for (uint32_t i = 0; i < registers; i++)
+						sum[i] = _mm256_add_ps(sum[i], _mm256_loadu_ps(columns + (size_t)(x + r) * K + i * 8u));
+				}
+				if (x > r)
+				{
+					for (uint32_t i = 0; i < registers; i++)
+						sum[i] = _mm256_sub_ps(sum[i], _mm256_loadu_ps(columns + (size_t)(x - r - 1u) * K + i * 8u));
+				}
+			}
+			const __m256 inv = _mm256_set1_ps(inv_rows / (float)(last - first + 1u));
+			for (uint32_t i = 0; i < registers; i++)
+				_mm256_storeu_ps(means + (size_t)x * K + i * 8u, _mm256_mul_ps(sum[i], inv));
+		}
+	}
+#endif
+
+	// Per worker rows of K floats per texel.
+	struct band_scratch
+	{
+		std::vector<float> columns;
+		std::vector<float> entering;
+		std::vector<float> leaving;
+		std::vector<float> means;
+	};
+
+	// Rows [y0, y1) of the box means of K quantities per texel of a width x height image: quantities(y, out) writes row y's,
+	// consume(y, means) takes each row's means.
+	template<uint32_t K, typename Quantities, typename Consume>
+	inline void BoxMeansBand(uint32_t width, uint32_t height, uint32_t r, uint32_t y0, uint32_t y1, bool avx2, band_scratch& scratch,
+		Quantities&& quantities, Consume&& consume)
+	{
+		const size_t count = (size_t)width * K;
+		scratch.columns.assign(count, 0.0f);
+		scratch.entering.resize(count);
+		scratch.leaving.resize(count);
+		scratch.means.resize(count);
+		auto move = [&](const float* entering, const float* leaving)
+		{
+#if defined(CPU_WAVE_X86)
+			if (avx2)
+			{
+				MoveColumnsAvx2(scratch.columns.data(), entering, leaving, count);
+				return;
+			}
+#endif
+			MoveColumnsScalar(scratch.columns.data(), entering, leaving, count);
+		};
+		for (uint32_t y = y0 > r ? y0 - r : 0u; y <= std::min(y0 + r, height - 1u); y++)
+		{
+			quantities(y, scratch.entering.data());
+			move(scratch.entering.data(), nullptr);
+		}
+		for (uint32_t y = y0; y < y1; y++)
+		{
+			if (y > y0)
+			{
+				const float* entering = nullptr;
+				const float* leaving = nullptr;
+				if (y + r < height)
+				{
+					quantities(y + r, scratch.entering.data());
+					entering = scratch.entering.data();
+				}
+				if (y > r)
+				{
+					quantities(y - r - 1u, scratch.leaving.data());
+					leaving = scratch.leaving.data();
+				}
+				move(entering, leaving);
+			}
+			const float inv_rows = 1.0f / (float)(std::min(y + r, height - 1u) - (y > r ? y - r : 0u) + 1u);
+#if defined(CPU_WAVE_X86)
+			if (avx2)
+				SweepRowAvx2<K>(scratch.columns.data(), width, r, inv_rows, scratch.means.data());
+			else
+#endif
+				SweepRowScalar<K>(scratch.columns.data(), width, r, inv_rows, scratch.means.data());
+			consume(y, (const float*)scratch.means.data());
+		}
+	}
+
+	// First pass quantities of a texel: I, I^2, p, I p.
+	inline void GrayQuantities(const float4& guide, const float4& input, float* q)
+	{
+		float i = Luminance(guide);
+		q[0] = i;
+		q[1] = i * i;
+		q[2] = input.x;
+		q[3] = input.y;
+		q[4] = input.z;
+		q[5] = i * input.x;
+		q[6] = i * input.y;
+		q[7] = i * input.z;
+	}
+
+	// From the means of GrayQuantities(), a per channel then b per channel.
+	inline void GrayCoefficients(const float* m, float eps, float* coefficients)
+	{
+		float var = m[1] - m[0] * m[0];
+		for (uint32_t c = 0; c < 3u; c++)
+		{
+			float a = (m[5 + c] - m[0] * m[2 + c]) / (var + eps);
+			coefficients[c] = a;
+			coefficients[3 + c] = m[2 + c] - a * m[0];
+		}
+		coefficients[6] = coefficients[7] = 0.0f;
+	}
+
+	inline float4 ApplyGray(const float* m, const float4& guide, const float4& input)
+	{
+		float i = Luminance(guide);
+		return float4{ m[0] * i + m[3], m[1] * i + m[4], m[2] * i + m[5], input.w };
+	}
+
+	// First pass quantities of a texel: I (3), the upper triangle of I I^T (rr rg rb gg gb bb), p (3), I_i p_c (3 x 3, i major).
+	inline void ColorQuantities(const float4& guide, const float4& input, float* q)
+	{
+		const float i[3] = { guide.x, guide.y, guide.z }, p[3] = { input.x, input.y, input.z };
+		q[0] = i[0];
+		q[1] = i[1];
+		q[2] = i[2];
+		q[3] = i[0] * i[0];
+		q[4] = i[0] * i[1];
+		q[5] = i[0] * i[2];
+		q[6] = i[1] * i[1];
+		q[7] = i[1] * i[2];
+		q[8] = i[2] * i[2];
+		q[9] = p[0];
+		q[10] = p[1];
+		q[11] = p[2];
+		for (uint32_t k = 0; k < 3u; k++)
+		{
+			for (uint32_t c = 0; c < 3u; c++)
+				q[12 + k * 3u + c] = i[k] * p[c];
+		}
+		q[21] = q[22] = q[23] = 0.0f;
+	}
+
+	// From the means of ColorQuantities(), a (3 per channel, channel major) then b per channel.
+	inline void ColorCoefficients(const float* m, float eps, float* coefficients)
+	{
+		const float mi[3] = { m[0], m[1], m[2] };
+		// cov(I) + eps U, symmetric, and its inverse by cofactors.
+		float rr = m[3] - mi[0] * mi[0] + eps, rg = m[4] - mi[0] * mi[1], rb = m[5] - mi[0] * mi[2];
+		float gg = m[6] - mi[1] * mi[1] + eps, gb = m[7] - mi[1] * mi[2], bb = m[8] - mi[2] * mi[2] + eps;
+		float c00 = gg * bb - gb * gb, c01 = rb * gb - rg * bb, c02 = rg * gb - rb * gg;
+		float c11 = rr * bb - rb * rb, c12 = rb * rg - rr * gb, c22 = rr * gg - rg * rg;
+		float inv_det = 1.0f / (rr * c00 + rg * c01 + rb * c02);
+		for (uint32_t c = 0; c < 3u; c++)
+		{
+			float mp = m[9 + c];
+			float v0 = m[12 + c] - mi[0] * mp, v1 = m[15 + c] - mi[1] * mp, v2 = m[18 + c] - mi[2] * mp;
+			float a0 = (c00 * v0 + c01 * v1 + c02 * v2) * inv_det;
+			float a1 = (c01 * v0 + c11 * v1 + c12 * v2) * inv_det;
+			float a2 = (c02 * v0 + c12 * v1 + c22 * v2) * inv_det;
+			coefficients[c * 3u] = a0;
+			coefficients[c * 3u + 1u] = a1;
+			coefficients[c * 3u + 2u] = a2;
+			coefficients[9 + c] = mp - (a0 * mi[0] + a1 * mi[1] + a2 * mi[2]);
+		}
+		std::fill(coefficients + 12, coefficients + 16, 0.0f);
+	}
+
+	inline float4 ApplyColor(const float* m, const float4& guide, const float4& input)
+	{
+		return float4{ m[0] * guide.x + m[1] * guide.y + m[2] * guide.z + m[9], m[3] * guide.x + m[4] * guide.y + m[5] * guide.z + m[10],
+			m[6] * guide.x + m[7] * guide.y + m[8] * guide.z + m[11], input.w };
+	}
+
+	// Box average of s x s blocks, the last ones truncated.
+	inline void Downsample(cpu_thread_pool& pool, const cpu_texture& SRV, uint32_t s, cpu_texture& out)
+	{
+		const uint32_t width = (SRV.width + s - 1u) / s, height = (SRV.height + s - 1u) / s;
+		if (out.width != width || out.height != height)
+			out.Resize(width, height);
+		pool.ParallelFor(0u, height, 8u, [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			for (uint32_t y = begin; y < end; y++)
+			{
+				const uint32_t sy0 = y * s, sy1 = std::min(sy0 + s, SRV.height);
+				for (uint32_t x = 0; x < width; x++)
+				{
+					const uint32_t sx0 = x * s, sx1 = std::min(sx0 + s, SRV.width);
+					float4 sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+					for (uint32_t sy = sy0; sy < sy1; sy++)
+					{
+						for (uint32_t sx = sx0; sx < sx1; sx++)
+						{
+							const float4& t = SRV.texels[(size_t)sy * SRV.width + sx];
+							sum.x += t.x;
+							sum.y += t.y;
+							sum.z += t.z;
+							sum.w += t.w;
+						}
+					}
+					float inv = 1.0f / (float)((sy1 - sy0) * (sx1 - sx0));
+					out.texels[(size_t)y * width + x] = float4{ sum.x * inv, sum.y * inv, sum.z * inv, sum.w * inv };
+				}
+			}
+		});
+	}
+}
+
+// Keeps the coefficients, low resolution copies and per worker rows between runs, so filtering same sized images doesn't
+// allocate.
+class cpu_guided_filter
+{
+public:
+	// Filters SRV into UAV guided by guide, all the same size; UAV is resized to match.
+	void Run(cpu_thread_pool& pool, const cpu_texture& guide, const cpu_texture& SRV, cpu_texture& UAV, const cpu_guided_filter_options& options)
+	{
+		if (options.guide == cpu_guided_guide::gray)
+			RunGuide<cpu_guided_guide::gray>(pool, guide, SRV, UAV, options);
+		else
+			RunGuide<cpu_guided_guide::color>(pool, guide, SRV, UAV, options);
+	}
+
+	// Self guided, the usual edge preserving smoothing.
+	void Run(cpu_thread_pool& pool, const cpu_texture& SRV, cpu_texture& UAV, const cpu_guided_filter_options& options)
+	{
+		Run(pool, SRV, SRV, UAV, options);
+	}
+
+	// Of the last run.
+	const cpu_guided_filter_stats& Stats() const { return stats; }
+
+private:
+	template<cpu_guided_guide Guide>
+	void RunGuide(cpu_thread_pool& pool, const cpu_texture& guide, const cpu_texture& SRV, cpu_texture& UAV, const cpu_guided_filter_options& options)
+	{
+		using namespace cpu_guided_filter_detail;
+		const uint32_t K1 = pass_sizes<Guide>::quantities, K2 = pass_sizes<Guide>::coefficients;
+		const uint32_t width = SRV.width, height = SRV.height;
+		if (UAV.width != width || UAV.height != height)
+			UAV.Resize(width, height);
+		stats = cpu_guided_filter_stats();
+		if (width == 0u || height == 0u)
+			return;
+		const uint32_t s = std::max(1u, options.subsample);
+		const cpu_texture* low_guide = &guide;
+		const cpu_texture* low_input = &SRV;
+		if (s > 1u)
+		{
+			Downsample(pool, SRV, s, input_low);
+			if (&guide != &SRV)
+				Downsample(pool, guide, s, guide_low);
+			low_input = &input_low;
+			low_guide = &guide != &SRV ? &guide_low : &input_low;
+			stats.intermediate_bytes += (uint64_t)(&guide != &SRV ? 2u : 1u) * input_low.texels.size() * sizeof(float4);
+		}
+		const uint32_t w = low_input->width, h = low_input->height;
+		const uint32_t r = s > 1u ? std::max(1u, (options.radius + s / 2u) / s) : options.radius;
+		stats.coefficient_width = w;
+		stats.coefficient_height = h;
+		stats.radius = r;
+		const float eps = options.eps;
+		const uint32_t band = std::max(1u, options.band_height), bands = (h + band - 1u) / band;
+		if (scratch.size() < pool.Size())
+			scratch.resize(pool.Size());
+		bool avx2 = options.isa != cpu_wave_isa::scalar && IsWaveIsaSupported(cpu_wave_isa::avx2);
+
+		// Pass 1: the box means of the quantities straight into the coefficients.
+		coefficients.resize((size_t)w * h * K2);
+		stats.intermediate_bytes += coefficients.size() * sizeof(float);
+		pool.ParallelFor(0u, bands, 1u, [&](uint32_t begin, uint32_t end, uint32_t worker)
+		{
+			for (uint32_t b = begin; b < end; b++)
+			{
+				BoxMeansBand<K1>(w, h, r, b * band, std::min(h, (b + 1u) * band), avx2, scratch[worker].value,
+					[&](uint32_t y, float* out)
+					{
+						const float4* g = &low_guide->texels[(size_t)y * w];
+						const float4* p = &low_input->texels[(size_t)y * w];
+						for (uint32_t x = 0; x < w; x++)
+						{
+							if (Guide == cpu_guided_guide::gray)
+								GrayQuantities(g[x], p[x], out + (size_t)x * K1);
+							else
+								ColorQuantities(g[x], p[x], out + (size_t)x * K1);
+						}
+					},
+					[&](uint32_t y, const float* means)
+					{
+						float* out = &coefficients[(size_t)y * w * K2];
+						for (uint32_t x = 0; x < w; x++)
+						{
+							if (Guide == cpu_guided_guide::gray)
+								GrayCoefficients(means + (size_t)x * K1, eps, out + (size_t)x * K2);
+							else
+								ColorCoefficients(means + (size_t)x * K1, eps, out + (size_t)x * K2);
+						}
+					});
+			}
+		});
+
+		// Pass 2: the box means of the coefficients, applied to the guide, or kept for upsampling.
+		if (s > 1u)
+		{
+			mean_coefficients.resize(coefficients.size());
+			stats.intermediate_bytes += mean_coefficients.size() * sizeof(float);
+		}
+		pool.ParallelFor(0u, bands, 1u, [&](uint32_t begin, uint32_t end, uint32_t worker)
+		{
+			for (uint32_t b = begin; b < end; b++)
+			{
+				BoxMeansBand<K2>(w, h, r, b * band, std::min(h, (b + 1u) * band), avx2, scratch[worker].value,
+					[&](uint32_t y, float* out) { std::copy_n(&coefficients[(size_t)y * w * K2], (size_t)w * K2, out); },
+					[&](uint32_t y, const float* means)
+					{
+						if (s > 1u)
+						{
+							std::copy_n(means, (size_t)w * K2, &mean_coefficients[(size_t)y * w * K2]);
+							return;
+						}
+						const float4* g = &guide.texels[(size_t)y * width];
+						const float4* p = &SRV.texels[(size_t)y * width];
+						float4* out = &UAV.texels[(size_t)y * width];
+						for (uint32_t x = 0; x < width; x++)
+							out[x] = Guide == cpu_guided_guide::gray ? ApplyGray(means + (size_t)x * K2, g[x], p[x]) : ApplyColor(means + (size_t)x * K2, g[x], p[x]);
+					});
+			}
+		});
+		if (s == 1u)
+			return;
+
+		// Bilinear upsampling of the mean coefficients, low resolution texel centers at (x + 0.5) s: per row the two low
+		// resolution rows are blended once, then each texel blends two of those.
+		pool.ParallelFor(0u, height, 8u, [&](uint32_t begin, uint32_t end, uint32_t worker)
+		{
+			std::vector<float>& blended = scratch[worker].value.entering;
+			blended.resize((size_t)w * K2);
+			float m[K2];
+			for (uint32_t y = begin; y < end; y++)
+			{
+				float fy = std::clamp(((float)y + 0.5f) / (float)s - 0.5f, 0.0f, (float)(h - 1u));
+				uint32_t y0 = std::min((uint32_t)fy, h - 1u), y1 = std::min(y0 + 1u, h - 1u);
+				float ty = fy - (float)y0;
+				const float* top = &mean_coefficients[(size_t)y0 * w * K2];
+				const float* bottom = &mean_coefficients[(size_t)y1 * w * K2];
+				for (size_t i = 0; i < (size_t)w * K2; i++)
+					blended[i] = top[i] + (bottom[i] - top[i]) * ty;
+				const float4* g = &guide.texels[(size_t)y * width];
+				const float4* p = &SRV.texels[(size_t)y * width];
+				float4* out = &UAV.texels[(size_t)y * width];
+				for (uint32_t x = 0; x < width; x++)
+				{
+					float fx = std::clamp(((float)x + 0.5f) / (float)s - 0.5f, 0.0f, (float)(w - 1u));
+					uint32_t x0 = std::min((uint32_t)fx, w - 1u), x1 = std::min(x0 + 1u, w - 1u);
+					float tx = fx - (float)x0;
+					const float* left = &blended[(size_t)x0 * K2];
+					const float* right = &blended[(size_t)x1 * K2];
+					for (uint32_t i = 0; i < K2; i++)
+						m[i] = left[i] + (right[i] - left[i]) * tx;
+					out[x] = Guide == cpu_guided_guide::gray ? ApplyGray(m, g[x], p[x]) : ApplyColor(m, g[x], p[x]);
+				}
+			}
+		});
+	}
+
+	// Padded so workers don't share cache lines.
+	struct alignas(64) worker_scratch
+	{
+		cpu_guided_filter_detail::band_scratch value;
+	};
+
+	std::vector<float> coefficients;
+	std::vector<float> mean_coefficients;
+	cpu_texture input_low;
+	cpu_texture guide_low;
+	std::vector<worker_scratch> scratch;
+	cpu_guided_filter_stats stats;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image/stb_image.h"
+#endif
+
+#include "work_graph_records.h"
+
+//=================================================================================================================================
+// CPU side image containers.
+// cpu_image_rgba8 is what stbi_load_from_memory returns (4 channels, tightly packed rows).
+// cpu_texture stands in for a Texture2D<float4> / RWTexture2D<float4> with the same out of bounds rules as D3D:
+// loads outside the texture return 0 and stores outside the texture are dropped.
+//=================================================================================================================================
+struct cpu_image_rgba8
+{
+	uint32_t width = 0u;
+	uint32_t height = 0u;
+	std::vector<uint8_t> pixels;
+
+	uint8_t* Row(uint32_t y) { return pixels.data() + (size_t)y * width * 4u; }
+	const uint8_t* Row(uint32_t y) const { return pixels.data() + (size_t)y * width * 4u; }
+};
+
+struct cpu_texture
+{
+	uint32_t width = 0u;
+	uint32_t height = 0u;
+	std::vector<float4> texels;
+
+	void Resize(uint32_t w, uint32_t h)
+	{
+		width = w;
+		height = h;
+		texels.assign((size_t)w * h, float4{ 0.0f, 0.0f, 0.0f, 0.0f });
+	}
+
+	void Clear(float4 value)
+	{
+		std::fill(texels.begin(), texels.end(), value);
+	}
+
+	float4 Load(uint2 i) const
+	{
+		if (i.x >= width || i.y >= height)
+			return float4{ 0.0f, 0.0f, 0.0f, 0.0f };
+		return texels[(size_t)i.y * width + i.x];
+	}
+
+	void Store(uint2 i, float4 value)
+	{
+		if (i.x < width && i.y < height)
+			texels[(size_t)i.y * width + i.x] = value;
+	}
+};
+
+// Stands in for ResourceDescriptorHeap: nodes reach textures through the index they find in their records. SRVs and UAVs
+// of a texture share its one entry, the D3D12 app gives them separate descriptors.
+struct cpu_descriptor_heap
+{
+	std::vector<cpu_texture*> textures;
+
+	uint32_t Add(cpu_texture& texture)
+	{
+		textures.push_back(&texture);
+		return (uint32_t)textures.size() - 1u;
+	}
+
+	cpu_texture& operator[](uint32_t index) const { return *textures[index]; }
+};
+
+//=================================================================================================================================
+inline bool LoadImageFromMemory(const void* data, size_t data_size, cpu_image_rgba8& out_image)
+{
+	int image_width = 0;
+	int image_height = 0;
+	unsigned char* image_data = stbi_load_from_memory((const unsigned char*)data, (int)data_size, &image_width, &image_height, NULL, 4);
+	if (image_data == NULL)
+		return false;
+	out_image.width = (uint32_t)image_width;
+	out_image.height = (uint32_t)image_height;
+	out_image.pixels.assign(image_data, image_data + (size_t)image_width * image_height * 4u);
+	stbi_image_free(image_data);
+	return true;
+}
+
+inline bool LoadImageFromFile(const char* file_name, cpu_image_rgba8& out_image)
+{
+	FILE* f = fopen(file_name, "rb");
+	if (f == NULL)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long file_size = ftell(f);
+	if (file_size <= 0)
+	{
+		fclose(f);
+		return false;
+	}
+	fseek(f, 0, SEEK_SET);
+	std::vector<uint8_t> file_data((size_t)file_size);
+	size_t read = fread(file_data.data(), 1, file_data.size(), f);
+	fclose(f);
+	if (read != file_data.size())
+		return false;
+	return LoadImageFromMemory(file_data.data(), file_data.size(), out_image);
+}
+
+// Same conversion the sampler does for DXGI_FORMAT_R8G8B8A8_UNORM.
+inline void MakeTextureFromImage(const cpu_image_rgba8& image, cpu_texture& out_texture)
+{
+	out_texture.Resize(image.width, image.height);
+	const float scale = 1.0f / 255.0f;
+	for (size_t i = 0; i < out_texture.texels.size(); i++)
+	{
+		const uint8_t* p = &image.pixels[i * 4u];
+		out_texture.texels[i] = float4{ p[0] * scale, p[1] * scale, p[2] * scale, p[3] * scale };
+	}
+}
+
+// Returns the largest absolute per-channel difference, or INFINITY if the sizes differ.
+inline float CompareTextures(const cpu_texture& a, const cpu_texture& b)
+{
+	if (a.width != b.width || a.height != b.height)
+		return INFINITY;
+	float max_diff = 0.0f;
+	for (size_t i = 0; i < a.texels.size(); i++)
+	{
+		const float4& x = a.texels[i];
+		const float4& y = b.texels[i];
+		max_diff = std::fmax(max_diff, std::fabs(x.x - y.x));
+		max_diff = std::fmax(max_diff, std::fabs(x.y - y.y));
+		max_diff = std::fmax(max_diff, std::fabs(x.z - y.z));
+		max_diff = std::fmax(max_diff, std::fabs(x.w - y.w));
+	}
+	return max_diff;
+}
+
+// PSNR in dB over the RGB channels with a peak value of 1, INFINITY for identical textures.
+inline double ComputePSNR(const cpu_texture& a, const cpu_texture& b)
+{
+	if (a.width != b.width || a.height != b.height || a.texels.empty())
+		return 0.0;
+	double sum = 0.0;
+	for (size_t i = 0; i < a.texels.size(); i++)
+	{
+		const float4& x = a.texels[i];
+		const float4& y = b.texels[i];
+		double dx = x.x - y.x, dy = x.y - y.y, dz = x.z - y.z;
+		sum += dx * dx + dy * dy + dz * dz;
+	}
+	double mse = sum / (3.0 * (double)a.texels.size());
+	return mse > 0.0 ? 10.0 * std::log10(1.0 / mse) : INFINITY;
+}
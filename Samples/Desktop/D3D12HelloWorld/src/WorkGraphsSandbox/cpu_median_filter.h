@@ -0,0 +1,362 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "cpu_image.h"
+#include "cpu_thread_pool.h"
+#include "cpu_wave.h"
+
+//=================================================================================================================================
+// Constant time median filter of 8-bit RGBA images (Perreault and Hebert, "Median Filtering in Constant Time")
+//
+// The median of the (2r + 1)^2 window of each channel is read from a histogram of the window instead of sorting it, and the
+// histogram is kept up to date instead of rebuilt:
+// - a column histogram per column and channel counts the 2r + 1 texels above and below the current row; moving down a row
+//   takes one texel out and puts one in
+// - the window histogram along a row is the sum of 2r + 1 column histograms; moving right adds the column entering on the
+//   right and subtracts the one leaving on the left
+// so a texel costs the same at any radius. Histograms are two level, 16 coarse bins of 16 fine ones each: the coarse level is
+// updated at every step and picks the bin the median is in, and a fine bin is only brought up to date when the median lands
+// in it, from where it was last updated or from the columns if that is further than the window is wide. Both levels are
+// 16 uint16_t counts, one AVX2 register, so adding and subtracting histograms is one instruction each, and the AVX2 loops
+// find the median's bin from a compare of the running counts instead of a loop that stops at an unpredictable bin.
+//
+// A column histogram is moved down a row as it enters the window, so a row of histograms is walked once per row. That walk is
+// 2176 bytes per column, more than L2 holds for a whole row of a large image, so work items are tiles: a strip of columns,
+// sized so its histograms fit l2_bytes, by a band of rows. A tile primes its column histograms from the 2r rows around its
+// first row and keeps r columns of histograms past either side; this overlap with its neighbours is what makes tiles
+// independent, and it is what spreading over workers and fitting L2 cost. Edges are clamped, like a CLAMP sampler, so every
+// window holds (2r + 1)^2 texels.
+//=================================================================================================================================
+// Counts go up to (2r + 1)^2, which must fit a uint16_t.
+static const uint32_t c_medianMaxRadius = 127u;
+
+struct cpu_median_filter_options
+{
+	uint32_t radius = 2u;                  // clamped to c_medianMaxRadius
+	cpu_wave_isa isa = cpu_wave_isa::avx2; // avx512 runs the AVX2 loops
+	uint32_t l2_bytes = 512u * 1024u;      // budget for a tile's column histograms
+	uint32_t strip_width = 0u;             // texels per tile; 0 sizes strips from l2_bytes
+	uint32_t band_height = 0u;             // rows per tile; 0 picks about 4 tiles per worker, at least 4 windows high
+};
+
+struct cpu_median_filter_stats
+{
+	uint32_t tiles = 0u;
+	uint32_t strip_width = 0u;
+	uint32_t band_height = 0u;
+	uint64_t overlap_texels = 0u; // column texels counted outside their tile to prime and widen the histograms
+};
+
+namespace cpu_median_filter_detail
+{
+	static const uint32_t c_coarseBins = 16u;
+	static const uint32_t c_fineBins = 256u;
+	// uint16_t counts per column histogram, coarse then fine.
+	static const uint32_t c_columnHistogramSize = c_coarseBins + c_fineBins;
+
+	// The window histogram of one channel along a row.
+	struct alignas(32) window_histogram
+	{
+		uint16_t coarse[c_coarseBins];
+		uint16_t fine[c_fineBins];
+		int32_t updated[c_coarseBins]; // x each fine bin was last brought up to date at
+	};
+
+	// The column histograms of a tile, 4 channels per column, for image columns [first, last).
+	struct tile_columns
+	{
+		uint32_t width = 0u; // of the image
+		uint32_t first = 0u;
+		uint32_t last = 0u;
+		uint16_t* counts = nullptr;
+
+		// Clamped to the image, like the windows.
+		uint16_t* Column(int32_t x, uint32_t channel) const
+		{
+			x = std::clamp(x, 0, (int32_t)width - 1);
+			return counts + ((size_t)(x - (int32_t)first) * 4u + channel) * c_columnHistogramSize;
+		}
+	};
+
+	inline void AddRow(const tile_columns& columns, const uint8_t* row)
+	{
+		for (uint32_t x = columns.first; x < columns.last; x++)
+		{
+			for (uint32_t c = 0; c < 4u; c++)
+			{
+				uint8_t v = row[x * 4u + c];
+				uint16_t* h = columns.Column((int32_t)x, c);
+				h[v >> 4]++;
+				h[c_coarseBins + v]++;
+			}
+		}
+	}
+
+	// Column x one row down: its texel of row leaving goes, the one of row entering comes in.
+	inline void MoveColumn(const tile_columns& columns, uint32_t x, const uint8_t* leaving, const uint8_t* entering)
+	{
+		for (uint32_t c = 0; c < 4u; c++)
+		{
+			uint8_t o = leaving[x * 4u + c], i = entering[x * 4u + c];
+			uint16_t* h = columns.Column((int32_t)x, c);
+			h[o >> 4]--;
+			h[c_coarseBins + o]--;
+			h[i >> 4]++;
+			h[c_coarseBins + i]++;
+		}
+	}
+
+	// Index of the bin the rank'th count falls in, with rank made relative to that bin.
+	inline uint32_t FindRank(const uint16_t* counts, uint32_t& rank)
+	{
+		uint32_t i = 0;
+		while (counts[i] <= rank)
+			rank -= counts[i++];
+		return i;
+	}
+
+	// 16 counts: out = out + add - sub.
+	inline void MoveSegmentScalar(uint16_t* out, const uint16_t* add, const uint16_t* sub)
+	{
+		for (uint32_t i = 0; i < 16u; i++)
+			out[i] = (uint16_t)(out[i] + add[i] - sub[i]);
+	}
+
+	inline void AddSegmentScalar(uint16_t* out, const uint16_t* add)
+	{
+		for (uint32_t i = 0; i < 16u; i++)
+			out[i] = (uint16_t)(out[i] + add[i]);
+	}
+
+	// Moves the columns of the window at x0 down a row, unless leaving is null (the tile's first row, primed by AddRow()), and
+	// returns the next column to move: the row functions move each column as it enters the window, so a row of histograms is
+	// walked once.
+	inline uint32_t ColumnsBefore(const tile_columns& columns, uint32_t r, uint32_t x0, const uint8_t* leaving, const uint8_t* entering)
+	{
+		uint32_t next = std::min(x0 + r + 1u, columns.last);
+		if (leaving)
+		{
+			for (uint32_t x = columns.first; x < next; x++)
+				MoveColumn(columns, x, leaving, entering);
+		}
+		return next;
+	}
+
+	// Medians of texels [x0, x1) of a row of every channel into out. A column histogram holds the coarse counts first, then the 16 fine counts of
+	// coarse bin b at c_coarseBins + 16 b; the window's fine counts of the bin the median is in are moved along from where they
+	// were last updated, or summed again from the columns when that would take more steps.
+	inline void FilterRowScalar(const tile_columns& columns, uint32_t r, uint32_t x0, uint32_t x1, const uint8_t* leaving, const uint8_t* entering,
+		window_histogram* windows, uint8_t* out)
+	{
+		const int32_t radius = (int32_t)r, diameter = 2 * radius + 1;
+		const uint32_t median = (uint32_t)(diameter * diameter) / 2u;
+		uint32_t next = ColumnsBefore(columns, r, x0, leaving, entering);
+		for (uint32_t c = 0; c < 4u; c++)
+		{
+			window_histogram& w = windows[c];
+			memset(w.coarse, 0, sizeof(w.coarse));
+			for (int32_t k = -radius; k <= radius; k++)
+				AddSegmentScalar(w.coarse, columns.Column((int32_t)x0 + k, c));
+			std::fill(std::begin(w.updated), std::end(w.updated), (int32_t)x0 - diameter - 1);
+		}
+		for (int32_t x = (int32_t)x0; x < (int32_t)x1; x++)
+		{
+			if (leaving && x > (int32_t)x0 && next < columns.last)
+				MoveColumn(columns, next++, leaving, entering);
+			for (uint32_t c = 0; c < 4u; c++)
+			{
+				window_histogram& w = windows[c];
+				if (x > (int32_t)x0)
+					MoveSegmentScalar(w.coarse, columns.Column(x + radius, c), columns.Column(x - radius - 1, c));
+				uint32_t rank = median;
+				uint32_t b = FindRank(w.coarse, rank);
+				uint16_t* fine = w.fine + b * 16u;
+				const uint32_t offset = c_coarseBins + b * 16u;
+				if (2 * (x - w.updated[b]) > diameter)
+				{
+					memset(fine, 0, 16u * sizeof(uint16_t));
+					for (int32_t k = -radius; k <= radius; k++)
+						AddSegmentScalar(fine, columns.Column(x + k, c) + offset);
+				}
+				else
+				{
+					for (int32_t j = w.updated[b] + 1; j <= x; j++)
+						MoveSegmentScalar(fine, columns.Column(j + radius, c) + offset, columns.Column(j - radius - 1, c) + offset);
+				}
+				w.updated[b] = x;
+				out[x * 4u + c] = (uint8_t)(b * 16u + FindRank(fine, rank));
+			}
+		}
+	}
+
+#if defined(CPU_WAVE_X86)
+	CPU_WAVE_TARGET_AVX2 inline __m256i MoveSegmentAvx2(__m256i counts, const uint16_t* add, const uint16_t* sub)
+	{
+		return _mm256_add_epi16(counts, _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)add), _mm256_loadu_si256((const __m256i*)sub)));
+	}
+
+	// FindRank() on 16 counts without branches: their running sums are compared with rank, and the bin is the count of sums
+	// that don't exceed it. Counts and sums fit uint16_t, hence the unsigned compare through max.
+	CPU_WAVE_TARGET_AVX2 inline uint32_t FindRankAvx2(__m256i counts, uint32_t& rank)
+	{
+		__m256i sums = _mm256_add_epi16(counts, _mm256_slli_si256(counts, 2));
+		sums = _mm256_add_epi16(sums, _mm256_slli_si256(sums, 4));
+		sums = _mm256_add_epi16(sums, _mm256_slli_si256(sums, 8));
+		__m256i low_total = _mm256_permute2x128_si256(sums, sums, 0x08); // low half's sums in the high half, 0 in the low half
+		low_total = _mm256_unpackhi_epi64(_mm256_shufflehi_epi16(low_total, 0xff), _mm256_shufflehi_epi16(low_total, 0xff));
+		sums = _mm256_add_epi16(sums, low_total);
+		const __m256i r = _mm256_set1_epi16((short)rank);
+		uint32_t below = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_max_epu16(sums, r), r));
+		uint32_t bin = (uint32_t)std::countr_one(below) / 2u;
+		if (bin > 0u)
+		{
+			alignas(32) uint16_t stored[16];
+			_mm256_store_si256((__m256i*)stored, sums);
+			rank -= stored[bin - 1u];
+		}
+		return bin;
+	}
+
+	// Same as FilterRowScalar(), the segments moved and summed in registers.
+	CPU_WAVE_TARGET_AVX2 inline void FilterRowAvx2(const tile_columns& columns, uint32_t r, uint32_t x0, uint32_t x1, const uint8_t* leaving,
+		const uint8_t* entering, window_histogram* windows, uint8_t* out)
+	{
+		const int32_t radius = (int32_t)r, diameter = 2 * radius + 1;
+		const uint32_t median = (uint32_t)(diameter * diameter) / 2u;
+		uint32_t next = ColumnsBefore(columns, r, x0, leaving, entering);
+		for (uint32_t c = 0; c < 4u; c++)
+		{
+			window_histogram& w = windows[c];
+			__m256i coarse = _mm256_setzero_si256();
+			for (int32_t k = -radius; k <= radius; k++)
+				coarse = _mm256_add_epi16(coarse, _mm256_loadu_si256((const __m256i*)columns.Column((int32_t)x0 + k, c)));
+			_mm256_store_si256((__m256i*)w.coarse, coarse);
+			std::fill(std::begin(w.updated), std::end(w.updated), (int32_t)x0 - diameter - 1);
+		}
+		for (int32_t x = (int32_t)x0; x < (int32_t)x1; x++)
+		{
+			if (leaving && x > (int32_t)x0 && next < columns.last)
+				MoveColumn(columns, next++, leaving, entering);
+			for (uint32_t c = 0; c < 4u; c++)
+			{
+				window_histogram& w = windows[c];
+				if (x > (int32_t)x0)
+					_mm256_store_si256((__m256i*)w.coarse, MoveSegmentAvx2(_mm256_load_si256((const __m256i*)w.coarse),
+						columns.Column(x + radius, c), columns.Column(x - radius - 1, c)));
+				uint32_t rank = median;
+				uint32_t b = FindRankAvx2(_mm256_load_si256((const __m256i*)w.coarse), rank);
+				uint16_t* fine = w.fine + b * 16u;
+				const uint32_t offset = c_coarseBins + b * 16u;
+				__m256i segment;
+				if (2 * (x - w.updated[b]) > diameter)
+				{
+					segment = _mm256_setzero_si256();
+					for (int32_t k = -radius; k <= radius; k++)
+						segment = _mm256_add_epi16(segment, _mm256_loadu_si256((const __m256i*)(columns.Column(x + k, c) + offset)));
+				}
+				else
+				{
+					segment = _mm256_load_si256((const __m256i*)fine);
+					for (int32_t j = w.updated[b] + 1; j <= x; j++)
+						segment = MoveSegmentAvx2(segment, columns.Column(j + radius, c) + offset, columns.Column(j - radius - 1, c) + offset);
+				}
+				_mm256_store_si256((__m256i*)fine, segment);
+				w.updated[b] = x;
+				out[x * 4u + c] = (uint8_t)(b * 16u + FindRankAvx2(segment, rank));
+			}
+		}
+	}
+#endif
+}
+
+// Keeps the per worker histograms between runs, so filtering same sized images doesn't allocate.
+class cpu_median_filter
+{
+public:
+	// Filters SRV into UAV, which is resized to match.
+	void Run(cpu_thread_pool& pool, const cpu_image_rgba8& SRV, cpu_image_rgba8& UAV, const cpu_median_filter_options& options)
+	{
+		using namespace cpu_median_filter_detail;
+		const uint32_t width = SRV.width, height = SRV.height, r = std::min(options.radius, c_medianMaxRadius);
+		UAV.width = width;
+		UAV.height = height;
+		UAV.pixels.resize(SRV.pixels.size());
+		stats = cpu_median_filter_stats();
+		if (width == 0u || height == 0u)
+			return;
+		const uint32_t column_bytes = 4u * c_columnHistogramSize * sizeof(uint16_t);
+		// The budget covers the r columns past either side of the strip too.
+		uint32_t strip = options.l2_bytes / column_bytes;
+		strip = std::max(strip > 2u * r ? strip - 2u * r : 0u, std::max(16u, 2u * r));
+		strip = std::min(options.strip_width > 0u ? options.strip_width : strip, width);
+		const uint32_t strips = (width + strip - 1u) / strip;
+		const uint32_t tiles_per_band_goal = (4u * pool.Size() + strips - 1u) / strips;
+		uint32_t band = options.band_height > 0u ? options.band_height :
+			std::max(4u * (2u * r + 1u), (height + tiles_per_band_goal - 1u) / tiles_per_band_goal);
+		band = std::min(band, height);
+		const uint32_t bands = (height + band - 1u) / band;
+		stats.strip_width = strip;
+		stats.band_height = band;
+		stats.tiles = strips * bands;
+		if (workers.size() < pool.Size())
+			workers.resize(pool.Size());
+		const size_t histogram_count = (size_t)std::min(strip + 2u * r, width) * 4u * c_columnHistogramSize;
+		bool avx2 = options.isa != cpu_wave_isa::scalar && IsWaveIsaSupported(cpu_wave_isa::avx2);
+		auto clamp_row = [&](int32_t y) { return SRV.Row((uint32_t)std::clamp(y, 0, (int32_t)height - 1)); };
+
+		pool.ParallelFor(0u, stats.tiles, 1u, [&](uint32_t begin, uint32_t end, uint32_t worker)
+		{
+			worker_state& state = workers[worker];
+			if (state.counts.size() < histogram_count)
+				state.counts.resize(histogram_count);
+			for (uint32_t tile = begin; tile < end; tile++)
+			{
+				const uint32_t x0 = (tile % strips) * strip, x1 = std::min(width, x0 + strip);
+				const int32_t y0 = (int32_t)((tile / strips) * band), y1 = std::min((int32_t)height, y0 + (int32_t)band);
+				tile_columns columns = { width, x0 > r ? x0 - r : 0u, std::min(width, x1 + r), state.counts.data() };
+				std::fill(state.counts.begin(), state.counts.begin() + (size_t)(columns.last - columns.first) * 4u * c_columnHistogramSize, (uint16_t)0);
+				for (int32_t y = y0 - (int32_t)r; y <= y0 + (int32_t)r; y++)
+					AddRow(columns, clamp_row(y));
+				state.overlap_texels += (uint64_t)(2u * r) * (columns.last - columns.first) + (uint64_t)(columns.last - columns.first - (x1 - x0)) * (y1 - y0);
+				for (int32_t y = y0; y < y1; y++)
+				{
+					const uint8_t* leaving = y > y0 ? clamp_row(y - (int32_t)r - 1) : nullptr;
+					const uint8_t* entering = clamp_row(y + (int32_t)r);
+#if defined(CPU_WAVE_X86)
+					if (avx2)
+					{
+						FilterRowAvx2(columns, r, x0, x1, leaving, entering, state.windows, UAV.Row((uint32_t)y));
+						continue;
+					}
+#endif
+					FilterRowScalar(columns, r, x0, x1, leaving, entering, state.windows, UAV.Row((uint32_t)y));
+				}
+			}
+		});
+
+		for (worker_state& state : workers)
+		{
+			stats.overlap_texels += state.overlap_texels;
+			state.overlap_texels = 0u;
+		}
+	}
+
+	// Of the last run.
+	const cpu_median_filter_stats& Stats() const { return stats; }
+
+private:
+	struct alignas(64) worker_state
+	{
+		cpu_median_filter_detail::window_histogram windows[4];
+		std::vector<uint16_t> counts; // column histograms
+		uint64_t overlap_texels = 0u;
+	};
+
+	std::vector<worker_state> workers;
+	cpu_median_filter_stats stats;
+};
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_bilateral_filter.h"
+#include "cpu_image.h"
+#include "cpu_thread_pool.h"
+#include "cpu_wave.h"
+
+//=================================================================================================================================
+// Non-local means denoiser of a cpu_texture (Buades, Coll and Morel), with patch distances from integral images
+//
+// out(p) = sum_q w(p, q) c(q) / sum_q w(p, q) over the (2 search_radius + 1)^2 window around p, where
+//   w(p, q) = exp(-max(d2(p, q) - 2 sigma^2, 0) / h^2)
+// and d2 is the mean squared RGB difference of the (2 patch_radius + 1)^2 patches around p and q. q = p gets the largest
+// weight of the others instead of 1, which would outweigh them. Weights come from the bilateral range LUT built for
+// sigma_range = h / sqrt(2), so they are within BilateralLutTolerance() of exp(). All four channels are averaged.
+//
+// Done directly, every pixel costs search^2 * patch^2 taps. Instead the work is turned around: for one offset d = q - p at a
+// time, the squared difference |c(x) - c(x + d)|^2 of every pixel of a tile and its patch_radius halo goes into an integral
+// image, and the patch distance of every pixel of the tile for that offset is four lookups into it, whatever the patch size.
+// The tile's sums and weights are accumulated per offset, so a pixel costs search^2 lookups. Work items are tiles of
+// tile_size texels; a tile's integral image and accumulators stay in L1/L2 while it walks the offsets. The AVX2 loops do
+// 8 pixels at a time: the differences, the running sums along an integral image row as an in-register prefix sum, and the
+// weights with a gather from the LUT. They round differently from the scalar loops, within the same float tolerance.
+//
+// The quality knob picks the window sizes: best follows the parameters Buades, Coll and Morel give for color images by
+// noise level (IPOL 2011), balanced and fast keep their patches and h but search 6 and 3 texels instead of 10 or 17.
+//=================================================================================================================================
+enum class cpu_nlm_quality
+{
+	fast,
+	balanced,
+	best,
+};
+
+inline const char* NlmQualityName(cpu_nlm_quality quality)
+{
+	switch (quality)
+	{
+	case cpu_nlm_quality::fast: return "fast";
+	case cpu_nlm_quality::balanced: return "balanced";
+	case cpu_nlm_quality::best: return "best";
+	}
+	return "?";
+}
+
+struct cpu_nlm_filter_options
+{
+	cpu_nlm_quality quality = cpu_nlm_quality::balanced;
+	float sigma = 0.0f;                    // of the noise in [0, 1] units; <= 0 estimates it with EstimateNoiseSigma()
+	uint32_t search_radius = 0u;           // 0 picks from quality
+	uint32_t patch_radius = 0u;            // 0 picks from quality
+	float h = 0.0f;                        // filtering strength; <= 0 picks from quality and sigma
+	cpu_wave_isa isa = cpu_wave_isa::avx2; // avx512 runs the AVX2 loops
+	uint32_t tile_size = 64u;
+};
+
+// What a run used, options resolved.
+struct cpu_nlm_params
+{
+	float sigma = 0.0f;
+	uint32_t search_radius = 0u;
+	uint32_t patch_radius = 0u;
+	float h = 0.0f;
+};
+
+inline cpu_nlm_params ResolveNlmParams(const cpu_nlm_filter_options& options, float sigma)
+{
+	// IPOL, color: up to sigma 25 of 255, 3x3 patches, a 21x21 window and h = 0.55 sigma; above, 5x5, 35x35 and 0.4 sigma.
+	bool strong = sigma * 255.0f > 25.0f;
+	cpu_nlm_params params;
+	params.sigma = sigma;
+	params.patch_radius = options.patch_radius > 0u ? options.patch_radius : strong ? 2u : 1u;
+	uint32_t search = options.quality == cpu_nlm_quality::fast ? 3u : options.quality == cpu_nlm_quality::balanced ? 6u : strong ? 17u : 10u;
+	params.search_radius = options.search_radius > 0u ? options.search_radius : search;
+	params.h = options.h > 0.0f ? options.h : (strong ? 0.4f : 0.55f) * sigma;
+	return params;
+}
+
+// Immerkaer's estimate of the sigma of white noise, averaged over R, G and B: sqrt(pi / 2) / 6 * mean |Laplacian difference|
+// over the interior pixels (see work_graph_tile_radius.h).
+inline float EstimateNoiseSigma(cpu_thread_pool& pool, const cpu_texture& SRV)
+{
+	if (SRV.width < 3u || SRV.height < 3u)
+		return 0.0f;
+	struct alignas(64) partial_sum
+	{
+		double sum = 0.0;
+	};
+	std::vector<partial_sum> sums(pool.Size());
+	const uint32_t width = SRV.width;
+	pool.ParallelFor(1u, SRV.height - 1u, 16u, [&](uint32_t begin, uint32_t end, uint32_t worker)
+	{
+		double sum = 0.0;
+		for (uint32_t y = begin; y < end; y++)
+		{
+			const float4* row = &SRV.texels[(size_t)y * width];
+			for (uint32_t x = 1; x + 1u < width; x++)
+			{
+				const float4* p = row + x;
+				for (uint32_t c = 0; c < 3u; c++)
+				{
+					auto at = [&](int32_t dx, int32_t dy) { return (&p[dy * (int32_t)width + dx].x)[c]; };
+					float l = at(-1, -1) + at(1, -1) + at(-1, 1) + at(1, 1) - 2.0f * (at(0, -1) + at(-1, 0) + at(1, 0) + at(0, 1)) + 4.0f * at(0, 0);
+					sum += std::fabs(l);
+				}
+			}
+		}
+		sums[worker].sum += sum;
+	});
+	double total = 0.0;
+	for (const partial_sum& s : sums)
+		total += s.sum;
+	return (float)(0.2088856896 * total / (3.0 * (width - 2.0) * (SRV.height - 2.0)));
+}
+
+// One pixel done directly in doubles with exp(), what the integral image path is checked against. Past the LUT's cutoff
+// weights are 0 here too: a pixel with no similar patch keeps its color rather than averaging weights below 1e-4.
+inline float4 NlmFilterPixelExact(const cpu_texture& SRV, uint32_t px, uint32_t py, const cpu_nlm_params& params)
+{
+	const int32_t s = (int32_t)params.search_radius, f = (int32_t)params.patch_radius;
+	auto load = [&](int32_t x, int32_t y)
+	{
+		return SRV.texels[(size_t)std::clamp(y, 0, (int32_t)SRV.height - 1) * SRV.width + std::clamp(x, 0, (int32_t)SRV.width - 1)];
+	};
+	const double patch_texels = 3.0 * (2 * f + 1) * (2 * f + 1), two_sigma2 = 2.0 * params.sigma * params.sigma;
+	double sum[4] = {}, weight_sum = 0.0, max_weight = 0.0;
+	for (int32_t dy = -s; dy <= s; dy++)
+	{
+		for (int32_t dx = -s; dx <= s; dx++)
+		{
+			if (dx == 0 && dy == 0)
+				continue;
+			double d2 = 0.0;
+			for (int32_t ky = -f; ky <= f; ky++)
+			{
+				for (int32_t kx = -f; kx <= f; kx++)
+				{
+					float4 a = load((int32_t)px + kx, (int32_t)py + ky), b = load((int32_t)px + dx + kx, (int32_t)py + dy + ky);
+					d2 += ((double)a.x - b.x) * ((double)a.x - b.x) + ((double)a.y - b.y) * ((double)a.y - b.y) + ((double)a.z - b.z) * ((double)a.z - b.z);
+				}
+			}
+			double x = std::max(d2 / patch_texels - two_sigma2, 0.0) / ((double)params.h * params.h);
+			double w = x <= c_bilateralRangeCutoff ? std::exp(-x) : 0.0;
+			float4 q = load((int32_t)px + dx, (int32_t)py + dy);
+			sum[0] += w * q.x;
+			sum[1] += w * q.y;
+			sum[2] += w * q.z;
+			sum[3] += w * q.w;
+			weight_sum += w;
+			max_weight = std::max(max_weight, w);
+		}
+	}
+	double center_weight = max_weight > 0.0 ? max_weight : 1.0;
+	float4 p = load((int32_t)px, (int32_t)py);
+	weight_sum += center_weight;
+	return float4{ (float)((sum[0] + center_weight * p.x) / weight_sum), (float)((sum[1] + center_weight * p.y) / weight_sum),
+		(float)((sum[2] + center_weight * p.z) / weight_sum), (float)((sum[3] + center_weight * p.w) / weight_sum) };
+}
+
+namespace cpu_nlm_filter_detail
+{
+	// The padded planes and LUT one run reads.
+	struct filter_view
+	{
+		const float* planes[4]; // r, g, b, a; the texel (x, y) at [(y + pad) * pitch + x + pad]
+		uint32_t pitch;
+		uint32_t pad;           // search_radius + patch_radius
+		uint32_t patch_radius;
+		float inv_patch_texels; // 1 / (3 (2 patch_radius + 1)^2)
+		float two_sigma2;
+		const float* lut;
+		float lut_scale;
+
+		size_t Index(int32_t x, int32_t y) const { return (size_t)(y + (int32_t)pad) * pitch + (size_t)(x + (int32_t)pad); }
+	};
+
+	// A tile's integral image and accumulators, 4 sums then the weight sum and the largest weight, tile_size^2 floats each.
+	struct tile_buffers
+	{
+		float* integral;
+		uint32_t integral_pitch;
+		float* sums[4];
+		float* weight_sum;
+		float* max_weight;
+		uint32_t pitch; // of the accumulators
+	};
+
+	inline float Weight(const filter_view& v, float patch_sum)
+	{
+		float d2 = std::max(patch_sum * v.inv_patch_texels - v.two_sigma2, 0.0f);
+		return v.lut[(uint32_t)std::min(d2 * v.lut_scale + 0.5f, (float)c_bilateralRangeLutSize)];
+	}
+
+	// Integral image of |c(x) - c(x + d)|^2 over the tile [x0, x0 + w) x [y0, y0 + h) and its halo: entry (i, j) sums the
+	// region texels [0, i) x [0, j), the region starting at (x0 - f, y0 - f).
+	inline void BuildIntegralScalar(const filter_view& v, int32_t x0, int32_t y0, uint32_t w, uint32_t h, int32_t dx, int32_t dy, const tile_buffers& t)
+	{
+		const int32_t f = (int32_t)v.patch_radius;
+		const uint32_t columns = w + 2u * f, rows = h + 2u * f;
+		std::fill(t.integral, t.integral + columns + 1u, 0.0f);
+		for (uint32_t j = 0; j < rows; j++)
+		{
+			size_t a = v.Index(x0 - f, y0 - f + (int32_t)j), b = v.Index(x0 - f + dx, y0 - f + (int32_t)j + dy);
+			const float* above = t.integral + (size_t)j * t.integral_pitch;
+			float* row = t.integral + (size_t)(j + 1u) * t.integral_pitch;
+			row[0] = 0.0f;
+			float sum = 0.0f;
+			for (uint32_t i = 0; i < columns; i++)
+			{
+				float dr = v.planes[0][a + i] - v.planes[0][b + i], dg = v.planes[1][a + i] - v.planes[1][b + i], db = v.planes[2][a + i] - v.planes[2][b + i];
+				sum += dr * dr + dg * dg + db * db;
+				row[i + 1u] = sum + above[i + 1u];
+			}
+		}
+	}
+
+	// Weights of offset d for the tile pixels [i0, w) of every row, from the integral image, into the accumulators.
+	inline void AccumulateScalar(const filter_view& v, int32_t x0, int32_t y0, uint32_t i0, uint32_t w, uint32_t h, int32_t dx, int32_t dy,
+		const tile_buffers& t)
+	{
+		const uint32_t side = 2u * v.patch_radius + 1u;
+		for (uint32_t j = 0; j < h; j++)
+		{
+			const float* top = t.integral + (size_t)j * t.integral_pitch;
+			const float* bottom = t.integral + (size_t)(j + side) * t.integral_pitch;
+			size_t q = v.Index(x0 + dx, y0 + (int32_t)j + dy);
+			size_t o = (size_t)j * t.pitch;
+			for (uint32_t i = i0; i < w; i++)
+			{
+				float weight = Weight(v, bottom[i + side] - bottom[i] - top[i + side] + top[i]);
+				for (uint32_t c = 0; c < 4u; c++)
+					t.sums[c][o + i] += weight * v.planes[c][q + i];
+				t.weight_sum[o + i] += weight;
+				t.max_weight[o + i] = std::max(t.max_weight[o + i], weight);
+			}
+		}
+	}
+
+#if defined(CPU_WAVE_X86)
+	// Running sums of 8 floats: in each 128-bit half, then the low half's total into the high half.
+	CPU_WAVE_TARGET_AVX2 inline __m256 PrefixSumAvx2(__m256 x)
+	{
+		x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 4)));
+		x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 8)));
+		__m256 low_total = _mm256_permute_ps(x, 0xff);
+		return _mm256_add_ps(x, _mm256_permute2f128_ps(low_total, low_total, 0x08));
+	}
+
+	CPU_WAVE_TARGET_AVX2 inline void BuildIntegralAvx2(const filter_view& v, int32_t x0, int32_t y0, uint32_t w, uint32_t h, int32_t dx, int32_t dy,
+		const tile_buffers& t)
+	{
+		const int32_t f = (int32_t)v.patch_radius;
+		const uint32_t columns = w + 2u * f, rows = h + 2u * f;
+		std::fill(t.integral, t.integral + columns + 1u, 0.0f);
+		for (uint32_t j = 0; j < rows; j++)
+		{
+			size_t a = v.Index(x0 - f, y0 - f + (int32_t)j), b = v.Index(x0 - f + dx, y0 - f + (int32_t)j + dy);
+			const float* above = t.integral + (size_t)j * t.integral_pitch;
+			float* row = t.integral + (size_t)(j + 1u) * t.integral_pitch;
+			row[0] = 0.0f;
+			__m256 carry = _mm256_setzero_ps();
+			uint32_t i = 0;
+			for (; i + 8u <= columns; i += 8u)
+			{
+				__m256 dr = _mm256_sub_ps(_mm256_loadu_ps(v.planes[0] + a + i), _mm256_loadu_ps(v.planes[0] + b + i));
+				__m256 dg = _mm256_sub_ps(_mm256_loadu_ps(v.planes[1] + a + i), _mm256_loadu_ps(v.planes[1] + b + i));
+				__m256 db = _mm256_sub_ps(_mm256_loadu_ps(v.planes[2] + a + i), _mm256_loadu_ps(v.planes[2] + b + i));
+				__m256 d2 = _mm256_fmadd_ps(dr, dr, _mm256_fmadd_ps(dg, dg, _mm256_mul_ps(db, db)));
+				__m256 sums = _mm256_add_ps(PrefixSumAvx2(d2), carry);
+				_mm256_storeu_ps(row + i + 1u, _mm256_add_ps(sums, _mm256_loadu_ps(above + i + 1u)));
+				carry = _mm256_permute_ps(sums, 0xff);
+				carry = _mm256_permute2f128_ps(carry, carry, 0x11);
+			}
+			float sum = _mm256_cvtss_f32(carry);
+			for (; i < columns; i++)
+			{
+				float dr = v.planes[0][a + i] - v.planes[0][b + i], dg = v.planes[1][a + i] - v.planes[1][b + i], db = v.planes[2][a + i] - v.planes[2][b + i];
+				sum += dr * dr + dg * dg + db * db;
+				row[i + 1u] = sum + above[i + 1u];
+			}
+		}
+	}
+
+	// 8 pixels at a time while they fit, returns where the scalar loop takes over.
+	CPU_WAVE_TARGET_AVX2 inline uint32_t AccumulateAvx2(const filter_view& v, int32_t x0, int32_t y0, uint32_t w, uint32_t h, int32_t dx, int32_t dy,
+		const tile_buffers& t)
+	{
+		const uint32_t side = 2u * v.patch_radius + 1u, end = w & ~7u;
+		const __m256 inv_patch_texels = _mm256_set1_ps(v.inv_patch_texels), two_sigma2 = _mm256_set1_ps(v.two_sigma2);
+		const __m256 scale = _mm256_set1_ps(v.lut_scale), half = _mm256_set1_ps(0.5f), last = _mm256_set1_ps((float)c_bilateralRangeLutSize);
+		for (uint32_t j = 0; j < h; j++)
+		{
+			const float* top = t.integral + (size_t)j * t.integral_pitch;
+			const float* bottom = t.integral + (size_t)(j + side) * t.integral_pitch;
+			size_t q = v.Index(x0 + dx, y0 + (int32_t)j + dy);
+			size_t o = (size_t)j * t.pitch;
+			for (uint32_t i = 0; i < end; i += 8u)
+			{
+				__m256 patch = _mm256_sub_ps(_mm256_loadu_ps(bottom + i + side), _mm256_loadu_ps(bottom + i));
+				patch = _mm256_add_ps(_mm256_sub_ps(patch, _mm256_loadu_ps(top + i + side)), _mm256_loadu_ps(top + i));
+				__m256 d2 = _mm256_max_ps(_mm256_sub_ps(_mm256_mul_ps(patch, inv_patch_texels), two_sigma2), _mm256_setzero_ps());
+				__m256i index = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(d2, scale), half), last));
+				__m256 weight = _mm256_i32gather_ps(v.lut, index, 4);
+				for (uint32_t c = 0; c < 4u; c++)
+				{
+					float* sum = t.sums[c] + o + i;
+					_mm256_storeu_ps(sum, _mm256_fmadd_ps(weight, _mm256_loadu_ps(v.planes[c] + q + i), _mm256_loadu_ps(sum)));
+				}
+				_mm256_storeu_ps(t.weight_sum + o + i, _mm256_add_ps(weight, _mm256_loadu_ps(t.weight_sum + o + i)));
+				_mm256_storeu_ps(t.max_weight + o + i, _mm256_max_ps(weight, _mm256_loadu_ps(t.max_weight + o + i)));
+			}
+		}
+		return end;
+	}
+#endif
+}
+
+struct cpu_nlm_filter_stats
+{
+	uint64_t offsets = 0u;      // per pixel, the center excluded
+	uint64_t direct_taps = 0u;  // per pixel a direct implementation would read, offsets x patch texels
+	uint32_t tiles = 0u;
+};
+
+// Keeps the LUT, planes and per worker tile buffers between runs, so filtering same sized images doesn't allocate.
+class cpu_nlm_filter
+{
+public:
+	// Filters SRV into UAV, which is resized to match.
+	void Run(cpu_thread_pool& pool, const cpu_texture& SRV, cpu_texture& UAV, const cpu_nlm_filter_options& options)
+	{
+		using namespace cpu_nlm_filter_detail;
+		const uint32_t width = SRV.width, height = SRV.height;
+		if (UAV.width != width || UAV.height != height)
+			UAV.Resize(width, height);
+		stats = cpu_nlm_filter_stats();
+		if (width == 0u || height == 0u)
+			return;
+		params = ResolveNlmParams(options, options.sigma > 0.0f ? options.sigma : EstimateNoiseSigma(pool, SRV));
+		params.h = std::max(params.h, 1e-4f);
+		if (params.h != lut_h || lut.empty())
+		{
+			lut_scale = BuildBilateralRangeLut(params.h * 0.70710678f, lut);
+			lut_h = params.h;
+		}
+		const uint32_t f = params.patch_radius, s = params.search_radius, pad = s + f;
+		cpu_bilateral_filter_detail::BuildPaddedPlanes(pool, SRV, pad, planes);
+		filter_view view = { { planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data() }, width + 2u * pad, pad, f,
+			1.0f / (3.0f * (2u * f + 1u) * (2u * f + 1u)), 2.0f * params.sigma * params.sigma, lut.data(), lut_scale };
+
+		const uint32_t tile = std::max(8u, options.tile_size);
+		const uint32_t tiles_x = (width + tile - 1u) / tile, tiles_y = (height + tile - 1u) / tile;
+		const uint32_t integral_pitch = tile + 2u * f + 1u;
+		if (workers.size() < pool.Size())
+			workers.resize(pool.Size());
+		bool avx2 = options.isa != cpu_wave_isa::scalar && IsWaveIsaSupported(cpu_wave_isa::avx2);
+
+		pool.ParallelFor(0u, tiles_x * tiles_y, 1u, [&](uint32_t begin, uint32_t end, uint32_t worker)
+		{
+			worker_state& state = workers[worker];
+			const size_t tile_texels = (size_t)tile * tile;
+			state.integral.resize((size_t)integral_pitch * integral_pitch);
+			state.accumulators.resize(6u * tile_texels);
+			float* a = state.accumulators.data();
+			tile_buffers buffers = { state.integral.data(), integral_pitch, { a, a + tile_texels, a + 2u * tile_texels, a + 3u * tile_texels },
+				a + 4u * tile_texels, a + 5u * tile_texels, tile };
+			for (uint32_t t = begin; t < end; t++)
+			{
+				const int32_t x0 = (int32_t)((t % tiles_x) * tile), y0 = (int32_t)((t / tiles_x) * tile);
+				const uint32_t w = std::min(tile, width - (uint32_t)x0), h = std::min(tile, height - (uint32_t)y0);
+				std::fill(state.accumulators.begin(), state.accumulators.end(), 0.0f);
+				for (int32_t dy = -(int32_t)s; dy <= (int32_t)s; dy++)
+				{
+					for (int32_t dx = -(int32_t)s; dx <= (int32_t)s; dx++)
+					{
+						if (dx == 0 && dy == 0)
+							continue;
+						uint32_t i0 = 0u;
+#if defined(CPU_WAVE_X86)
+						if (avx2)
+						{
+							BuildIntegralAvx2(view, x0, y0, w, h, dx, dy, buffers);
+							i0 = AccumulateAvx2(view, x0, y0, w, h, dx, dy, buffers);
+						}
+						else
+#endif
+						{
+							BuildIntegralScalar(view, x0, y0, w, h, dx, dy, buffers);
+						}
+						if (i0 < w)
+							AccumulateScalar(view, x0, y0, i0, w, h, dx, dy, buffers);
+					}
+				}
+				// The center, weighted like the most similar patch.
+				for (uint32_t j = 0; j < h; j++)
+				{
+					size_t p = view.Index(x0, y0 + (int32_t)j), o = (size_t)j * tile;
+					float4* out = &UAV.texels[(size_t)(y0 + (int32_t)j) * width + x0];
+					for (uint32_t i = 0; i < w; i++)
+					{
+						float center_weight = buffers.max_weight[o + i] > 0.0f ? buffers.max_weight[o + i] : 1.0f;
+						float inv = 1.0f / (buffers.weight_sum[o + i] + center_weight);
+						float* result = &out[i].x;
+						for (uint32_t c = 0; c < 4u; c++)
+							result[c] = (buffers.sums[c][o + i] + center_weight * planes[c][p + i]) * inv;
+					}
+				}
+			}
+		});
+
+		stats.offsets = (uint64_t)(2u * s + 1u) * (2u * s + 1u) - 1u;
+		stats.direct_taps = stats.offsets * (2u * f + 1u) * (2u * f + 1u);
+		stats.tiles = tiles_x * tiles_y;
+	}
+
+	// Of the last run.
+	const cpu_nlm_params& Params() const { return params; }
+	const cpu_nlm_filter_stats& Stats() const { return stats; }
+
+private:
+	struct alignas(64) worker_state
+	{
+		std::vector<float> integral;
+		std::vector<float> accumulators;
+	};
+
+	cpu_nlm_params params;
+	std::vector<float> lut;
+	float lut_scale = 0.0f;
+	float lut_h = 0.0f;
+	std::vector<float> planes[4];
+	std::vector<worker_state> workers;
+	cpu_nlm_filter_stats stats;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "cpu_record_block.h"
+
+//=================================================================================================================================
+// Slab allocator for the record blocks consumed by one node
+//
+// Every block a node can receive has a known upper bound: [MaxRecords(N)] of the producing output times the input record
+// stride (or the coalescing batch size), so all blocks for a node are carved from fixed size slots. Slots are allocated
+// slots_per_slab at a time and never returned to the heap; a block released after its consumer ran goes back to the
+// releasing worker's free list. Free lists are balanced through a shared list in batches, so after the first frames a
+// dispatch runs without touching the heap no matter which worker produces or consumes.
+//=================================================================================================================================
+class cpu_record_arena
+{
+public:
+	static constexpr uint32_t slots_per_slab = 64u;
+	static constexpr uint32_t transfer_batch = 32u; // slots moved between a worker's free list and the shared one at once
+
+	cpu_record_arena(uint32_t node, uint32_t record_stride, uint32_t max_records, uint32_t num_workers)
+		: node(node), record_stride(record_stride), max_records(max_records)
+	{
+		// Header and records share a slot, both aligned to a cache line so neighbouring blocks don't false share.
+		header_bytes = RoundUp((uint32_t)sizeof(cpu_record_block), 64u);
+		slot_bytes = header_bytes + RoundUp(std::max(1u, record_stride * max_records), 64u);
+		for (uint32_t w = 0; w < num_workers; w++)
+		{
+			workers.emplace_back(new worker_cache());
+			workers.back()->free_slots.reserve(2u * transfer_batch + 1u);
+		}
+	}
+
+	cpu_record_arena(const cpu_record_arena&) = delete;
+	cpu_record_arena& operator=(const cpu_record_arena&) = delete;
+
+	// A block for up to max_records records. count is the number of records the caller intends to write.
+	cpu_record_block* Allocate(uint32_t worker, uint32_t count)
+	{
+		assert(count <= max_records && "record block larger than the slab slot, check [MaxRecords]");
+		std::vector<cpu_record_block*>& free_slots = workers[worker]->free_slots;
+		if (free_slots.empty())
+			Refill(free_slots);
+		cpu_record_block* block = free_slots.back();
+		free_slots.pop_back();
+
+		block->node = node;
+		block->count = count;
+		block->stride = record_stride;
+		block->producer_worker = worker;
+		block->recursion_level = 0u;
+
+		uint64_t bytes = bytes_in_flight.fetch_add(slot_bytes) + slot_bytes;
+		uint64_t peak = peak_bytes_in_flight.load(std::memory_order_relaxed);
+		while (bytes > peak && !peak_bytes_in_flight.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {}
+		allocations.fetch_add(1u, std::memory_order_relaxed);
+		return block;
+	}
+
+	void Release(uint32_t worker, cpu_record_block* block)
+	{
+		assert(block->arena == this);
+		bytes_in_flight.fetch_sub(slot_bytes);
+		std::vector<cpu_record_block*>& free_slots = workers[worker]->free_slots;
+		free_slots.push_back(block);
+		if (free_slots.size() > 2u * transfer_batch)
+		{
+			std::lock_guard<std::mutex> lock(shared_mutex);
+			shared_free_slots.insert(shared_free_slots.end(), free_slots.end() - transfer_batch, free_slots.end());
+			free_slots.resize(free_slots.size() - transfer_batch);
+		}
+	}
+
+	uint32_t Node() const { return node; }
+	uint32_t MaxRecords() const { return max_records; }
+	uint32_t SlotBytes() const { return slot_bytes; }
+	uint64_t ReservedBytes() const { return (uint64_t)slab_count.load() * slots_per_slab * slot_bytes; }
+	uint64_t BytesInFlight() const { return bytes_in_flight; }
+	uint64_t PeakBytesInFlight() const { return peak_bytes_in_flight; }
+	uint64_t Allocations() const { return allocations; }
+	// Heap allocations made by this arena since it was created, one per slab.
+	uint64_t HeapAllocations() const { return slab_count; }
+
+	void ResetStats()
+	{
+		peak_bytes_in_flight = bytes_in_flight.load();
+		allocations = 0u;
+	}
+
+private:
+	struct alignas(64) worker_cache
+	{
+		std::vector<cpu_record_block*> free_slots;
+	};
+
+	static uint32_t RoundUp(uint32_t x, uint32_t alignment) { return (x + alignment - 1u) & ~(alignment - 1u); }
+
+	void Refill(std::vector<cpu_record_block*>& free_slots)
+	{
+		std::lock_guard<std::mutex> lock(shared_mutex);
+		if (shared_free_slots.empty())
+			AllocateSlab();
+		uint32_t n = std::min(transfer_batch, (uint32_t)shared_free_slots.size());
+		free_slots.insert(free_slots.end(), shared_free_slots.end() - n, shared_free_slots.end());
+		shared_free_slots.resize(shared_free_slots.size() - n);
+	}
+
+	// Called with shared_mutex held.
+	void AllocateSlab()
+	{
+		slabs.emplace_back(new slab_storage[(size_t)slots_per_slab * slot_bytes / sizeof(slab_storage)]);
+		uint8_t* base = reinterpret_cast<uint8_t*>(slabs.back().get());
+		for (uint32_t i = 0; i < slots_per_slab; i++)
+		{
+			uint8_t* slot = base + (size_t)i * slot_bytes;
+			cpu_record_block* block = new (slot) cpu_record_block();
+			block->capacity = slot_bytes - header_bytes;
+			block->data = slot + header_bytes;
+			block->arena = this;
+			shared_free_slots.push_back(block);
+		}
+		slab_count++;
+	}
+
+	struct alignas(64) slab_storage
+	{
+		uint8_t bytes[64];
+	};
+
+	uint32_t node;
+	uint32_t record_stride;
+	uint32_t max_records;
+	uint32_t header_bytes = 0u;
+	uint32_t slot_bytes = 0u;
+
+	std::vector<std::unique_ptr<worker_cache>> workers;
+	std::mutex shared_mutex;
+	std::vector<cpu_record_block*> shared_free_slots;
+	std::vector<std::unique_ptr<slab_storage[]>> slabs;
+
+	std::atomic<uint32_t> slab_count{ 0u };
+	std::atomic<uint64_t> bytes_in_flight{ 0u };
+	std::atomic<uint64_t> peak_bytes_in_flight{ 0u };
+	std::atomic<uint64_t> allocations{ 0u };
+};
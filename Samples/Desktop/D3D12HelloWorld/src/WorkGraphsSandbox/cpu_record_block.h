@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+class cpu_record_arena;
+
+//=================================================================================================================================
+// A run of records produced by one OutputComplete() (or by the CPU input of DispatchGraph), owned until every
+// work item referencing it has executed. The record storage belongs to whoever allocated the block, normally the consumer
+// node's cpu_record_arena.
+struct cpu_record_block
+{
+	std::atomic<uint32_t> pending_items{ 0u };
+	uint32_t node = 0u; // consumer
+	uint32_t count = 0u;
+	uint32_t stride = 0u;
+	uint32_t producer_worker = 0u;
+	uint32_t recursion_level = 0u; // how many times the records went through a node's output to itself
+	uint32_t capacity = 0u; // bytes at data
+	uint8_t* data = nullptr;
+	cpu_record_arena* arena = nullptr; // nullptr when not arena owned
+
+	uint8_t* Record(uint32_t i) { return data + (size_t)i * stride; }
+	const uint8_t* Record(uint32_t i) const { return data + (size_t)i * stride; }
+};
+
+struct cpu_work_item
+{
+	cpu_record_block* block = nullptr;
+	uint32_t first_record = 0u;
+	uint32_t record_count = 0u;
+	uint32_t group_begin = 0u; // broadcasting only, linear group range within the dispatch grid
+	uint32_t group_end = 0u;
+	const uint32_t* group_order = nullptr; // broadcasting only, maps the linear range to row-major groups; nullptr if row major
+	uint32_t owner = 0u;                   // worker whose storage holds the item, it goes back there after running
+	cpu_work_item* next_returned = nullptr; // link in the owner's list of items run by other workers
+};
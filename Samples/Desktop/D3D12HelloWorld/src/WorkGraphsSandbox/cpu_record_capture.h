@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//=================================================================================================================================
+// Record stream captured from a cpu_work_graph, see cpu_work_graph::EnableCapture().
+//
+// Holds the CPU input of every DispatchGraph and every block of records submitted by OutputComplete(), as raw records in
+// the layout the consumer reads them. Workers append to their own buffers, which are merged in worker order when the
+// dispatch ends, so the stream of a single threaded run is deterministic and a multithreaded one holds the same records
+// per dispatch in some order.
+//
+// File layout, little endian:
+//   "WGRC", u32 version, u32 node count, per node { u32 record stride, u32 name length, name }
+//   chunks until the end of the file: { u32 dispatch, u32 node, u32 record count, records }
+//=================================================================================================================================
+class cpu_record_capture
+{
+public:
+	static constexpr uint32_t version = 1u;
+
+	struct chunk
+	{
+		uint32_t dispatch = 0u;
+		uint32_t node = 0u;
+		uint32_t count = 0u;
+		size_t offset = 0u; // of the first record in the stream
+	};
+
+	// Called by the graph before its first captured dispatch; drops anything captured so far.
+	void Begin(const std::vector<std::string>& node_names, const std::vector<uint32_t>& node_strides, uint32_t num_buffers)
+	{
+		names = node_names;
+		strides = node_strides;
+		buffers.assign(num_buffers, std::vector<uint8_t>());
+		stream.clear();
+		chunks.clear();
+		dispatches = 0u;
+	}
+
+	bool IsBegun() const { return !buffers.empty(); }
+
+	// buffer is the appending worker, or the one after the workers for the CPU input. Only that thread may use it until
+	// EndDispatch().
+	void Append(uint32_t buffer, uint32_t node, const uint8_t* records, uint32_t count)
+	{
+		std::vector<uint8_t>& b = buffers[buffer];
+		const uint32_t header[3] = { dispatches, node, count };
+		size_t at = b.size();
+		b.resize(at + sizeof(header) + (size_t)count * strides[node]);
+		memcpy(b.data() + at, header, sizeof(header));
+		memcpy(b.data() + at + sizeof(header), records, (size_t)count * strides[node]);
+	}
+
+	void EndDispatch()
+	{
+		// The CPU input buffer is the last one but goes first.
+		for (size_t i = 0; i < buffers.size(); i++)
+		{
+			std::vector<uint8_t>& b = buffers[(i + buffers.size() - 1u) % buffers.size()];
+			size_t base = stream.size();
+			stream.insert(stream.end(), b.begin(), b.end());
+			Index(base);
+			b.clear();
+		}
+		dispatches++;
+	}
+
+	uint32_t NodeCount() const { return (uint32_t)names.size(); }
+	const std::string& NodeName(uint32_t node) const { return names[node]; }
+	uint32_t RecordStride(uint32_t node) const { return strides[node]; }
+	uint32_t Dispatches() const { return dispatches; }
+	const std::vector<chunk>& Chunks() const { return chunks; }
+	size_t StreamBytes() const { return stream.size(); }
+	const uint8_t* Records(const chunk& c) const { return stream.data() + c.offset; }
+
+	// ~0u if the capture has no node of that name.
+	uint32_t FindNode(const std::string& name) const
+	{
+		for (uint32_t n = 0; n < names.size(); n++)
+			if (names[n] == name)
+				return n;
+		return ~0u;
+	}
+
+	uint64_t RecordCount(uint32_t node) const
+	{
+		uint64_t count = 0u;
+		for (const chunk& c : chunks)
+			count += c.node == node ? c.count : 0u;
+		return count;
+	}
+
+	// All records node received during one dispatch, in stream order.
+	uint32_t Gather(uint32_t node, uint32_t dispatch, std::vector<uint8_t>& out_records) const
+	{
+		out_records.clear();
+		uint32_t count = 0u;
+		for (const chunk& c : chunks)
+		{
+			if (c.node != node || c.dispatch != dispatch)
+				continue;
+			out_records.insert(out_records.end(), Records(c), Records(c) + (size_t)c.count * strides[node]);
+			count += c.count;
+		}
+		return count;
+	}
+
+	bool Write(const char* file_name) const
+	{
+		FILE* f = fopen(file_name, "wb");
+		if (f == NULL)
+			return false;
+		bool ok = fwrite("WGRC", 1, 4, f) == 4u;
+		const uint32_t header[2] = { version, (uint32_t)names.size() };
+		ok = ok && fwrite(header, sizeof(header), 1, f) == 1u;
+		for (size_t n = 0; n < names.size(); n++)
+		{
+			const uint32_t node[2] = { strides[n], (uint32_t)names[n].size() };
+			ok = ok && fwrite(node, sizeof(node), 1, f) == 1u;
+			ok = ok && fwrite(names[n].data(), 1, names[n].size(), f) == names[n].size();
+		}
+		ok = ok && fwrite(stream.data(), 1, stream.size(), f) == stream.size();
+		return fclose(f) == 0 && ok;
+	}
+
+	bool Read(const char* file_name)
+	{
+		FILE* f = fopen(file_name, "rb");
+		if (f == NULL)
+			return false;
+		std::vector<uint8_t> file;
+		uint8_t block[1u << 16];
+		for (size_t read; (read = fread(block, 1, sizeof(block), f)) > 0u; )
+			file.insert(file.end(), block, block + read);
+		fclose(f);
+
+		size_t at = 0u;
+		auto read_u32 = [&](uint32_t& out) { if (at + 4u > file.size()) return false; memcpy(&out, &file[at], 4u); at += 4u; return true; };
+		uint32_t file_version = 0u, node_count = 0u;
+		if (file.size() < 4u || memcmp(file.data(), "WGRC", 4u) != 0)
+			return false;
+		at = 4u;
+		if (!read_u32(file_version) || file_version != version || !read_u32(node_count))
+			return false;
+		std::vector<std::string> node_names(node_count);
+		std::vector<uint32_t> node_strides(node_count);
+		for (uint32_t n = 0; n < node_count; n++)
+		{
+			uint32_t length = 0u;
+			if (!read_u32(node_strides[n]) || !read_u32(length) || at + length > file.size())
+				return false;
+			node_names[n].assign((const char*)&file[at], length);
+			at += length;
+		}
+
+		Begin(node_names, node_strides, 0u);
+		stream.assign(file.begin() + at, file.end());
+		if (!Index(0u))
+		{
+			stream.clear();
+			chunks.clear();
+			return false;
+		}
+		for (const chunk& c : chunks)
+			dispatches = std::max(dispatches, c.dispatch + 1u);
+		return true;
+	}
+
+private:
+	// Adds the chunks from stream[base, end) to the index, false if they run past the end or name unknown nodes.
+	bool Index(size_t base)
+	{
+		size_t at = base;
+		while (at < stream.size())
+		{
+			if (at + 12u > stream.size())
+				return false;
+			chunk c;
+			memcpy(&c.dispatch, &stream[at], 4u);
+			memcpy(&c.node, &stream[at + 4u], 4u);
+			memcpy(&c.count, &stream[at + 8u], 4u);
+			c.offset = at + 12u;
+			if (c.node >= strides.size() || c.offset + (size_t)c.count * strides[c.node] > stream.size())
+				return false;
+			chunks.push_back(c);
+			at = c.offset + (size_t)c.count * strides[c.node];
+		}
+		return true;
+	}
+
+	std::vector<std::string> names;
+	std::vector<uint32_t> strides;
+	std::vector<std::vector<uint8_t>> buffers;
+	std::vector<uint8_t> stream;
+	std::vector<chunk> chunks;
+	uint32_t dispatches = 0u;
+};
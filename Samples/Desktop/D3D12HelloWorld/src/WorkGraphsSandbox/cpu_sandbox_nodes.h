@@ -0,0 +1,736 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include "cpu_group_executor.h"
+#include "cpu_group_order.h"
+#include "cpu_image.h"
+#include "cpu_wave.h"
+#include "cpu_work_graph.h"
+#include "work_graph_record_encoding.h"
+
+//=================================================================================================================================
+// CPU ports of the nodes in D3D12WorkGraphsSandbox.hlsl.
+// Each function follows the HLSL body line by line so GPU output can be validated against the CPU result.
+//=================================================================================================================================
+
+// [NodeLaunch("broadcasting")] [NodeMaxDispatchGrid(256,256,1)] [NumThreads(16,16,1)]
+inline void FirstNode(cpu_node_invocation& inv, const cpu_texture& SRV)
+{
+	cpu_output_records<secondNodeInput> out_record = inv.GetGroupNodeOutputRecords<secondNodeInput>(0, 256);
+	for (uint32_t gy = 0; gy < 16u; gy++)
+	{
+		for (uint32_t gx = 0; gx < 16u; gx++)
+		{
+			uint2 i = { inv.group_id.x * 16u + gx, inv.group_id.y * 16u + gy };
+			float4 r = SRV.Load(i);
+
+			uint32_t u = gx + gy * 16u;
+			out_record[u].value = r;
+			out_record[u].index = i;
+		}
+	}
+	out_record.OutputComplete();
+}
+
+// Variant of FirstNode that only emits records for pixels with luminance >= threshold, compacting them with
+// GetGroupNodeOutputRecords(count). Not in the HLSL; used to study coalescing batch fill rates with sparse producers.
+inline void FirstNodeThresholded(cpu_node_invocation& inv, const cpu_texture& SRV, float threshold)
+{
+	secondNodeInput records[256];
+	uint32_t count = 0u;
+	for (uint32_t gy = 0; gy < 16u; gy++)
+	{
+		for (uint32_t gx = 0; gx < 16u; gx++)
+		{
+			uint2 i = { inv.group_id.x * 16u + gx, inv.group_id.y * 16u + gy };
+			float4 r = SRV.Load(i);
+			if (0.299f * r.x + 0.587f * r.y + 0.114f * r.z >= threshold)
+				records[count++] = secondNodeInput{ r, i };
+		}
+	}
+	cpu_output_records<secondNodeInput> out_record = inv.GetGroupNodeOutputRecords<secondNodeInput>(0, count);
+	for (uint32_t u = 0; u < count; u++)
+		out_record[u] = records[u];
+	out_record.OutputComplete();
+}
+
+// [NodeLaunch("thread")]
+inline void SecondNode(cpu_node_invocation& inv, cpu_texture& UAV)
+{
+	const secondNodeInput& input = inv.Get<secondNodeInput>();
+	UAV.Store(input.index, input.value);
+}
+
+// secondNode as a wave function, the records of up to c_cpuWaveMaxLanes threads at a time in structure-of-arrays lanes.
+inline void SecondNodeWaveScalar(cpu_node_invocation& inv, cpu_texture& UAV)
+{
+	const uint8_t* records = inv.InputRecords();
+	const uint32_t stride = inv.InputStride();
+	uint32_t active = WaveLaneMask(inv.Count());
+	uint32_t value[4][c_cpuWaveMaxLanes];
+	uint32_t index[2][c_cpuWaveMaxLanes];
+	for (uint32_t c = 0; c < 4u; c++)
+		GatherWaveLanes(records, stride, (uint32_t)offsetof(secondNodeInput, value) + 4u * c, active, value[c]);
+	for (uint32_t c = 0; c < 2u; c++)
+		GatherWaveLanes(records, stride, (uint32_t)offsetof(secondNodeInput, index) + 4u * c, active, index[c]);
+
+	for (uint32_t l = 0; l < inv.Count(); l++)
+	{
+		float4 v;
+		memcpy(&v.x, &value[0][l], 4u);
+		memcpy(&v.y, &value[1][l], 4u);
+		memcpy(&v.z, &value[2][l], 4u);
+		memcpy(&v.w, &value[3][l], 4u);
+		UAV.Store(uint2{ index[0][l], index[1][l] }, v);
+	}
+}
+
+#if defined(CPU_WAVE_X86)
+// 8 lanes per step: gathers the fields, masks off lanes outside the UAV, transposes the value back to one float4 per lane
+// and stores the active lanes in lane order (no scatter before AVX-512).
+CPU_WAVE_TARGET_AVX2 inline void SecondNodeWaveAvx2(cpu_node_invocation& inv, cpu_texture& UAV)
+{
+	const uint32_t stride = inv.InputStride();
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i lane_offsets = _mm256_mullo_epi32(lane, _mm256_set1_epi32((int)stride));
+	// Unsigned compares as signed ones with the sign bit flipped.
+	const __m256i sign = _mm256_set1_epi32((int)0x80000000u);
+	const __m256i width = _mm256_set1_epi32((int)UAV.width);
+	const __m256i width_biased = _mm256_xor_si256(width, sign);
+	const __m256i height_biased = _mm256_set1_epi32((int)(UAV.height ^ 0x80000000u));
+	float* texels = &UAV.texels.data()->x;
+	for (uint32_t base = 0; base < inv.Count(); base += 8u)
+	{
+		const uint8_t* records = inv.InputRecords() + (size_t)base * stride;
+		__m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)std::min(8u, inv.Count() - base)), lane);
+		__m256i x = GatherWaveLanesAvx2(records, lane_offsets, (uint32_t)offsetof(secondNodeInput, index), active);
+		__m256i y = GatherWaveLanesAvx2(records, lane_offsets, (uint32_t)offsetof(secondNodeInput, index) + 4u, active);
+		__m256 v[4];
+		for (uint32_t c = 0; c < 4u; c++)
+			v[c] = _mm256_castsi256_ps(GatherWaveLanesAvx2(records, lane_offsets, (uint32_t)offsetof(secondNodeInput, value) + 4u * c, active));
+
+		__m256i inside = _mm256_and_si256(_mm256_cmpgt_epi32(width_biased, _mm256_xor_si256(x, sign)),
+			_mm256_cmpgt_epi32(height_biased, _mm256_xor_si256(y, sign)));
+		uint32_t store_mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(active, inside)));
+		alignas(32) uint32_t texel[8];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(texel), _mm256_add_epi32(_mm256_mullo_epi32(y, width), x));
+
+		// x0..x7, y0..y7, z0..z7, w0..w7 -> lane l in the low (l < 4) or high half of t[l & 3].
+		__m256 xy_lo = _mm256_unpacklo_ps(v[0], v[1]), xy_hi = _mm256_unpackhi_ps(v[0], v[1]);
+		__m256 zw_lo = _mm256_unpacklo_ps(v[2], v[3]), zw_hi = _mm256_unpackhi_ps(v[2], v[3]);
+		__m256 t[4] = { _mm256_shuffle_ps(xy_lo, zw_lo, 0x44), _mm256_shuffle_ps(xy_lo, zw_lo, 0xee),
+			_mm256_shuffle_ps(xy_hi, zw_hi, 0x44), _mm256_shuffle_ps(xy_hi, zw_hi, 0xee) };
+		for (uint32_t l = 0; l < 8u; l++)
+		{
+			if (store_mask & (1u << l))
+				_mm_storeu_ps(texels + (size_t)texel[l] * 4u, l < 4u ? _mm256_castps256_ps128(t[l]) : _mm256_extractf128_ps(t[l & 3u], 1));
+		}
+	}
+}
+
+// 16 lanes in one step, stored with masked scatters. Scatters write overlapping lanes in lane order, like the scalar loop.
+CPU_WAVE_TARGET_AVX512 inline void SecondNodeWaveAvx512(cpu_node_invocation& inv, cpu_texture& UAV)
+{
+	const uint8_t* records = inv.InputRecords();
+	const __m512i lane_offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+		_mm512_set1_epi32((int)inv.InputStride()));
+	const __m512i width = _mm512_set1_epi32((int)UAV.width);
+	__mmask16 active = (__mmask16)WaveLaneMask(inv.Count());
+	__m512i x = GatherWaveLanesAvx512(records, lane_offsets, (uint32_t)offsetof(secondNodeInput, index), active);
+	__m512i y = GatherWaveLanesAvx512(records, lane_offsets, (uint32_t)offsetof(secondNodeInput, index) + 4u, active);
+	active = _mm512_mask_cmplt_epu32_mask(active, x, width);
+	active = _mm512_mask_cmplt_epu32_mask(active, y, _mm512_set1_epi32((int)UAV.height));
+	// In 8 byte units, the largest scatter scale; a texel is 16 bytes.
+	__m512i texel = _mm512_add_epi32(_mm512_mullo_epi32(y, width), x);
+	__m512i offset = _mm512_add_epi32(texel, texel);
+	float* texels = &UAV.texels.data()->x;
+	for (uint32_t c = 0; c < 4u; c++)
+	{
+		__m512i v = GatherWaveLanesAvx512(records, lane_offsets, (uint32_t)offsetof(secondNodeInput, value) + 4u * c, active);
+		_mm512_mask_i32scatter_ps(texels + c, active, offset, _mm512_castsi512_ps(v), 8);
+	}
+}
+#endif
+
+// Runs the variant for isa, which the CPU must support. AVX2 takes two steps for more than 8 lanes.
+inline void SecondNodeWave(cpu_node_invocation& inv, cpu_texture& UAV, cpu_wave_isa isa)
+{
+	switch (isa)
+	{
+#if defined(CPU_WAVE_X86)
+	case cpu_wave_isa::avx512: SecondNodeWaveAvx512(inv, UAV); break;
+	case cpu_wave_isa::avx2: SecondNodeWaveAvx2(inv, UAV); break;
+#endif
+	default: SecondNodeWaveScalar(inv, UAV); break;
+	}
+}
+
+// firstNode with secondNode fused in, what FuseWorkGraphHLSL() emits for the thread launch secondNode: each thread stores
+// its pixel instead of writing a 24 byte record for secondNode to read back.
+inline void FirstNodeFused(cpu_node_invocation& inv, const cpu_texture& SRV, cpu_texture& UAV)
+{
+	for (uint32_t gy = 0; gy < 16u; gy++)
+	{
+		for (uint32_t gx = 0; gx < 16u; gx++)
+		{
+			uint2 i = { inv.group_id.x * 16u + gx, inv.group_id.y * 16u + gy };
+			UAV.Store(i, SRV.Load(i));
+		}
+	}
+}
+
+// [NodeLaunch("broadcasting")] [NodeMaxDispatchGrid(256,256,1)] [NumThreads(16,16,1)]
+inline void HalfFirstNode(cpu_node_invocation& inv, const cpu_texture& SRV)
+{
+	cpu_output_records<secondNodeInputHalf> out_record = inv.GetGroupNodeOutputRecords<secondNodeInputHalf>(0, 256);
+	for (uint32_t gy = 0; gy < 16u; gy++)
+	{
+		for (uint32_t gx = 0; gx < 16u; gx++)
+		{
+			uint2 i = { inv.group_id.x * 16u + gx, inv.group_id.y * 16u + gy };
+			float4 r = SRV.Load(i);
+
+			uint32_t u = gx + gy * 16u;
+			out_record[u].color = EncodeColorHalf4(r);
+			out_record[u].index = EncodePixelIndex16(i);
+		}
+	}
+	out_record.OutputComplete();
+}
+
+// [NodeLaunch("thread")]
+inline void HalfSecondNode(cpu_node_invocation& inv, cpu_texture& UAV)
+{
+	const secondNodeInputHalf& input = inv.Get<secondNodeInputHalf>();
+	UAV.Store(DecodePixelIndex16(input.index), DecodeColorHalf4(input.color));
+}
+
+// [NodeLaunch("broadcasting")] [NodeMaxDispatchGrid(256,256,1)] [NumThreads(16,16,1)]
+inline void Unorm8FirstNode(cpu_node_invocation& inv, const cpu_texture& SRV)
+{
+	cpu_output_records<secondNodeInputUnorm8> out_record = inv.GetGroupNodeOutputRecords<secondNodeInputUnorm8>(0, 256);
+	for (uint32_t gy = 0; gy < 16u; gy++)
+	{
+		for (uint32_t gx = 0; gx < 16u; gx++)
+		{
+			uint2 i = { inv.group_id.x * 16u + gx, inv.group_id.y * 16u + gy };
+			float4 r = SRV.Load(i);
+
+			uint32_t u = gx + gy * 16u;
+			out_record[u].color = EncodeColorUnorm8(r);
+			out_record[u].index = EncodePixelIndex16(i);
+		}
+	}
+	out_record.OutputComplete();
+}
+
+// [NodeLaunch("thread")]
+inline void Unorm8SecondNode(cpu_node_invocation& inv, cpu_texture& UAV)
+{
+	const secondNodeInputUnorm8& input = inv.Get<secondNodeInputUnorm8>();
+	UAV.Store(DecodePixelIndex16(input.index), DecodeColorUnorm8(input.color));
+}
+
+// [NodeLaunch("coalescing")] [NumThreads(16,16,1)], the #if 0 variant of secondNode
+inline void SecondNodeCoalescing(cpu_node_invocation& inv, cpu_texture& UAV)
+{
+	// One iteration per SV_GroupIndex; threads past Count() return early in the HLSL.
+	for (uint32_t threadIndex = 0; threadIndex < inv.Count(); threadIndex++)
+	{
+		const secondNodeInput& input = inv.Get<secondNodeInput>(threadIndex);
+		UAV.Store(input.index, input.value);
+	}
+}
+
+// [NodeLaunch("broadcasting")] [NodeIsProgramEntry] [NodeDispatchGrid(1,1,1)] [NumThreads(16,16,1)] [NodeMaxRecursionDepth(4)]
+// Outputs: 0 refineTile [MaxRecords(4)], 1 fillTile [MaxRecords(1)], 2 secondNode [MaxRecords(256)]
+inline void RefineTile(cpu_node_invocation& inv, const cpu_texture& SRV, float threshold)
+{
+	const tileRecord& tile = inv.Get<tileRecord>();
+	uint32_t cell = tile.size / 16u;
+
+	float4 r[256];
+	uint2 i[256];
+	float lum_min = INFINITY;
+	float lum_max = 0.0f;
+	uint32_t color_sum[4] = {};
+	for (uint32_t u = 0; u < 256u; u++)
+	{
+		uint32_t gx = u % 16u, gy = u / 16u;
+		i[u] = { tile.origin.x + gx * cell + cell / 2u, tile.origin.y + gy * cell + cell / 2u };
+		r[u] = SRV.Load(i[u]);
+		float lum = 0.299f * r[u].x + 0.587f * r[u].y + 0.114f * r[u].z;
+		lum_min = std::min(lum_min, lum);
+		lum_max = std::max(lum_max, lum);
+		const float c[4] = { r[u].x, r[u].y, r[u].z, r[u].w };
+		for (uint32_t k = 0; k < 4u; k++)
+			color_sum[k] += (uint32_t)(std::min(std::max(c[k], 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	bool is_uniform = lum_max - lum_min <= threshold;
+	bool can_split = tile.size > 16u && inv.GetRemainingRecursionLevels() > 0u;
+	if (is_uniform || (!can_split && tile.size > 16u))
+	{
+		cpu_output_records<fillTileInput> fill = inv.GetGroupNodeOutputRecords<fillTileInput>(1, 1);
+		fill[0].gridSize = { tile.size / 16u, tile.size / 16u, 1u };
+		fill[0].origin = tile.origin;
+		const float scale = 1.0f / (256.0f * 255.0f);
+		fill[0].value = { color_sum[0] * scale, color_sum[1] * scale, color_sum[2] * scale, color_sum[3] * scale };
+		fill.OutputComplete();
+	}
+	else if (can_split)
+	{
+		cpu_output_records<tileRecord> children = inv.GetGroupNodeOutputRecords<tileRecord>(0, 4);
+		uint32_t child_size = tile.size / 2u;
+		for (uint32_t c = 0; c < 4u; c++)
+		{
+			children[c].origin = { tile.origin.x + (c & 1u) * child_size, tile.origin.y + (c >> 1u) * child_size };
+			children[c].size = child_size;
+		}
+		children.OutputComplete();
+	}
+	else
+	{
+		cpu_output_records<secondNodeInput> out_record = inv.GetGroupNodeOutputRecords<secondNodeInput>(2, 256);
+		for (uint32_t u = 0; u < 256u; u++)
+		{
+			out_record[u].value = r[u];
+			out_record[u].index = i[u];
+		}
+		out_record.OutputComplete();
+	}
+}
+
+// [NodeLaunch("broadcasting")] [NodeMaxDispatchGrid(16,16,1)] [NumThreads(16,16,1)]
+inline void FillTile(cpu_node_invocation& inv, cpu_texture& UAV)
+{
+	const fillTileInput& input = inv.Get<fillTileInput>();
+	for (uint32_t gy = 0; gy < 16u; gy++)
+		for (uint32_t gx = 0; gx < 16u; gx++)
+			UAV.Store({ input.origin.x + inv.group_id.x * 16u + gx, input.origin.y + inv.group_id.y * 16u + gy }, input.value);
+}
+
+//=================================================================================================================================
+// Ports that keep the HLSL's per-thread structure, with its barriers and groupshared variables, on cpu_group_executor.
+//=================================================================================================================================
+
+// groupshared in refineTile, plus the records the group requested, see RefineTileThread().
+struct refine_tile_shared
+{
+	uint32_t g_lumMin;
+	uint32_t g_lumMax;
+	uint32_t g_colorSum[4];
+	std::optional<cpu_output_records<tileRecord>> children;
+	std::optional<cpu_output_records<secondNodeInput>> out_record;
+};
+
+// One thread of refineTile, line by line. GetGroupNodeOutputRecords() and OutputComplete() are group wide, so thread 0
+// makes them and hands the records to the others through groupshared memory, between barriers.
+inline cpu_group_thread RefineTileThread(cpu_thread_group& group, refine_tile_shared& shared, uint32_t groupIndex,
+	cpu_node_invocation& inv, const cpu_texture& SRV, float threshold)
+{
+	const tileRecord& tile = inv.Get<tileRecord>();
+	uint32_t cell = tile.size / 16u;
+	uint2 groupThreadID = { groupIndex % 16u, groupIndex / 16u };
+	uint2 i = { tile.origin.x + groupThreadID.x * cell + cell / 2u, tile.origin.y + groupThreadID.y * cell + cell / 2u };
+	float4 r = SRV.Load(i);
+
+	if (groupIndex == 0u)
+	{
+		shared.g_lumMin = 0xffffffffu;
+		shared.g_lumMax = 0u;
+		for (uint32_t c = 0; c < 4u; c++)
+			shared.g_colorSum[c] = 0u;
+	}
+	co_await group.Barrier();
+
+	float lum_f = 0.299f * r.x + 0.587f * r.y + 0.114f * r.z;
+	uint32_t lum;
+	memcpy(&lum, &lum_f, 4u);
+	shared.g_lumMin = std::min(shared.g_lumMin, lum);
+	shared.g_lumMax = std::max(shared.g_lumMax, lum);
+	const float q[4] = { r.x, r.y, r.z, r.w };
+	for (uint32_t c = 0; c < 4u; c++)
+		shared.g_colorSum[c] += (uint32_t)(std::min(std::max(q[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+	co_await group.Barrier();
+
+	float lum_min, lum_max;
+	memcpy(&lum_min, &shared.g_lumMin, 4u);
+	memcpy(&lum_max, &shared.g_lumMax, 4u);
+	bool is_uniform = lum_max - lum_min <= threshold;
+	bool can_split = tile.size > 16u && inv.GetRemainingRecursionLevels() > 0u;
+	if (is_uniform || (!can_split && tile.size > 16u))
+	{
+		// Only thread 0 writes the record, it can own the request too.
+		if (groupIndex == 0u)
+		{
+			cpu_output_records<fillTileInput> fill = inv.GetGroupNodeOutputRecords<fillTileInput>(1, 1);
+			fill[0].gridSize = { tile.size / 16u, tile.size / 16u, 1u };
+			fill[0].origin = tile.origin;
+			const float scale = 1.0f / (256.0f * 255.0f);
+			fill[0].value = { shared.g_colorSum[0] * scale, shared.g_colorSum[1] * scale, shared.g_colorSum[2] * scale,
+				shared.g_colorSum[3] * scale };
+			fill.OutputComplete();
+		}
+	}
+	else if (can_split)
+	{
+		if (groupIndex == 0u)
+			shared.children.emplace(inv.GetGroupNodeOutputRecords<tileRecord>(0, 4));
+		co_await group.Barrier();
+		if (groupIndex < 4u)
+		{
+			uint32_t child_size = tile.size / 2u;
+			(*shared.children)[groupIndex].origin = { tile.origin.x + (groupIndex & 1u) * child_size, tile.origin.y + (groupIndex >> 1u) * child_size };
+			(*shared.children)[groupIndex].size = child_size;
+		}
+		co_await group.Barrier();
+		if (groupIndex == 0u)
+			shared.children->OutputComplete();
+	}
+	else
+	{
+		if (groupIndex == 0u)
+			shared.out_record.emplace(inv.GetGroupNodeOutputRecords<secondNodeInput>(2, 256));
+		co_await group.Barrier();
+		(*shared.out_record)[groupIndex].value = r;
+		(*shared.out_record)[groupIndex].index = i;
+		co_await group.Barrier();
+		if (groupIndex == 0u)
+			shared.out_record->OutputComplete();
+	}
+}
+
+// [NodeLaunch("broadcasting")] [NodeIsProgramEntry] [NodeDispatchGrid(1,1,1)] [NumThreads(16,16,1)] [NodeMaxRecursionDepth(4)]
+// Same output as RefineTile().
+inline void RefineTileGroup(cpu_node_invocation& inv, cpu_group_executor& executor, const cpu_texture& SRV, float threshold)
+{
+	executor.Run<refine_tile_shared>(inv.worker, 256u, [&](cpu_thread_group& group, refine_tile_shared& shared, uint32_t groupIndex)
+		{ return RefineTileThread(group, shared, groupIndex, inv, SRV, threshold); });
+}
+
+// groupshared in thirdNode.
+struct third_node_shared
+{
+	uint32_t g_sum[c_numEntryRecords];
+};
+
+// One thread of the disabled thirdNode. UAV is the RWBuffer<uint> of counters the original sample binds at u0; threads of
+// different groups add to it concurrently.
+inline cpu_group_thread ThirdNodeThread(cpu_thread_group& group, third_node_shared& shared, uint32_t threadIndex,
+	const cpu_node_invocation& inputData, std::atomic<uint32_t>* UAV)
+{
+	if (threadIndex >= inputData.Count())
+		co_return;
+
+	for (uint32_t i = 0; i < c_numEntryRecords; i++)
+		shared.g_sum[i] = 0u;
+	co_await group.Barrier();
+
+	shared.g_sum[inputData.Get<thirdNodeInput>(threadIndex).entryRecordIndex] += 1u;
+	co_await group.Barrier();
+
+	if (threadIndex > 0u)
+		co_return;
+
+	for (uint32_t l = 0; l < c_numEntryRecords; l++)
+	{
+		uint32_t recordIndex = c_numEntryRecords + l;
+		UAV[recordIndex].fetch_add(shared.g_sum[l]);
+	}
+}
+
+// [NodeLaunch("coalescing")] [NumThreads(32,1,1)], input [MaxRecords(32)]
+inline void ThirdNodeGroup(cpu_node_invocation& inv, cpu_group_executor& executor, std::atomic<uint32_t>* UAV)
+{
+	executor.Run<third_node_shared>(inv.worker, 32u, [&](cpu_thread_group& group, third_node_shared& shared, uint32_t threadIndex)
+		{ return ThirdNodeThread(group, shared, threadIndex, inv, UAV); });
+}
+
+// thirdNode with the barriers split by hand, like the other ports, to compare ThirdNodeGroup() against.
+inline void ThirdNode(cpu_node_invocation& inv, std::atomic<uint32_t>* UAV)
+{
+	uint32_t g_sum[c_numEntryRecords] = {};
+	for (uint32_t threadIndex = 0; threadIndex < inv.Count(); threadIndex++)
+		g_sum[inv.Get<thirdNodeInput>(threadIndex).entryRecordIndex] += 1u;
+	for (uint32_t l = 0; l < c_numEntryRecords; l++)
+		UAV[c_numEntryRecords + l].fetch_add(g_sum[l]);
+}
+
+// [NodeLaunch("broadcasting")] [NodeMaxDispatchGrid(256,256,1)] [NumThreads(16,16,1)]
+inline void BatchFirstNode(cpu_node_invocation& inv, const cpu_descriptor_heap& heap)
+{
+	const batchEntryRecord& entry = inv.Get<batchEntryRecord>();
+	const cpu_texture& src = heap[entry.srvIndex];
+	cpu_output_records<batchPixelRecord> out_record = inv.GetGroupNodeOutputRecords<batchPixelRecord>(0, 256);
+	for (uint32_t gy = 0; gy < 16u; gy++)
+	{
+		for (uint32_t gx = 0; gx < 16u; gx++)
+		{
+			uint2 i = { entry.origin.x + inv.group_id.x * 16u + gx, entry.origin.y + inv.group_id.y * 16u + gy };
+			uint32_t u = gx + gy * 16u;
+			out_record[u].value = src.Load(i);
+			out_record[u].index = i;
+			out_record[u].uavIndex = entry.uavIndex;
+		}
+	}
+	out_record.OutputComplete();
+}
+
+// [NodeLaunch("thread")]
+inline void BatchSecondNode(cpu_node_invocation& inv, const cpu_descriptor_heap& heap)
+{
+	const batchPixelRecord& input = inv.Get<batchPixelRecord>();
+	heap[input.uavIndex].Store(input.index, input.value);
+}
+
+//=================================================================================================================================
+struct cpu_hello_work_graph
+{
+	uint32_t first_node = 0u;
+	uint32_t second_node = 0u;
+};
+
+struct cpu_hello_work_graph_config
+{
+	// Use the coalescing variant of secondNode with [MaxRecords(second_node_max_records)].
+	bool coalescing_second_node = false;
+	uint32_t second_node_max_records = 256u;
+	std::shared_ptr<const cpu_flush_heuristic> flush_heuristic;
+	// Values > 0 make firstNode emit only pixels at or above this luminance, see FirstNodeThresholded().
+	float producer_threshold = 0.0f;
+	// > 0 runs the thread launch secondNode as a wave of up to this many lanes (at most c_cpuWaveMaxLanes) with the
+	// SecondNodeWave() variant for wave_isa, or the best the CPU supports if it lacks that.
+	uint32_t second_node_wave_lanes = 0u;
+	cpu_wave_isa wave_isa = cpu_wave_isa::avx512;
+	// Run FirstNodeFused() and leave secondNode without producers. Ignored with a coalescing secondNode or a threshold.
+	bool fuse_second_node = false;
+	// Order in which firstNode's groups run, see cpu_group_order.h.
+	cpu_group_order first_node_group_order = cpu_group_order::row_major;
+	// > 0 bounds secondNode's input queue: firstNode stalls while that many records are queued, see cpu_node_output_desc.
+	uint32_t second_node_high_water_mark = 0u;
+	// Record firstNode sends secondNode, see work_graph_record_encoding.h. The packed ones build halfFirstNode ->
+	// halfSecondNode or unorm8FirstNode -> unorm8SecondNode, which only have the thread launch secondNode: the coalescing,
+	// threshold, wave and fusion options are ignored with them.
+	work_graph_record_encoding second_node_encoding = work_graph_record_encoding::float4_uint2;
+};
+
+// The packed record variants of the graph, see cpu_hello_work_graph_config::second_node_encoding.
+inline cpu_hello_work_graph AddPackedHelloWorkGraphNodes(cpu_work_graph& graph, const cpu_texture& SRV, cpu_texture& UAV,
+	const cpu_hello_work_graph_config& config)
+{
+	cpu_hello_work_graph ids;
+	bool half = config.second_node_encoding == work_graph_record_encoding::half4_uint16;
+	uint32_t stride = RecordEncodingSize(config.second_node_encoding);
+
+	cpu_node_desc second;
+	second.name = half ? "halfSecondNode" : "unorm8SecondNode";
+	second.launch = cpu_node_launch::thread;
+	second.input_record_stride = stride;
+	if (half)
+		second.function = [&UAV](cpu_node_invocation& inv) { HalfSecondNode(inv, UAV); };
+	else
+		second.function = [&UAV](cpu_node_invocation& inv) { Unorm8SecondNode(inv, UAV); };
+	ids.second_node = graph.AddNode(std::move(second));
+
+	cpu_node_desc first;
+	first.name = half ? "halfFirstNode" : "unorm8FirstNode";
+	first.launch = cpu_node_launch::broadcasting;
+	first.num_threads = { 16u, 16u, 1u };
+	first.max_dispatch_grid = { 256u, 256u, 1u };
+	first.group_order = config.first_node_group_order;
+	first.dispatch_grid_offset = offsetof(entryRecord, gridSize);
+	first.input_record_stride = sizeof(entryRecord);
+	first.outputs.push_back({ ids.second_node, stride, 256u, config.second_node_high_water_mark });
+	if (half)
+		first.function = [&SRV](cpu_node_invocation& inv) { HalfFirstNode(inv, SRV); };
+	else
+		first.function = [&SRV](cpu_node_invocation& inv) { Unorm8FirstNode(inv, SRV); };
+	ids.first_node = graph.AddNode(std::move(first));
+
+	return ids;
+}
+
+// Builds the HelloWorkGraphs graph. SRV and UAV must outlive the graph.
+inline cpu_hello_work_graph AddHelloWorkGraphNodes(cpu_work_graph& graph, const cpu_texture& SRV, cpu_texture& UAV,
+	const cpu_hello_work_graph_config& config = cpu_hello_work_graph_config())
+{
+	if (config.second_node_encoding != work_graph_record_encoding::float4_uint2)
+		return AddPackedHelloWorkGraphNodes(graph, SRV, UAV, config);
+	cpu_hello_work_graph ids;
+
+	cpu_node_desc second;
+	second.name = "secondNode";
+	second.input_record_stride = sizeof(secondNodeInput);
+	if (config.coalescing_second_node)
+	{
+		second.launch = cpu_node_launch::coalescing;
+		second.num_threads = { 16u, 16u, 1u };
+		second.max_input_records = config.second_node_max_records;
+		second.flush_heuristic = config.flush_heuristic;
+		second.function = [&UAV](cpu_node_invocation& inv) { SecondNodeCoalescing(inv, UAV); };
+	}
+	else
+	{
+		second.launch = cpu_node_launch::thread;
+		second.function = [&UAV](cpu_node_invocation& inv) { SecondNode(inv, UAV); };
+		if (config.second_node_wave_lanes > 0u)
+		{
+			cpu_wave_isa isa = IsWaveIsaSupported(config.wave_isa) ? config.wave_isa : BestWaveIsa();
+			second.wave_lanes = std::min(config.second_node_wave_lanes, c_cpuWaveMaxLanes);
+			second.wave_function = [&UAV, isa](cpu_node_invocation& inv) { SecondNodeWave(inv, UAV, isa); };
+		}
+	}
+	ids.second_node = graph.AddNode(std::move(second));
+
+	cpu_node_desc first;
+	first.name = "firstNode";
+	first.launch = cpu_node_launch::broadcasting;
+	first.num_threads = { 16u, 16u, 1u };
+	first.max_dispatch_grid = { 256u, 256u, 1u };
+	first.group_order = config.first_node_group_order;
+	first.dispatch_grid_offset = offsetof(entryRecord, gridSize);
+	first.input_record_stride = sizeof(entryRecord);
+	if (config.fuse_second_node && !config.coalescing_second_node && config.producer_threshold <= 0.0f)
+	{
+		first.function = [&SRV, &UAV](cpu_node_invocation& inv) { FirstNodeFused(inv, SRV, UAV); };
+		ids.first_node = graph.AddNode(std::move(first));
+		return ids;
+	}
+	first.outputs.push_back({ ids.second_node, (uint32_t)sizeof(secondNodeInput), 256u, config.second_node_high_water_mark });
+	if (config.producer_threshold > 0.0f)
+	{
+		float threshold = config.producer_threshold;
+		first.function = [&SRV, threshold](cpu_node_invocation& inv) { FirstNodeThresholded(inv, SRV, threshold); };
+	}
+	else
+	{
+		first.function = [&SRV](cpu_node_invocation& inv) { FirstNode(inv, SRV); };
+	}
+	ids.first_node = graph.AddNode(std::move(first));
+
+	return ids;
+}
+
+// Same seeding as run_work_graph(): one entry record covering the image with 16x16 groups.
+inline entryRecord MakeHelloEntryRecord(uint32_t width, uint32_t height, uint32_t record_index)
+{
+	entryRecord record = {};
+	record.gridSize = { width / 16u, height / 16u, 1u };
+	record.recordIndex = record_index;
+	return record;
+}
+
+//=================================================================================================================================
+struct cpu_adaptive_work_graph
+{
+	uint32_t refine_tile = 0u;
+	uint32_t fill_tile = 0u;
+	uint32_t second_node = 0u;
+};
+
+// Builds the refineTile -> { refineTile, fillTile, secondNode } part of the graph. SRV and UAV must outlive the graph.
+// threshold is c_refineThreshold in the shader.
+// With executor set refineTile runs as RefineTileGroup(); the executor must outlive the graph.
+inline cpu_adaptive_work_graph AddAdaptiveTilingNodes(cpu_work_graph& graph, const cpu_texture& SRV, cpu_texture& UAV, float threshold = 0.05f,
+	cpu_group_executor* executor = nullptr)
+{
+	cpu_adaptive_work_graph ids;
+
+	cpu_node_desc second;
+	second.name = "secondNode";
+	second.launch = cpu_node_launch::thread;
+	second.input_record_stride = sizeof(secondNodeInput);
+	second.function = [&UAV](cpu_node_invocation& inv) { SecondNode(inv, UAV); };
+	ids.second_node = graph.AddNode(std::move(second));
+
+	cpu_node_desc fill;
+	fill.name = "fillTile";
+	fill.launch = cpu_node_launch::broadcasting;
+	fill.num_threads = { 16u, 16u, 1u };
+	fill.max_dispatch_grid = { 16u, 16u, 1u };
+	fill.dispatch_grid_offset = offsetof(fillTileInput, gridSize);
+	fill.input_record_stride = sizeof(fillTileInput);
+	fill.function = [&UAV](cpu_node_invocation& inv) { FillTile(inv, UAV); };
+	ids.fill_tile = graph.AddNode(std::move(fill));
+
+	// The refineTile output targets the node itself, its id is the next one to be handed out.
+	ids.refine_tile = graph.NodeCount();
+	cpu_node_desc refine;
+	refine.name = "refineTile";
+	refine.launch = cpu_node_launch::broadcasting;
+	refine.num_threads = { 16u, 16u, 1u };
+	refine.dispatch_grid = { 1u, 1u, 1u };
+	refine.max_recursion_depth = c_maxRefineDepth;
+	refine.input_record_stride = sizeof(tileRecord);
+	refine.outputs.push_back({ ids.refine_tile, (uint32_t)sizeof(tileRecord), 4u });
+	refine.outputs.push_back({ ids.fill_tile, (uint32_t)sizeof(fillTileInput), 1u });
+	refine.outputs.push_back({ ids.second_node, (uint32_t)sizeof(secondNodeInput), 256u });
+	if (executor)
+		refine.function = [executor, &SRV, threshold](cpu_node_invocation& inv) { RefineTileGroup(inv, *executor, SRV, threshold); };
+	else
+		refine.function = [&SRV, threshold](cpu_node_invocation& inv) { RefineTile(inv, SRV, threshold); };
+	graph.AddNode(std::move(refine));
+
+	return ids;
+}
+
+// thirdNode alone, fed by DispatchGraph; UAV holds 2 * c_numEntryRecords counters. With executor set it runs as
+// ThirdNodeGroup(), which must outlive the graph.
+inline uint32_t AddThirdNode(cpu_work_graph& graph, std::atomic<uint32_t>* UAV, cpu_group_executor* executor = nullptr)
+{
+	cpu_node_desc third;
+	third.name = "thirdNode";
+	third.launch = cpu_node_launch::coalescing;
+	third.num_threads = { 32u, 1u, 1u };
+	third.max_input_records = 32u;
+	third.input_record_stride = sizeof(thirdNodeInput);
+	if (executor)
+		third.function = [executor, UAV](cpu_node_invocation& inv) { ThirdNodeGroup(inv, *executor, UAV); };
+	else
+		third.function = [UAV](cpu_node_invocation& inv) { ThirdNode(inv, UAV); };
+	return graph.AddNode(std::move(third));
+}
+
+//=================================================================================================================================
+struct cpu_batch_work_graph
+{
+	uint32_t batch_first_node = 0u;
+	uint32_t batch_second_node = 0u;
+};
+
+// Builds batchFirstNode -> batchSecondNode. Seed it with BuildBatchEntryRecords() using indices from heap, which must outlive
+// the graph. Textures can be added to the heap after the graph is built. group_order is batchFirstNode's, see cpu_group_order.h.
+inline cpu_batch_work_graph AddBatchNodes(cpu_work_graph& graph, const cpu_descriptor_heap& heap,
+	cpu_group_order group_order = cpu_group_order::row_major)
+{
+	cpu_batch_work_graph ids;
+
+	cpu_node_desc second;
+	second.name = "batchSecondNode";
+	second.launch = cpu_node_launch::thread;
+	second.input_record_stride = sizeof(batchPixelRecord);
+	second.function = [&heap](cpu_node_invocation& inv) { BatchSecondNode(inv, heap); };
+	ids.batch_second_node = graph.AddNode(std::move(second));
+
+	cpu_node_desc first;
+	first.name = "batchFirstNode";
+	first.launch = cpu_node_launch::broadcasting;
+	first.num_threads = { 16u, 16u, 1u };
+	first.max_dispatch_grid = { 256u, 256u, 1u };
+	first.group_order = group_order;
+	first.dispatch_grid_offset = offsetof(batchEntryRecord, gridSize);
+	first.input_record_stride = sizeof(batchEntryRecord);
+	first.outputs.push_back({ ids.batch_second_node, (uint32_t)sizeof(batchPixelRecord), 256u });
+	first.function = [&heap](cpu_node_invocation& inv) { BatchFirstNode(inv, heap); };
+	ids.batch_first_node = graph.AddNode(std::move(first));
+
+	return ids;
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "cpu_image.h"
+#include "cpu_thread_pool.h"
+#include "cpu_wave.h"
+
+//=================================================================================================================================
+// Summed-area tables of RGBA images, and the box filters that read them in O(1) per texel whatever the radius
+//
+// Entry (x, y) of a table holds the per channel sums of the texels [0, x) x [0, y), for x <= width and y <= height, so the
+// first row and column are 0 and the sum over any box is four lookups with no edge cases. Two kinds:
+// - cpu_summed_area_table<uint32_t> of a cpu_image_rgba8, exact: the sums wrap past 2^32 on large images, but a box sum is a
+//   difference of them, which comes out right modulo 2^32, so it is exact for every box whose own sum fits
+// - cpu_summed_area_table<double> of a cpu_texture: a float sum would lose the low bits of the texels once the running sums
+//   grow, a double keeps every texel's bits for images up to 2^29 texels
+// A table is built in two parallel passes, a running sum along each row, then one down the columns in strips of
+// strip_width entries, so every worker streams whole row segments. The AVX2 row scan adds two texels per step, the column
+// scan two (uint32_t) or one (double) per instruction; the scalar loops are the fallback and give the same sums.
+//
+// BoxFilter() averages the box of radius r around each texel over the part of it inside the image (the table has no texels
+// past the edges to clamp to, unlike cpu_gaussian_blur). cpu_iterated_box_filter repeats it with the radii that make n
+// boxes approximate a Gaussian of a given sigma (Kovesi, "Fast almost-Gaussian filtering").
+//=================================================================================================================================
+// The largest radius for a table of 8-bit texels: a box sum, 255 (2r + 1)^2, must fit an int32_t to convert to float.
+static const uint32_t c_satMaxBoxRadius = 1448u;
+
+struct cpu_summed_area_table_options
+{
+	cpu_wave_isa isa = cpu_wave_isa::avx2; // avx512 runs the AVX2 loops
+	uint32_t strip_width = 256u;           // entries per column scan work item
+	uint32_t band_height = 8u;             // rows per work item of the row scan and the box filter
+};
+
+template<typename T>
+struct cpu_summed_area_table
+{
+	uint32_t width = 0u;  // of the image, the table has one more column
+	uint32_t height = 0u; // and one more row
+	std::vector<T> sums;  // 4 channels per entry, row major
+
+	size_t Pitch() const { return ((size_t)width + 1u) * 4u; }
+	const T* Row(uint32_t y) const { return sums.data() + y * Pitch(); }
+	T* Row(uint32_t y) { return sums.data() + y * Pitch(); }
+};
+
+namespace cpu_summed_area_table_detail
+{
+	// Texels of row of image into the running sums out[4..], out[0..3] = 0.
+	inline void ScanRowScalar(const uint8_t* row, uint32_t* out, uint32_t width)
+	{
+		uint32_t sum[4] = {};
+		for (uint32_t c = 0; c < 4u; c++)
+			out[c] = 0u;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			for (uint32_t c = 0; c < 4u; c++)
+			{
+				sum[c] += row[x * 4u + c];
+				out[(x + 1u) * 4u + c] = sum[c];
+			}
+		}
+	}
+
+	inline void ScanRowScalar(const float4* row, double* out, uint32_t width)
+	{
+		double sum[4] = {};
+		for (uint32_t c = 0; c < 4u; c++)
+			out[c] = 0.0;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const float* t = &row[x].x;
+			for (uint32_t c = 0; c < 4u; c++)
+			{
+				sum[c] += t[c];
+				out[(x + 1u) * 4u + c] = sum[c];
+			}
+		}
+	}
+
+	template<typename T>
+	inline void AddRowScalar(const T* above, T* row, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			row[i] += above[i];
+	}
+
+#if defined(CPU_WAVE_X86)
+	// Two texels per step: [t0 | t1] becomes [t0 | t0 + t1] plus the sum so far in both halves.
+	CPU_WAVE_TARGET_AVX2 inline void ScanRowAvx2(const uint8_t* row, uint32_t* out, uint32_t width)
+	{
+		_mm_storeu_si128((__m128i*)out, _mm_setzero_si128());
+		__m256i sum = _mm256_setzero_si256();
+		uint32_t x = 0;
+		for (; x + 2u <= width; x += 2u)
+		{
+			__m256i t = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row + x * 4u)));
+			t = _mm256_add_epi32(t, _mm256_permute2x128_si256(t, t, 0x08)); // low half into the high one, low half 0
+			t = _mm256_add_epi32(t, sum);
+			_mm256_storeu_si256((__m256i*)(out + (x + 1u) * 4u), t);
+			sum = _mm256_permute2x128_si256(t, t, 0x11);
+		}
+		if (x < width)
+		{
+			__m128i t = _mm_cvtepu8_epi32(_mm_loadu_si32(row + x * 4u));
+			_mm_storeu_si128((__m128i*)(out + (x + 1u) * 4u), _mm_add_epi32(t, _mm256_castsi256_si128(sum)));
+		}
+	}
+
+	// One texel per step, its four channels in one register.
+	CPU_WAVE_TARGET_AVX2 inline void ScanRowAvx2(const float4* row, double* out, uint32_t width)
+	{
+		_mm256_storeu_pd(out, _mm256_setzero_pd());
+		__m256d sum = _mm256_setzero_pd();
+		for (uint32_t x = 0; x < width; x++)
+		{
+			sum = _mm256_add_pd(sum, _mm256_cvtps_pd(_mm_loadu_ps(&row[x].x)));
+			_mm256_storeu_pd(out + (x + 1u) * 4u, sum);
+		}
+	}
+
+	CPU_WAVE_TARGET_AVX2 inline void AddRowAvx2(const uint32_t* above, uint32_t* row, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8u <= count; i += 8u)
+			_mm256_storeu_si256((__m256i*)(row + i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(row + i)), _mm256_loadu_si256((const __m256i*)(above + i))));
+		AddRowScalar(above + i, row + i, count - i);
+	}
+
+	CPU_WAVE_TARGET_AVX2 inline void AddRowAvx2(const double* above, double* row, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4u <= count; i += 4u)
+			_mm256_storeu_pd(row + i, _mm256_add_pd(_mm256_loadu_pd(row + i), _mm256_loadu_pd(above + i)));
+		AddRowScalar(above + i, row + i, count - i);
+	}
+#endif
+
+	inline const uint8_t* ImageRow(const cpu_image_rgba8& image, uint32_t y) { return image.Row(y); }
+	inline const float4* ImageRow(const cpu_texture& texture, uint32_t y) { return &texture.texels[(size_t)y * texture.width]; }
+
+	// Both kinds of table are built the same way from their kind of image.
+	template<typename Image, typename T>
+	inline void BuildTable(cpu_thread_pool& pool, const Image& image, cpu_summed_area_table<T>& out_table, const cpu_summed_area_table_options& options)
+	{
+		const uint32_t width = image.width, height = image.height;
+		out_table.width = width;
+		out_table.height = height;
+		const size_t pitch = out_table.Pitch();
+		out_table.sums.resize(pitch * (height + 1u));
+		std::fill(out_table.sums.begin(), out_table.sums.begin() + pitch, T(0));
+		if (width == 0u || height == 0u)
+			return;
+		bool avx2 = options.isa != cpu_wave_isa::scalar && IsWaveIsaSupported(cpu_wave_isa::avx2);
+
+		pool.ParallelFor(0u, height, std::max(1u, options.band_height), [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			for (uint32_t y = begin; y < end; y++)
+			{
+#if defined(CPU_WAVE_X86)
+				if (avx2)
+				{
+					ScanRowAvx2(ImageRow(image, y), out_table.Row(y + 1u), width);
+					continue;
+				}
+#endif
+				ScanRowScalar(ImageRow(image, y), out_table.Row(y + 1u), width);
+			}
+		});
+
+		// Row 1 has only 0s above it.
+		const size_t strip = std::max<size_t>(8u, (size_t)options.strip_width * 4u);
+		const uint32_t strips = (uint32_t)((pitch + strip - 1u) / strip);
+		pool.ParallelFor(0u, strips, 1u, [&](uint32_t begin, uint32_t end, uint32_t)
+		{
+			for (uint32_t s = begin; s < end; s++)
+			{
+				size_t first = s * strip, count = std::min(strip, pitch - first);
+				for (uint32_t y = 2u; y <= height; y++)
+				{
+#if defined(CPU_WAVE_X86)
+					if (avx2)
+					{
+						AddRowAvx2(out_table.Row(y - 1u) + first, out_table.Row(y) + first, count);
+						continue;
+					}
+#endif
+					AddRowScalar(out_table.Row(y - 1u) + first, out_table.Row(y) + first, count);
+				}
+			}
+		});
+	}
+
+	// Texels [x_begin, x_end) of a row of the box filter: boxes span rows [y0, y1) of the table through top = Row(y0) and
+	// bottom = Row(y1), and columns [max(x - r, 0), min(x + r + 1, width)). scale is the normalization over the box's rows,
+	// inv_columns[x] the one over its columns.
+	inline void BoxRowScalar(const uint32_t* top, const uint32_t* bottom, uint32_t x_begin, uint32_t x_end, uint32_t width, uint32_t r,
+		float scale, const float* inv_columns, float4* out)
+	{
+		for (uint32_t x = x_begin; x < x_end; x++)
+		{
+			size_t x0 = (size_t)(x > r ? x - r : 0u) * 4u, x1 = (size_t)std::min(x + r + 1u, width) * 4u;
+			float s = scale * inv_columns[x];
+			float* o = &out[x].x;
+			for (uint32_t c = 0; c < 4u; c++)
+				o[c] = (float)(int32_t)(bottom[x1 + c] - bottom[x0 + c] - top[x1 + c] + top[x0 + c]) * s;
+		}
+	}
+
+	inline void BoxRowScalar(const double* top, const double* bottom, uint32_t x_begin, uint32_t x_end, uint32_t width, uint32_t r,
+		double scale, const double* inv_columns, float4* out)
+	{
+		for (uint32_t x = x_begin; x < x_end; x++)
+		{
+			size_t x0 = (size_t)(x > r ? x - r : 0u) * 4u, x1 = (size_t)std::min(x + r + 1u, width) * 4u;
+			double s = scale * inv_columns[x];
+			float* o = &out[x].x;
+			for (uint32_t c = 0; c < 4u; c++)
+				o[c] = (float)((bottom[x1 + c] - bottom[x0 + c] - top[x1 + c] + top[x0 + c]) * s);
+		}
+	}
+
+#if defined(CPU_WAVE_X86)
+	// Texels [x_begin, x_end), all with the whole box inside the row, two per step. Same arithmetic as the scalar loop.
+	CPU_WAVE_TARGET_AVX2 inline void BoxRowAvx2(const uint32_t* top, const uint32_t* bottom, uint32_t x_begin, uint32_t x_end, uint32_t r,
+		float scale, const float* inv_columns, float4* out)
+	{
+		const __m256 s = _mm256_set1_ps(scale * inv_columns[x_begin]);
+		uint32_t x = x_begin;
+		for (; x + 2u <= x_end; x += 2u)
+		{
+			size_t x0 = (size_t)(x - r) * 4u, x1 = (size_t)(x + r + 1u) * 4u;
+			__m256i sum = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(bottom + x1)), _mm256_loadu_si256((const __m256i*)(bottom + x0)));
+			sum = _mm256_sub_epi32(sum, _mm256_loadu_si256((const __m256i*)(top + x1)));
+			sum = _mm256_add_epi32(sum, _mm256_loadu_si256((const __m256i*)(top + x0)));
+			_mm256_storeu_ps(&out[x].x, _mm256_mul_ps(_mm256_cvtepi32_ps(sum), s));
+		}
+		BoxRowScalar(top, bottom, x, x_end, x_end + r, r, scale, inv_columns, out);
+	}
+
+	CPU_WAVE_TARGET_AVX2 inline void BoxRowAvx2(const double* top, const double* bottom, uint32_t x_begin, uint32_t x_end, uint32_t r,
+		double scale, const double* inv_columns, float4* out)
+	{
+		const __m256d s = _mm256_set1_pd(scale * inv_columns[x_begin]);
+		for (uint32_t x = x_begin; x < x_end; x++)
+		{
+			size_t x0 = (size_t)(x - r) * 4u, x1 = (size_t)(x + r + 1u) * 4u;
+			__m256d sum = _mm256_sub_pd(_mm256_loadu_pd(bottom + x1), _mm256_loadu_pd(bottom + x0));
+			sum = _mm256_sub_pd(sum, _mm256_loadu_pd(top + x1));
+			sum = _mm256_add_pd(sum, _mm256_loadu_pd(top + x0));
+			_mm_storeu_ps(&out[x].x, _mm256_cvtpd_ps(_mm256_mul_pd(sum, s)));
+		}
+	}
+#endif
+
+	// 1 / 255 turns sums of 8-bit texels into [0, 1] like MakeTextureFromImage(); the scales are kept in the table's precision.
+	inline float BoxNormalization(const cpu_summed_area_table<uint32_t>&) { return 1.0f / 255.0f; }
+	inline double BoxNormalization(const cpu_summed_area_table<double>&) { return 1.0; }
+
+	template<typename T>
+	using box_scale = std::conditional_t<std::is_same_v<T, double>, double, float>;
+}
+
+// Averages the box of radius r around every texel of the table's image, over the part of the box inside the image, into
+// UAV, which is resized to match. inv_columns is scratch. For 8-bit tables r is clamped to c_satMaxBoxRadius.
+template<typename T>
+inline void BoxFilter(cpu_thread_pool& pool, const cpu_summed_area_table<T>& table, uint32_t r, cpu_texture& UAV,
+	const cpu_summed_area_table_options& options, std::vector<cpu_summed_area_table_detail::box_scale<T>>& inv_columns)
+{
+	using namespace cpu_summed_area_table_detail;
+	using scale_type = box_scale<T>;
+	const uint32_t width = table.width, height = table.height;
+	if (UAV.width != width || UAV.height != height)
+		UAV.Resize(width, height);
+	if (width == 0u || height == 0u)
+		return;
+	if (sizeof(T) == sizeof(uint32_t))
+		r = std::min(r, c_satMaxBoxRadius);
+	inv_columns.resize(width);
+	for (uint32_t x = 0; x < width; x++)
+		inv_columns[x] = (scale_type)1 / (scale_type)(std::min(x + r + 1u, width) - (x > r ? x - r : 0u));
+	// The texels whose box doesn't reach past either side of the row.
+	const uint32_t inner_begin = std::min(r, width), inner_end = std::max(inner_begin, width > r ? width - r : 0u);
+	bool avx2 = options.isa != cpu_wave_isa::scalar && IsWaveIsaSupported(cpu_wave_isa::avx2);
+
+	pool.ParallelFor(0u, height, std::max(1u, options.band_height), [&](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t y = begin; y < end; y++)
+		{
+			uint32_t y0 = y > r ? y - r : 0u, y1 = std::min(y + r + 1u, height);
+			const T* top = table.Row(y0);
+			const T* bottom = table.Row(y1);
+			scale_type scale = BoxNormalization(table) / (scale_type)(y1 - y0);
+			float4* out = &UAV.texels[(size_t)y * width];
+#if defined(CPU_WAVE_X86)
+			if (avx2 && inner_begin < inner_end)
+			{
+				BoxRowScalar(top, bottom, 0u, inner_begin, width, r, scale, inv_columns.data(), out);
+				BoxRowAvx2(top, bottom, inner_begin, inner_end, r, scale, inv_columns.data(), out);
+				BoxRowScalar(top, bottom, inner_end, width, width, r, scale, inv_columns.data(), out);
+				continue;
+			}
+#endif
+			BoxRowScalar(top, bottom, 0u, width, width, r, scale, inv_columns.data(), out);
+		}
+	});
+}
+
+inline void BuildSummedAreaTable(cpu_thread_pool& pool, const cpu_image_rgba8& image, cpu_summed_area_table<uint32_t>& out_table,
+	const cpu_summed_area_table_options& options)
+{
+	cpu_summed_area_table_detail::BuildTable(pool, image, out_table, options);
+}
+
+inline void BuildSummedAreaTable(cpu_thread_pool& pool, const cpu_texture& texture, cpu_summed_area_table<double>& out_table,
+	const cpu_summed_area_table_options& options)
+{
+	cpu_summed_area_table_detail::BuildTable(pool, texture, out_table, options);
+}
+
+// Radii of passes boxes whose repeated average has about the variance of a Gaussian of sigma: the ideal odd width
+// sqrt(12 sigma^2 / passes + 1) rounded down to an odd width for the first passes and up for the rest, split so the
+// variances add up to sigma^2 as closely as whole widths allow.
+inline void IteratedBoxRadii(float sigma, uint32_t passes, std::vector<uint32_t>& out_radii)
+{
+	passes = std::max(1u, passes);
+	double ideal = std::sqrt(12.0 * sigma * sigma / passes + 1.0);
+	int32_t lower = (int32_t)std::floor(ideal);
+	if ((lower & 1) == 0)
+		lower--;
+	lower = std::max(1, lower);
+	double m = (12.0 * sigma * sigma - passes * lower * lower - 4.0 * passes * lower - 3.0 * passes) / (-4.0 * lower - 4.0);
+	uint32_t lower_passes = (uint32_t)std::clamp((int32_t)std::lround(m), 0, (int32_t)passes);
+	out_radii.resize(passes);
+	for (uint32_t i = 0; i < passes; i++)
+		out_radii[i] = (uint32_t)(i < lower_passes ? lower : lower + 2) / 2u;
+}
+
+struct cpu_iterated_box_filter_options
+{
+	float sigma = 8.0f;
+	uint32_t passes = 3u; // 3 is within a few percent of a Gaussian
+	cpu_summed_area_table_options table;
+};
+
+// Approximate Gaussian blur as passes box filters in a row, each through a summed-area table of the previous one's result.
+// Keeps the tables and intermediates between runs.
+class cpu_iterated_box_filter
+{
+public:
+	// From 8-bit texels the first table is exact, the later ones are of float results.
+	void Run(cpu_thread_pool& pool, const cpu_image_rgba8& image, cpu_texture& UAV, const cpu_iterated_box_filter_options& options)
+	{
+		IteratedBoxRadii(options.sigma, options.passes, radii);
+		BuildSummedAreaTable(pool, image, table_u32, options.table);
+		BoxFilter(pool, table_u32, radii[0], radii.size() % 2u ? UAV : intermediate, options.table, inv_columns_f32);
+		RunLaterPasses(pool, UAV, options);
+	}
+
+	void Run(cpu_thread_pool& pool, const cpu_texture& SRV, cpu_texture& UAV, const cpu_iterated_box_filter_options& options)
+	{
+		IteratedBoxRadii(options.sigma, options.passes, radii);
+		BuildSummedAreaTable(pool, SRV, table_f64, options.table);
+		BoxFilter(pool, table_f64, radii[0], radii.size() % 2u ? UAV : intermediate, options.table, inv_columns_f64);
+		RunLaterPasses(pool, UAV, options);
+	}
+
+	// Of the last run.
+	const std::vector<uint32_t>& Radii() const { return radii; }
+
+private:
+	// Ping-pongs between intermediate and UAV so the last pass lands in UAV.
+	void RunLaterPasses(cpu_thread_pool& pool, cpu_texture& UAV, const cpu_iterated_box_filter_options& options)
+	{
+		for (size_t pass = 1; pass < radii.size(); pass++)
+		{
+			bool into_uav = (radii.size() - pass) % 2u == 1u;
+			BuildSummedAreaTable(pool, into_uav ? intermediate : UAV, table_f64, options.table);
+			BoxFilter(pool, table_f64, radii[pass], into_uav ? UAV : intermediate, options.table, inv_columns_f64);
+		}
+	}
+
+	std::vector<uint32_t> radii;
+	cpu_summed_area_table<uint32_t> table_u32;
+	cpu_summed_area_table<double> table_f64;
+	std::vector<float> inv_columns_f32;
+	std::vector<double> inv_columns_f64;
+	cpu_texture intermediate;
+};
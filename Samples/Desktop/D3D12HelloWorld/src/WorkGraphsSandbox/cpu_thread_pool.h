@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//=================================================================================================================================
+// Fixed size pool of worker threads used by the CPU execution paths.
+// The calling thread always participates as worker 0, so a pool of size 1 runs everything inline.
+//=================================================================================================================================
+class cpu_thread_pool
+{
+public:
+	explicit cpu_thread_pool(uint32_t num_workers = 0)
+	{
+		if (num_workers == 0)
+			num_workers = std::max(1u, std::thread::hardware_concurrency());
+		for (uint32_t i = 1; i < num_workers; i++)
+			threads.emplace_back([this, i]() { worker_loop(i); });
+	}
+
+	~cpu_thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (auto& t : threads)
+			t.join();
+	}
+
+	cpu_thread_pool(const cpu_thread_pool&) = delete;
+	cpu_thread_pool& operator=(const cpu_thread_pool&) = delete;
+
+	uint32_t Size() const { return (uint32_t)threads.size() + 1u; }
+
+	// Runs job(worker_index) once on every worker and returns when all of them are done.
+	void Run(const std::function<void(uint32_t)>& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			current_job = &job;
+			running = (uint32_t)threads.size();
+			generation++;
+		}
+		wake.notify_all();
+		job(0);
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return running == 0; });
+		current_job = nullptr;
+	}
+
+	// Splits [begin, end) into chunks of 'grain' indices that workers pull from a shared counter.
+	// fn(chunk_begin, chunk_end, worker_index)
+	template<typename Fn>
+	void ParallelFor(uint32_t begin, uint32_t end, uint32_t grain, Fn&& fn)
+	{
+		if (begin >= end)
+			return;
+		grain = std::max(1u, grain);
+		std::atomic<uint32_t> next(begin);
+		Run([&](uint32_t worker)
+		{
+			for (;;)
+			{
+				uint32_t chunk_begin = next.fetch_add(grain);
+				if (chunk_begin >= end)
+					break;
+				fn(chunk_begin, std::min(end, chunk_begin + grain), worker);
+			}
+		});
+	}
+
+private:
+	void worker_loop(uint32_t worker)
+	{
+		uint64_t seen_generation = 0;
+		for (;;)
+		{
+			const std::function<void(uint32_t)>* job = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return quit || generation != seen_generation; });
+				if (quit)
+					return;
+				seen_generation = generation;
+				job = current_job;
+			}
+			(*job)(worker);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				running--;
+			}
+			done.notify_one();
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(uint32_t)>* current_job = nullptr;
+	uint64_t generation = 0;
+	uint32_t running = 0;
+	bool quit = false;
+};
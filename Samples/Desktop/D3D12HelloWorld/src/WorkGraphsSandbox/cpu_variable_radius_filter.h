@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_bilateral_filter.h"
+#include "cpu_image.h"
+#include "cpu_thread_pool.h"
+#include "cpu_wave.h"
+#include "work_graph_tile_radius.h"
+
+//=================================================================================================================================
+// Bilateral denoise with a radius per 16x16 tile, the CPU engine of the varianceTile -> filterTile graph
+//
+// A prepass estimates every tile's noise and picks its radius from it (work_graph_tile_radius.h), then each tile is filtered at
+// its own radius, so taps are spent where the noise is; tiles with radius 0 are copied. A tile costs (2r + 1)^2 taps per
+// pixel, so the dearest tile of radius 8 costs 289 times a radius 0 one. How tiles are spread over the workers:
+// - raster: equal counts of tiles in raster order per worker, what splitting a dispatch evenly does; whoever gets the noisy
+//   part of the image finishes last
+// - cost_sorted: dearest first, one tile per pull from the shared counter, so a worker that drew cheap tiles comes back for
+//   more while another is still on a dear one (longest processing time first list scheduling)
+// Tiles are filtered by cpu_bilateral_filter's kernels with the same planes, spatial table per radius and range LUT, so a tile
+// matches the fixed radius filter at its radius exactly. filterTile evaluates exp() where this looks the LUT up, which keeps
+// each weight within BilateralLutTolerance().
+//=================================================================================================================================
+enum class cpu_tile_schedule
+{
+	raster,
+	cost_sorted,
+};
+
+inline const char* TileScheduleName(cpu_tile_schedule schedule)
+{
+	switch (schedule)
+	{
+	case cpu_tile_schedule::raster: return "raster";
+	case cpu_tile_schedule::cost_sorted: return "cost sorted";
+	}
+	return "?";
+}
+
+struct cpu_variable_radius_filter_options
+{
+	uint32_t max_radius = c_maxTileRadius;
+	float noise_target = c_tileNoiseTarget;
+	float sigma_range = c_tileRangeSigma;
+	cpu_tile_schedule schedule = cpu_tile_schedule::cost_sorted;
+	cpu_wave_isa isa = cpu_wave_isa::avx2; // avx512 runs the AVX2 kernel
+};
+
+// The prepass result, per tile in row major order.
+struct cpu_tile_radius_map
+{
+	uint32_t tiles_x = 0u;
+	uint32_t tiles_y = 0u;
+	std::vector<float> noise;    // sigma, TileNoiseSigma()
+	std::vector<float> variance; // of the luminance, TileLuminanceVariance()
+	std::vector<uint8_t> radius;
+};
+
+// The noise, variance and radius of every c_radiusTileSize tile of SRV, partial tiles at the edges included.
+inline void EstimateTileRadii(cpu_thread_pool& pool, const cpu_texture& SRV, float noise_target, uint32_t max_radius, cpu_tile_radius_map& map)
+{
+	const uint32_t size = c_radiusTileSize;
+	map.tiles_x = (SRV.width + size - 1u) / size;
+	map.tiles_y = (SRV.height + size - 1u) / size;
+	const uint32_t tiles = map.tiles_x * map.tiles_y;
+	map.noise.resize(tiles);
+	map.variance.resize(tiles);
+	map.radius.resize(tiles);
+	pool.ParallelFor(0u, tiles, map.tiles_x, [&](uint32_t begin, uint32_t end, uint32_t)
+	{
+		uint32_t lum[c_radiusTileSize * c_radiusTileSize];
+		for (uint32_t t = begin; t < end; t++)
+		{
+			uint32_t x0 = (t % map.tiles_x) * size, y0 = (t / map.tiles_x) * size;
+			uint32_t w = std::min(size, SRV.width - x0), h = std::min(size, SRV.height - y0);
+			uint32_t sum = 0u, sum_squares = 0u;
+			for (uint32_t y = 0; y < h; y++)
+			{
+				for (uint32_t x = 0; x < w; x++)
+				{
+					uint32_t l = QuantizeTileLuminance(SRV.texels[(size_t)(y0 + y) * SRV.width + x0 + x]);
+					lum[y * size + x] = l;
+					sum += l;
+					sum_squares += l * l;
+				}
+			}
+			uint32_t laplacian = 0u, count = 0u;
+			for (uint32_t y = 1; y + 1u < h; y++)
+			{
+				for (uint32_t x = 1; x + 1u < w; x++)
+				{
+					const uint32_t* p = &lum[y * size + x];
+					int32_t c = (int32_t)(p[-(int32_t)size - 1] + p[-(int32_t)size + 1] + p[size - 1u] + p[size + 1u]) -
+						2 * (int32_t)(p[-(int32_t)size] + p[-1] + p[1] + p[size]) + 4 * (int32_t)p[0];
+					laplacian += (uint32_t)(c < 0 ? -c : c);
+					count++;
+				}
+			}
+			map.noise[t] = count > 0u ? TileNoiseSigma(laplacian, count) : 0.0f;
+			map.variance[t] = TileLuminanceVariance(sum, sum_squares, w * h);
+			map.radius[t] = (uint8_t)PickTileRadius(map.noise[t], noise_target, max_radius);
+		}
+	});
+}
+
+// The order workers take the tiles of map in, and how many they take per pull, for schedule and that many workers.
+inline uint32_t BuildTileOrder(const cpu_tile_radius_map& map, cpu_tile_schedule schedule, uint32_t workers, std::vector<uint32_t>& out_order)
+{
+	const uint32_t tiles = (uint32_t)map.radius.size();
+	out_order.resize(tiles);
+	if (schedule == cpu_tile_schedule::raster)
+	{
+		for (uint32_t t = 0; t < tiles; t++)
+			out_order[t] = t;
+		workers = std::max(1u, workers);
+		return std::max(1u, (tiles + workers - 1u) / workers);
+	}
+	// Counting sort by descending radius, raster order within a radius.
+	uint32_t first[256 + 1] = {};
+	for (uint8_t r : map.radius)
+		first[255u - r + 1u]++;
+	for (uint32_t r = 1; r <= 256u; r++)
+		first[r] += first[r - 1u];
+	for (uint32_t t = 0; t < tiles; t++)
+		out_order[first[255u - map.radius[t]]++] = t;
+	return 1u;
+}
+
+struct cpu_variable_radius_filter_stats
+{
+	uint32_t tiles_filtered = 0u;  // radius > 0
+	uint32_t tiles_copied = 0u;
+	uint64_t taps = 0u;            // over every filtered pixel
+	uint64_t max_worker_taps = 0u; // of the worker that did the most
+};
+
+// Keeps the tables, planes and tile order between runs, so filtering same sized images doesn't allocate.
+class cpu_variable_radius_filter
+{
+public:
+	// Filters SRV into UAV, which is resized to match.
+	void Run(cpu_thread_pool& pool, const cpu_texture& SRV, cpu_texture& UAV, const cpu_variable_radius_filter_options& options)
+	{
+		using namespace cpu_bilateral_filter_detail;
+		const uint32_t width = SRV.width, height = SRV.height, max_radius = std::min(options.max_radius, 255u);
+		if (UAV.width != width || UAV.height != height)
+			UAV.Resize(width, height);
+		stats = cpu_variable_radius_filter_stats();
+		if (width == 0u || height == 0u)
+			return;
+		EstimateTileRadii(pool, SRV, options.noise_target, max_radius, map);
+		if (spatial.size() != max_radius + 1u || options.sigma_range != table_sigma_range || lut.empty())
+		{
+			spatial.resize(max_radius + 1u);
+			for (uint32_t r = 0; r <= max_radius; r++)
+				BuildBilateralSpatialTable(r, 0.0f, spatial[r]);
+			lut_scale = BuildBilateralRangeLut(options.sigma_range, lut);
+			table_sigma_range = options.sigma_range;
+		}
+		BuildPaddedPlanes(pool, SRV, max_radius, planes);
+		const uint32_t pitch = width + 2u * max_radius;
+		uint32_t grain = BuildTileOrder(map, options.schedule, pool.Size(), order);
+		if (worker_taps.size() < pool.Size())
+			worker_taps.resize(pool.Size());
+		std::fill(worker_taps.begin(), worker_taps.end(), tap_count());
+		bool avx2 = options.isa != cpu_wave_isa::scalar && IsWaveIsaSupported(cpu_wave_isa::avx2);
+
+		pool.ParallelFor(0u, (uint32_t)order.size(), grain, [&](uint32_t begin, uint32_t end, uint32_t worker)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				uint32_t t = order[i], r = map.radius[t];
+				uint32_t x0 = (t % map.tiles_x) * c_radiusTileSize, y0 = (t / map.tiles_x) * c_radiusTileSize;
+				uint32_t x1 = std::min(width, x0 + c_radiusTileSize), y1 = std::min(height, y0 + c_radiusTileSize);
+				if (r == 0u)
+				{
+					for (uint32_t y = y0; y < y1; y++)
+						std::copy(&SRV.texels[(size_t)y * width + x0], &SRV.texels[(size_t)y * width + x1], &UAV.texels[(size_t)y * width + x0]);
+					continue;
+				}
+				// The planes are padded for max_radius; moved in by the difference they look padded for r.
+				size_t shift = (size_t)(max_radius - r) * pitch + (max_radius - r);
+				filter_view view = { { planes[0].data() + shift, planes[1].data() + shift, planes[2].data() + shift, planes[3].data() + shift },
+					pitch, r, spatial[r].data(), lut.data(), lut_scale };
+				FilterRect(view, x0, x1, y0, y1, avx2, UAV);
+				worker_taps[worker].taps += (uint64_t)(2u * r + 1u) * (2u * r + 1u) * (x1 - x0) * (y1 - y0);
+			}
+		});
+
+		for (uint8_t r : map.radius)
+			(r > 0u ? stats.tiles_filtered : stats.tiles_copied)++;
+		for (const tap_count& w : worker_taps)
+		{
+			stats.taps += w.taps;
+			stats.max_worker_taps = std::max(stats.max_worker_taps, w.taps);
+		}
+	}
+
+	// Of the last run.
+	const cpu_tile_radius_map& Map() const { return map; }
+	const cpu_variable_radius_filter_stats& Stats() const { return stats; }
+
+private:
+	// Padded so workers don't share cache lines.
+	struct alignas(64) tap_count
+	{
+		uint64_t taps = 0u;
+	};
+
+	cpu_tile_radius_map map;
+	std::vector<std::vector<float>> spatial; // per radius
+	std::vector<float> lut;
+	float lut_scale = 0.0f;
+	float table_sigma_range = 0.0f;
+	std::vector<float> planes[4];
+	std::vector<uint32_t> order;
+	std::vector<tap_count> worker_taps;
+	cpu_variable_radius_filter_stats stats;
+};
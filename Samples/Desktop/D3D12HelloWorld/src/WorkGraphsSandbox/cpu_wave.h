@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_WAVE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+//=================================================================================================================================
+// Wave emulation for thread launch nodes
+//
+// A thread node with a wave function gets up to cpu_node_desc::wave_lanes of its records per call instead of one (see
+// cpu_work_graph), the way a GPU wave runs 32 threads of a thread node side by side. The function gathers the records into
+// structure-of-arrays lanes and runs the node body across them, with lanes at and past Count() masked off: a work item's last
+// batch is usually partially filled.
+//
+// Node bodies come in one variant per ISA. The vector variants are compiled for their ISA whatever the build targets (GCC
+// and Clang need a target attribute for that, MSVC doesn't) and picked at runtime, so only call one the CPU supports.
+//=================================================================================================================================
+#if defined(CPU_WAVE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_WAVE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define CPU_WAVE_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define CPU_WAVE_TARGET_AVX2
+#define CPU_WAVE_TARGET_AVX512
+#endif
+
+static constexpr uint32_t c_cpuWaveMaxLanes = 16u;
+
+enum class cpu_wave_isa
+{
+	scalar,
+	avx2,   // 8 lanes per instruction
+	avx512, // 16 lanes per instruction
+};
+
+inline const char* WaveIsaName(cpu_wave_isa isa)
+{
+	switch (isa)
+	{
+	case cpu_wave_isa::scalar: return "scalar";
+	case cpu_wave_isa::avx2: return "AVX2";
+	case cpu_wave_isa::avx512: return "AVX-512";
+	}
+	return "?";
+}
+
+inline bool IsWaveIsaSupported(cpu_wave_isa isa)
+{
+	if (isa == cpu_wave_isa::scalar)
+		return true;
+#if defined(CPU_WAVE_X86) && defined(_MSC_VER)
+	// CPUID feature bits plus the OS saving the YMM (and for AVX-512 the ZMM and opmask) state.
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return false;
+	__cpuid(regs, 1);
+	if ((regs[2] & (1 << 27)) == 0) // OSXSAVE
+		return false;
+	bool fma = (regs[2] & (1 << 12)) != 0;
+	unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(regs, 7, 0);
+	if (isa == cpu_wave_isa::avx2)
+		return fma && (regs[1] & (1 << 5)) != 0 && (xcr0 & 0x6u) == 0x6u;
+	return (regs[1] & (1 << 16)) != 0 && (xcr0 & 0xe6u) == 0xe6u;
+#elif defined(CPU_WAVE_X86)
+	return isa == cpu_wave_isa::avx2 ? __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") : __builtin_cpu_supports("avx512f");
+#else
+	return false;
+#endif
+}
+
+inline cpu_wave_isa BestWaveIsa()
+{
+	static const cpu_wave_isa best = IsWaveIsaSupported(cpu_wave_isa::avx512) ? cpu_wave_isa::avx512 :
+		IsWaveIsaSupported(cpu_wave_isa::avx2) ? cpu_wave_isa::avx2 : cpu_wave_isa::scalar;
+	return best;
+}
+
+// Bit l set for the lanes l < count.
+inline uint32_t WaveLaneMask(uint32_t count)
+{
+	return count >= 32u ? ~0u : (1u << count) - 1u;
+}
+
+// One 32-bit field of each active record, from the byte offset in records that are stride bytes apart. Lanes past the last
+// active one are left as they are, inactive lanes below it read 0.
+inline void GatherWaveLanes(const uint8_t* records, uint32_t stride, uint32_t offset, uint32_t lane_mask, uint32_t out[c_cpuWaveMaxLanes])
+{
+	for (uint32_t l = 0; l < c_cpuWaveMaxLanes && (lane_mask >> l) != 0u; l++)
+	{
+		out[l] = 0u;
+		if (lane_mask & (1u << l))
+			memcpy(&out[l], records + (size_t)l * stride + offset, 4u);
+	}
+}
+
+#if defined(CPU_WAVE_X86)
+// AVX2 version of GatherWaveLanes() for 8 lanes, lane_offsets = lane * stride.
+CPU_WAVE_TARGET_AVX2 inline __m256i GatherWaveLanesAvx2(const uint8_t* records, __m256i lane_offsets, uint32_t offset, __m256i lane_mask)
+{
+	return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(records + offset), lane_offsets, lane_mask, 1);
+}
+
+// AVX-512 version of GatherWaveLanes() for 16 lanes, lane_offsets = lane * stride.
+CPU_WAVE_TARGET_AVX512 inline __m512i GatherWaveLanesAvx512(const uint8_t* records, __m512i lane_offsets, uint32_t offset, __mmask16 lane_mask)
+{
+	return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), lane_mask, lane_offsets, records + offset, 1);
+}
+
+// Lanes 0..7 of x, y, z and w as 8 consecutive float4s, the inverse of gathering float4s into structure-of-arrays lanes.
+CPU_WAVE_TARGET_AVX2 inline void StoreFloat4LanesAvx2(float* out, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+	// t[i] holds lane i in its low half and lane i + 4 in its high half.
+	__m256 xy_lo = _mm256_unpacklo_ps(x, y), xy_hi = _mm256_unpackhi_ps(x, y);
+	__m256 zw_lo = _mm256_unpacklo_ps(z, w), zw_hi = _mm256_unpackhi_ps(z, w);
+	__m256 t0 = _mm256_shuffle_ps(xy_lo, zw_lo, 0x44), t1 = _mm256_shuffle_ps(xy_lo, zw_lo, 0xee);
+	__m256 t2 = _mm256_shuffle_ps(xy_hi, zw_hi, 0x44), t3 = _mm256_shuffle_ps(xy_hi, zw_hi, 0xee);
+	_mm256_storeu_ps(out, _mm256_permute2f128_ps(t0, t1, 0x20));
+	_mm256_storeu_ps(out + 8u, _mm256_permute2f128_ps(t2, t3, 0x20));
+	_mm256_storeu_ps(out + 16u, _mm256_permute2f128_ps(t0, t1, 0x31));
+	_mm256_storeu_ps(out + 24u, _mm256_permute2f128_ps(t2, t3, 0x31));
+}
+#endif
@@ -0,0 +1,1056 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_coalescing.h"
+#include "cpu_group_order.h"
+#include "cpu_record_capture.h"
+#include "cpu_record_arena.h"
+#include "cpu_record_block.h"
+#include "cpu_thread_pool.h"
+#include "cpu_wave.h"
+#include "cpu_work_stealing.h"
+#include "work_graph_records.h"
+#include "work_graph_trace.h"
+
+//=================================================================================================================================
+// CPU execution path for work graphs
+//
+// Mirrors the node semantics the sandbox graph relies on so the graph can be run, profiled and validated without a D3D12
+// device:
+// - broadcasting nodes launch one invocation per group of the dispatch grid read from the input record (SV_DispatchGrid)
+// - coalescing nodes receive up to [MaxRecords(N)] input records per invocation, batched by cpu_coalescing_queue
+// - thread nodes receive exactly one input record per invocation, or up to wave_lanes at once with a wave function
+// - a node may output to itself up to [NodeMaxRecursionDepth] levels deep (not for coalescing nodes)
+// Node bodies are written per group, i.e. a node function loops over its own SV_GroupThreadID range.
+// Output records live in a cpu_record_arena per consumer node, sized from the [MaxRecords(N)] declared on its inputs.
+//
+// Each node has one input queue, the records submitted to it and not yet consumed, shared by all edges into it. An output
+// with a high-water mark applies backpressure: once the consumer's queue holds that many records, GetGroupNodeOutputRecords()
+// on it stalls until the queue is back below the mark. A stalled worker doesn't block, it runs work of the nodes below the
+// producer (and launches the consumer's partial coalescing batch) and only yields when none is left for it, so the graph
+// can't deadlock on its own queues. The mark is checked before records are allocated and counted once they're submitted, so
+// a queue overshoots it by at most one [MaxRecords] block per worker.
+//=================================================================================================================================
+
+enum class cpu_node_launch
+{
+	broadcasting,
+	coalescing,
+	thread,
+};
+
+class cpu_node_invocation;
+using cpu_node_function = std::function<void(cpu_node_invocation&)>;
+
+struct cpu_node_output_desc
+{
+	uint32_t target_node = 0u;
+	uint32_t record_stride = 0u;
+	uint32_t max_records = 0u; // [MaxRecords(N)] per invocation
+	uint32_t high_water_mark = 0u; // records queued for target_node at which the producer stalls, 0 is unbounded; not for self recursion
+};
+
+struct cpu_node_desc
+{
+	std::string name;
+	cpu_node_launch launch = cpu_node_launch::thread;
+	uint3 num_threads = { 1u, 1u, 1u };
+	uint3 max_dispatch_grid = { 1u, 1u, 1u }; // broadcasting only
+	uint32_t dispatch_grid_offset = 0u;       // broadcasting only, byte offset of SV_DispatchGrid in the input record
+	uint3 dispatch_grid = { 0u, 0u, 0u };     // broadcasting only, [NodeDispatchGrid]; used instead of SV_DispatchGrid if set
+	cpu_group_order group_order = cpu_group_order::row_major; // broadcasting only, see cpu_group_order.h
+	uint32_t max_recursion_depth = 0u;        // [NodeMaxRecursionDepth], for outputs that target the node itself
+	uint32_t input_record_stride = 0u;
+	uint32_t max_input_records = 1u;          // coalescing only
+	std::shared_ptr<const cpu_flush_heuristic> flush_heuristic; // coalescing only, fill-to-max if not set
+	uint32_t wave_lanes = 0u;                 // thread only, > 0 runs wave_function on up to this many records at a time
+	cpu_node_function wave_function;          // thread only, see cpu_wave.h
+	std::vector<cpu_node_output_desc> outputs;
+	cpu_node_function function;
+};
+
+struct cpu_node_stats
+{
+	std::atomic<uint64_t> invocations{ 0u };
+	std::atomic<uint64_t> records_in{ 0u };
+	std::atomic<uint64_t> records_out{ 0u };
+	std::atomic<uint64_t> busy_ns{ 0u }; // summed over workers, without the time stalled on outputs
+	// Input queue occupancy: records submitted to the node (or passed to DispatchGraph) and not yet consumed, sampled each
+	// time records are added.
+	std::atomic<uint64_t> queued_records{ 0u };
+	std::atomic<uint64_t> peak_queued_records{ 0u };
+	std::atomic<uint64_t> queue_samples{ 0u };
+	std::atomic<uint64_t> queued_records_sum{ 0u };
+
+	double AverageBatchSize() const { return invocations ? (double)records_in / (double)invocations : 0.0; }
+	double RecordsPerSecond() const { return busy_ns ? (double)records_in * 1e9 / (double)busy_ns : 0.0; }
+	double AverageQueuedRecords() const { return queue_samples ? (double)queued_records_sum / (double)queue_samples : 0.0; }
+};
+
+// Backpressure on one output of a node, see cpu_node_output_desc::high_water_mark.
+struct cpu_edge_stats
+{
+	std::atomic<uint64_t> stalls{ 0u };     // GetGroupNodeOutputRecords() calls that found the consumer's queue at the mark
+	std::atomic<uint64_t> stall_ns{ 0u };   // summed over workers, includes the work run while stalled
+	std::atomic<uint64_t> items_run{ 0u };  // work items of other nodes run while stalled
+	std::atomic<uint64_t> yields{ 0u };     // times a stalled worker found nothing to run
+
+	double AverageStallMicroseconds() const { return stalls ? (double)stall_ns * 1e-3 / (double)stalls : 0.0; }
+};
+
+class cpu_work_graph;
+
+//=================================================================================================================================
+// Typed view of the records returned by GetGroupNodeOutputRecords(); submitted to the consumer by OutputComplete().
+template<typename T>
+class cpu_output_records
+{
+public:
+	cpu_output_records(cpu_work_graph* graph, uint32_t producer, uint32_t worker, cpu_record_block* block)
+		: graph(graph), producer(producer), worker(worker), block(block) {}
+
+	T& operator[](uint32_t i) { assert(i < Count()); return *reinterpret_cast<T*>(block->Record(i)); }
+	uint32_t Count() const { return block ? block->count : 0u; }
+	void OutputComplete();
+
+private:
+	cpu_work_graph* graph = nullptr;
+	uint32_t producer = 0u;
+	uint32_t worker = 0u;
+	cpu_record_block* block = nullptr;
+};
+
+//=================================================================================================================================
+// Everything a node function can see during one invocation.
+class cpu_node_invocation
+{
+public:
+	uint32_t worker = 0u;
+	uint3 group_id = { 0u, 0u, 0u };      // SV_GroupID, broadcasting only
+	uint3 dispatch_grid = { 1u, 1u, 1u }; // broadcasting only
+
+	template<typename T>
+	const T& Get(uint32_t i = 0u) const
+	{
+		assert(i < input_count && sizeof(T) <= input_stride);
+		return *reinterpret_cast<const T*>(input + (size_t)i * input_stride);
+	}
+	uint32_t Count() const { return input_count; }
+	// Raw input records for wave functions, which gather fields across records themselves.
+	const uint8_t* InputRecords() const { return input; }
+	uint32_t InputStride() const { return input_stride; }
+	uint32_t GetRemainingRecursionLevels() const;
+
+	template<typename T>
+	cpu_output_records<T> GetGroupNodeOutputRecords(uint32_t output, uint32_t count);
+
+private:
+	friend class cpu_work_graph;
+	cpu_work_graph* graph = nullptr;
+	uint32_t node = 0u;
+	const uint8_t* input = nullptr;
+	uint32_t input_count = 0u;
+	uint32_t input_stride = 0u;
+	uint32_t recursion_level = 0u;
+};
+
+//=================================================================================================================================
+// Work items flow between nodes through per-worker Chase-Lev deques: records submitted by OutputComplete() are pushed to the
+// producing worker's own deques, so a tile's records are mostly consumed on the core that produced them. Idle workers steal
+// from their nearest neighbours first.
+//
+// Each worker has one deque per node priority, the node's distance to the furthest leaf below it. Which priority runs first
+// is the scheduling policy:
+// - breadth_first runs the nodes closest to the entry first, oldest work first. Most parallelism, but a fan-out node
+//   like firstNode produces all of its records before any of them is consumed.
+// - depth_first runs the nodes closest to a leaf first, newest work first, and hands out broadcasting groups one at a time,
+//   so records are consumed right after they're produced. Least memory, but only thieves find producer work to run.
+// - hybrid is breadth first while fewer than in_flight_record_budget records are in flight and depth first above that.
+enum class cpu_scheduling_mode
+{
+	breadth_first,
+	depth_first,
+	hybrid,
+};
+
+struct cpu_scheduling_policy
+{
+	cpu_scheduling_mode mode = cpu_scheduling_mode::depth_first;
+	uint64_t in_flight_record_budget = 64u * 1024u; // hybrid only
+};
+
+inline const char* SchedulingModeName(cpu_scheduling_mode mode)
+{
+	switch (mode)
+	{
+	case cpu_scheduling_mode::breadth_first: return "breadth-first";
+	case cpu_scheduling_mode::depth_first: return "depth-first";
+	case cpu_scheduling_mode::hybrid: return "hybrid";
+	}
+	return "?";
+}
+
+struct cpu_scheduler_stats
+{
+	std::atomic<uint64_t> items_local{ 0u };   // popped from the executing worker's own deque
+	std::atomic<uint64_t> items_stolen{ 0u };  // taken from another worker's deque
+	std::atomic<uint64_t> records_local{ 0u }; // records consumed on the worker that produced them
+	std::atomic<uint64_t> records_remote{ 0u };
+	// Records allocated (or passed to DispatchGraph) and not yet consumed, and their size in bytes.
+	std::atomic<uint64_t> peak_records_in_flight{ 0u };
+	std::atomic<uint64_t> peak_record_bytes_in_flight{ 0u };
+
+	double LocalRecordFraction() const
+	{
+		uint64_t total = records_local + records_remote;
+		return total ? (double)records_local / (double)total : 0.0;
+	}
+};
+
+class cpu_work_graph
+{
+public:
+	explicit cpu_work_graph(cpu_thread_pool& pool, const cpu_scheduling_policy& policy = cpu_scheduling_policy())
+		: pool(pool), policy(policy)
+	{
+		for (uint32_t w = 0; w < pool.Size(); w++)
+		{
+			workers.emplace_back(new worker_state());
+			MakeStealOrder(w, pool.Size(), workers.back()->steal_order);
+		}
+	}
+
+	~cpu_work_graph()
+	{
+		for (auto& c : coalescers)
+		{
+			std::vector<cpu_record_block*> batches;
+			if (c)
+				c->Flush(cpu_flush_reason::drain, batches);
+			for (cpu_record_block* batch : batches)
+				FreeBlock(0u, batch);
+		}
+	}
+
+	uint32_t AddNode(cpu_node_desc desc)
+	{
+		std::unique_ptr<cpu_coalescing_queue> coalescer;
+		if (desc.launch == cpu_node_launch::coalescing)
+		{
+			assert(desc.max_recursion_depth == 0u && "batches don't track recursion levels, recursive coalescing nodes are not supported");
+			if (!desc.flush_heuristic)
+				desc.flush_heuristic = std::make_shared<cpu_fill_to_max_flush>();
+			coalescer.reset(new cpu_coalescing_queue(desc.max_input_records, desc.input_record_stride, desc.flush_heuristic.get()));
+		}
+		assert(desc.wave_lanes <= c_cpuWaveMaxLanes && (desc.wave_lanes == 0u || (desc.launch == cpu_node_launch::thread && desc.wave_function)));
+		edge_stats.emplace_back(new cpu_edge_stats[std::max<size_t>(desc.outputs.size(), 1u)]);
+		nodes.push_back(std::move(desc));
+		stats.emplace_back(new cpu_node_stats());
+		coalescers.push_back(std::move(coalescer));
+		graph_dirty = true;
+		return (uint32_t)nodes.size() - 1u;
+	}
+
+	uint32_t NodeCount() const { return (uint32_t)nodes.size(); }
+	const cpu_node_desc& Node(uint32_t node) const { return nodes[node]; }
+	const cpu_node_stats& Stats(uint32_t node) const { return *stats[node]; }
+	const cpu_edge_stats& EdgeStats(uint32_t node, uint32_t output) const { return edge_stats[node][output]; }
+	const cpu_scheduler_stats& SchedulerStats() const { return scheduler_stats; }
+	const cpu_scheduling_policy& SchedulingPolicy() const { return policy; }
+	// Not while a dispatch is running.
+	void SetSchedulingPolicy(const cpu_scheduling_policy& new_policy) { policy = new_policy; }
+	// nullptr unless the node uses coalescing launch.
+	const cpu_coalescing_queue* Coalescer(uint32_t node) const { return coalescers[node].get(); }
+	// nullptr for nodes that only receive records from DispatchGraph(). Valid once the graph has been dispatched.
+	const cpu_record_arena* Arena(uint32_t node) const { return node < arenas.size() ? arenas[node].get() : nullptr; }
+	// Work items allocated since the graph was created, items are recycled so this levels off once dispatches repeat. Not
+	// while a dispatch is running.
+	uint64_t ItemAllocations() const
+	{
+		uint64_t items = 0u;
+		for (const auto& w : workers)
+			items += w->item_storage.size();
+		return items;
+	}
+
+	// Records an event per executed work item (a range of broadcasting groups, a coalescing batch or a run of thread
+	// records) and one per DispatchGraph. Workers write to their own buffers, reserved here for max_events_per_worker
+	// events; events past that are dropped rather than growing the buffer mid dispatch. Not while a dispatch is running.
+	void EnableTracing(bool enable, size_t max_events_per_worker = 1u << 16)
+	{
+		tracing = enable;
+		trace_capacity = max_events_per_worker;
+		trace_origin = std::chrono::steady_clock::now();
+		trace_dropped = 0u;
+		for (auto& w : workers)
+		{
+			w->trace.clear();
+			w->trace.reserve(enable ? trace_capacity : 0u);
+		}
+		dispatch_trace.clear();
+	}
+
+	// Moves the events recorded since the last call to trace. Workers get a track each, DispatchGraph the track after them.
+	void CollectTrace(work_graph_trace& trace)
+	{
+		std::vector<uint32_t> names(nodes.size());
+		for (uint32_t n = 0; n < nodes.size(); n++)
+			names[n] = trace.Intern(nodes[n].name);
+		const uint32_t dispatch_track = (uint32_t)workers.size();
+		for (uint32_t w = 0; w < workers.size(); w++)
+		{
+			trace.SetTrackName(w, "CPU worker " + std::to_string(w));
+			for (work_graph_trace_event e : workers[w]->trace)
+			{
+				e.name = names[e.name];
+				trace.Add(e);
+			}
+			workers[w]->trace.clear();
+		}
+		trace.SetTrackName(dispatch_track, "DispatchGraph");
+		for (work_graph_trace_event e : dispatch_trace)
+		{
+			e.name = trace.Intern("DispatchGraph " + nodes[e.name].name);
+			e.track = dispatch_track;
+			trace.Add(e);
+		}
+		dispatch_trace.clear();
+	}
+
+	uint64_t DroppedTraceEvents() const { return trace_dropped; }
+
+	// Appends the CPU input and every submitted record block of the following dispatches to capture, nullptr stops.
+	// capture must outlive the graph or the next EnableCapture() call. Not while a dispatch is running.
+	void EnableCapture(cpu_record_capture* new_capture)
+	{
+		capture = new_capture;
+		if (capture && !capture->IsBegun())
+		{
+			std::vector<std::string> names;
+			std::vector<uint32_t> strides;
+			for (const cpu_node_desc& desc : nodes)
+			{
+				names.push_back(desc.name);
+				strides.push_back(desc.input_record_stride);
+			}
+			capture->Begin(names, strides, (uint32_t)workers.size() + 1u);
+		}
+	}
+
+	// Drops records submitted by OutputComplete() instead of launching their consumers, so DispatchGraph() runs the entry
+	// node alone. Used to replay one node from a cpu_record_capture. Not while a dispatch is running.
+	void SetOutputsDiscarded(bool discard) { discard_outputs = discard; }
+
+	void ResetStats()
+	{
+		for (auto& s : stats)
+		{
+			s->invocations = 0u;
+			s->records_in = 0u;
+			s->records_out = 0u;
+			s->busy_ns = 0u;
+			s->peak_queued_records = s->queued_records.load();
+			s->queue_samples = 0u;
+			s->queued_records_sum = 0u;
+		}
+		for (uint32_t n = 0; n < nodes.size(); n++)
+		{
+			for (uint32_t o = 0; o < nodes[n].outputs.size(); o++)
+			{
+				cpu_edge_stats& e = edge_stats[n][o];
+				e.stalls = 0u;
+				e.stall_ns = 0u;
+				e.items_run = 0u;
+				e.yields = 0u;
+			}
+		}
+		for (auto& c : coalescers)
+		{
+			if (c)
+				c->ResetStats();
+		}
+		for (auto& a : arenas)
+		{
+			if (a)
+				a->ResetStats();
+		}
+		scheduler_stats.items_local = 0u;
+		scheduler_stats.items_stolen = 0u;
+		scheduler_stats.records_local = 0u;
+		scheduler_stats.records_remote = 0u;
+		scheduler_stats.peak_records_in_flight = 0u;
+		scheduler_stats.peak_record_bytes_in_flight = 0u;
+	}
+
+	// Equivalent of DispatchGraph() with D3D12_DISPATCH_MODE_NODE_CPU_INPUT: seeds entry_node with the given records and
+	// returns once the graph has drained. The groups of a broadcasting entry are handed out to the workers in contiguous
+	// ranges up front.
+	void DispatchGraph(uint32_t entry_node, const void* records, uint32_t num_records, uint32_t record_stride)
+	{
+		if (num_records == 0u)
+			return;
+		if (graph_dirty)
+		{
+			CreateArenas();
+			CreatePriorities();
+			graph_dirty = false;
+		}
+
+		// The CPU input is copied once into storage owned by the graph and reused by the next dispatch.
+		size_t bytes = (size_t)num_records * record_stride;
+		if (entry_storage.size() < bytes)
+			entry_storage.resize(bytes);
+		memcpy(entry_storage.data(), records, bytes);
+		entry_block.node = entry_node;
+		entry_block.count = num_records;
+		entry_block.stride = record_stride;
+		entry_block.producer_worker = 0u;
+		entry_block.capacity = (uint32_t)entry_storage.size();
+		entry_block.data = entry_storage.data();
+
+		records_in_flight = 0u;
+		record_bytes_in_flight = 0u;
+		AddRecordsInFlight(num_records, bytes);
+		QueueRecords(entry_node, num_records);
+		outstanding_items = 0u;
+		if (capture)
+			capture->Append((uint32_t)workers.size(), entry_node, entry_block.data, num_records);
+		Enqueue(&entry_block, 0u, true);
+		auto start = std::chrono::steady_clock::now();
+		pool.Run([this](uint32_t worker) { WorkerLoop(worker); });
+		if (capture)
+			capture->EndDispatch();
+		if (tracing && dispatch_trace.size() < trace_capacity)
+		{
+			work_graph_trace_event e;
+			e.name = entry_node;
+			e.begin_ns = TraceTime(start);
+			e.end_ns = TraceTime(std::chrono::steady_clock::now());
+			e.records_in = num_records;
+			dispatch_trace.push_back(e);
+		}
+	}
+
+	// Called by cpu_output_records::OutputComplete().
+	void SubmitRecords(uint32_t producer, uint32_t worker, cpu_record_block* block)
+	{
+		stats[producer]->records_out += block->count;
+		workers[worker]->item_records_out += block->count;
+		if (capture)
+			capture->Append(worker, block->node, block->data, block->count);
+		if (discard_outputs)
+		{
+			RetireRecords(block->count, (uint64_t)block->count * block->stride);
+			FreeBlock(worker, block);
+			return;
+		}
+		QueueRecords(block->node, block->count);
+		Enqueue(block, worker, false);
+	}
+
+	cpu_record_block* AllocateOutput(uint32_t producer, uint32_t output, uint32_t count, uint32_t worker, uint32_t recursion_level)
+	{
+		const cpu_node_output_desc& desc = nodes[producer].outputs[output];
+		assert(count <= desc.max_records && "GetGroupNodeOutputRecords() exceeds [MaxRecords]");
+		if (desc.high_water_mark > 0u && desc.target_node != producer && !discard_outputs &&
+			stats[desc.target_node]->queued_records.load(std::memory_order_relaxed) >= desc.high_water_mark)
+			StallOnOutput(producer, output, worker);
+		AddRecordsInFlight(count, (uint64_t)count * desc.record_stride);
+		cpu_record_block* block = arenas[desc.target_node]->Allocate(worker, count);
+		if (desc.target_node == producer)
+		{
+			block->recursion_level = recursion_level + 1u;
+			assert(block->recursion_level <= nodes[producer].max_recursion_depth && "recursion deeper than [NodeMaxRecursionDepth]");
+		}
+		return block;
+	}
+
+private:
+	struct alignas(64) worker_state
+	{
+		std::vector<std::unique_ptr<cpu_chase_lev_deque<cpu_work_item*>>> deques; // indexed by node priority
+		std::deque<cpu_work_item> item_storage; // stable addresses, items are recycled through free_items
+		std::vector<cpu_work_item*> free_items;
+		alignas(64) std::atomic<cpu_work_item*> returned_items{ nullptr }; // items of this worker run by others, taken back all at once
+		std::vector<uint32_t> steal_order;
+		std::vector<cpu_record_block*> batches;
+		std::vector<work_graph_trace_event> trace; // name is the node index until CollectTrace()
+		uint32_t item_records_out = 0u; // submitted by the work item being executed
+		uint64_t item_stall_ns = 0u;    // spent stalled on outputs by the work item being executed
+	};
+
+	// One arena per node that has producers in the graph, its slots fit the largest block any of them can submit.
+	void CreateArenas()
+	{
+		arenas.clear();
+		for (uint32_t n = 0; n < nodes.size(); n++)
+		{
+			uint32_t max_records = nodes[n].launch == cpu_node_launch::coalescing ? nodes[n].max_input_records : 0u;
+			for (const cpu_node_desc& producer : nodes)
+			{
+				for (const cpu_node_output_desc& output : producer.outputs)
+				{
+					if (output.target_node != n)
+						continue;
+					assert(output.record_stride == nodes[n].input_record_stride && "output record doesn't match the consumer's input");
+					max_records = std::max(max_records, output.max_records);
+				}
+			}
+			arenas.emplace_back(max_records > 0u ? new cpu_record_arena(n, nodes[n].input_record_stride, max_records, pool.Size()) : nullptr);
+		}
+	}
+
+	// Priority of a node is its distance to the furthest leaf below it, leaves are 0. Self recursion doesn't count.
+	uint32_t LeafDistance(uint32_t node, std::vector<int>& distance) const
+	{
+		if (distance[node] >= 0)
+			return (uint32_t)distance[node];
+		assert(distance[node] != -2 && "cycles through several nodes are not supported");
+		distance[node] = -2;
+		uint32_t d = 0u;
+		for (const cpu_node_output_desc& output : nodes[node].outputs)
+		{
+			if (output.target_node != node)
+				d = std::max(d, LeafDistance(output.target_node, distance) + 1u);
+		}
+		distance[node] = (int)d;
+		return d;
+	}
+
+	void CreatePriorities()
+	{
+		std::vector<int> distance(nodes.size(), -1);
+		node_priority.resize(nodes.size());
+		uint32_t num_priorities = 1u;
+		for (uint32_t n = 0; n < nodes.size(); n++)
+		{
+			node_priority[n] = LeafDistance(n, distance);
+			num_priorities = std::max(num_priorities, node_priority[n] + 1u);
+		}
+		for (auto& ws : workers)
+		{
+			while (ws->deques.size() < num_priorities)
+				ws->deques.emplace_back(new cpu_chase_lev_deque<cpu_work_item*>());
+		}
+		priorities = num_priorities;
+	}
+
+	void AddRecordsInFlight(uint64_t records, uint64_t bytes)
+	{
+		UpdatePeak(scheduler_stats.peak_records_in_flight, records_in_flight.fetch_add(records) + records);
+		UpdatePeak(scheduler_stats.peak_record_bytes_in_flight, record_bytes_in_flight.fetch_add(bytes) + bytes);
+	}
+
+	void RetireRecords(uint64_t records, uint64_t bytes)
+	{
+		records_in_flight.fetch_sub(records);
+		record_bytes_in_flight.fetch_sub(bytes);
+	}
+
+	void QueueRecords(uint32_t node, uint64_t records)
+	{
+		cpu_node_stats& s = *stats[node];
+		uint64_t queued = s.queued_records.fetch_add(records) + records;
+		UpdatePeak(s.peak_queued_records, queued);
+		s.queue_samples.fetch_add(1u, std::memory_order_relaxed);
+		s.queued_records_sum.fetch_add(queued, std::memory_order_relaxed);
+	}
+
+	void DequeueRecords(uint32_t node, uint64_t records)
+	{
+		stats[node]->queued_records.fetch_sub(records);
+	}
+
+	// Backpressure: runs the work of the nodes below the producer, which the consumer is one of, on this worker until the
+	// consumer's queue is back below the output's high-water mark.
+	void StallOnOutput(uint32_t producer, uint32_t output, uint32_t worker)
+	{
+		const cpu_node_output_desc& desc = nodes[producer].outputs[output];
+		cpu_edge_stats& es = edge_stats[producer][output];
+		worker_state& ws = *workers[worker];
+		const uint32_t records_out = ws.item_records_out;
+		const uint64_t stall_ns = ws.item_stall_ns;
+		auto start = std::chrono::steady_clock::now();
+		es.stalls.fetch_add(1u, std::memory_order_relaxed);
+		while (stats[desc.target_node]->queued_records.load() >= desc.high_water_mark)
+		{
+			cpu_work_item* item = nullptr;
+			bool stolen = false;
+			if (FindWork(worker, item, stolen, node_priority[producer]))
+			{
+				RunItem(*item, worker, stolen);
+				es.items_run.fetch_add(1u, std::memory_order_relaxed);
+				continue;
+			}
+			// Records waiting in a partial batch are only consumed once it launches.
+			if (cpu_coalescing_queue* coalescer = coalescers[desc.target_node].get())
+			{
+				std::vector<cpu_record_block*>& batches = ws.batches;
+				batches.clear();
+				if (coalescer->Flush(cpu_flush_reason::backpressure, batches))
+				{
+					EnqueueBatches(worker, batches);
+					WakeSleepers();
+					continue;
+				}
+			}
+			es.yields.fetch_add(1u, std::memory_order_relaxed);
+			std::this_thread::yield();
+		}
+		uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		es.stall_ns.fetch_add(ns, std::memory_order_relaxed);
+		// The items run here have reset the producer's per item counters.
+		ws.item_records_out = records_out;
+		ws.item_stall_ns = stall_ns + ns;
+	}
+
+	static void UpdatePeak(std::atomic<uint64_t>& peak, uint64_t value)
+	{
+		uint64_t current = peak.load(std::memory_order_relaxed);
+		while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+	}
+
+	// Groups per broadcasting work item. Depth first hands out single groups so their records are consumed before the next
+	// group produces more.
+	uint32_t BroadcastChunk(uint32_t num_groups) const
+	{
+		if (policy.mode != cpu_scheduling_mode::breadth_first)
+			return 1u;
+		return std::max(1u, num_groups / ((uint32_t)workers.size() * 16u));
+	}
+
+	static const uint3& DispatchGrid(const cpu_node_desc& desc, const uint8_t* record)
+	{
+		if (desc.dispatch_grid.x != 0u)
+			return desc.dispatch_grid;
+		return *reinterpret_cast<const uint3*>(record + desc.dispatch_grid_offset);
+	}
+
+	void FreeBlock(uint32_t worker, cpu_record_block* block)
+	{
+		if (block->arena)
+			block->arena->Release(worker, block);
+	}
+
+	// Returns true if this was the last work item referencing the block.
+	bool ReleaseBlock(uint32_t worker, cpu_record_block* block)
+	{
+		if (block->pending_items.fetch_sub(1u) != 1u)
+			return false;
+		FreeBlock(worker, block);
+		return true;
+	}
+
+	// Items come from and go back to one worker's storage, so stealing doesn't move them to the thief and the storage stops
+	// growing once the dispatches repeat. Called by the owner, or by DispatchGraph() before the workers start.
+	cpu_work_item* AllocateItem(uint32_t worker)
+	{
+		worker_state& ws = *workers[worker];
+		if (ws.free_items.empty())
+		{
+			// Taking the whole list at once is free of ABA, other workers only ever push.
+			for (cpu_work_item* item = ws.returned_items.exchange(nullptr, std::memory_order_acquire); item; item = item->next_returned)
+				ws.free_items.push_back(item);
+		}
+		if (ws.free_items.empty())
+		{
+			ws.item_storage.emplace_back();
+			ws.item_storage.back().owner = worker;
+			return &ws.item_storage.back();
+		}
+		cpu_work_item* item = ws.free_items.back();
+		ws.free_items.pop_back();
+		return item;
+	}
+
+	void FreeItem(uint32_t worker, cpu_work_item* item)
+	{
+		if (item->owner == worker)
+		{
+			workers[worker]->free_items.push_back(item);
+			return;
+		}
+		std::atomic<cpu_work_item*>& returned = workers[item->owner]->returned_items;
+		item->next_returned = returned.load(std::memory_order_relaxed);
+		while (!returned.compare_exchange_weak(item->next_returned, item, std::memory_order_release, std::memory_order_relaxed)) {}
+	}
+
+	void Push(uint32_t worker, cpu_work_item* item)
+	{
+		outstanding_items.fetch_add(1u);
+		workers[worker]->deques[node_priority[item->block->node]]->Push(item);
+	}
+
+	void WakeSleepers()
+	{
+		if (sleepers.load() > 0u)
+			wake.notify_all();
+	}
+
+	// Splits a block into work items for its consumer node and pushes them to the deque of 'worker'.
+	// With distribute set (only allowed before the workers run), broadcasting groups are spread over all workers instead.
+	void Enqueue(cpu_record_block* block, uint32_t worker, bool distribute)
+	{
+		const cpu_node_desc& desc = nodes[block->node];
+		// Once its last item is pushed the block may run and be freed on another worker, don't read it after that.
+		const uint32_t count = block->count;
+		switch (desc.launch)
+		{
+		case cpu_node_launch::broadcasting:
+			{
+				const uint32_t num_workers = (uint32_t)workers.size();
+				uint32_t total_items = 0u;
+				for (uint32_t r = 0; r < count; r++)
+				{
+					const uint3& grid = DispatchGrid(desc, block->Record(r));
+					assert(desc.dispatch_grid.x != 0u ||
+						(grid.x <= desc.max_dispatch_grid.x && grid.y <= desc.max_dispatch_grid.y && grid.z <= desc.max_dispatch_grid.z));
+					uint32_t num_groups = grid.x * grid.y * grid.z;
+					uint32_t chunk = BroadcastChunk(num_groups);
+					total_items += (num_groups + chunk - 1u) / chunk;
+				}
+				if (total_items == 0u)
+				{
+					DequeueRecords(block->node, count);
+					FreeBlock(worker, block);
+					return;
+				}
+				block->pending_items = total_items;
+
+				uint32_t item_index = 0u;
+				for (uint32_t r = 0; r < count; r++)
+				{
+					const uint3& grid = DispatchGrid(desc, block->Record(r));
+					uint32_t num_groups = grid.x * grid.y * grid.z;
+					uint32_t chunk = BroadcastChunk(num_groups);
+					uint32_t num_chunks = (num_groups + chunk - 1u) / chunk;
+					const uint32_t* group_order = group_orders.Get(desc.group_order, grid);
+					// Pushed back to front so each owner pops its range in ascending order and thieves take the far end.
+					for (uint32_t c = num_chunks; c-- > 0u; )
+					{
+						uint32_t target = distribute ? (uint32_t)(((uint64_t)(item_index + c) * num_workers) / total_items) : worker;
+						cpu_work_item* item = AllocateItem(target);
+						item->block = block;
+						item->first_record = r;
+						item->record_count = 1u;
+						item->group_begin = c * chunk;
+						item->group_end = std::min(num_groups, (c + 1u) * chunk);
+						item->group_order = group_order;
+						Push(target, item);
+					}
+					item_index += num_chunks;
+				}
+			}
+			break;
+		case cpu_node_launch::coalescing:
+			{
+				// Records are copied into batches, the producer's block is done with once that's finished.
+				std::vector<cpu_record_block*>& batches = workers[worker]->batches;
+				batches.clear();
+				cpu_record_arena* arena = arenas[block->node].get();
+				coalescers[block->node]->Append(block->Record(0), block->count,
+					[arena, worker](uint32_t capacity) { return arena->Allocate(worker, capacity); }, batches);
+				uint32_t producer_worker = block->producer_worker;
+				FreeBlock(worker, block);
+				for (cpu_record_block* batch : batches)
+					batch->producer_worker = producer_worker;
+				EnqueueBatches(worker, batches);
+			}
+			break;
+		case cpu_node_launch::thread:
+			{
+				// A large CPU input, e.g. a replayed record stream, is split so every worker gets a share.
+				const uint32_t num_workers = (uint32_t)workers.size();
+				uint32_t chunk = distribute ? thread_entry_chunk : count;
+				uint32_t num_items = (count + chunk - 1u) / chunk;
+				block->pending_items = num_items;
+				for (uint32_t c = num_items; c-- > 0u; )
+				{
+					uint32_t target = distribute ? (uint32_t)(((uint64_t)c * num_workers) / num_items) : worker;
+					cpu_work_item* item = AllocateItem(target);
+					item->block = block;
+					item->first_record = c * chunk;
+					item->record_count = std::min(chunk, count - c * chunk);
+					Push(target, item);
+				}
+			}
+			break;
+		}
+		WakeSleepers();
+	}
+
+	void EnqueueBatches(uint32_t worker, const std::vector<cpu_record_block*>& batches)
+	{
+		for (cpu_record_block* batch : batches)
+		{
+			batch->pending_items = 1u;
+			cpu_work_item* item = AllocateItem(worker);
+			item->block = batch;
+			item->first_record = 0u;
+			item->record_count = batch->count;
+			Push(worker, item);
+		}
+	}
+
+	// Launches partial coalescing batches. With cpu_flush_reason::drain every partial batch launches.
+	bool FlushCoalescers(cpu_flush_reason reason, uint32_t worker)
+	{
+		std::vector<cpu_record_block*>& batches = workers[worker]->batches;
+		batches.clear();
+		for (auto& c : coalescers)
+		{
+			if (c)
+				c->Flush(reason, batches);
+		}
+		EnqueueBatches(worker, batches);
+		WakeSleepers();
+		return !batches.empty();
+	}
+
+	// Highest priority first: leaf side when running depth first, entry side when running breadth first. Within a priority
+	// the worker's own deque comes first (LIFO depth first, FIFO breadth first), then its neighbours'. With below_priority
+	// set only the nodes below that priority are considered, depth first.
+	bool FindWork(uint32_t worker, cpu_work_item*& out_item, bool& out_stolen, uint32_t below_priority = ~0u)
+	{
+		worker_state& ws = *workers[worker];
+		bool depth_first = policy.mode == cpu_scheduling_mode::depth_first || below_priority != ~0u ||
+			(policy.mode == cpu_scheduling_mode::hybrid && records_in_flight.load(std::memory_order_relaxed) >= policy.in_flight_record_budget);
+		for (uint32_t p = 0; p < std::min(priorities, below_priority); p++)
+		{
+			uint32_t priority = depth_first ? p : priorities - 1u - p;
+			cpu_chase_lev_deque<cpu_work_item*>& own = *ws.deques[priority];
+			out_stolen = false;
+			if (depth_first ? own.Pop(out_item) : own.Steal(out_item))
+				return true;
+			out_stolen = true;
+			for (uint32_t victim : ws.steal_order)
+			{
+				if (workers[victim]->deques[priority]->Steal(out_item))
+					return true;
+			}
+		}
+		return false;
+	}
+
+	void WorkerLoop(uint32_t worker)
+	{
+		uint32_t idle_rounds = 0u;
+		for (;;)
+		{
+			cpu_work_item* item = nullptr;
+			bool stolen = false;
+			if (FindWork(worker, item, stolen))
+			{
+				idle_rounds = 0u;
+				RunItem(*item, worker, stolen);
+				continue;
+			}
+
+			// Nothing to run: partial batches get their chance to launch before this worker backs off.
+			bool drained = outstanding_items.load() == 0u;
+			if (FlushCoalescers(drained ? cpu_flush_reason::drain : cpu_flush_reason::idle, worker))
+				continue;
+			if (drained)
+				return;
+			if (++idle_rounds < 64u)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(sleep_mutex);
+			sleepers++;
+			wake.wait_for(lock, std::chrono::microseconds(100));
+			sleepers--;
+		}
+	}
+
+	void RunItem(cpu_work_item& item, uint32_t worker, bool stolen)
+	{
+		Execute(item, worker, stolen);
+		FreeItem(worker, &item);
+		if (outstanding_items.fetch_sub(1u) == 1u)
+			wake.notify_all();
+	}
+
+	uint64_t TraceTime(std::chrono::steady_clock::time_point t) const
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t - trace_origin).count();
+	}
+
+	void TraceItem(uint32_t worker, uint32_t node, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end,
+		uint32_t invocations, uint32_t records_in)
+	{
+		worker_state& ws = *workers[worker];
+		if (ws.trace.size() >= trace_capacity)
+		{
+			trace_dropped.fetch_add(1u, std::memory_order_relaxed);
+			return;
+		}
+		work_graph_trace_event e;
+		e.name = node;
+		e.track = worker;
+		e.begin_ns = TraceTime(start);
+		e.end_ns = TraceTime(end);
+		e.invocations = invocations;
+		e.records_in = records_in;
+		e.records_out = ws.item_records_out;
+		ws.trace.push_back(e);
+	}
+
+	void Execute(const cpu_work_item& item, uint32_t worker, bool stolen)
+	{
+		cpu_record_block* block = item.block;
+		const cpu_node_desc& desc = nodes[block->node];
+		cpu_node_stats& node_stats = *stats[block->node];
+
+		(stolen ? scheduler_stats.items_stolen : scheduler_stats.items_local) += 1u;
+		(block->producer_worker == worker ? scheduler_stats.records_local : scheduler_stats.records_remote) += item.record_count;
+
+		cpu_node_invocation inv;
+		inv.graph = this;
+		inv.node = block->node;
+		inv.worker = worker;
+		inv.input_stride = block->stride;
+		inv.recursion_level = block->recursion_level;
+		workers[worker]->item_records_out = 0u;
+		workers[worker]->item_stall_ns = 0u;
+		uint32_t invocations = 0u, records_in = 0u;
+		auto start = std::chrono::steady_clock::now();
+
+		switch (desc.launch)
+		{
+		case cpu_node_launch::broadcasting:
+			{
+				inv.input = block->Record(item.first_record);
+				inv.input_count = 1u;
+				inv.dispatch_grid = DispatchGrid(desc, inv.input);
+				for (uint32_t i = item.group_begin; i < item.group_end; i++)
+				{
+					uint32_t g = item.group_order ? item.group_order[i] : i;
+					inv.group_id.x = g % inv.dispatch_grid.x;
+					inv.group_id.y = (g / inv.dispatch_grid.x) % inv.dispatch_grid.y;
+					inv.group_id.z = g / (inv.dispatch_grid.x * inv.dispatch_grid.y);
+					desc.function(inv);
+				}
+				invocations = item.group_end - item.group_begin;
+				records_in = item.group_begin == 0u ? 1u : 0u;
+			}
+			break;
+		case cpu_node_launch::coalescing:
+			inv.input = block->Record(item.first_record);
+			inv.input_count = item.record_count;
+			desc.function(inv);
+			invocations = 1u;
+			records_in = item.record_count;
+			RetireRecords(item.record_count, (uint64_t)item.record_count * block->stride);
+			DequeueRecords(block->node, item.record_count);
+			break;
+		case cpu_node_launch::thread:
+			if (desc.wave_lanes > 0u)
+			{
+				for (uint32_t r = item.first_record; r < item.first_record + item.record_count; r += desc.wave_lanes)
+				{
+					inv.input = block->Record(r);
+					inv.input_count = std::min(desc.wave_lanes, item.first_record + item.record_count - r);
+					desc.wave_function(inv);
+				}
+			}
+			else
+			{
+				inv.input_count = 1u;
+				for (uint32_t r = item.first_record; r < item.first_record + item.record_count; r++)
+				{
+					inv.input = block->Record(r);
+					desc.function(inv);
+				}
+			}
+			invocations = item.record_count;
+			records_in = item.record_count;
+			RetireRecords(item.record_count, (uint64_t)item.record_count * block->stride);
+			DequeueRecords(block->node, item.record_count);
+			break;
+		}
+		auto end = std::chrono::steady_clock::now();
+		node_stats.invocations += invocations;
+		node_stats.records_in += records_in;
+		node_stats.busy_ns += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() - workers[worker]->item_stall_ns;
+		if (tracing)
+			TraceItem(worker, block->node, start, end, invocations, records_in);
+
+		// A broadcasting input record is consumed once all of its groups ran.
+		uint32_t node = block->node, count = block->count, stride = block->stride;
+		if (ReleaseBlock(worker, block) && desc.launch == cpu_node_launch::broadcasting)
+		{
+			RetireRecords(count, (uint64_t)count * stride);
+			DequeueRecords(node, count);
+		}
+	}
+
+	cpu_thread_pool& pool;
+	std::vector<cpu_node_desc> nodes;
+	std::vector<std::unique_ptr<cpu_node_stats>> stats;
+	std::vector<std::unique_ptr<cpu_edge_stats[]>> edge_stats; // per output
+	std::vector<std::unique_ptr<cpu_coalescing_queue>> coalescers;
+	std::vector<std::unique_ptr<cpu_record_arena>> arenas;
+	cpu_group_order_cache group_orders; // shared by all broadcasting nodes, see cpu_node_desc::group_order
+	std::vector<uint32_t> node_priority;
+	uint32_t priorities = 1u;
+	bool graph_dirty = true;
+	cpu_scheduling_policy policy;
+	cpu_record_block entry_block;
+	std::vector<uint8_t> entry_storage;
+	cpu_scheduler_stats scheduler_stats;
+	bool tracing = false;
+	size_t trace_capacity = 0u;
+	std::chrono::steady_clock::time_point trace_origin;
+	std::vector<work_graph_trace_event> dispatch_trace; // name is the entry node index until CollectTrace()
+	std::atomic<uint64_t> trace_dropped{ 0u };
+	cpu_record_capture* capture = nullptr;
+	bool discard_outputs = false;
+	static constexpr uint32_t thread_entry_chunk = 256u; // records per work item when a thread node is the entry
+
+	std::vector<std::unique_ptr<worker_state>> workers;
+	std::atomic<uint64_t> outstanding_items{ 0u }; // pushed but not yet finished
+	std::atomic<uint64_t> records_in_flight{ 0u };
+	std::atomic<uint64_t> record_bytes_in_flight{ 0u };
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::atomic<uint32_t> sleepers{ 0u };
+};
+
+//=================================================================================================================================
+template<typename T>
+void cpu_output_records<T>::OutputComplete()
+{
+	if (block)
+		graph->SubmitRecords(producer, worker, block);
+	block = nullptr;
+}
+
+template<typename T>
+cpu_output_records<T> cpu_node_invocation::GetGroupNodeOutputRecords(uint32_t output, uint32_t count)
+{
+	assert(sizeof(T) == graph->Node(node).outputs[output].record_stride);
+	if (count == 0u)
+		return cpu_output_records<T>(graph, node, worker, nullptr);
+	return cpu_output_records<T>(graph, node, worker, graph->AllocateOutput(node, output, count, worker, recursion_level));
+}
+
+inline uint32_t cpu_node_invocation::GetRemainingRecursionLevels() const
+{
+	return graph->Node(node).max_recursion_depth - recursion_level;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//=================================================================================================================================
+// Chase-Lev work-stealing deque (Le, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory
+// Models", PPoPP 2013).
+//
+// The owning worker pushes and pops at the bottom (LIFO, so the records it just produced are consumed while still in its
+// caches), other workers steal from the top (FIFO, the oldest and usually largest pieces of work).
+// T must be trivially copyable and fit in a lock-free std::atomic, the executor stores pointers.
+//=================================================================================================================================
+template<typename T>
+class cpu_chase_lev_deque
+{
+public:
+	explicit cpu_chase_lev_deque(uint32_t initial_capacity = 256u)
+	{
+		uint32_t capacity = 1u;
+		while (capacity < initial_capacity)
+			capacity <<= 1u;
+		arrays.emplace_back(new ring(capacity));
+		array.store(arrays.back().get(), std::memory_order_relaxed);
+	}
+
+	cpu_chase_lev_deque(const cpu_chase_lev_deque&) = delete;
+	cpu_chase_lev_deque& operator=(const cpu_chase_lev_deque&) = delete;
+
+	// Owner only.
+	void Push(T x)
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		ring* a = array.load(std::memory_order_relaxed);
+		if (b - t > (int64_t)a->mask)
+			a = Grow(a, t, b);
+		a->Put(b, x);
+		// Release store instead of the paper's release fence + relaxed store, same guarantees and visible to TSAN.
+		bottom.store(b + 1, std::memory_order_release);
+	}
+
+	// Owner only.
+	bool Pop(T& out)
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		ring* a = array.load(std::memory_order_relaxed);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+		if (t > b)
+		{
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+		out = a->Get(b);
+		if (t == b)
+		{
+			// Last element, race against thieves for it.
+			bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+		return true;
+	}
+
+	// Any thread.
+	bool Steal(T& out)
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return false;
+		ring* a = array.load(std::memory_order_acquire);
+		T x = a->Get(t);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return false;
+		out = x;
+		return true;
+	}
+
+	// Approximate, for heuristics only.
+	int64_t Size() const
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_relaxed);
+		return b > t ? b - t : 0;
+	}
+
+private:
+	struct ring
+	{
+		explicit ring(uint32_t capacity) : mask(capacity - 1u), slots(new std::atomic<T>[capacity]) {}
+		T Get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+		void Put(int64_t i, T x) { slots[i & mask].store(x, std::memory_order_relaxed); }
+
+		uint64_t mask;
+		std::unique_ptr<std::atomic<T>[]> slots;
+	};
+
+	// Old rings stay alive until the deque is destroyed since a thief may still be reading from them.
+	ring* Grow(ring* a, int64_t t, int64_t b)
+	{
+		ring* grown = new ring((uint32_t)(a->mask + 1u) * 2u);
+		for (int64_t i = t; i < b; i++)
+			grown->Put(i, a->Get(i));
+		arrays.emplace_back(grown);
+		array.store(grown, std::memory_order_release);
+		return grown;
+	}
+
+	alignas(64) std::atomic<int64_t> top{ 0 };
+	alignas(64) std::atomic<int64_t> bottom{ 0 };
+	std::atomic<ring*> array{ nullptr };
+	std::vector<std::unique_ptr<ring>> arrays;
+};
+
+//=================================================================================================================================
+// Victims in order of distance from the thief: w+1, w-1, w+2, w-2, ...
+// Neighbouring workers were handed neighbouring tiles of the dispatch grid, so stealing close by keeps records near the
+// tile that produced them.
+inline void MakeStealOrder(uint32_t worker, uint32_t num_workers, std::vector<uint32_t>& out_order)
+{
+	out_order.clear();
+	for (uint32_t d = 1; out_order.size() + 1u < num_workers; d++)
+	{
+		out_order.push_back((worker + d) % num_workers);
+		if (out_order.size() + 1u < num_workers)
+			out_order.push_back((worker + num_workers - d) % num_workers);
+	}
+}
@@ -100,6 +100,11 @@ struct ExampleDescriptorHeapAllocator
 		int cpu_idx = (int)((out_cpu_desc_handle.ptr - HeapStartCpu.ptr) / HeapHandleIncrement);
 		FreeIndices.push_back(cpu_idx);
 	}
+	// Heap index of a handle from Alloc(), what shaders use with ResourceDescriptorHeap[].
+	UINT Index(D3D12_CPU_DESCRIPTOR_HANDLE cpu_desc_handle) const
+	{
+		return (UINT)((cpu_desc_handle.ptr - HeapStartCpu.ptr) / HeapHandleIncrement);
+	}
 };
 
 struct FrameContext
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "work_graph_records.h"
+
+//=================================================================================================================================
+// Seeding of batchFirstNode, which runs the firstNode -> secondNode copy over many images with one DispatchGraph.
+//
+// The shaders reach each image through ResourceDescriptorHeap with the heap indices carried in its records, so the images'
+// descriptors can live anywhere in the heap and nothing has to be packed into a contiguous table or rebound between images.
+// One broadcasting record covers at most [NodeMaxDispatchGrid(256,256,1)] groups of 16x16, larger images (or any image
+// when a smaller tile_size is asked for) are split into tiles, one record each with the tile origin.
+// Shared by the D3D12 app and the CPU path, keep it free of D3D types.
+//=================================================================================================================================
+struct work_graph_batch_image
+{
+	uint32_t width = 0u;
+	uint32_t height = 0u;
+	uint32_t srv_index = 0u; // descriptor heap index of the input SRV
+	uint32_t uav_index = 0u; // descriptor heap index of the output UAV
+};
+
+// Largest tile one batchFirstNode record can cover.
+static const uint32_t c_batchMaxTileSize = 256u * 16u;
+
+// tile_size rounded down to a whole number of groups and clamped to what one record can cover.
+inline uint32_t BatchTileSize(uint32_t tile_size)
+{
+	return std::min(std::max(tile_size & ~15u, 16u), c_batchMaxTileSize);
+}
+
+inline uint32_t BatchEntryRecordCount(const work_graph_batch_image& image, uint32_t tile_size)
+{
+	tile_size = BatchTileSize(tile_size);
+	return ((image.width + tile_size - 1u) / tile_size) * ((image.height + tile_size - 1u) / tile_size);
+}
+
+// Appends the records for images[0, count) to out_records and returns how many were added. Unlike the width / 16 grid
+// run_work_graph() gives firstNode, partial groups at the right and bottom edges are kept since arbitrary image sizes are
+// expected; their extra threads read zeros and their stores are dropped.
+inline uint32_t BuildBatchEntryRecords(const work_graph_batch_image* images, size_t count, uint32_t tile_size,
+	std::vector<batchEntryRecord>& out_records)
+{
+	tile_size = BatchTileSize(tile_size);
+	size_t first = out_records.size();
+	size_t total = first;
+	for (size_t i = 0; i < count; i++)
+		total += BatchEntryRecordCount(images[i], tile_size);
+	out_records.reserve(total);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const work_graph_batch_image& image = images[i];
+		for (uint32_t y = 0; y < image.height; y += tile_size)
+		{
+			for (uint32_t x = 0; x < image.width; x += tile_size)
+			{
+				batchEntryRecord record;
+				record.gridSize.x = (std::min(tile_size, image.width - x) + 15u) / 16u;
+				record.gridSize.y = (std::min(tile_size, image.height - y) + 15u) / 16u;
+				record.gridSize.z = 1u;
+				record.origin = { x, y };
+				record.srvIndex = image.srv_index;
+				record.uavIndex = image.uav_index;
+				out_records.push_back(record);
+			}
+		}
+	}
+	return (uint32_t)(out_records.size() - first);
+}
+
+inline uint32_t BuildBatchEntryRecords(const std::vector<work_graph_batch_image>& images, uint32_t tile_size,
+	std::vector<batchEntryRecord>& out_records)
+{
+	return BuildBatchEntryRecords(images.data(), images.size(), tile_size, out_records);
+}
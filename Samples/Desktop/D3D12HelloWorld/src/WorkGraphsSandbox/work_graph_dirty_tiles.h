@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "work_graph_batch.h"
+#include "work_graph_records.h"
+
+//=================================================================================================================================
+// Change tracking so the copy is only re-dispatched where its output is stale
+//
+// The sandbox's input doesn't change between frames, so dispatching the graph every frame redraws the same image. This keeps
+// a dirty flag per 16x16 tile (one batchFirstNode group) of an image:
+// - edits to the input mark the tiles they touch, MarkRect()
+// - a change of the parameters the output depends on marks every tile, TrackParameters()
+// BuildDirtyEntryRecords() then seeds batchFirstNode with records that cover just the dirty tiles, one per horizontal run of
+// them, and clears the flags. Nothing dirty means nothing to dispatch. batchFirstNode is a plain copy, so this only redraws
+// what firstNode and batchFirstNode would draw. refineTile is seeded with the root tiles that hold a dirty tile instead,
+// BuildDirtyRefineRoots(). The other entries take an entryRecord that has no origin, so they have to be redrawn in full.
+// Shared by the D3D12 app and the CPU path, keep it free of D3D types.
+//=================================================================================================================================
+class work_graph_dirty_tiles
+{
+public:
+	static const uint32_t c_tileSize = 16u;
+
+	// Starts with every tile dirty.
+	void Resize(uint32_t new_width, uint32_t new_height)
+	{
+		width = new_width;
+		height = new_height;
+		tiles_x = (width + c_tileSize - 1u) / c_tileSize;
+		tiles_y = (height + c_tileSize - 1u) / c_tileSize;
+		dirty.assign((size_t)tiles_x * tiles_y, 0u);
+		dirty_count = 0u;
+		MarkAll();
+	}
+
+	uint32_t Width() const { return width; }
+	uint32_t Height() const { return height; }
+	uint32_t TilesX() const { return tiles_x; }
+	uint32_t TilesY() const { return tiles_y; }
+	uint32_t TileCount() const { return tiles_x * tiles_y; }
+	uint32_t DirtyCount() const { return dirty_count; }
+	bool Any() const { return dirty_count > 0u; }
+	bool All() const { return dirty_count == TileCount(); }
+	bool IsDirty(uint32_t tile_x, uint32_t tile_y) const { return dirty[(size_t)tile_y * tiles_x + tile_x] != 0u; }
+
+	void MarkAll()
+	{
+		std::fill(dirty.begin(), dirty.end(), (uint8_t)1u);
+		dirty_count = TileCount();
+	}
+
+	void Clear()
+	{
+		std::fill(dirty.begin(), dirty.end(), (uint8_t)0u);
+		dirty_count = 0u;
+	}
+
+	// Marks the tiles overlapping the pixels [x, x + w) x [y, y + h), clipped to the image.
+	void MarkRect(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+	{
+		if (x >= width || y >= height || w == 0u || h == 0u)
+			return;
+		uint32_t x_end = (std::min(width - x, w) + x + c_tileSize - 1u) / c_tileSize;
+		uint32_t y_end = (std::min(height - y, h) + y + c_tileSize - 1u) / c_tileSize;
+		for (uint32_t ty = y / c_tileSize; ty < y_end; ty++)
+		{
+			for (uint32_t tx = x / c_tileSize; tx < x_end; tx++)
+			{
+				uint8_t& d = dirty[(size_t)ty * tiles_x + tx];
+				dirty_count += d ? 0u : 1u;
+				d = 1u;
+			}
+		}
+	}
+
+	// Marks every tile if parameters differ from the ones of the previous call, or on the first call, and returns whether it
+	// did. They're compared bytewise, so value initialize structs that have padding.
+	template<typename T>
+	bool TrackParameters(const T& parameters)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "parameters are compared bytewise");
+		if (tracked_parameters.size() == sizeof(T) && memcmp(tracked_parameters.data(), &parameters, sizeof(T)) == 0)
+			return false;
+		tracked_parameters.resize(sizeof(T));
+		memcpy(tracked_parameters.data(), &parameters, sizeof(T));
+		MarkAll();
+		return true;
+	}
+
+	// Appends batchFirstNode records for the dirty tiles of image (which must be the tracked size) to out_records, clears the
+	// flags and returns how many records were added. Each record is one horizontal run of dirty tiles, up to what one record
+	// can cover; with every tile dirty the image is split as BuildBatchEntryRecords() does, into the fewest records.
+	uint32_t BuildDirtyEntryRecords(const work_graph_batch_image& image, std::vector<batchEntryRecord>& out_records)
+	{
+		if (All())
+		{
+			Clear();
+			return BuildBatchEntryRecords(&image, 1, c_batchMaxTileSize, out_records);
+		}
+		const uint32_t max_run = c_batchMaxTileSize / c_tileSize;
+		size_t first = out_records.size();
+		for (uint32_t ty = 0; ty < tiles_y && dirty_count > 0u; ty++)
+		{
+			const uint8_t* row = &dirty[(size_t)ty * tiles_x];
+			for (uint32_t tx = 0; tx < tiles_x; )
+			{
+				if (!row[tx])
+				{
+					tx++;
+					continue;
+				}
+				uint32_t run = 1u;
+				while (tx + run < tiles_x && run < max_run && row[tx + run])
+					run++;
+				batchEntryRecord record;
+				record.gridSize = { run, 1u, 1u };
+				record.origin = { tx * c_tileSize, ty * c_tileSize };
+				record.srvIndex = image.srv_index;
+				record.uavIndex = image.uav_index;
+				out_records.push_back(record);
+				dirty_count -= run;
+				tx += run;
+			}
+		}
+		Clear();
+		return (uint32_t)(out_records.size() - first);
+	}
+
+	// Appends the refineTile root tiles of MakeRefineRootTiles() that hold a dirty tile to out_tiles, clears the flags and
+	// returns how many were added. Root tiles refine independently, so this redraws them as a full dispatch would.
+	uint32_t BuildDirtyRefineRoots(std::vector<tileRecord>& out_tiles)
+	{
+		const uint32_t root_tiles = (16u << c_maxRefineDepth) / c_tileSize;
+		size_t first = out_tiles.size();
+		for (uint32_t ry = 0; ry < tiles_y && dirty_count > 0u; ry += root_tiles)
+		{
+			for (uint32_t rx = 0; rx < tiles_x; rx += root_tiles)
+			{
+				bool any = false;
+				for (uint32_t ty = ry; ty < std::min(ry + root_tiles, tiles_y) && !any; ty++)
+				{
+					for (uint32_t tx = rx; tx < std::min(rx + root_tiles, tiles_x) && !any; tx++)
+						any = dirty[(size_t)ty * tiles_x + tx] != 0u;
+				}
+				if (any)
+					out_tiles.push_back({ { rx * c_tileSize, ry * c_tileSize }, root_tiles * c_tileSize });
+			}
+		}
+		Clear();
+		return (uint32_t)(out_tiles.size() - first);
+	}
+
+private:
+	uint32_t width = 0u;
+	uint32_t height = 0u;
+	uint32_t tiles_x = 0u;
+	uint32_t tiles_y = 0u;
+	std::vector<uint8_t> dirty; // per tile, row major
+	uint32_t dirty_count = 0u;
+	std::vector<uint8_t> tracked_parameters;
+};
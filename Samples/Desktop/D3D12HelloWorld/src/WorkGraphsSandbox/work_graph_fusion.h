@@ -0,0 +1,383 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "work_graph_memory_estimator.h"
+
+//=================================================================================================================================
+// Node fusion pass
+//
+// Finds producer -> consumer edges where the consumer is a thread launch node that only runs the record it was given, and
+// inlines the consumer into the producer: the output records become a local variable and OutputComplete() becomes the
+// consumer body. A consumer is removed once every edge into it is fused. In the sandbox graph this folds secondNode into
+// firstNode and refineTile, and batchSecondNode into batchFirstNode.
+//
+// An edge fuses when
+// - the consumer uses thread launch, is not a program entry, has no outputs and takes nothing but its
+//   ThreadNodeInputRecord, only reads it through Get() and has no return statement
+// - the output is a plain NodeOutput (no array, no MaxRecordsSharedWith) with one record per producer thread:
+//   [MaxRecords] equals the producer's group size and every GetGroupNodeOutputRecords() asks for exactly that many
+//   (1 and GetThreadNodeOutputRecords(1) for thread launch producers)
+// - the producer only touches the output to get records, index them and call OutputComplete()
+// It is assumed, not checked, that each thread writes the record at its own index, which is what one record per thread
+// means in practice.
+//
+// The rewrite works on the source with comments and inactive #if blocks removed (the same view the estimator parses), so
+// the emitted HLSL is a generated variant to compile next to the original, not a replacement for it.
+//=================================================================================================================================
+struct work_graph_fusion_edge
+{
+	std::string producer;
+	std::string consumer;
+	std::string output;      // producer's output parameter
+	std::string record_type;
+	uint32_t record_size = 0u;
+	bool fused = false;
+	std::string reason;      // why not, if not fused
+	double records_per_frame = 0.0; // expected, from EstimateWorkGraphMemory()
+	double bytes_per_frame = 0.0;   // record bytes written by the producer and read back by the consumer
+};
+
+struct work_graph_fusion_result
+{
+	std::string hlsl;
+	std::vector<work_graph_fusion_edge> edges; // every edge into a thread node
+	std::vector<std::string> removed_nodes;
+	std::vector<std::string> warnings;
+
+	double EliminatedBytesPerFrame() const
+	{
+		double bytes = 0.0;
+		for (const work_graph_fusion_edge& e : edges)
+			bytes += e.fused ? e.bytes_per_frame : 0.0;
+		return bytes;
+	}
+};
+
+namespace work_graph_fusion_detail
+{
+	struct function_span
+	{
+		size_t begin = 0u;        // first attribute
+		size_t params_begin = 0u; // after '('
+		size_t params_end = 0u;   // at ')'
+		size_t body_begin = 0u;   // after '{'
+		size_t body_end = 0u;     // at '}'
+	};
+
+	// Index of the bracket closing the one at text[open], npos if unbalanced.
+	inline size_t MatchClose(const std::string& text, size_t open)
+	{
+		const char o = text[open];
+		const char c = o == '(' ? ')' : o == '[' ? ']' : '}';
+		int depth = 0;
+		for (size_t i = open; i < text.size(); i++)
+		{
+			if (text[i] == o)
+				depth++;
+			else if (text[i] == c && --depth == 0)
+				return i;
+		}
+		return std::string::npos;
+	}
+
+	inline bool FindFunction(const std::string& text, const std::string& name, function_span& out)
+	{
+		std::regex re("\\bvoid\\s+" + name + "\\s*\\(");
+		for (std::sregex_iterator it(text.begin(), text.end(), re), end; it != end; ++it)
+		{
+			size_t open = (size_t)(it->position() + it->length() - 1);
+			size_t close = MatchClose(text, open);
+			if (close == std::string::npos)
+				return false;
+			size_t brace = text.find_first_not_of(" \t\r\n", close + 1);
+			if (brace == std::string::npos || text[brace] != '{')
+				continue; // a declaration
+			size_t body_end = MatchClose(text, brace);
+			if (body_end == std::string::npos)
+				return false;
+
+			// Walk back over the attribute blocks.
+			size_t begin = (size_t)it->position();
+			for (;;)
+			{
+				size_t prev = text.find_last_not_of(" \t\r\n", begin == 0u ? 0u : begin - 1u);
+				if (prev == std::string::npos || begin == 0u || text[prev] != ']')
+					break;
+				int depth = 0;
+				size_t i = prev + 1u;
+				while (i-- > 0u)
+				{
+					if (text[i] == ']')
+						depth++;
+					else if (text[i] == '[' && --depth == 0)
+						break;
+				}
+				if (depth != 0)
+					break;
+				begin = i;
+			}
+			out = { begin, open + 1u, close, brace + 1u, body_end };
+			return true;
+		}
+		return false;
+	}
+
+	// [begin, end) ranges of the comma separated items in text[begin, end), ignoring commas inside brackets.
+	inline std::vector<std::pair<size_t, size_t>> SplitParameters(const std::string& text, size_t begin, size_t end)
+	{
+		std::vector<std::pair<size_t, size_t>> out;
+		int depth = 0;
+		size_t item = begin;
+		for (size_t i = begin; i < end; i++)
+		{
+			char c = text[i];
+			if (c == '(' || c == '[' || c == '<')
+				depth++;
+			else if (c == ')' || c == ']' || c == '>')
+				depth--;
+			else if (c == ',' && depth == 0)
+			{
+				out.push_back({ item, i });
+				item = i + 1u;
+			}
+		}
+		if (work_graph_estimator_detail::Trim(text.substr(item, end - item)).size())
+			out.push_back({ item, end });
+		return out;
+	}
+
+	inline bool ContainsWord(const std::string& text, const std::string& word)
+	{
+		return std::regex_search(text, std::regex("\\b" + word + "\\b"));
+	}
+
+	inline std::string ReplaceAll(const std::string& text, const std::string& pattern, const std::string& replacement)
+	{
+		return std::regex_replace(text, std::regex(pattern), replacement);
+	}
+
+	// Lines of body with their common leading whitespace replaced by indent, blank lines at either end dropped.
+	inline std::string Reindent(const std::string& body, const std::string& indent)
+	{
+		std::vector<std::string> lines;
+		std::stringstream stream(body);
+		for (std::string l; std::getline(stream, l); )
+			lines.push_back(l.substr(0, l.find_last_not_of(" \t\r") + 1u));
+		while (!lines.empty() && lines.front().empty())
+			lines.erase(lines.begin());
+		while (!lines.empty() && lines.back().empty())
+			lines.pop_back();
+		size_t common = std::string::npos;
+		for (const std::string& l : lines)
+			if (!l.empty())
+				common = std::min(common, l.find_first_not_of(" \t"));
+		std::string out;
+		for (const std::string& l : lines)
+			out += "\n" + (l.empty() ? l : indent + l.substr(common));
+		return out;
+	}
+
+	// The consumer body with its input record replaced by record_var, or empty and a reason.
+	inline std::string InlineConsumer(const std::string& text, const std::string& consumer, const std::string& record_var, std::string& reason)
+	{
+		function_span f;
+		if (!FindFunction(text, consumer, f))
+		{
+			reason = "no function body named " + consumer;
+			return std::string();
+		}
+		std::vector<std::pair<size_t, size_t>> params = SplitParameters(text, f.params_begin, f.params_end);
+		std::smatch m;
+		std::string param = params.size() == 1u ? text.substr(params[0].first, params[0].second - params[0].first) : std::string();
+		if (!std::regex_search(param, m, std::regex("ThreadNodeInputRecord\\s*<\\s*\\w+\\s*>\\s*(\\w+)")))
+		{
+			reason = consumer + " takes more than its ThreadNodeInputRecord";
+			return std::string();
+		}
+		const std::string input = m[1];
+		std::string body = text.substr(f.body_begin, f.body_end - f.body_begin);
+		if (ContainsWord(body, "return"))
+		{
+			reason = consumer + " has a return statement";
+			return std::string();
+		}
+		body = ReplaceAll(body, "\\b" + input + "\\s*\\.\\s*Get\\s*\\(\\s*\\)", record_var);
+		if (ContainsWord(body, input))
+		{
+			reason = consumer + " uses its input record other than through Get()";
+			return std::string();
+		}
+		return body;
+	}
+
+	// Rewrites the producer body for one fusable edge, false and a reason if the body doesn't follow the pattern.
+	inline bool FuseIntoProducer(std::string& text, const hlsl_node_decl& producer, const hlsl_node_output& output,
+		const std::string& consumer, std::string& reason)
+	{
+		function_span f;
+		if (!FindFunction(text, producer.name, f))
+		{
+			reason = "no function body named " + producer.name;
+			return false;
+		}
+		const bool thread_launch = producer.launch == hlsl_node_launch::thread;
+		const uint32_t per_invocation = thread_launch ? 1u : producer.num_threads[0] * producer.num_threads[1] * producer.num_threads[2];
+		std::string body = text.substr(f.body_begin, f.body_end - f.body_begin);
+
+		// Each Get*NodeOutputRecords(N) .. OutputComplete() pair becomes a local record and the inlined consumer.
+		std::regex get_re("(?:Group|Thread)NodeOutputRecords\\s*<\\s*(\\w+)\\s*>\\s*(\\w+)\\s*=\\s*" + output.name +
+			"\\s*\\.\\s*Get(?:Group|Thread)NodeOutputRecords\\s*\\(\\s*([^;]*?)\\s*\\)\\s*;");
+		std::vector<std::smatch> gets;
+		for (std::sregex_iterator it(body.begin(), body.end(), get_re), end; it != end; ++it)
+			gets.push_back(*it);
+		if (gets.empty())
+		{
+			reason = producer.name + " never gets records for " + output.name;
+			return false;
+		}
+		if (ContainsWord(std::regex_replace(body, get_re, ""), output.name))
+		{
+			reason = producer.name + " uses " + output.name + " other than to get records";
+			return false;
+		}
+		std::string fused = body;
+		for (size_t g = gets.size(); g-- > 0u; )
+		{
+			const std::smatch& m = gets[g];
+			if (m[3].str() != std::to_string(per_invocation))
+			{
+				reason = producer.name + " asks for " + m[3].str() + " records, not one per thread (" + std::to_string(per_invocation) + ")";
+				return false;
+			}
+			const std::string var = m[2];
+			size_t decl = (size_t)m.position(), decl_end = decl + (size_t)m.length();
+			std::smatch done;
+			std::string rest = fused.substr(decl_end);
+			if (!std::regex_search(rest, done, std::regex("\\b" + var + "\\s*\\.\\s*OutputComplete\\s*\\(\\s*\\)\\s*;")))
+			{
+				reason = producer.name + ": no OutputComplete() for " + var;
+				return false;
+			}
+			std::string inlined = InlineConsumer(text, consumer, var, reason);
+			if (!reason.empty())
+				return false;
+			std::string between = ReplaceAll(rest.substr(0, (size_t)done.position()), "\\b" + var + "\\s*\\[[^\\]]*\\]", var);
+			size_t line = fused.rfind('\n', decl);
+			std::string indent = fused.substr(line + 1u, decl - line - 1u);
+			std::string replacement = m[1].str() + " " + var + "; // fused " + output.name + " record" + between +
+				"{ // " + consumer + Reindent(inlined, indent + "    ") + "\n" + indent + "}";
+			fused = fused.substr(0, decl) + replacement + rest.substr((size_t)(done.position() + done.length()));
+		}
+
+		// Drop the output parameter.
+		std::vector<std::pair<size_t, size_t>> params = SplitParameters(text, f.params_begin, f.params_end);
+		std::string new_params;
+		for (const auto& p : params)
+		{
+			std::string param = text.substr(p.first, p.second - p.first);
+			if (std::regex_search(param, std::regex("NodeOutput\\s*<[^>]*>\\s*" + output.name + "\\b")))
+				continue;
+			new_params += new_params.empty() ? param : "," + param;
+		}
+		text = text.substr(0, f.params_begin) + new_params + text.substr(f.params_end, f.body_begin - f.params_end) + fused +
+			text.substr(f.body_end);
+		return true;
+	}
+}
+
+// Fuses what it can in source and reports every edge into a thread node. options feed the per-frame byte counts.
+inline work_graph_fusion_result FuseWorkGraphHLSL(const std::string& source,
+	const work_graph_estimate_options& options = work_graph_estimate_options())
+{
+	using namespace work_graph_fusion_detail;
+	work_graph_fusion_result result;
+	hlsl_work_graph_desc desc = ParseWorkGraphHLSL(source);
+	work_graph_memory_estimate estimate = EstimateWorkGraphMemory(desc, options);
+	result.warnings = desc.warnings;
+
+	std::map<std::string, std::string> defines;
+	std::vector<std::string> ignored, includes;
+	std::string text = work_graph_estimator_detail::Preprocess(work_graph_estimator_detail::StripComments(source), defines, ignored, &includes);
+
+	for (size_t c = 0; c < desc.nodes.size(); c++)
+	{
+		const hlsl_node_decl& consumer = desc.nodes[c];
+		if (consumer.launch != hlsl_node_launch::thread)
+			continue;
+		std::string consumer_reason;
+		if (consumer.is_program_entry)
+			consumer_reason = "consumer is a program entry";
+		else if (!consumer.outputs.empty())
+			consumer_reason = "consumer has outputs";
+
+		bool all_fused = true;
+		for (size_t p = 0; p < desc.nodes.size(); p++)
+		{
+			const hlsl_node_decl& producer = desc.nodes[p];
+			for (const hlsl_node_output& o : producer.outputs)
+			{
+				if (o.target != consumer.name)
+					continue;
+				work_graph_fusion_edge edge;
+				edge.producer = producer.name;
+				edge.consumer = consumer.name;
+				edge.output = o.name;
+				edge.record_type = o.record_type;
+				edge.record_size = o.record_size;
+				auto fill = options.output_fill.find(producer.name + "." + o.name);
+				edge.records_per_frame = estimate.nodes[p].invocations[1] * o.max_records * (fill != options.output_fill.end() ? fill->second : 1.0f);
+				edge.bytes_per_frame = edge.records_per_frame * o.record_size * 2.0;
+
+				const uint32_t threads = producer.launch == hlsl_node_launch::thread ? 1u :
+					producer.num_threads[0] * producer.num_threads[1] * producer.num_threads[2];
+				edge.reason = consumer_reason;
+				if (edge.reason.empty() && p == c)
+					edge.reason = "recursive";
+				if (edge.reason.empty() && (o.array_size != 1u || !o.shared_with.empty()))
+					edge.reason = "output is an array or shares its records";
+				if (edge.reason.empty() && o.max_records != threads)
+					edge.reason = "[MaxRecords(" + std::to_string(o.max_records) + ")] is not one record per thread";
+				if (edge.reason.empty())
+				{
+					std::string fused = text;
+					if (FuseIntoProducer(fused, producer, o, consumer.name, edge.reason))
+						text = fused;
+				}
+				edge.fused = edge.reason.empty();
+				all_fused = all_fused && edge.fused;
+				result.edges.push_back(edge);
+			}
+		}
+
+		function_span f;
+		if (all_fused && FindFunction(text, consumer.name, f))
+		{
+			text = text.substr(0, f.begin) + text.substr(f.body_end + 1u);
+			result.removed_nodes.push_back(consumer.name);
+		}
+	}
+
+	// Preprocess() dropped the directive lines, put the defines and includes back in front. The includes are relative to the
+	// original's directory.
+	std::string header = "// Generated by FuseWorkGraphHLSL() from the active code of the original, fused:";
+	for (const work_graph_fusion_edge& e : result.edges)
+		if (e.fused)
+			header += " " + e.producer + "<-" + e.consumer;
+	header += "\n";
+	for (const auto& d : defines)
+		header += "#define " + d.first + " " + d.second + "\n";
+	for (const std::string& i : includes)
+		header += i + "\n";
+	header += "\n";
+	// Collapse the blank runs left by removed comments and blocks.
+	text = ReplaceAll(text, "\\n(\\s*\\n){2,}", "\n\n");
+	result.hlsl = header + text.substr(std::min(text.size(), text.find_first_not_of(" \t\r\n")));
+	return result;
+}
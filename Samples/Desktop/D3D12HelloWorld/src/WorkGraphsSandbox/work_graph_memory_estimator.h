@@ -0,0 +1,882 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+//=================================================================================================================================
+// Offline work graph backing memory estimator
+//
+// Reads the node declarations out of a work graph .hlsl file without compiling it: record structs, [Shader("node")]
+// functions with their [NodeLaunch], [NodeMaxDispatchGrid]/[NodeDispatchGrid], [NumThreads], [NodeMaxRecursionDepth]
+// attributes and their input/output parameters with [MaxRecords(N)]. From that it propagates record counts from the entry
+// nodes through the graph and reports, per node, how many bytes of records it can receive in the worst case and in the
+// expected case for a given dispatch.
+//
+// The driver's backing memory is not a linear function of these numbers (it spills and recycles records while the graph
+// runs), so the estimate is meant to compare graphs and to pick a point between MinSizeInBytes and MaxSizeInBytes, not to
+// replace GetWorkGraphMemoryRequirements().
+//
+// The preprocessor handling is deliberately small: comments, #define NAME [integer], #if/#ifdef/#ifndef/#elif/#else/#endif
+// on integer literals, defined() and known macros. Anything else counts as true and is reported in 'warnings'.
+//=================================================================================================================================
+
+struct hlsl_record_struct
+{
+	std::string name;
+	uint32_t size = 0u;      // bytes, natural alignment like a structured buffer element
+	uint32_t alignment = 4u;
+	bool has_dispatch_grid = false; // has an SV_DispatchGrid member
+};
+
+enum class hlsl_node_launch
+{
+	broadcasting,
+	coalescing,
+	thread,
+};
+
+struct hlsl_node_output
+{
+	std::string name;        // parameter name
+	std::string target;      // [NodeId] if present, else the parameter name
+	std::string record_type; // empty for EmptyNodeOutput
+	uint32_t record_size = 0u;
+	uint32_t max_records = 0u;   // [MaxRecords(N)] per thread group (per thread for thread launch)
+	uint32_t array_size = 1u;    // [NodeArraySize(N)] for NodeOutputArray
+	std::string shared_with;     // [MaxRecordsSharedWith(name)]
+};
+
+struct hlsl_node_decl
+{
+	std::string name;
+	hlsl_node_launch launch = hlsl_node_launch::broadcasting;
+	uint32_t num_threads[3] = { 1u, 1u, 1u };
+	uint32_t dispatch_grid[3] = { 0u, 0u, 0u };     // [NodeDispatchGrid], 0 if not fixed
+	uint32_t max_dispatch_grid[3] = { 0u, 0u, 0u }; // [NodeMaxDispatchGrid], 0 if not declared
+	uint32_t max_recursion_depth = 0u;
+	bool is_program_entry = false;
+	std::string input_record_type; // empty for EmptyNodeInput or no input
+	uint32_t input_record_size = 0u;
+	uint32_t max_input_records = 1u; // [MaxRecords(N)] on GroupNodeInputRecords
+	std::vector<hlsl_node_output> outputs;
+};
+
+struct hlsl_work_graph_desc
+{
+	std::vector<hlsl_record_struct> records;
+	std::vector<hlsl_node_decl> nodes;
+	std::vector<std::string> warnings;
+
+	const hlsl_record_struct* FindRecord(const std::string& name) const
+	{
+		for (const hlsl_record_struct& r : records)
+			if (r.name == name)
+				return &r;
+		return nullptr;
+	}
+	int FindNode(const std::string& name) const
+	{
+		for (size_t i = 0; i < nodes.size(); i++)
+			if (nodes[i].name == name)
+				return (int)i;
+		return -1;
+	}
+	// Whether DispatchGraph() can feed the node: [NodeIsProgramEntry], or no other node outputs to it.
+	bool IsEntry(size_t node) const
+	{
+		if (nodes[node].is_program_entry)
+			return true;
+		for (size_t i = 0; i < nodes.size(); i++)
+			for (const hlsl_node_output& o : nodes[i].outputs)
+				if (i != node && o.target == nodes[node].name)
+					return false;
+		return true;
+	}
+};
+
+namespace work_graph_estimator_detail
+{
+	struct token
+	{
+		enum kind_type { identifier, number, string, punct } kind;
+		std::string text;
+	};
+
+	inline std::string StripComments(const std::string& source)
+	{
+		std::string out;
+		out.reserve(source.size());
+		for (size_t i = 0; i < source.size(); )
+		{
+			if (source.compare(i, 2, "//") == 0)
+			{
+				while (i < source.size() && source[i] != '\n')
+					i++;
+			}
+			else if (source.compare(i, 2, "/*") == 0)
+			{
+				size_t end = source.find("*/", i + 2);
+				end = end == std::string::npos ? source.size() : end + 2;
+				for (; i < end; i++)
+					if (source[i] == '\n')
+						out += '\n';
+			}
+			else if (source[i] == '"')
+			{
+				size_t end = source.find('"', i + 1);
+				end = end == std::string::npos ? source.size() : end + 1;
+				out.append(source, i, end - i);
+				i = end;
+			}
+			else
+			{
+				out += source[i++];
+			}
+		}
+		return out;
+	}
+
+	inline std::string Trim(const std::string& s)
+	{
+		size_t b = s.find_first_not_of(" \t\r\n");
+		size_t e = s.find_last_not_of(" \t\r\n");
+		return b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+	}
+
+	// Evaluates the few #if forms we understand. Returns false in 'understood' for anything else.
+	inline bool EvaluateCondition(std::string expr, const std::map<std::string, std::string>& defines, bool& understood)
+	{
+		expr = Trim(expr);
+		understood = true;
+		bool negate = false;
+		while (!expr.empty() && expr[0] == '!')
+		{
+			negate = !negate;
+			expr = Trim(expr.substr(1));
+		}
+		bool value = true;
+		if (expr.compare(0, 7, "defined") == 0)
+		{
+			std::string name = expr.substr(7);
+			name.erase(std::remove_if(name.begin(), name.end(), [](char c) { return c == '(' || c == ')' || isspace((unsigned char)c); }), name.end());
+			value = defines.count(name) != 0;
+		}
+		else if (!expr.empty() && isdigit((unsigned char)expr[0]))
+		{
+			char* end = nullptr;
+			value = strtoll(expr.c_str(), &end, 0) != 0;
+			understood = Trim(end).empty();
+		}
+		else
+		{
+			auto it = defines.find(expr);
+			if (it != defines.end())
+				value = strtoll(it->second.c_str(), nullptr, 0) != 0 || it->second.empty();
+			else
+				understood = false;
+		}
+		return negate ? !value : value;
+	}
+
+	// Drops inactive #if blocks and directive lines, collecting #define NAME value on the way, and the active #include lines in
+	// includes if set. Included files aren't read.
+	inline std::string Preprocess(const std::string& source, std::map<std::string, std::string>& defines, std::vector<std::string>& warnings,
+		std::vector<std::string>* includes = nullptr)
+	{
+		struct conditional { bool parent_active; bool active; bool taken; };
+		std::vector<conditional> stack;
+		bool active = true;
+		std::string out;
+		size_t line_start = 0;
+		uint32_t line_number = 0;
+		while (line_start <= source.size())
+		{
+			size_t line_end = source.find('\n', line_start);
+			if (line_end == std::string::npos)
+				line_end = source.size();
+			std::string line = source.substr(line_start, line_end - line_start);
+			line_number++;
+			std::string trimmed = Trim(line);
+			if (!trimmed.empty() && trimmed[0] == '#')
+			{
+				std::string directive = Trim(trimmed.substr(1));
+				size_t split = directive.find_first_of(" \t(");
+				std::string keyword = directive.substr(0, split);
+				std::string rest = split == std::string::npos ? std::string() : Trim(directive.substr(split));
+				bool understood = true;
+				if (keyword == "if" || keyword == "ifdef" || keyword == "ifndef")
+				{
+					bool value = keyword == "if" ? EvaluateCondition(rest, defines, understood) :
+						(defines.count(rest) != 0) == (keyword == "ifdef");
+					stack.push_back({ active, active && value, value });
+					active = stack.back().active;
+				}
+				else if (keyword == "elif" && !stack.empty())
+				{
+					bool value = EvaluateCondition(rest, defines, understood);
+					conditional& c = stack.back();
+					c.active = c.parent_active && !c.taken && value;
+					c.taken = c.taken || value;
+					active = c.active;
+				}
+				else if (keyword == "else" && !stack.empty())
+				{
+					conditional& c = stack.back();
+					c.active = c.parent_active && !c.taken;
+					c.taken = true;
+					active = c.active;
+				}
+				else if (keyword == "endif" && !stack.empty())
+				{
+					active = stack.back().parent_active;
+					stack.pop_back();
+				}
+				else if (keyword == "define" && active)
+				{
+					size_t name_end = rest.find_first_of(" \t(");
+					defines[rest.substr(0, name_end)] = name_end == std::string::npos ? std::string() : Trim(rest.substr(name_end));
+				}
+				else if (keyword == "include" && active && includes)
+				{
+					includes->push_back(trimmed);
+				}
+				if (!understood)
+					warnings.push_back("line " + std::to_string(line_number) + ": '#" + directive + "' not understood, assumed true");
+				out += '\n';
+			}
+			else
+			{
+				if (active)
+					out += line;
+				out += '\n';
+			}
+			line_start = line_end + 1;
+		}
+		return out;
+	}
+
+	inline std::vector<token> Tokenize(const std::string& source)
+	{
+		std::vector<token> tokens;
+		for (size_t i = 0; i < source.size(); )
+		{
+			char c = source[i];
+			if (isspace((unsigned char)c))
+			{
+				i++;
+			}
+			else if (isalpha((unsigned char)c) || c == '_')
+			{
+				size_t b = i;
+				while (i < source.size() && (isalnum((unsigned char)source[i]) || source[i] == '_'))
+					i++;
+				tokens.push_back({ token::identifier, source.substr(b, i - b) });
+			}
+			else if (isdigit((unsigned char)c))
+			{
+				size_t b = i;
+				while (i < source.size() && (isalnum((unsigned char)source[i]) || source[i] == '.'))
+					i++;
+				tokens.push_back({ token::number, source.substr(b, i - b) });
+			}
+			else if (c == '"')
+			{
+				size_t end = source.find('"', i + 1);
+				end = end == std::string::npos ? source.size() : end;
+				tokens.push_back({ token::string, source.substr(i + 1, end - i - 1) });
+				i = end + 1;
+			}
+			else
+			{
+				tokens.push_back({ token::punct, std::string(1, c) });
+				i++;
+			}
+		}
+		return tokens;
+	}
+
+	// Size and alignment of an HLSL type name such as uint, float4, half2, float3x4, uint16_t2 or a known struct.
+	inline bool TypeSize(const std::string& type, const std::vector<hlsl_record_struct>& records, uint32_t& out_size, uint32_t& out_alignment)
+	{
+		for (const hlsl_record_struct& r : records)
+		{
+			if (r.name == type)
+			{
+				out_size = r.size;
+				out_alignment = r.alignment;
+				return true;
+			}
+		}
+		// Without -enable-16bit-types half and min16 types are 32-bit, the explicit *16_t types need it and are 16-bit.
+		static const struct { const char* name; uint32_t size; } scalars[] =
+		{
+			{ "float16_t", 2 }, { "uint16_t", 2 }, { "int16_t", 2 },
+			{ "float64_t", 8 }, { "uint64_t", 8 }, { "int64_t", 8 }, { "double", 8 },
+			{ "float32_t", 4 }, { "uint32_t", 4 }, { "int32_t", 4 },
+			{ "min16float", 4 }, { "min16uint", 4 }, { "min16int", 4 },
+			{ "float", 4 }, { "uint", 4 }, { "int", 4 }, { "bool", 4 }, { "half", 4 }, { "dword", 4 },
+		};
+		for (const auto& scalar : scalars)
+		{
+			size_t n = strlen(scalar.name);
+			if (type.compare(0, n, scalar.name) != 0)
+				continue;
+			std::string dims = type.substr(n);
+			uint32_t rows = 1u, cols = 1u;
+			if (dims.size() == 1 && dims[0] >= '1' && dims[0] <= '4')
+				cols = (uint32_t)(dims[0] - '0');
+			else if (dims.size() == 3 && dims[1] == 'x')
+			{
+				rows = (uint32_t)(dims[0] - '0');
+				cols = (uint32_t)(dims[2] - '0');
+			}
+			else if (!dims.empty())
+				continue;
+			out_size = scalar.size * rows * cols;
+			out_alignment = scalar.size;
+			return true;
+		}
+		return false;
+	}
+
+	class parser
+	{
+	public:
+		parser(const std::vector<token>& tokens, const std::map<std::string, std::string>& defines, hlsl_work_graph_desc& desc)
+			: tokens(tokens), defines(defines), desc(desc) {}
+
+		void Parse()
+		{
+			while (pos < tokens.size())
+			{
+				if (Is("struct"))
+					ParseStruct();
+				else if (Is("static") && Is("const", 1))
+					ParseConstant();
+				else if (Is("["))
+					ParseAttributedDeclaration();
+				else
+					SkipDeclaration();
+			}
+		}
+
+	private:
+		struct attribute
+		{
+			std::string name;
+			std::vector<token> args;
+		};
+
+		bool Is(const char* text, size_t ahead = 0) const { return pos + ahead < tokens.size() && tokens[pos + ahead].text == text; }
+		const token& Next() { static const token end = { token::punct, "" }; return pos < tokens.size() ? tokens[pos++] : end; }
+
+		void SkipBalanced(const char* open, const char* close)
+		{
+			int depth = 0;
+			do
+			{
+				if (Is(open))
+					depth++;
+				else if (Is(close))
+					depth--;
+				pos++;
+			} while (pos < tokens.size() && depth > 0);
+		}
+
+		void SkipDeclaration()
+		{
+			while (pos < tokens.size() && !Is(";"))
+			{
+				if (Is("{"))
+				{
+					SkipBalanced("{", "}");
+					if (!Is(";"))
+						return; // function body
+				}
+				else
+				{
+					pos++;
+				}
+			}
+			pos++;
+		}
+
+		uint32_t Value(const token& t)
+		{
+			if (t.kind == token::number)
+				return (uint32_t)strtoul(t.text.c_str(), nullptr, 0);
+			auto c = constants.find(t.text);
+			if (c != constants.end())
+				return c->second;
+			auto d = defines.find(t.text);
+			if (d != defines.end())
+				return (uint32_t)strtoul(d->second.c_str(), nullptr, 0);
+			desc.warnings.push_back("unknown constant '" + t.text + "', assumed 0");
+			return 0u;
+		}
+
+		// static const uint name = N;
+		void ParseConstant()
+		{
+			size_t start = pos;
+			pos += 2;
+			if (pos + 4 < tokens.size() && tokens[pos].kind == token::identifier && tokens[pos + 1].kind == token::identifier &&
+				tokens[pos + 2].text == "=" && tokens[pos + 4].text == ";")
+			{
+				constants[tokens[pos + 1].text] = Value(tokens[pos + 3]);
+				pos += 5;
+				return;
+			}
+			pos = start;
+			SkipDeclaration();
+		}
+
+		void ParseStruct()
+		{
+			pos++;
+			hlsl_record_struct record;
+			record.name = Next().text;
+			if (!Is("{"))
+			{
+				SkipDeclaration();
+				return;
+			}
+			pos++;
+			uint32_t offset = 0u;
+			while (pos < tokens.size() && !Is("}"))
+			{
+				// [modifiers] type name [ [N] ] [: semantic] ;
+				std::vector<token> member;
+				while (pos < tokens.size() && !Is(";") && !Is("}"))
+					member.push_back(Next());
+				if (Is(";"))
+					pos++;
+				if (member.size() < 2)
+					continue;
+
+				size_t colon = member.size();
+				for (size_t i = 0; i < member.size(); i++)
+					if (member[i].text == ":")
+						colon = i;
+				if (colon + 1 < member.size() && member[colon + 1].text == "SV_DispatchGrid")
+					record.has_dispatch_grid = true;
+
+				uint32_t count = 1u;
+				size_t name_index = colon - 1;
+				if (member[name_index].text == "]" && name_index >= 3 && member[name_index - 2].text == "[")
+				{
+					count = Value(member[name_index - 1]);
+					name_index -= 3;
+				}
+				if (name_index == 0)
+					continue;
+				const std::string& type = member[name_index - 1].text;
+				uint32_t size = 0u, alignment = 4u;
+				if (!TypeSize(type, desc.records, size, alignment))
+					desc.warnings.push_back("struct " + record.name + ": unknown member type '" + type + "', assumed 4 bytes");
+				size = size ? size : 4u;
+				offset = (offset + alignment - 1u) / alignment * alignment + size * count;
+				record.alignment = std::max(record.alignment, alignment);
+			}
+			pos++;
+			if (Is(";"))
+				pos++;
+			record.size = (offset + record.alignment - 1u) / record.alignment * record.alignment;
+			desc.records.push_back(record);
+		}
+
+		void ParseAttributes(std::vector<attribute>& out)
+		{
+			while (Is("["))
+			{
+				pos++;
+				while (pos < tokens.size() && !Is("]"))
+				{
+					attribute a;
+					a.name = Next().text;
+					if (Is("("))
+					{
+						pos++;
+						int depth = 1;
+						while (pos < tokens.size())
+						{
+							if (Is("("))
+								depth++;
+							else if (Is(")") && --depth == 0)
+								break;
+							if (!Is(","))
+								a.args.push_back(tokens[pos]);
+							pos++;
+						}
+						pos++;
+					}
+					out.push_back(a);
+					if (Is(","))
+						pos++;
+				}
+				pos++;
+			}
+		}
+
+		static const attribute* Find(const std::vector<attribute>& attributes, const char* name)
+		{
+			for (const attribute& a : attributes)
+				if (a.name == name)
+					return &a;
+			return nullptr;
+		}
+
+		void ReadUint3(const attribute& a, uint32_t out[3])
+		{
+			for (size_t i = 0; i < 3; i++)
+				out[i] = i < a.args.size() ? Value(a.args[i]) : 1u;
+		}
+
+		void ParseAttributedDeclaration()
+		{
+			std::vector<attribute> attributes;
+			ParseAttributes(attributes);
+			const attribute* shader = Find(attributes, "Shader");
+			if (!shader || shader->args.empty() || shader->args[0].text != "node")
+			{
+				SkipDeclaration();
+				return;
+			}
+
+			// void name ( params ) { body }
+			hlsl_node_decl node;
+			pos++; // return type
+			node.name = Next().text;
+			if (const attribute* id = Find(attributes, "NodeID"))
+				node.name = id->args.empty() ? node.name : id->args[0].text;
+			if (const attribute* launch = Find(attributes, "NodeLaunch"))
+			{
+				const std::string& mode = launch->args.empty() ? std::string() : launch->args[0].text;
+				node.launch = mode == "coalescing" ? hlsl_node_launch::coalescing : mode == "thread" ? hlsl_node_launch::thread : hlsl_node_launch::broadcasting;
+			}
+			if (const attribute* a = Find(attributes, "NumThreads"))
+				ReadUint3(*a, node.num_threads);
+			if (const attribute* a = Find(attributes, "NodeDispatchGrid"))
+				ReadUint3(*a, node.dispatch_grid);
+			if (const attribute* a = Find(attributes, "NodeMaxDispatchGrid"))
+				ReadUint3(*a, node.max_dispatch_grid);
+			if (const attribute* a = Find(attributes, "NodeMaxRecursionDepth"))
+				node.max_recursion_depth = a->args.empty() ? 0u : Value(a->args[0]);
+			node.is_program_entry = Find(attributes, "NodeIsProgramEntry") != nullptr;
+
+			if (Is("("))
+			{
+				pos++;
+				while (pos < tokens.size() && !Is(")"))
+					ParseParameter(node);
+				pos++;
+			}
+			if (Is("{"))
+				SkipBalanced("{", "}");
+			desc.nodes.push_back(node);
+		}
+
+		void ParseParameter(hlsl_node_decl& node)
+		{
+			std::vector<attribute> attributes;
+			ParseAttributes(attributes);
+			std::vector<token> rest;
+			int depth = 0;
+			while (pos < tokens.size())
+			{
+				if (depth == 0 && (Is(",") || Is(")")))
+					break;
+				if (Is("<") || Is("("))
+					depth++;
+				else if (Is(">") || Is(")"))
+					depth--;
+				rest.push_back(Next());
+			}
+			if (Is(","))
+				pos++;
+
+			std::string object, record_type, name;
+			for (size_t i = 0; i < rest.size(); i++)
+			{
+				const std::string& t = rest[i].text;
+				if (t == "globallycoherent" || t == "in" || t == "out" || t == "inout")
+					continue;
+				if (object.empty())
+				{
+					object = t;
+					if (i + 2 < rest.size() && rest[i + 1].text == "<")
+					{
+						record_type = rest[i + 2].text;
+						i += 3;
+					}
+					continue;
+				}
+				if (name.empty() && rest[i].kind == token::identifier)
+					name = t;
+			}
+
+			uint32_t record_size = 0u, alignment = 4u;
+			if (!record_type.empty() && !TypeSize(record_type, desc.records, record_size, alignment))
+				desc.warnings.push_back(node.name + ": unknown record type '" + record_type + "'");
+			const attribute* max_records = Find(attributes, "MaxRecords");
+
+			if (object.find("NodeInputRecord") != std::string::npos || object == "EmptyNodeInput")
+			{
+				node.input_record_type = record_type;
+				node.input_record_size = record_size;
+				if (max_records && !max_records->args.empty())
+					node.max_input_records = Value(max_records->args[0]);
+			}
+			else if (object.find("NodeOutput") != std::string::npos)
+			{
+				hlsl_node_output output;
+				output.name = name;
+				output.target = name;
+				if (const attribute* id = Find(attributes, "NodeID"))
+					output.target = id->args.empty() ? name : id->args[0].text;
+				output.record_type = record_type;
+				output.record_size = record_size;
+				if (max_records && !max_records->args.empty())
+					output.max_records = Value(max_records->args[0]);
+				if (const attribute* array_size = Find(attributes, "NodeArraySize"))
+					output.array_size = array_size->args.empty() ? 1u : Value(array_size->args[0]);
+				if (const attribute* shared = Find(attributes, "MaxRecordsSharedWith"))
+					output.shared_with = shared->args.empty() ? std::string() : shared->args[0].text;
+				node.outputs.push_back(output);
+			}
+		}
+
+		const std::vector<token>& tokens;
+		const std::map<std::string, std::string>& defines;
+		hlsl_work_graph_desc& desc;
+		std::map<std::string, uint32_t> constants;
+		size_t pos = 0;
+	};
+}
+
+// Parses the node declarations of a work graph library. Unknown constructs are skipped; see desc.warnings.
+inline hlsl_work_graph_desc ParseWorkGraphHLSL(const std::string& source)
+{
+	using namespace work_graph_estimator_detail;
+	hlsl_work_graph_desc desc;
+	std::map<std::string, std::string> defines;
+	std::string text = Preprocess(StripComments(source), defines, desc.warnings);
+	std::vector<token> tokens = Tokenize(text);
+	parser(tokens, defines, desc).Parse();
+	return desc;
+}
+
+//=================================================================================================================================
+// Record traffic estimate
+//
+// Worst case: every broadcasting node launches its [NodeMaxDispatchGrid] (or fixed [NodeDispatchGrid]), every coalescing
+// group gets a single record, every invocation emits [MaxRecords] on every output and recursion runs to
+// [NodeMaxRecursionDepth]. Expected: the entry dispatch grids passed in, full coalescing batches and outputs filled to the
+// per-output fraction in output_fill (default 1, keyed "node.output").
+struct work_graph_estimate_options
+{
+	std::map<std::string, uint32_t> entry_records;           // entry node -> records in the DispatchGraph call, default 1
+	std::map<std::string, std::vector<uint32_t>> entry_grid;  // broadcasting entry node -> expected SV_DispatchGrid, ignored for others
+	std::map<std::string, float> output_fill;                 // "node.output" -> expected fraction of MaxRecords used
+};
+
+struct work_graph_node_estimate
+{
+	std::string name;
+	double input_records[2] = {};  // [0] worst, [1] expected
+	double invocations[2] = {};    // thread groups, or threads for thread launch
+	double input_bytes[2] = {};    // records this node receives, the record memory the graph has to hold for it
+	double output_bytes[2] = {};
+	uint64_t invocation_output_bytes = 0u; // largest output one invocation can request, what a group needs to make progress
+};
+
+struct work_graph_memory_estimate
+{
+	std::vector<work_graph_node_estimate> nodes;
+	double total_bytes[2] = {};  // record bytes summed over the nodes, worst and expected
+	uint64_t min_progress_bytes = 0u; // largest single invocation output in the graph
+	std::vector<std::string> warnings;
+};
+
+inline work_graph_memory_estimate EstimateWorkGraphMemory(const hlsl_work_graph_desc& desc,
+	const work_graph_estimate_options& options = work_graph_estimate_options())
+{
+	work_graph_memory_estimate estimate;
+	const size_t n = desc.nodes.size();
+	estimate.nodes.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		estimate.nodes[i].name = desc.nodes[i].name;
+		for (const hlsl_node_output& o : desc.nodes[i].outputs)
+		{
+			if (desc.FindNode(o.target) < 0)
+				estimate.warnings.push_back(desc.nodes[i].name + "." + o.name + ": no node named '" + o.target + "'");
+		}
+	}
+
+	// Entry records.
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!desc.IsEntry(i))
+			continue;
+		auto records = options.entry_records.find(desc.nodes[i].name);
+		double count = records != options.entry_records.end() ? (double)records->second : 1.0;
+		estimate.nodes[i].input_records[0] = estimate.nodes[i].input_records[1] = count;
+	}
+
+	// Kahn's order over the non recursive edges; recursion is unrolled in place below.
+	std::vector<uint32_t> indegree(n, 0u);
+	for (size_t i = 0; i < n; i++)
+		for (const hlsl_node_output& o : desc.nodes[i].outputs)
+		{
+			int t = desc.FindNode(o.target);
+			if (t >= 0 && (size_t)t != i)
+				indegree[t]++;
+		}
+	std::vector<size_t> order;
+	for (size_t i = 0; i < n; i++)
+		if (indegree[i] == 0u)
+			order.push_back(i);
+	for (size_t k = 0; k < order.size(); k++)
+		for (const hlsl_node_output& o : desc.nodes[order[k]].outputs)
+		{
+			int t = desc.FindNode(o.target);
+			if (t >= 0 && (size_t)t != order[k] && --indegree[t] == 0u)
+				order.push_back((size_t)t);
+		}
+	if (order.size() != n)
+		estimate.warnings.push_back("graph has a cycle through several nodes, only self recursion is supported");
+
+	for (size_t i : order)
+	{
+		const hlsl_node_decl& node = desc.nodes[i];
+		work_graph_node_estimate& e = estimate.nodes[i];
+
+		// Groups (or threads) launched per input record.
+		double per_record[2] = { 1.0, 1.0 };
+		if (node.launch == hlsl_node_launch::broadcasting)
+		{
+			const uint32_t* grid = node.dispatch_grid[0] ? node.dispatch_grid : node.max_dispatch_grid;
+			per_record[0] = grid[0] ? (double)grid[0] * grid[1] * grid[2] : 1.0;
+			per_record[1] = per_record[0];
+			// Records from other nodes carry the grid their producer wrote, only entries get the one passed in.
+			auto expected = options.entry_grid.find(node.name);
+			if (expected != options.entry_grid.end() && !node.dispatch_grid[0] && desc.IsEntry(i))
+			{
+				per_record[1] = 1.0;
+				for (uint32_t g : expected->second)
+					per_record[1] *= (double)g;
+			}
+		}
+
+		uint64_t invocation_bytes = 0u;
+		for (const hlsl_node_output& o : node.outputs)
+			if (o.shared_with.empty() || o.shared_with == o.name)
+				invocation_bytes += (uint64_t)o.max_records * o.record_size;
+		e.invocation_output_bytes = invocation_bytes;
+		estimate.min_progress_bytes = std::max(estimate.min_progress_bytes, invocation_bytes);
+
+		// Self recursion re-enters the node with what it emitted to itself, up to NodeMaxRecursionDepth times.
+		double level_records[2] = { e.input_records[0], e.input_records[1] };
+		e.input_records[0] = e.input_records[1] = 0.0;
+		for (uint32_t level = 0; level <= node.max_recursion_depth; level++)
+		{
+			double self_records[2] = {};
+			for (int c = 0; c < 2; c++)
+			{
+				e.input_records[c] += level_records[c];
+				double invocations = level_records[c] * per_record[c];
+				if (node.launch == hlsl_node_launch::coalescing)
+					invocations = c == 0 ? level_records[c] : ceil(level_records[c] / std::max(1u, node.max_input_records));
+				e.invocations[c] += invocations;
+
+				for (const hlsl_node_output& o : node.outputs)
+				{
+					if (!o.shared_with.empty() && o.shared_with != o.name)
+						continue; // counted with the output it shares its budget with
+					double fill = 1.0;
+					auto f = options.output_fill.find(node.name + "." + o.name);
+					if (c == 1 && f != options.output_fill.end())
+						fill = f->second;
+					double records = invocations * o.max_records * fill;
+					e.output_bytes[c] += records * o.record_size;
+					int t = desc.FindNode(o.target);
+					if (t < 0)
+						continue;
+					if ((size_t)t == i)
+						self_records[c] += records;
+					else
+						estimate.nodes[t].input_records[c] += records;
+				}
+			}
+			if (self_records[0] == 0.0 && self_records[1] == 0.0)
+				break;
+			level_records[0] = self_records[0];
+			level_records[1] = self_records[1];
+		}
+	}
+
+	for (size_t i = 0; i < n; i++)
+		for (int c = 0; c < 2; c++)
+		{
+			estimate.nodes[i].input_bytes[c] = estimate.nodes[i].input_records[c] * desc.nodes[i].input_record_size;
+			estimate.total_bytes[c] += estimate.nodes[i].input_bytes[c];
+		}
+	return estimate;
+}
+
+//=================================================================================================================================
+// Backing memory sizing policy
+//
+// GetWorkGraphMemoryRequirements() allows any size from MinSizeInBytes to MaxSizeInBytes in steps of
+// SizeGranularityInBytes. Less memory means the driver has to drain the graph more often, more memory buys throughput.
+enum class work_graph_backing_memory_mode
+{
+	min,
+	max,
+	budgeted, // MinSizeInBytes + budget_fraction * (MaxSizeInBytes - MinSizeInBytes)
+};
+
+struct work_graph_backing_memory_policy
+{
+	work_graph_backing_memory_mode mode = work_graph_backing_memory_mode::max;
+	float budget_fraction = 1.0f;
+};
+
+inline const char* BackingMemoryModeName(work_graph_backing_memory_mode mode)
+{
+	switch (mode)
+	{
+	case work_graph_backing_memory_mode::min: return "min";
+	case work_graph_backing_memory_mode::max: return "max";
+	case work_graph_backing_memory_mode::budgeted: return "budgeted";
+	}
+	return "?";
+}
+
+inline uint64_t ChooseBackingMemorySize(uint64_t min_size, uint64_t max_size, uint64_t granularity,
+	const work_graph_backing_memory_policy& policy)
+{
+	max_size = std::max(min_size, max_size);
+	switch (policy.mode)
+	{
+	case work_graph_backing_memory_mode::min:
+		return min_size;
+	case work_graph_backing_memory_mode::max:
+		return max_size;
+	case work_graph_backing_memory_mode::budgeted:
+		break;
+	}
+	double fraction = std::min(1.0, std::max(0.0, (double)policy.budget_fraction));
+	uint64_t extra = (uint64_t)(fraction * (double)(max_size - min_size));
+	if (granularity > 1u)
+		extra = (extra + granularity - 1u) / granularity * granularity;
+	return std::min(max_size, min_size + extra);
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+//=================================================================================================================================
+// Packed layouts of the firstNode -> secondNode record, shared by D3D12WorkGraphsSandbox.hlsl and the CPU path
+//
+// secondNodeInput is a float4 color and a uint2 index, 24 bytes for every pixel that firstNode writes and secondNode reads
+// back. That's 48 MB of record traffic to copy a 1024x1024 image that is 4 MB as R8G8B8A8. Two smaller layouts:
+// - secondNodeInputHalf, 12 bytes: the color as four halves, the index as two 16-bit coordinates. A half is within 1/16 of
+//   a step of every 8-bit UNORM value, and it is what the R16G16B16A16_FLOAT result stores anyway.
+// - secondNodeInputUnorm8, 8 bytes: the color as R8G8B8A8 UNORM, the index as above. Lossless only for 8-bit sources, such
+//   as the R8G8B8A8_UNORM textures the sandbox loads.
+// 16-bit coordinates cover images up to 65536 pixels a side, more than one firstNode dispatch (4096) does.
+//
+// This file is compiled as HLSL and as C++, so it sticks to what both accept: scalar code, member access on float4 and uint2,
+// and the HLSL intrinsics below, which get C++ versions.
+//=================================================================================================================================
+#if !defined(__HLSL_VERSION)
+#include <cstdint>
+#include <cstring>
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#include <immintrin.h>
+#endif
+
+#include "work_graph_records.h"
+
+inline float saturate(float value)
+{
+	value = value > 0.0f ? value : 0.0f; // NaN becomes 0, as in HLSL
+	return value < 1.0f ? value : 1.0f;
+}
+
+// Rounds to nearest even, like the GPU's conversion to R16_FLOAT; the half is in the low 16 bits. NaNs become quiet NaNs.
+inline uint32_t f32tof16(float value)
+{
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+	return (uint32_t)_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+	uint32_t f;
+	memcpy(&f, &value, 4u);
+	uint32_t sign = (f >> 16) & 0x8000u;
+	f &= 0x7fffffffu;
+	if (f >= (143u << 23)) // too large for a half, infinity or NaN
+		return sign | (f > 0x7f800000u ? 0x7e00u : 0x7c00u);
+	if (f < (113u << 23))
+	{
+		// Denormal half or 0: adding 0.5 lines the half's mantissa up with the bottom of the float's, and the float add
+		// rounds it to nearest even.
+		float magic, sum;
+		uint32_t magic_bits = 126u << 23, sum_bits;
+		memcpy(&magic, &magic_bits, 4u);
+		memcpy(&sum, &f, 4u);
+		sum += magic;
+		memcpy(&sum_bits, &sum, 4u);
+		return sign | (sum_bits - magic_bits);
+	}
+	// Rebias the exponent and round the 13 dropped bits to nearest even; a carry out of the mantissa bumps the exponent.
+	uint32_t odd = (f >> 13) & 1u;
+	f += 0xc8000fffu + odd; // ((15 - 127) << 23) + 0xfff, wrapping
+	return sign | (f >> 13);
+#endif
+}
+
+// The half in the low 16 bits of value, exactly.
+inline float f16tof32(uint32_t value)
+{
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+	return _cvtsh_ss((unsigned short)value);
+#else
+	uint32_t f = (value & 0x7fffu) << 13;
+	uint32_t exponent = f & (0x1fu << 23);
+	f += (127u - 15u) << 23;
+	float result;
+	if (exponent == (0x1fu << 23))
+	{
+		f += (128u - 16u) << 23; // infinity or NaN
+	}
+	else if (exponent == 0u)
+	{
+		// Denormal half: renormalized by the float subtract.
+		f += 1u << 23;
+		const uint32_t magic_bits = 113u << 23;
+		float magic;
+		memcpy(&magic, &magic_bits, 4u);
+		memcpy(&result, &f, 4u);
+		result -= magic;
+		memcpy(&f, &result, 4u);
+	}
+	f |= (value & 0x8000u) << 16;
+	memcpy(&result, &f, 4u);
+	return result;
+#endif
+}
+#endif
+
+// x in the low 16 bits, y in the high 16.
+inline uint32_t EncodePixelIndex16(uint2 index)
+{
+	return (index.x & 0xffffu) | (index.y << 16);
+}
+
+inline uint2 DecodePixelIndex16(uint32_t packed)
+{
+	uint2 index;
+	index.x = packed & 0xffffu;
+	index.y = packed >> 16;
+	return index;
+}
+
+// .x holds r and g, .y holds b and a, each half in 16 bits with the first channel low.
+inline uint2 EncodeColorHalf4(float4 color)
+{
+	uint2 packed;
+	packed.x = f32tof16(color.x) | (f32tof16(color.y) << 16);
+	packed.y = f32tof16(color.z) | (f32tof16(color.w) << 16);
+	return packed;
+}
+
+inline float4 DecodeColorHalf4(uint2 packed)
+{
+	float4 color;
+	color.x = f16tof32(packed.x & 0xffffu);
+	color.y = f16tof32(packed.x >> 16);
+	color.z = f16tof32(packed.y & 0xffffu);
+	color.w = f16tof32(packed.y >> 16);
+	return color;
+}
+
+// Converts like a store to R8G8B8A8_UNORM: clamped to [0, 1] and rounded to the nearest step. r is the low byte.
+inline uint32_t EncodeColorUnorm8(float4 color)
+{
+	uint32_t r = (uint32_t)(saturate(color.x) * 255.0f + 0.5f);
+	uint32_t g = (uint32_t)(saturate(color.y) * 255.0f + 0.5f);
+	uint32_t b = (uint32_t)(saturate(color.z) * 255.0f + 0.5f);
+	uint32_t a = (uint32_t)(saturate(color.w) * 255.0f + 0.5f);
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+// Same scaling as a load from R8G8B8A8_UNORM, and as MakeTextureFromImage().
+inline float4 DecodeColorUnorm8(uint32_t packed)
+{
+	const float scale = 1.0f / 255.0f;
+	float4 color;
+	color.x = (float)(packed & 0xffu) * scale;
+	color.y = (float)((packed >> 8) & 0xffu) * scale;
+	color.z = (float)((packed >> 16) & 0xffu) * scale;
+	color.w = (float)(packed >> 24) * scale;
+	return color;
+}
+
+#if !defined(__HLSL_VERSION)
+// Which record firstNode sends secondNode.
+enum class work_graph_record_encoding
+{
+	float4_uint2,  // secondNodeInput
+	half4_uint16,  // secondNodeInputHalf
+	unorm8_uint16, // secondNodeInputUnorm8
+};
+
+inline const char* RecordEncodingName(work_graph_record_encoding encoding)
+{
+	switch (encoding)
+	{
+	case work_graph_record_encoding::float4_uint2: return "float4+uint2";
+	case work_graph_record_encoding::half4_uint16: return "half4+2x16";
+	case work_graph_record_encoding::unorm8_uint16: return "unorm8+2x16";
+	}
+	return "?";
+}
+
+inline uint32_t RecordEncodingSize(work_graph_record_encoding encoding)
+{
+	switch (encoding)
+	{
+	case work_graph_record_encoding::float4_uint2: return (uint32_t)sizeof(secondNodeInput);
+	case work_graph_record_encoding::half4_uint16: return (uint32_t)sizeof(secondNodeInputHalf);
+	case work_graph_record_encoding::unorm8_uint16: return (uint32_t)sizeof(secondNodeInputUnorm8);
+	}
+	return 0u;
+}
+#endif
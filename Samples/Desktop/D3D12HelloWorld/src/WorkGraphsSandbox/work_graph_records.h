@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//=================================================================================================================================
+// C++ mirrors of the record structs declared in D3D12WorkGraphsSandbox.hlsl.
+// Used both for seeding DispatchGraph and by the CPU execution path, so keep these in sync with the shader.
+// Records follow structured buffer packing (4 byte alignment, no padding to 16 bytes).
+//=================================================================================================================================
+struct float4
+{
+	float x, y, z, w;
+};
+
+struct uint2
+{
+	uint32_t x, y;
+};
+
+struct uint3
+{
+	uint32_t x, y, z;
+};
+
+struct entryRecord
+{
+	uint3 gridSize; // SV_DispatchGrid
+	uint32_t recordIndex;
+};
+
+struct secondNodeInput
+{
+	float4 value;
+	uint2 index;
+};
+
+// Packed secondNodeInput layouts, see work_graph_record_encoding.h.
+struct secondNodeInputHalf
+{
+	uint2 color; // EncodeColorHalf4()
+	uint32_t index; // EncodePixelIndex16()
+};
+
+struct secondNodeInputUnorm8
+{
+	uint32_t color; // EncodeColorUnorm8()
+	uint32_t index; // EncodePixelIndex16()
+};
+
+struct tileRecord
+{
+	uint2 origin;
+	uint32_t size;
+};
+
+struct fillTileInput
+{
+	uint3 gridSize; // SV_DispatchGrid
+	uint2 origin;
+	float4 value;
+};
+
+struct batchEntryRecord
+{
+	uint3 gridSize; // SV_DispatchGrid
+	uint2 origin;
+	uint32_t srvIndex; // ResourceDescriptorHeap index
+	uint32_t uavIndex;
+};
+
+struct batchPixelRecord
+{
+	float4 value;
+	uint2 index;
+	uint32_t uavIndex;
+};
+
+// varianceTile -> filterTile, see work_graph_tile_radius.h.
+struct filterTileRecord
+{
+	uint2 origin;
+	uint32_t radius;
+};
+
+// thirdNode is disabled in the shader (#if 0), the CPU port still runs it.
+struct thirdNodeInput
+{
+	uint32_t entryRecordIndex;
+};
+
+static_assert(sizeof(entryRecord) == 16, "entryRecord must match the HLSL layout");
+static_assert(sizeof(secondNodeInput) == 24, "secondNodeInput must match the HLSL layout");
+static_assert(sizeof(secondNodeInputHalf) == 12, "secondNodeInputHalf must match the HLSL layout");
+static_assert(sizeof(secondNodeInputUnorm8) == 8, "secondNodeInputUnorm8 must match the HLSL layout");
+static_assert(sizeof(tileRecord) == 12, "tileRecord must match the HLSL layout");
+static_assert(sizeof(fillTileInput) == 36, "fillTileInput must match the HLSL layout");
+static_assert(sizeof(batchEntryRecord) == 28, "batchEntryRecord must match the HLSL layout");
+static_assert(sizeof(batchPixelRecord) == 28, "batchPixelRecord must match the HLSL layout");
+static_assert(sizeof(filterTileRecord) == 12, "filterTileRecord must match the HLSL layout");
+static_assert(sizeof(thirdNodeInput) == 4, "thirdNodeInput must match the HLSL layout");
+
+// c_numEntryRecords in the shader.
+static const uint32_t c_numEntryRecords = 1u;
+
+// c_maxRefineDepth in the shader. Root tiles for refineTile are 16 << c_maxRefineDepth pixels wide.
+static const uint32_t c_maxRefineDepth = 4u;
+
+// Root tiles covering a width x height image, the CPU input for refineTile.
+inline void MakeRefineRootTiles(uint32_t width, uint32_t height, std::vector<tileRecord>& out_tiles)
+{
+	const uint32_t root = 16u << c_maxRefineDepth;
+	out_tiles.clear();
+	for (uint32_t y = 0; y < height; y += root)
+		for (uint32_t x = 0; x < width; x += root)
+			out_tiles.push_back({ { x, y }, root });
+}
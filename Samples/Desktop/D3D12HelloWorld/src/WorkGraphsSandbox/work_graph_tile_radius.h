@@ -0,0 +1,65 @@
+#pragma once
+
+//=================================================================================================================================
+// Denoise radius per 16x16 tile, shared by D3D12WorkGraphsSandbox.hlsl (varianceTile) and cpu_variable_radius_filter.h
+//
+// A tile's noise is estimated with Immerkaer's method: its luminance is convolved with
+//    1 -2  1
+//   -2  4 -2
+//    1 -2  1
+// which cancels constant and linear regions and mostly cancels straight edges, so what is left is mostly noise, and
+// sigma = sqrt(pi / 2) / 6 * mean |convolution| over the pixels with all 8 neighbours in the tile. The radius is the smallest
+// r at which averaging the (2r + 1)^2 texels of a box brings that noise down to c_tileNoiseTarget, sigma / (2r + 1) <= target,
+// clamped to c_maxTileRadius. Clean tiles get 0 and are copied, the noisiest get the full radius.
+// The tile's luminance variance is summed along with it, to tell noise from detail when looking at a map.
+//
+// Luminance is quantized to c_tileLuminanceScale steps and summed as integers, so both sides get the same sums in any order
+// and pick the same radius, up to the rounding of the luminance itself. Like work_graph_record_encoding.h, this file is
+// compiled as HLSL and as C++.
+//=================================================================================================================================
+#if !defined(__HLSL_VERSION)
+#include <cstdint>
+
+#include "work_graph_records.h"
+#endif
+
+static const uint32_t c_radiusTileSize = 16;
+static const uint32_t c_maxTileRadius = 8;
+static const float c_tileNoiseTarget = 0.015f;
+// Range sigma of filterTile's bilateral weights, of the RGB distance in [0, 1] units.
+static const float c_tileRangeSigma = 0.3f;
+static const uint32_t c_tileLuminanceScale = 1023;
+
+inline uint32_t QuantizeTileLuminance(float4 color)
+{
+	float lum = 0.299f * color.x + 0.587f * color.y + 0.114f * color.z;
+	lum = lum > 0.0f ? lum : 0.0f;
+	lum = lum < 1.0f ? lum : 1.0f;
+	return (uint32_t)(lum * (float)c_tileLuminanceScale + 0.5f);
+}
+
+// From the sum of |convolution| over count pixels, in [0, 1] units.
+inline float TileNoiseSigma(uint32_t abs_laplacian_sum, uint32_t count)
+{
+	// sqrt(pi / 2) / 6
+	return 0.2088856896f * (float)abs_laplacian_sum / ((float)count * (float)c_tileLuminanceScale);
+}
+
+// From the sums of the quantized luminance and its squares over count pixels, in [0, 1] units.
+inline float TileLuminanceVariance(uint32_t sum, uint32_t sum_squares, uint32_t count)
+{
+	float mean = (float)sum / (float)count;
+	float variance = (float)sum_squares / (float)count - mean * mean;
+	return (variance > 0.0f ? variance : 0.0f) / ((float)c_tileLuminanceScale * (float)c_tileLuminanceScale);
+}
+
+inline uint32_t PickTileRadius(float noise_sigma, float target, uint32_t max_radius)
+{
+	float r = (noise_sigma / target - 1.0f) * 0.5f;
+	if (!(r > 0.0f))
+		return 0;
+	if (r >= (float)max_radius)
+		return max_radius;
+	uint32_t radius = (uint32_t)r;
+	return (float)radius < r ? radius + 1 : radius;
+}
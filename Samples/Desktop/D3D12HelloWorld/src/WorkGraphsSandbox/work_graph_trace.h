@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//=================================================================================================================================
+// Execution trace shared by the CPU path (per node work item, see cpu_work_graph::EnableTracing) and the D3D12 app (GPU
+// timestamps around DispatchGraph).
+//
+// Events are spans on a track; tracks become threads and names become event names when exported as Chrome trace_event JSON,
+// which chrome://tracing and https://ui.perfetto.dev open directly. Times are nanoseconds from an arbitrary per-trace origin.
+//=================================================================================================================================
+struct work_graph_trace_event
+{
+	uint32_t name = 0u;  // work_graph_trace::Name()
+	uint32_t track = 0u;
+	uint64_t begin_ns = 0u;
+	uint64_t end_ns = 0u;
+	uint32_t invocations = 0u;
+	uint32_t records_in = 0u;
+	uint32_t records_out = 0u;
+};
+
+struct work_graph_trace_summary
+{
+	std::string name;
+	uint64_t events = 0u;
+	uint64_t invocations = 0u;
+	uint64_t records_in = 0u;
+	uint64_t records_out = 0u;
+	uint64_t total_ns = 0u;
+	uint64_t max_ns = 0u;
+};
+
+class work_graph_trace
+{
+public:
+	uint32_t Intern(const std::string& name)
+	{
+		auto it = name_ids.find(name);
+		if (it != name_ids.end())
+			return it->second;
+		names.push_back(name);
+		name_ids.emplace(name, (uint32_t)names.size() - 1u);
+		return (uint32_t)names.size() - 1u;
+	}
+
+	void SetTrackName(uint32_t track, const std::string& name)
+	{
+		if (track_names.size() <= track)
+			track_names.resize(track + 1u);
+		track_names[track] = name;
+	}
+
+	void Add(const work_graph_trace_event& event) { events.push_back(event); }
+
+	// Keeps names and track names.
+	void Clear() { events.clear(); }
+
+	// Drops the oldest events beyond max_events, for traces that are appended to every frame.
+	void Trim(size_t max_events)
+	{
+		if (events.size() > max_events)
+			events.erase(events.begin(), events.end() - max_events);
+	}
+
+	const std::vector<work_graph_trace_event>& Events() const { return events; }
+	const std::string& Name(uint32_t name) const { return names[name]; }
+
+	// One entry per event name, in order of first appearance.
+	void Summarize(std::vector<work_graph_trace_summary>& out_summary) const
+	{
+		out_summary.assign(names.size(), work_graph_trace_summary());
+		for (size_t n = 0; n < names.size(); n++)
+			out_summary[n].name = names[n];
+		for (const work_graph_trace_event& e : events)
+		{
+			work_graph_trace_summary& s = out_summary[e.name];
+			uint64_t ns = e.end_ns - e.begin_ns;
+			s.events++;
+			s.invocations += e.invocations;
+			s.records_in += e.records_in;
+			s.records_out += e.records_out;
+			s.total_ns += ns;
+			s.max_ns = std::max(s.max_ns, ns);
+		}
+		out_summary.erase(std::remove_if(out_summary.begin(), out_summary.end(),
+			[](const work_graph_trace_summary& s) { return s.events == 0u; }), out_summary.end());
+	}
+
+	// Complete ("X") events with the record counts as args, plus thread_name metadata for the named tracks.
+	std::string ChromeTraceJson(uint32_t pid = 0u) const
+	{
+		std::string json = "{\"traceEvents\":[\n";
+		char line[256];
+		bool first = true;
+		for (size_t t = 0; t < track_names.size(); t++)
+		{
+			if (track_names[t].empty())
+				continue;
+			snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%zu,\"args\":{\"name\":\"",
+				first ? "" : ",\n", pid, t);
+			json += line;
+			json += Escape(track_names[t]);
+			json += "\"}}";
+			first = false;
+		}
+		for (const work_graph_trace_event& e : events)
+		{
+			json += first ? "{\"name\":\"" : ",\n{\"name\":\"";
+			json += Escape(names[e.name]);
+			snprintf(line, sizeof(line), "\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+				"\"args\":{\"invocations\":%u,\"records_in\":%u,\"records_out\":%u}}",
+				pid, e.track, e.begin_ns * 1e-3, (e.end_ns - e.begin_ns) * 1e-3, e.invocations, e.records_in, e.records_out);
+			json += line;
+			first = false;
+		}
+		json += "\n],\"displayTimeUnit\":\"ns\"}\n";
+		return json;
+	}
+
+	bool WriteChromeTrace(const char* file_name, uint32_t pid = 0u) const
+	{
+		FILE* f = fopen(file_name, "wb");
+		if (f == NULL)
+			return false;
+		std::string json = ChromeTraceJson(pid);
+		bool ok = fwrite(json.data(), 1, json.size(), f) == json.size();
+		return fclose(f) == 0 && ok;
+	}
+
+private:
+	static std::string Escape(const std::string& s)
+	{
+		std::string out;
+		for (char c : s)
+		{
+			if (c == '"' || c == '\\')
+				out += '\\';
+			if ((unsigned char)c >= 0x20u)
+				out += c;
+		}
+		return out;
+	}
+
+	std::vector<std::string> names;
+	std::unordered_map<std::string, uint32_t> name_ids;
+	std::vector<std::string> track_names;
+	std::vector<work_graph_trace_event> events;
+};